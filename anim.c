@@ -0,0 +1,121 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * Keyframe animation player, see anim.h
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "anim.h"
+
+const struct anim_keyframe *anim_keyframe(const struct anim_header *h, uint32_t i){
+    const uint32_t *index=(const uint32_t *)((const char *)h + h->index);
+    return (const struct anim_keyframe *)((const char *)h + index[i]);
+}
+
+//every offset, count and LED number is checked here once so playback can trust the mapping
+static const char *anim_check(const struct anim_header *h, size_t len, uint8_t nleds){
+    if(len<sizeof(*h) || h->magic!=ANIM_MAGIC) return "not a kbled animation";
+    if(h->version!=ANIM_VERSION) return "made for another version of kbled";
+    if(h->size!=len) return "truncated";
+    if(h->nleds==0 || h->nleds>LAYOUT_MAXLEDS) return "bad LED count";
+    if(nleds!=0 && h->nleds!=nleds) return "made for a layout with a different number of LEDs";
+    if(h->nframes==0 || h->index%4 || h->index>len || (len-h->index)/4<h->nframes) return "bad keyframe index";
+    const uint32_t *index=(const uint32_t *)((const char *)h + h->index);
+    uint32_t last=0;
+    for(uint32_t i=0; i<h->nframes; i++){
+        if(index[i]%4 || index[i]<sizeof(*h) || index[i]>len-sizeof(struct anim_keyframe)) return "bad keyframe offset";
+        const struct anim_keyframe *k=anim_keyframe(h, i);
+        if(index[i]+sizeof(*k)+k->nchanges*4u>len) return "keyframe runs past the end of the file";
+        if(i>0 && k->ms<=last) return "keyframe times out of order";
+        last=k->ms;
+        for(int c=0; c<k->nchanges; c++) if(k->change[c][0]>=h->nleds) return "LED number out of range";
+    }
+    if(last!=h->duration) return "duration doesn't match the last keyframe";
+    return NULL;
+}
+
+int anim_open(struct anim *a, const char *path, uint8_t nleds, char *err, size_t errlen){
+    struct stat st;
+    const char *why;
+    a->h=NULL;
+    int fd=open(path, O_RDONLY | O_CLOEXEC);
+    if(fd<0 || fstat(fd, &st)!=0){
+        snprintf(err, errlen, "%s: %m", path);
+        if(fd>=0) close(fd);
+        return 1;
+    }
+    void *p=(st.st_size>0)? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if(p==MAP_FAILED){
+        snprintf(err, errlen, "%s: can't map it", path);
+        return 1;
+    }
+    if((why=anim_check(p, st.st_size, nleds))!=NULL){
+        snprintf(err, errlen, "%s: %s", path, why);
+        munmap(p, st.st_size);
+        return 1;
+    }
+    a->h=p;
+    a->len=st.st_size;
+    anim_rewind(a);
+    return 0;
+}
+
+void anim_close(struct anim *a){
+    if(a->h) munmap((void *)a->h, a->len);
+    a->h=NULL;
+}
+
+static void anim_apply(const struct anim_keyframe *k, unsigned char (*rgb)[3]){
+    for(int c=0; c<k->nchanges; c++) memcpy(rgb[k->change[c][0]], &k->change[c][1], 3);
+}
+
+//to[] and fading for the keyframe after cur
+static void anim_next(struct anim *a){
+    memcpy(a->to, a->from, sizeof(a->to));
+    keyset_clear(&a->fading);
+    if(a->cur+1>=a->h->nframes) return;
+    const struct anim_keyframe *k=anim_keyframe(a->h, a->cur+1);
+    anim_apply(k, a->to);
+    if(k->flags & ANIM_STEP) return;
+    for(int c=0; c<k->nchanges; c++) keyset_add(&a->fading, k->change[c][0]);
+}
+
+void anim_rewind(struct anim *a){
+    memset(a->from, 0, sizeof(a->from));
+    a->cur=0;
+    anim_apply(anim_keyframe(a->h, 0), a->from);
+    anim_next(a);
+}
+
+int anim_render(struct anim *a, uint32_t ms, unsigned char (*frame)[3]){
+    const struct anim_header *h=a->h;
+    int ended=0;
+    if(h->flags & ANIM_LOOP) ms=(h->duration>0)? ms%h->duration : 0;
+    else if(ms>=h->duration) {
+        ms=h->duration;
+        ended=1;
+    }
+    if(ms<anim_keyframe(h, a->cur)->ms) anim_rewind(a); //looped around
+    //walk forward one keyframe at a time, each step only applies that keyframe's changes
+    while(a->cur+1<h->nframes && anim_keyframe(h, a->cur+1)->ms<=ms){
+        memcpy(a->from, a->to, sizeof(a->from));
+        a->cur++;
+        anim_next(a);
+    }
+    memcpy(frame, a->from, h->nleds*3);
+    if(!keyset_empty(&a->fading)){
+        uint32_t t0=anim_keyframe(h, a->cur)->ms, t1=anim_keyframe(h, a->cur+1)->ms;
+        uint32_t f=(uint32_t)(((uint64_t)(ms-t0)<<8)/(t1-t0)); //0-256 of the way to the next keyframe
+        for(int i=keyset_next(&a->fading, -1); i>=0; i=keyset_next(&a->fading, i)){
+            for(int c=0; c<3; c++) frame[i][c]=(unsigned char)(a->from[i][c] + (((int)a->to[i][c]-a->from[i][c])*(int)f)/256);
+        }
+    }
+    return ended;
+}
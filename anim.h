@@ -0,0 +1,60 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * Keyframe animations: a binary file made offline by kbledanim from a text description, mmapped by kbled and
+ * played straight out of the mapping.  The file is a header, the keyframes and an index of keyframe offsets.
+ * Each keyframe only lists the LEDs whose color differs from the keyframe before it (the first one from black),
+ * the player fades every listed LED from the previous keyframe's color unless the keyframe is a step.
+ */
+
+#ifndef ANIM_H
+#define ANIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "layout.h"
+
+#define ANIM_MAGIC    0x4d494e41444c424bULL  //"KBLDANIM" file signature
+#define ANIM_VERSION  1                      //bump when the structures below change
+#define ANIM_LOOP     0x01                   //header flag: start over after the last keyframe
+#define ANIM_STEP     0x01                   //keyframe flag: jump to the colors at ms instead of fading into them
+
+struct anim_header {
+    uint64_t magic;               //ANIM_MAGIC
+    uint32_t version;             //ANIM_VERSION
+    uint32_t size;                //file size in bytes
+    char layout[LAYOUT_NAMELEN];  //keyboard layout the LED numbers refer to
+    uint8_t nleds;                //LEDs in that layout
+    uint8_t flags;                //ANIM_LOOP
+    uint16_t pad;
+    uint32_t nframes;             //number of keyframes, at least 1
+    uint32_t duration;            //ms from the start to the last keyframe, the length of one loop
+    uint32_t index;               //file offset of nframes uint32_t keyframe offsets
+};
+
+struct anim_keyframe {
+    uint32_t ms;           //time from the start, increasing from one keyframe to the next
+    uint8_t flags;         //ANIM_STEP
+    uint8_t nchanges;      //number of change[] entries
+    uint16_t pad;
+    uint8_t change[][4];   //[LED, R, G, B] of each LED whose color changed
+};
+
+//player state, everything but the mapping is a few hundred bytes of colors
+struct anim {
+    const struct anim_header *h;          //the mapped file, NULL when closed
+    size_t len;                           //length of the mapping
+    uint32_t cur;                         //keyframe at or before the last time rendered
+    unsigned char from[LAYOUT_MAXLEDS][3]; //colors at keyframe cur
+    unsigned char to[LAYOUT_MAXLEDS][3];   //colors at keyframe cur+1
+    keyset fading;                        //LEDs that change between them
+};
+
+int anim_open(struct anim *a, const char *path, uint8_t nleds, char *err, size_t errlen); //map and bounds check the file once, 0 on success
+void anim_close(struct anim *a);
+void anim_rewind(struct anim *a); //back to the first keyframe
+int anim_render(struct anim *a, uint32_t ms, unsigned char (*frame)[3]); //colors at ms from the start, returns 1 once a one-shot animation has ended
+const struct anim_keyframe *anim_keyframe(const struct anim_header *h, uint32_t i); //keyframe i of a checked file
+
+#endif
@@ -0,0 +1,238 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * kbledanim - build keyframe animations for kbled from a text description and check what they will cost
+ *
+ * Text format, one item per line, fields separated by spaces or commas, # starts a comment:
+ *   layout <name|path>                  keyboard layout for zone names (built in bonw15 if not given)
+ *   loop                                start over after the last keyframe
+ *   <ms> <zone> <Red> <Grn> <Blu> [step] at ms the zone fades to the color from the keyframe before it,
+ *                                       or jumps to it with step.  Lines with the same ms make one keyframe,
+ *                                       keys not mentioned keep their color
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "anim.h"
+#include "zone.h"
+#include "keymap.h"
+#include "sharedmem.h"
+
+#define ANIM_MAXLINE 512
+
+void print_usage(char *program_name) {
+    fprintf(stderr, "Usage: %s -c <input.txt> <output.kanim>   Build an animation\n", program_name);
+    fprintf(stderr, "       %s -i <file.kanim> [--fps <1-%i>]  Check an animation and report the USB traffic it needs\n", program_name, SM_MAXFPS);
+    fprintf(stderr, "Play one by adding \"anim <file.kanim>\" to /etc/kbled.conf and selecting it with kbledclient -sfx\n");
+}
+
+//append to the output buffer
+static int put(unsigned char **buf, size_t *len, size_t *cap, const void *data, size_t n){
+    if(*len+n > *cap){
+        size_t c=(*cap)? *cap*2 : 4096;
+        while(c<*len+n) c*=2;
+        unsigned char *b=realloc(*buf, c);
+        if(b==NULL) return 1;
+        *buf=b;
+        *cap=c;
+    }
+    memcpy(*buf+*len, data, n);
+    *len+=n;
+    return 0;
+}
+
+//one keyframe: the LEDs of target that differ from shown, then shown catches up
+static int putframe(unsigned char **buf, size_t *len, size_t *cap, uint32_t **index, uint32_t *nframes, uint32_t ms, uint8_t flags,
+                    uint8_t nleds, unsigned char (*target)[3], unsigned char (*shown)[3]){
+    struct anim_keyframe k={ms, flags, 0, 0};
+    uint8_t change[LAYOUT_MAXLEDS][4];
+    for(int i=0; i<nleds; i++){
+        if(*nframes>0 && memcmp(target[i], shown[i], 3)==0) continue;
+        if(*nframes==0 && target[i][0]==0 && target[i][1]==0 && target[i][2]==0) continue; //first keyframe starts from black
+        change[k.nchanges][0]=i;
+        memcpy(&change[k.nchanges][1], target[i], 3);
+        k.nchanges++;
+        memcpy(shown[i], target[i], 3);
+    }
+    uint32_t *ix=realloc(*index, (*nframes+1)*sizeof(uint32_t));
+    if(ix==NULL) return 1;
+    *index=ix;
+    ix[(*nframes)++]=*len;
+    return put(buf, len, cap, &k, sizeof(k)) || put(buf, len, cap, change, k.nchanges*4u);
+}
+
+int convert(const char *in, const char *out){
+    FILE *file=fopen(in, "r");
+    if(file==NULL){
+        perror(in);
+        return 1;
+    }
+    static struct layout parsed;
+    const struct layout *l=&layout_builtin;
+    struct anim_header h;
+    memset(&h, 0, sizeof(h));
+    h.magic=ANIM_MAGIC;
+    h.version=ANIM_VERSION;
+    unsigned char target[LAYOUT_MAXLEDS][3]={{0}}, shown[LAYOUT_MAXLEDS][3]={{0}};
+    unsigned char *buf=NULL;
+    size_t len=0, cap=0;
+    uint32_t *index=NULL, nframes=0;
+    char line[ANIM_MAXLINE];
+    int lineno=0, err=0, pending=0; //pending: target holds a keyframe not written yet
+    uint32_t ms=0;
+    uint8_t flags=0;
+    put(&buf, &len, &cap, &h, sizeof(h)); //filled in at the end
+    while(!err && fgets(line, sizeof(line), file)){
+        lineno++;
+        line[strcspn(line, "#\r\n")]='\0';
+        char *tok[8];
+        int ntok=0;
+        for(char *t=strtok(line, " \t,"); t!=NULL && ntok<8; t=strtok(NULL, " \t,")) tok[ntok++]=t;
+        if(ntok==0) continue;
+        if(strcasecmp(tok[0], "layout")==0 && ntok==2 && !pending && nframes==0){
+            char path[320];
+            if(strchr(tok[1], '/')) snprintf(path, sizeof(path), "%s", tok[1]);
+            else snprintf(path, sizeof(path), "%s/%s.layout", LAYOUT_DIR, tok[1]);
+            if(layout_parse(path, &parsed)!=0){
+                fprintf(stderr, "%s:%i: can't load layout %s\n", in, lineno, path);
+                err=1;
+            }
+            l=&parsed;
+            continue;
+        }
+        if(strcasecmp(tok[0], "loop")==0 && ntok==1){
+            h.flags|=ANIM_LOOP;
+            continue;
+        }
+        char *end;
+        unsigned long t=strtoul(tok[0], &end, 10);
+        keyset keys;
+        unsigned char rgb[3];
+        int c;
+        for(c=0; c<3 && ntok>=5; c++){
+            long v=strtol(tok[2+c], NULL, 10);
+            if(v<0 || v>255) break;
+            rgb[c]=v;
+        }
+        if(*end!='\0' || c<3 || ntok>6 || (ntok==6 && strcasecmp(tok[5], "step")!=0)){
+            fprintf(stderr, "%s:%i: expected <ms> <zone> <Red> <Grn> <Blu> [step]\n", in, lineno);
+            err=1;
+            break;
+        }
+        if(zone_parse(l, tok[1], &keys)!=0){
+            fprintf(stderr, "%s:%i: zone %s is not on the %s layout\n", in, lineno, tok[1], l->name);
+            err=1;
+            break;
+        }
+        if(pending && t<ms){
+            fprintf(stderr, "%s:%i: %lu ms is before the keyframe at %u ms\n", in, lineno, t, ms);
+            err=1;
+            break;
+        }
+        if(pending && t>ms){
+            err=putframe(&buf, &len, &cap, &index, &nframes, ms, flags, l->nleds, target, shown);
+            flags=0;
+        }
+        ms=t;
+        pending=1;
+        if(ntok==6) flags|=ANIM_STEP;
+        for(int i=keyset_next(&keys, -1); i>=0; i=keyset_next(&keys, i)) memcpy(target[i], rgb, 3);
+    }
+    fclose(file);
+    if(!err && !pending){
+        fprintf(stderr, "%s: no keyframes\n", in);
+        err=1;
+    }
+    if(!err) err=putframe(&buf, &len, &cap, &index, &nframes, ms, flags, l->nleds, target, shown);
+    if(!err){
+        struct anim_header *hp=(struct anim_header *)buf;
+        snprintf(hp->layout, sizeof(hp->layout), "%s", l->name);
+        hp->nleds=l->nleds;
+        hp->flags=h.flags;
+        hp->nframes=nframes;
+        hp->duration=ms;
+        hp->index=len;
+        err=put(&buf, &len, &cap, index, nframes*sizeof(uint32_t));
+        hp=(struct anim_header *)buf;
+        hp->size=len;
+    }
+    if(!err){
+        FILE *o=fopen(out, "wb");
+        if(o==NULL || fwrite(buf, 1, len, o)!=len){
+            perror(out);
+            err=1;
+        }
+        if(o!=NULL && fclose(o)!=0) err=1;
+        if(!err) printf("%s: %u keyframes, %u ms, %zu bytes for the %s layout\n", out, nframes, ms, len, l->name);
+    }
+    free(buf);
+    free(index);
+    return err;
+}
+
+int info(const char *path, int fps){
+    struct anim a;
+    char err[256];
+    if(anim_open(&a, path, 0, err, sizeof(err))!=0){
+        fprintf(stderr, "%s\n", err);
+        return 1;
+    }
+    const struct anim_header *h=a.h;
+    uint32_t changes=0, steps=0;
+    for(uint32_t i=0; i<h->nframes; i++){
+        changes+=anim_keyframe(h, i)->nchanges;
+        if(anim_keyframe(h, i)->flags & ANIM_STEP) steps++;
+    }
+    printf("%s: %s layout (%u LEDs), %u keyframes (%u steps), %u ms%s, %u bytes, %u LED changes\n", path, h->layout, h->nleds,
+        h->nframes, steps, h->duration, (h->flags & ANIM_LOOP)? " looped" : "", h->size, changes);
+    //play it the way kbled would: one frame every 1/fps s, a USB report for every LED that differs from the frame before.
+    //The first frame is left out, what it costs depends on what was lit before the animation started
+    unsigned char frame[LAYOUT_MAXLEDS][3], last[LAYOUT_MAXLEDS][3];
+    uint32_t nf=(uint64_t)h->duration*fps/1000 + 1;
+    if(h->flags & ANIM_LOOP) nf++; //and the wrap back to the start
+    uint32_t *perframe=calloc(nf, sizeof(uint32_t));
+    if(perframe==NULL) return 1;
+    uint32_t peakframe=0, peakat=0, total=0, window=0, peaksec=0, peaksecat=0;
+    for(uint32_t f=0; f<nf; f++){
+        anim_render(&a, (uint32_t)((uint64_t)f*1000/fps), frame);
+        for(int i=0; i<h->nleds; i++) if(f>0 && memcmp(frame[i], last[i], 3)!=0) perframe[f]++;
+        memcpy(last, frame, sizeof(last));
+        total+=perframe[f];
+        window+=perframe[f];
+        if(f>=(uint32_t)fps) window-=perframe[f-fps]; //reports in the second ending at this frame
+        if(perframe[f]>peakframe){
+            peakframe=perframe[f];
+            peakat=f;
+        }
+        if(window>peaksec){
+            peaksec=window;
+            peaksecat=f;
+        }
+    }
+    printf("At %i fps: %u frames, %u USB reports, %.0f reports/s on average\n", fps, nf, total, total*(double)fps/nf);
+    printf("Peak: %u reports in one frame at %u ms (%u reports/s while it lasts), %u reports in the second ending at %u ms\n",
+        peakframe, (uint32_t)((uint64_t)peakat*1000/fps), peakframe*fps, peaksec, (uint32_t)((uint64_t)peaksecat*1000/fps));
+    free(perframe);
+    anim_close(&a);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 4 && strcmp(argv[1], "-c") == 0) return convert(argv[2], argv[3]);
+    if ((argc == 3 || argc == 5) && strcmp(argv[1], "-i") == 0) {
+        int fps = SM_DEFAULTFPS;
+        if (argc == 5) {
+            fps = atoi(argv[4]);
+            if (strcmp(argv[3], "--fps") != 0 || fps < 1 || fps > SM_MAXFPS) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+        return info(argv[2], fps);
+    }
+    print_usage(argv[0]);
+    return 1;
+}
@@ -0,0 +1,84 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * Output calibration tables, see calib.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "calib.h"
+#include "config.h"
+#include "zone.h"
+
+uint8_t calib_on=0;
+uint16_t calib_lut[3][256];
+uint16_t calib_gain[256][3];
+
+static const struct layout *calibl; //layout gain lines are resolved against
+static int ngains;                   //LEDs given a gain
+
+//level for value v through gamma g in 8.8 fixed point, anything above 0 stays lit
+static void calib_gamma(int c, double g){
+    for(int v=0; v<256; v++){
+        double out=255.0*CALIB_ONE*pow(v/255.0, g)+0.5;
+        calib_lut[c][v]=(v>0 && out<CALIB_ONE)? CALIB_ONE : (uint16_t)out;
+    }
+}
+
+//parse a number in [min, max] from tok, 0 on success
+static int calib_number(const char *tok, double min, double max, double *out){
+    char *end;
+    *out=strtod(tok, &end);
+    return (end==tok || *end!='\0' || !(*out>=min && *out<=max))? 1 : 0;
+}
+
+//gamma <g> | gamma <R> <G> <B>
+static int calib_gammaline(int ntok, char **tok, const char *raw, int lineno){
+    (void)raw;
+    double g[3];
+    if(ntok!=2 && ntok!=4) return 1;
+    for(int c=0; c<3; c++) if(calib_number(tok[(ntok==2)? 1 : 1+c], 0.1, CALIB_MAXGAMMA, &g[c])!=0) {
+        printf("Gamma on line %i must be 0.1-%.1f\n", lineno, CALIB_MAXGAMMA);
+        return 1;
+    }
+    for(int c=0; c<3; c++) calib_gamma(c, g[c]);
+    calib_on=1;
+    return 0;
+}
+
+//gain <zone> <R> <G> <B>
+static int calib_gainline(int ntok, char **tok, const char *raw, int lineno){
+    (void)raw;
+    double g[3];
+    keyset s;
+    if(ntok!=5) return 1;
+    if(zone_parse(calibl, tok[1], &s)!=0 || keyset_empty(&s)) {
+        printf("Unknown zone %s on line %i\n", tok[1], lineno);
+        return 1;
+    }
+    for(int c=0; c<3; c++) if(calib_number(tok[2+c], 0.0, CALIB_MAXGAIN, &g[c])!=0) {
+        printf("Gain on line %i must be 0-%.1f\n", lineno, CALIB_MAXGAIN);
+        return 1;
+    }
+    for(int i=keyset_next(&s, -1); i>=0; i=keyset_next(&s, i)) {
+        for(int c=0; c<3; c++) calib_gain[calibl->addr[i]][c]=(uint16_t)(g[c]*CALIB_ONE+0.5);
+        ngains++;
+    }
+    calib_on=1;
+    return 0;
+}
+
+int calib_load(const char *conffile, const struct layout *l, char verbose){
+    int n=0, r;
+    calib_on=0;
+    calibl=l;
+    ngains=0;
+    for(int c=0; c<3; c++) calib_gamma(c, 1.0);
+    for(int a=0; a<256; a++) for(int c=0; c<3; c++) calib_gain[a][c]=CALIB_ONE;
+    if(conffile!=NULL && (r=config_parse(conffile, "gamma", calib_gammaline))>0) n+=r;
+    if(conffile!=NULL && (r=config_parse(conffile, "gain", calib_gainline))>0) n+=r;
+    if(verbose && calib_on) printf("Output calibration: %i gamma/gain lines, %i LEDs with their own gain\n", n, ngains);
+    return n;
+}
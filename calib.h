@@ -0,0 +1,33 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * Output calibration: a gamma table per channel and a gain per LED and channel from the gamma and gain lines in
+ * kbled.conf.  it829x_setled()/it829x_setleds() run every color through calib_apply() while they fill in the
+ * report, so the rest of the daemon keeps working with the raw 0-255 values clients asked for.
+ */
+
+#ifndef CALIB_H
+#define CALIB_H
+
+#include <stdint.h>
+#include "layout.h"
+
+#define CALIB_ONE      256   //gain of 1.0 and the 8.8 fixed point scale of calib_lut[]
+#define CALIB_MAXGAIN  4.0   //largest gain accepted on a gain line
+#define CALIB_MAXGAMMA 4.0   //largest gamma accepted on a gamma line
+
+extern uint8_t calib_on;                 //0 until calib_load() finds a gamma or gain line, colors go out untouched
+extern uint16_t calib_lut[3][256];       //gamma corrected level per channel in 8.8 fixed point
+extern uint16_t calib_gain[256][3];      //gain per LED address and channel, CALIB_ONE is 1.0
+
+//color c of raw level v for the LED at controller address addr
+static inline uint8_t calib_apply(uint8_t addr, int c, uint8_t v){
+    uint32_t out=((uint32_t)calib_lut[c][v]*calib_gain[addr][c]+CALIB_ONE*CALIB_ONE/2)/(CALIB_ONE*CALIB_ONE);
+    return (out>255)? 255 : (uint8_t)out;
+}
+
+//read gamma and gain lines from conffile, zones in gain lines are resolved against layout l.  Returns # of lines used
+int calib_load(const char *conffile, const struct layout *l, char verbose);
+
+#endif
@@ -0,0 +1,226 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * cgroup v2 cpu and memory sampler, see cgroups.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/inotify.h>
+#include "cgroups.h"
+
+#define CGROUPS_EVENTS (IN_CREATE | IN_DELETE | IN_MOVE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+//reread an open file holding a number or "max" (UINT64_MAX), 0 on success
+static int cgroups_number(int fd, uint64_t *v){
+    char buf[32];
+    ssize_t n=pread(fd, buf, sizeof(buf)-1, 0);
+    if(n<=0) return -1;
+    buf[n]='\0';
+    if(strncmp(buf, "max", 3)==0) *v=UINT64_MAX;
+    else *v=strtoull(buf, NULL, 10);
+    return 0;
+}
+
+//depth first search for a directory called name at most depth levels below rel
+static int cgroups_find(const char *root, const char *rel, const char *name, char *out, size_t len, int depth){
+    char dir[320], sub[CGROUPS_MAXSPEC];
+    snprintf(dir, sizeof(dir), "%s/%s", root, rel);
+    DIR *d=opendir(dir);
+    if(d==NULL) return -1;
+    struct dirent *e;
+    int found=-1;
+    while(found<0 && (e=readdir(d))!=NULL){
+        if(e->d_type!=DT_DIR || e->d_name[0]=='.') continue;
+        if((size_t)snprintf(sub, sizeof(sub), "%s%s%s", rel, rel[0]? "/" : "", e->d_name)>=sizeof(sub)) continue;
+        if(strcmp(e->d_name, name)==0) {
+            snprintf(out, len, "%s", sub);
+            found=0;
+        }
+        else if(depth>1) found=cgroups_find(root, sub, name, out, len, depth-1);
+    }
+    closedir(d);
+    return found;
+}
+
+//cgroup path of a spec: paths as they are, a slice by its name (a-b.slice is a.slice/a-b.slice), other units where
+//they are running now, or under system.slice where systemd will start them
+static void cgroups_path(const struct cgroups *cs, const char *spec, char *out, size_t len){
+    size_t n=strlen(spec);
+    const char *dot=strrchr(spec, '.');
+    out[0]='\0';
+    if(strchr(spec, '/')!=NULL || dot==NULL) snprintf(out, len, "%s", spec+(spec[0]=='/'));
+    else if(strcmp(dot, ".slice")==0) {
+        if(strcmp(spec, "-.slice")==0) return;
+        for(const char *dash=strchr(spec, '-'); dash!=NULL; dash=strchr(dash+1, '-'))
+            snprintf(out+strlen(out), len-strlen(out), "%.*s.slice/", (int)(dash-spec), spec);
+        snprintf(out+strlen(out), len-strlen(out), "%.*s", (int)n, spec);
+    }
+    else if(cgroups_find(cs->root, "", spec, out, len, CGROUPS_MAXDEPTH)!=0) snprintf(out, len, "system.slice/%s", spec);
+}
+
+static void cgroups_detach(struct cgroup *g){
+    if(g->fdcpu>=0) close(g->fdcpu);
+    if(g->fdcur>=0) close(g->fdcur);
+    if(g->fdmax>=0) close(g->fdmax);
+    g->fdcpu=g->fdcur=g->fdmax=-1;
+    g->valid=0;
+    g->cpus=g->cpu=g->mem=0.0f;
+}
+
+static int cgroups_open_in(const char *dir, const char *file){
+    char path[384];
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+//open the files of a cgroup if it is there and move its watch to the directory above it, or to the deepest one of
+//its path that exists so the next level being created is seen
+static void cgroups_attach(struct cgroups *cs, struct cgroup *g){
+    char dir[320];
+    int old=g->wd, len=(int)strlen(g->path);
+    cgroups_detach(g);
+    for(int tries=0; tries<=CGROUPS_MAXSPEC; tries++){
+        snprintf(dir, sizeof(dir), "%s/%s", cs->root, g->path);
+        if(g->fdcpu<0 && (g->fdcpu=cgroups_open_in(dir, "cpu.stat"))>=0){
+            char buf[64];
+            g->fdcur=cgroups_open_in(dir, "memory.current");
+            g->fdmax=cgroups_open_in(dir, "memory.max");
+            g->limit=cs->ncpu;
+            int fd=cgroups_open_in(dir, "cpu.max");
+            ssize_t n= (fd>=0)? read(fd, buf, sizeof(buf)-1) : -1;
+            if(fd>=0) close(fd);
+            if(n>0) {
+                unsigned long long quota, period;
+                buf[n]='\0';
+                if(sscanf(buf, "%llu %llu", &quota, &period)==2 && period>0) g->limit=(float)quota/period;
+            }
+        }
+        //deepest directory that exists, starting above the cgroup when it is there
+        int depth=len;
+        do {
+            while(depth>0 && g->path[--depth]!='/');
+            snprintf(dir, sizeof(dir), "%s/%.*s", cs->root, depth, g->path);
+        } while(depth>0 && access(dir, F_OK)!=0);
+        g->depth=depth;
+        g->wd=inotify_add_watch(cs->ino, dir, CGROUPS_EVENTS);
+        if(g->fdcpu>=0) break;
+        //the next level could have been made before the watch was in place
+        int next=depth+(depth>0);
+        next+=(int)strcspn(g->path+next, "/");
+        snprintf(dir, sizeof(dir), "%s/%.*s", cs->root, next, g->path);
+        if(access(dir, F_OK)!=0) break;
+    }
+    if(old>=0 && old!=g->wd) {
+        int shared=0;
+        for(int i=0; i<cs->n; i++) if(cs->g[i].wd==old) shared=1;
+        if(!shared) inotify_rm_watch(cs->ino, old);
+    }
+}
+
+int cgroups_open(struct cgroups *cs){
+    memset(cs, 0, sizeof(*cs));
+    if(access(CGROUPS_ROOT "/cgroup.controllers", F_OK)==0) snprintf(cs->root, sizeof(cs->root), "%s", CGROUPS_ROOT);
+    else if(access(CGROUPS_HYBRID "/cgroup.controllers", F_OK)==0) snprintf(cs->root, sizeof(cs->root), "%s", CGROUPS_HYBRID);
+    else {
+        printf("No cgroup v2 hierarchy at %s or %s\n", CGROUPS_ROOT, CGROUPS_HYBRID);
+        return -1;
+    }
+    cs->ino=inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(cs->ino<0) {
+        perror("inotify_init1");
+        return -1;
+    }
+    long n=sysconf(_SC_NPROCESSORS_ONLN);
+    cs->ncpu= (n>0)? (float)n : 1.0f;
+    cs->ram=(uint64_t)sysconf(_SC_PHYS_PAGES)*(uint64_t)sysconf(_SC_PAGESIZE);
+    return 0;
+}
+
+void cgroups_close(struct cgroups *cs){
+    for(int i=0; i<cs->n; i++) cgroups_detach(&cs->g[i]);
+    if(cs->ino>=0) close(cs->ino);
+    cs->ino=-1;
+    cs->n=0;
+}
+
+int cgroups_add(struct cgroups *cs, const char *spec){
+    if(cs->n>=CGROUPS_MAX){
+        printf("Only %i cgroups can be shown, %s ignored\n", CGROUPS_MAX, spec);
+        return -1;
+    }
+    struct cgroup *g=&cs->g[cs->n];
+    memset(g, 0, sizeof(*g));
+    g->fdcpu=g->fdcur=g->fdmax=g->wd=-1;
+    snprintf(g->spec, sizeof(g->spec), "%s", spec);
+    cgroups_path(cs, spec, g->path, sizeof(g->path));
+    size_t len=strlen(g->path);
+    while(len>0 && g->path[len-1]=='/') g->path[--len]='\0';
+    cgroups_attach(cs, g);
+    if(g->wd<0 && g->fdcpu<0){
+        printf("Can't open or watch cgroup %s/%s\n", cs->root, g->path);
+        return -1;
+    }
+    return cs->n++;
+}
+
+//is name the level of g's path below the watched directory
+static int cgroups_next(const struct cgroup *g, const char *name){
+    const char *p=g->path+g->depth+(g->depth>0);
+    size_t n=strcspn(p, "/");
+    return strlen(name)==n && strncmp(p, name, n)==0;
+}
+
+int cgroups_sample(struct cgroups *cs){
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    uint32_t stale=0; //bit i set when g[i] has to be looked up again
+    ssize_t len;
+    while((len=read(cs->ino, events, sizeof(events)))>0){
+        for(char *p=events; p<events+len; p+=sizeof(struct inotify_event)+((struct inotify_event *)p)->len){
+            const struct inotify_event *ev=(const struct inotify_event *)p;
+            for(int i=0; i<cs->n; i++){
+                if(ev->mask & IN_Q_OVERFLOW) stale|=1u<<i;
+                else if(ev->wd==cs->g[i].wd && ((ev->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) || (ev->len>0 && cgroups_next(&cs->g[i], ev->name))))
+                    stale|=1u<<i;
+            }
+        }
+    }
+    int fail=0;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    for(int i=0; i<cs->n; i++){
+        struct cgroup *g=&cs->g[i];
+        char buf[64];
+        if(stale & (1u<<i)) cgroups_attach(cs, g);
+        if(g->fdcpu<0) continue;
+        ssize_t n=pread(g->fdcpu, buf, sizeof(buf)-1, 0);
+        if(n<=0) { //removed under us before the event got here
+            cgroups_attach(cs, g);
+            continue;
+        }
+        buf[n]='\0';
+        if(strncmp(buf, "usage_usec ", 11)!=0) {
+            fail=-1;
+            continue;
+        }
+        uint64_t usage=strtoull(buf+11, NULL, 10), cur, max;
+        if(g->valid){
+            double dt=(double)(now.tv_sec-g->t.tv_sec)+(now.tv_nsec-g->t.tv_nsec)*1e-9;
+            if(dt>0.0) g->cpus=(float)((usage-g->usage)*1e-6/dt);
+            g->cpu=g->cpus/g->limit;
+        }
+        g->usage=usage;
+        g->t=now;
+        g->valid=1;
+        if(g->fdcur>=0 && cgroups_number(g->fdcur, &cur)==0){
+            if(g->fdmax<0 || cgroups_number(g->fdmax, &max)!=0 || max==UINT64_MAX || max>cs->ram) max=cs->ram;
+            g->mem= (max>0)? (float)((double)cur/max) : 0.0f;
+        }
+    }
+    return fail;
+}
@@ -0,0 +1,54 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * Per cgroup cpu and memory use for kbledpsmon.  Each shown cgroup v2 directory, given as a path or a systemd unit,
+ * keeps cpu.stat, memory.current and memory.max open and a sample is a pread of each.  Cgroups that don't exist
+ * yet or go away are followed with inotify on the deepest directory of their path that does exist, so starting and
+ * stopping services costs an event instead of a scan of the hierarchy every update.
+ */
+
+#ifndef CGROUPS_H
+#define CGROUPS_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define CGROUPS_ROOT     "/sys/fs/cgroup"          //unified hierarchy
+#define CGROUPS_HYBRID   "/sys/fs/cgroup/unified"  //where it is on systems still mounting v1 controllers
+#define CGROUPS_MAX      8                         //cgroups shown at once
+#define CGROUPS_MAXSPEC  128                       //longest cgroup path or unit name
+#define CGROUPS_MAXDEPTH 4                         //levels searched for a unit that isn't under a slice by name
+
+struct cgroup {
+    char spec[CGROUPS_MAXSPEC];  //as given
+    char path[CGROUPS_MAXSPEC];  //relative to the root, "" for the root itself
+    int wd;                      //inotify watch on the directory above it, or on the deepest one there is
+    int depth;                   //length of path watched by wd
+    int fdcpu, fdcur, fdmax;     //cpu.stat, memory.current and memory.max, -1 while the cgroup is missing
+    float limit;                 //cpus allowed by cpu.max, or every cpu
+    uint64_t usage;              //usage_usec at the last sample
+    struct timespec t;           //time of the last sample
+    int valid;                   //usage and t are from a previous sample
+    float cpus;                  //cpus kept busy over the last interval
+    float cpu;                   //cpus as a share of limit
+    float mem;                   //memory.current as a share of memory.max, or of the RAM without a limit
+};
+
+struct cgroups {
+    char root[32];
+    int ino;                     //inotify descriptor
+    float ncpu;
+    uint64_t ram;                //bytes
+    int n;
+    struct cgroup g[CGROUPS_MAX];
+};
+
+int cgroups_open(struct cgroups *cs); //find the hierarchy, 0 on success
+void cgroups_close(struct cgroups *cs);
+//show a cgroup: a path under the root (system.slice/sshd.service) or a systemd unit (sshd.service, user.slice).
+//It doesn't have to exist yet.  Returns its index in g[] or -1
+int cgroups_add(struct cgroups *cs, const char *spec);
+int cgroups_sample(struct cgroups *cs); //follow cgroups coming and going, then update cpu and mem, 0 on success
+
+#endif
@@ -14,7 +14,11 @@
 #include <ctype.h>
 #include <semaphore.h>
 #include <fcntl.h>
+#include <signal.h>
+#include <time.h>
 #include "sharedmem.h"
+#include "image.h"
+#include "resample.h"
 
 void print_usage(char *program_name) {
     fprintf(stderr, "Usage: %s [-v] [parameters...]\n", program_name);
@@ -32,18 +36,34 @@ void print_usage(char *program_name) {
     fprintf(stderr, " -p+                          Increment pattern\n");
     fprintf(stderr, " -p-                          Decrement pattern\n");
     fprintf(stderr, " -p <-1 to 6>                 Set pattern, (default=-1 [no pattern])\n");
+    fprintf(stderr, " -sfx <0-%i>                  Set software effect drawn with the backlight/focus colors, 0=none 1=wave 2=breathe 3=scan 4=snake 5=ripple\n", SM_SFX_USER+SM_SFX_MAXUSER-1);
+    fprintf(stderr, "                              %i and up are the sfx lines in kbled.conf in order\n", SM_SFX_USER);
+    fprintf(stderr, " --fps <1-%i>                 Software effect frames per second (default=%i)\n", SM_MAXFPS, SM_DEFAULTFPS);
     fprintf(stderr, " -bl <Red> <Grn> <Blu>        Set global backlight color\n");
     fprintf(stderr, " -fo <Red> <Grn> <Blu>        Set global focus color (caps/num/scroll locks)\n");
     fprintf(stderr, " -c                           Cycle through preset backlight/focus colors\n");
-    fprintf(stderr, " -k <LED#> <Red> <Grn> <Blu>  Set individual LED (0-%i) color\n", NKEYS-1);
-    fprintf(stderr, " -kb <LED#>                   Set individual LED (0-%i) to backlight color\n", NKEYS-1);
-    fprintf(stderr, " -kf <LED#>                   Set individual LED (0-%i) to focus color\n", NKEYS-1);
+    fprintf(stderr, " -k <LED#> <Red> <Grn> <Blu>  Set individual LED (0-%i on bonw15, see --layout) color\n", NKEYS-1);
+    fprintf(stderr, " -kb <LED#>                   Set individual LED (0-%i on bonw15, see --layout) to backlight color\n", NKEYS-1);
+    fprintf(stderr, " -kf <LED#>                   Set individual LED (0-%i on bonw15, see --layout) to focus color\n", NKEYS-1);
+    fprintf(stderr, " -z <zone> <Red> <Grn> <Blu>  Fill a zone with one color (see --zones)\n");
+    fprintf(stderr, " -zg <zone> <RGB> <RGB>       Fill a zone with a left to right gradient between two colors\n");
+    fprintf(stderr, " -zv <zone> <RGB> <RGB>       Fill a zone with a top to bottom gradient between two colors\n");
+    fprintf(stderr, " -n <zone> <Red> <Grn> <Blu> <ms>   Light a zone for ms milliseconds then restore it, returns without waiting\n");
+    fprintf(stderr, " -nb <zone> <Red> <Grn> <Blu> <ms>  Blink a zone for ms milliseconds\n");
+    fprintf(stderr, " -np <zone> <Red> <Grn> <Blu> <ms>  Pulse a zone for ms milliseconds\n");
+    fprintf(stderr, " --nprio <0-255>              Priority of the notifications where they overlap (default=128)\n");
+    fprintf(stderr, " --image <file.png|file.gif>  Show a picture fitted to the keyboard, an animated GIF plays on a layer until it ends or Ctrl-C\n");
+    fprintf(stderr, " --loops <0-65535>            Times to play an animated GIF, 0=forever (default=what the GIF asks for)\n");
+    fprintf(stderr, " -host <0-14> <on|off|tog>    Set host state bit that drives host<n> indicator bindings in kbled.conf\n");
     fprintf(stderr, " -cpu                         Display the time it took kbled daemon to execute the last update\n");
     fprintf(stderr, " --scan                       Change update speed (1 to 65535 ms) default= 100 ms\n");
+    fprintf(stderr, " --layout                     List the keys of the keyboard layout the daemon is using\n");
+    fprintf(stderr, " --zones                      List the named zones of the keyboard layout\n");
     fprintf(stderr, " --dump                       Show contents of shared memory\n");
     fprintf(stderr, " --dump+                      Show contents of shared memory with each key's state\n");
     fprintf(stderr, " -h or --help                 Display this message\n");
-    fprintf(stderr, " Where <Red> <Grn> <Blu> are 0-255\n");
+    fprintf(stderr, " Where <Red> <Grn> <Blu> are 0-255 and <RGB> is <Red> <Grn> <Blu>\n");
+    fprintf(stderr, " <zone> is a zone, all, multi, row<n>, col<n>, key name, LED name or LED number; combine with + & - e.g. alpha+numrow-locks\n");
 }
 
 int validrgb(const char *value) {
@@ -53,9 +73,9 @@ int validrgb(const char *value) {
 
 void printstructure(struct shared_data *data, char type) {
     // Print each member of the structure
-    printf("Status: 0x%04x SM_B:%i SM_BI:%i SM_S:%i SM_SI:%i SM_E:%i SM_EI:%i SM_BL:%i SM_FO:%i SM_KEY:%i \nSM_SSPD: %i SM_PALT: %i SM_ONOFF: %i SM_BIT13: %i SM_BIT14: %i SM_BIT15: %i SM_BIT16: %i\n", data->status,
+    printf("Status: 0x%08x SM_B:%i SM_BI:%i SM_S:%i SM_SI:%i SM_E:%i SM_EI:%i SM_BL:%i SM_FO:%i SM_KEY:%i \nSM_SSPD: %i SM_PALT: %i SM_ONOFF: %i SM_HOST: %i SM_ZONE: %i SM_SFX: %i SM_FPS: %i SM_LAYER: %i SM_NOTIFY: %i\n", data->status,
         data->status & 1,(data->status>>1) & 1,(data->status>>2) & 1,(data->status>>3) & 1,(data->status>>4) & 1,(data->status>>5) & 1,(data->status>>6) & 1,(data->status>>7) & 1,(data->status>>8) & 1,
-        (data->status>>9) & 1,(data->status>>10) & 1, (data->status>>11) & 1, (data->status>>12) & 1, (data->status>>13) & 1, (data->status>>14) & 1, (data->status>>15) & 1);
+        (data->status>>9) & 1,(data->status>>10) & 1, (data->status>>11) & 1, (data->status>>12) & 1, (data->status>>13) & 1, (data->status>>14) & 1, (data->status>>15) & 1, (data->status>>16) & 1, (data->status>>17) & 1);
     printf("On/Off state: %u\n", data->onoff);
     printf("Brightness: %u\n", data->brightness);
     printf("Brightness Increment: %d\n", data->brightnessinc);
@@ -73,23 +93,129 @@ void printstructure(struct shared_data *data, char type) {
     // Print the key array if memdump=2
     if(type==2){
         printf("Keys: (R,G,B) Updt\n");
-        for (int j = 0; j < NKEYS; j++) {
+        for (int j = 0; j < data->nkeys; j++) {
             printf("Key[%d]:(%u,%u,%u)%u\n", j,data->key[j][0],data->key[j][1],data->key[j][2],data->key[j][3]);
         }
     }
 }
 
+//--image: every frame resampled to LED colors as it is decoded, only those are kept for playback
+struct imageframe {
+    uint32_t ms;                          //how long the frame stays up
+    keyset covered;                       //LEDs the picture reaches, the rest are left alone
+    unsigned char rgb[LAYOUT_MAXLEDS][3];
+};
+
+struct imageplay {
+    const struct layout *layout;
+    struct resample m;             //weights for the current canvas size
+    struct imageframe *frames;
+    uint32_t nframes, cap;
+    double applyus;                //time spent resampling, for -v
+};
+
+volatile sig_atomic_t stopplay = 0;
+
+void handle_stop(int sig) {
+    (void)sig;
+    stopplay = 1;
+}
+
+int imageframe(const unsigned char *rgb, uint16_t w, uint16_t h, uint32_t ms, void *ctx) {
+    struct imageplay *play = ctx;
+    struct timespec a, b;
+    if (play->nframes == play->cap) {
+        uint32_t cap = play->cap ? play->cap * 2 : 16;
+        struct imageframe *f = realloc(play->frames, cap * sizeof(*f));
+        if (f == NULL) return 1;
+        play->frames = f;
+        play->cap = cap;
+    }
+    if (resample_build(&play->m, play->layout, w, h) != 0) return 1;
+    struct imageframe *f = &play->frames[play->nframes++];
+    f->ms = ms;
+    clock_gettime(CLOCK_MONOTONIC, &a);
+    f->covered = resample_apply(&play->m, rgb, f->rgb);
+    clock_gettime(CLOCK_MONOTONIC, &b);
+    play->applyus += (b.tv_sec - a.tv_sec) * 1e6 + (b.tv_nsec - a.tv_nsec) / 1e3;
+    return 0;
+}
+
+//play an animation on our own layer with absolute deadlines so decode and lock time don't add up
+int imageanimate(const struct imageplay *play, int loops, char verbose) {
+    sharedmem_lock();
+    int layer = sharedmem_layeropen("kbledclient", SM_PRIO_DASHBOARD, 255);
+    sharedmem_unlock();
+    if (layer < 0) {
+        fprintf(stderr, "All %i kbled layers are in use\n", SM_MAXLAYERS);
+        return 1;
+    }
+    signal(SIGINT, handle_stop);
+    signal(SIGTERM, handle_stop);
+    if(verbose)printf("Playing %u frames on layer %i%s\n", play->nframes, layer, loops ? "" : ", Ctrl-C to stop");
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (int n = 0; !stopplay && (loops == 0 || n < loops); n++) {
+        for (uint32_t f = 0; f < play->nframes && !stopplay; f++) {
+            const struct imageframe *fr = &play->frames[f];
+            sharedmem_lock();
+            for (int j = 0; j < shm_ptr->nkeys; j++) {
+                if (keyset_has(&fr->covered, j)) sharedmem_layerkey(layer, j, fr->rgb[j]);
+                else sharedmem_layerclear(layer, j);
+            }
+            sharedmem_unlock();
+            next.tv_nsec += (long)(fr->ms % 1000) * 1000000L;
+            next.tv_sec += fr->ms / 1000 + next.tv_nsec / 1000000000L;
+            next.tv_nsec %= 1000000000L;
+            while (!stopplay && clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) != 0);
+        }
+    }
+    return 0; //the layer goes back when we detach
+}
+
+void printlayout(const struct layout *l) {
+    // Print the LED index clients use along with the name and geometry of each key
+    printf("Layout: %s (%s) %u keys, %u rows, %u columns\n", l->name, l->description, l->nleds, l->nrows, l->ncols);
+    printf("LED#  Name            Addr  Row  Col     X     Y\n");
+    for (int j = 0; j < l->nleds; j++) {
+        printf("%4d  %-15s %4u  %3u  %3u  %4.2f  %4.2f\n", j, l->ledname[j], l->addr[j], l->row[j], l->col[j],
+            (float)l->x[j]/LAYOUT_UNIT, (float)l->y[j]/LAYOUT_UNIT);
+    }
+}
+
+void printzones(const struct layout *l) {
+    // Print each named zone with the LEDs it covers
+    printf("Zones: %u (also all, multi, row<n>, col<n> and any key or LED name)\n", l->nzones);
+    for (int j = 0; j < l->nzones; j++) {
+        keyset s = l->zones[j].keys;
+        printf("%-15s %3d:", l->zones[j].name, keyset_count(&s));
+        for (int k = keyset_next(&s, -1); k >= 0; k = keyset_next(&s, k)) printf(" %s", l->ledname[k]);
+        printf("\n");
+    }
+}
+
 int main(int argc, char *argv[]) {
     if (argc < 2) {
         print_usage(argv[0]);
         return 1;
     }
     
-    struct shared_data new_ptr;
-    memset(&new_ptr, 0, sizeof(struct shared_data));
+    struct shared_data *new_ptr = sharedmem_newlocal(); // local staging copy, sized for the largest layout until we know the real one
+    if(new_ptr == NULL) return 1;
     char verbose = 0; // Flag for verbose output
     char memdump = 0; // Flag for dumping shared memory
     char cputime = 0; // Flag for reporting time spent in last kbled keyboard update event
+    char layout = 0; // Flag for listing the keys of the active layout
+    char zones = 0; // Flag for listing the zones of the active layout
+    const char *zoneexpr[SM_MAXZONEFILL]; // zone expressions of -z/-zg/-zv, resolved against the daemon's layout once attached
+    struct sm_notify notes[SM_MAXNOTIFY]; // notifications of -n/-nb/-np, sent on their own without waiting for the daemon
+    const char *noteexpr[SM_MAXNOTIFY]; // zone expressions of the notifications
+    int nnote = 0;
+    uint8_t noteprio = 128; // priority of all the notifications
+    int maxled = -1; // highest LED index referenced, checked against the daemon's layout once attached
+    uint16_t hostset = 0, hostclr = 0, hosttog = 0; // host state bits to set, clear and toggle
+    const char *imagefile = NULL; // --image, loaded once the daemon's layout is known
+    int imageloops = -1; // --loops, -1 for what the GIF asks for
     int i = 1;
     while (i < argc) {
         if (strcmp(argv[i], "-v") == 0) {
@@ -100,44 +226,44 @@ int main(int argc, char *argv[]) {
         else if (strcmp(argv[i], "-on") == 0) {
             // Increase brightness
             if(verbose)printf("Turn backlight on\n");
-            new_ptr.onoff=SM_ON; //increment value
-            new_ptr.status |= SM_ONOFF; //set update flag
+            new_ptr->onoff=SM_ON; //increment value
+            new_ptr->status |= SM_ONOFF; //set update flag
             i++;
         }
         else if (strcmp(argv[i], "-off") == 0) {
             // Increase brightness
             if(verbose)printf("Turn backlight off\n");
-            new_ptr.onoff=SM_OFF; //increment value
-            new_ptr.status |= SM_ONOFF; //set update flag
+            new_ptr->onoff=SM_OFF; //increment value
+            new_ptr->status |= SM_ONOFF; //set update flag
             i++;
         }
         else if (strcmp(argv[i], "-tog") == 0) {
             // Increase brightness
             if(verbose)printf("Toggle backlight on/off\n");
-            new_ptr.onoff |= SM_TOG; //increment value
-            new_ptr.status |= SM_ONOFF; //set update flag
+            new_ptr->onoff |= SM_TOG; //increment value
+            new_ptr->status |= SM_ONOFF; //set update flag
             i++;
         }
         else if (strcmp(argv[i], "-b+") == 0) {
             // Increase brightness
             if(verbose)printf("Increase brightness\n");
-            new_ptr.brightnessinc=1; //increment value
-            new_ptr.status |= SM_BI; //set update flag
+            new_ptr->brightnessinc=1; //increment value
+            new_ptr->status |= SM_BI; //set update flag
             i++;
         }
         else if (strcmp(argv[i], "-b-") == 0) {
             // Decrease brightness
             if(verbose)printf("Decrease brightness\n");
-            new_ptr.brightnessinc=-1; //decrement value
-            new_ptr.status |= SM_BI; //set update flag
+            new_ptr->brightnessinc=-1; //decrement value
+            new_ptr->status |= SM_BI; //set update flag
             i++;
         }
         else if (strcmp(argv[i], "-b") == 0) {
             // Set brightness (0-10)
             if (i + 1 < argc && atoi(argv[i + 1]) >= 0 && atoi(argv[i + 1]) <= 10) {
                 if(verbose)printf("Set brightness to %s\n", argv[i + 1]);
-                new_ptr.brightness=atoi(argv[i+1]); //set value
-                new_ptr.status |= SM_B; //set update flag
+                new_ptr->brightness=atoi(argv[i+1]); //set value
+                new_ptr->status |= SM_B; //set update flag
                 i += 2;
             } else {
                 fprintf(stderr, "Error: -b requires an argument between 0 and 10\n");
@@ -147,23 +273,23 @@ int main(int argc, char *argv[]) {
         else if (strcmp(argv[i], "-s+") == 0) {
             // Increase pattern speed
             if(verbose)printf("Increase pattern speed\n");
-            new_ptr.speedinc=1; //increment value
-            new_ptr.status |= SM_SI; //set update flag
+            new_ptr->speedinc=1; //increment value
+            new_ptr->status |= SM_SI; //set update flag
             i++;
         }
         else if (strcmp(argv[i], "-s-") == 0) {
             // Decrease pattern speed
             if(verbose)printf("Decrease pattern speed\n");
-            new_ptr.speedinc=-1; //decrement value
-            new_ptr.status |= SM_SI; //set update flag
+            new_ptr->speedinc=-1; //decrement value
+            new_ptr->status |= SM_SI; //set update flag
             i++;
         }
         else if (strcmp(argv[i], "-s") == 0) {
             // Set pattern speed (0-2)
             if (i + 1 < argc && atoi(argv[i + 1]) >= 0 && atoi(argv[i + 1]) <= 2) {
                 if(verbose)printf("Set pattern speed to %s\n", argv[i + 1]);
-                new_ptr.speed=atoi(argv[i+1]); //set value
-                new_ptr.status |= SM_S; //set update flag
+                new_ptr->speed=atoi(argv[i+1]); //set value
+                new_ptr->status |= SM_S; //set update flag
                 i += 2;
             } else {
                 fprintf(stderr, "Error: -s requires an argument between 0 and 2\n");
@@ -173,37 +299,61 @@ int main(int argc, char *argv[]) {
         else if (strcmp(argv[i], "-p+") == 0) {
             // Increment pattern
             if(verbose)printf("Increment pattern\n");
-            new_ptr.effectinc=1; //increment value
-            new_ptr.status |= SM_EI; //set update flag
+            new_ptr->effectinc=1; //increment value
+            new_ptr->status |= SM_EI; //set update flag
             i++;
         }
         else if (strcmp(argv[i], "-p-") == 0) {
             // Decrement pattern
             if(verbose)printf("Decrement pattern\n");
-            new_ptr.effectinc=-1; //decrement value
-            new_ptr.status |= SM_EI; //set update flag
+            new_ptr->effectinc=-1; //decrement value
+            new_ptr->status |= SM_EI; //set update flag
             i++;
         }
         else if (strcmp(argv[i], "-p") == 0) {
             // Set pattern (-1 to 6)
             if (i + 1 < argc && atoi(argv[i + 1]) >= -1 && atoi(argv[i + 1]) <= 6) {
                 if(verbose)printf("Set pattern to %s\n", argv[i + 1]);
-                new_ptr.effect=atoi(argv[i+1]); //set value
-                new_ptr.status |= SM_E; //set update flag
+                new_ptr->effect=atoi(argv[i+1]); //set value
+                new_ptr->status |= SM_E; //set update flag
                 i += 2;
             } else {
                 fprintf(stderr, "Error: -p requires an argument between -1 and 6\n");
                 return 1;
             }
         }
+        else if (strcmp(argv[i], "-sfx") == 0) {
+            // Set software effect (0 to SM_SFX_MAX built in, then the ones kbled.conf defines; kbled turns unknown ones off)
+            if (i + 1 < argc && atoi(argv[i + 1]) >= 0 && atoi(argv[i + 1]) < SM_SFX_USER + SM_SFX_MAXUSER) {
+                if(verbose)printf("Set software effect to %s\n", argv[i + 1]);
+                new_ptr->sfx=atoi(argv[i+1]); //set value
+                new_ptr->status |= SM_SFX; //set update flag
+                i += 2;
+            } else {
+                fprintf(stderr, "Error: -sfx requires an argument between 0 and %i\n", SM_SFX_USER + SM_SFX_MAXUSER - 1);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--fps") == 0) {
+            // Set software effect frame rate
+            if (i + 1 < argc && atoi(argv[i + 1]) >= 1 && atoi(argv[i + 1]) <= SM_MAXFPS) {
+                if(verbose)printf("Set software effect frame rate to %s fps\n", argv[i + 1]);
+                new_ptr->fps=atoi(argv[i+1]); //set value
+                new_ptr->status |= SM_FPS; //set update flag
+                i += 2;
+            } else {
+                fprintf(stderr, "Error: --fps requires an argument between 1 and %i\n", SM_MAXFPS);
+                return 1;
+            }
+        }
         else if (strcmp(argv[i], "-bl") == 0) {
             // Set backlight color (3 values: Red, Green, Blue)
             if (i + 3 < argc && validrgb(argv[i + 1]) && validrgb(argv[i + 2]) && validrgb(argv[i + 3])) {
                 if(verbose)printf("Set backlight color to Red=%s, Green=%s, Blue=%s\n", argv[i + 1], argv[i + 2], argv[i + 3]);
-                new_ptr.backlight[0]=atoi(argv[i+1]); //set value
-                new_ptr.backlight[1]=atoi(argv[i+2]); //set value
-                new_ptr.backlight[2]=atoi(argv[i+3]); //set value
-                new_ptr.status |= SM_BL; //set update flag
+                new_ptr->backlight[0]=atoi(argv[i+1]); //set value
+                new_ptr->backlight[1]=atoi(argv[i+2]); //set value
+                new_ptr->backlight[2]=atoi(argv[i+3]); //set value
+                new_ptr->status |= SM_BL; //set update flag
                 i += 4;
             } else {
                 fprintf(stderr, "Error: -bl requires three numeric arguments (Red, Green, Blue) in the range 0-255\n");
@@ -214,10 +364,10 @@ int main(int argc, char *argv[]) {
             // Set focus color (3 values: Red, Green, Blue)
             if (i + 3 < argc && validrgb(argv[i + 1]) && validrgb(argv[i + 2]) && validrgb(argv[i + 3])) {
                 if(verbose)printf("Set focus color to Red=%s, Green=%s, Blue=%s\n", argv[i + 1], argv[i + 2], argv[i + 3]);
-                new_ptr.focus[0]=atoi(argv[i+1]); //set value
-                new_ptr.focus[1]=atoi(argv[i+2]); //set value
-                new_ptr.focus[2]=atoi(argv[i+3]); //set value
-                new_ptr.status |= SM_FO; //set update flag
+                new_ptr->focus[0]=atoi(argv[i+1]); //set value
+                new_ptr->focus[1]=atoi(argv[i+2]); //set value
+                new_ptr->focus[2]=atoi(argv[i+3]); //set value
+                new_ptr->status |= SM_FO; //set update flag
                 i += 4;
             } else {
                 fprintf(stderr, "Error: -fo requires three numeric arguments (Red, Green, Blue) in the range 0-255\n");
@@ -227,23 +377,24 @@ int main(int argc, char *argv[]) {
         else if (strcmp(argv[i], "-c") == 0) {
             // Cycle through preset backlight/focus colors
             if(verbose)printf("Cycle through preset backlight/focus colors\n");
-            new_ptr.status |= SM_PALT; //set update flag
+            new_ptr->status |= SM_PALT; //set update flag
             i++;
         }
         else if (strcmp(argv[i], "-k") == 0) {
-            // Set individual LED color (0-NKEYS)
+            // Set individual LED color (0-nkeys)
             if (i + 4 < argc) {
                 unsigned char led = atoi(argv[i + 1]);
-                if (atoi(argv[i + 1]) >= 0 && led < NKEYS-1 && validrgb(argv[i + 2]) && validrgb(argv[i + 3]) && validrgb(argv[i + 4])) {
+                if (atoi(argv[i + 1]) >= 0 && atoi(argv[i + 1]) < KB_MAXKEYS && validrgb(argv[i + 2]) && validrgb(argv[i + 3]) && validrgb(argv[i + 4])) {
                     if(verbose)printf("Set LED %d color to Red=%s, Green=%s, Blue=%s\n", led, argv[i + 2], argv[i + 3], argv[i + 4]);
-                    new_ptr.key[led][0]=atoi(argv[i+2]); //set value
-                    new_ptr.key[led][1]=atoi(argv[i+3]); //set value
-                    new_ptr.key[led][2]=atoi(argv[i+4]); //set value
-                    new_ptr.key[led][3]=SM_UPD; //set update flag
-                    new_ptr.status |= SM_KEY; //set update flag
+                    new_ptr->key[led][0]=atoi(argv[i+2]); //set value
+                    new_ptr->key[led][1]=atoi(argv[i+3]); //set value
+                    new_ptr->key[led][2]=atoi(argv[i+4]); //set value
+                    new_ptr->key[led][3]=SM_UPD; //set update flag
+                    new_ptr->status |= SM_KEY; //set update flag
+                    if(led > maxled) maxled = led;
                     i += 5;
                 } else {
-                    fprintf(stderr, "Error: -k requires a valid LED (0-%i) and three numeric color arguments (Red, Green, Blue) in the range 0-255\n", NKEYS-1);
+                    fprintf(stderr, "Error: -k requires a valid LED (0-%i) and three numeric color arguments (Red, Green, Blue) in the range 0-255\n", KB_MAXKEYS-1);
                     return 1;
                 }
             } else {
@@ -253,27 +404,115 @@ int main(int argc, char *argv[]) {
         }
         else if (strcmp(argv[i], "-kb") == 0) {
             // Set key to background color
-            if (i + 1 < argc && atoi(argv[i + 1]) >= 0 && atoi(argv[i + 1]) <= NKEYS-1) {
+            if (i + 1 < argc && atoi(argv[i + 1]) >= 0 && atoi(argv[i + 1]) < KB_MAXKEYS) {
                 unsigned char led = atoi(argv[i + 1]);
                 if(verbose)printf("Set LED %i to background color\n", led);
-                new_ptr.key[led][3]=SM_BKGND; //set update value to background color
-                new_ptr.status |= SM_KEY; //set update flag
+                new_ptr->key[led][3]=SM_BKGND; //set update value to background color
+                new_ptr->status |= SM_KEY; //set update flag
+                if(led > maxled) maxled = led;
                 i += 2;
             } else {
-                fprintf(stderr, "Error: -kb requires a LED number between 0 and %i\n",NKEYS-1);
+                fprintf(stderr, "Error: -kb requires a LED number between 0 and %i\n",KB_MAXKEYS-1);
                 return 1;
             }
         }
         else if (strcmp(argv[i], "-kf") == 0) {
             // Set key to focus color
-            if (i + 1 < argc && atoi(argv[i + 1]) >= 0 && atoi(argv[i + 1]) <= NKEYS-1) {
+            if (i + 1 < argc && atoi(argv[i + 1]) >= 0 && atoi(argv[i + 1]) < KB_MAXKEYS) {
                 unsigned char led = atoi(argv[i + 1]);
                 if(verbose)printf("Set LED %i to backlight color\n", led);
-                new_ptr.key[led][3]=SM_FOCUS; //set update value to focus color
-                new_ptr.status |= SM_KEY; //set update flag
+                new_ptr->key[led][3]=SM_FOCUS; //set update value to focus color
+                new_ptr->status |= SM_KEY; //set update flag
+                if(led > maxled) maxled = led;
+                i += 2;
+            } else {
+                fprintf(stderr, "Error: -kf requires a LED number between 0 and %i\n",KB_MAXKEYS-1);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-z") == 0 || strcmp(argv[i], "-zg") == 0 || strcmp(argv[i], "-zv") == 0) {
+            // Fill a zone with a color or gradient
+            int ncolor = (argv[i][2] == '\0')? 1 : 2;
+            int valid = (i + 1 + 3*ncolor < argc && new_ptr->nzonefill < SM_MAXZONEFILL);
+            for (int c = 0; valid && c < 3*ncolor; c++) valid = validrgb(argv[i + 2 + c]);
+            if (valid) {
+                struct sm_zonefill *z = &new_ptr->zonefill[new_ptr->nzonefill];
+                z->mode = (ncolor == 1)? ZONE_SOLID : (argv[i][2] == 'g')? ZONE_HGRAD : ZONE_VGRAD;
+                for (int c = 0; c < 3; c++) {
+                    z->from[c] = atoi(argv[i + 2 + c]);
+                    z->to[c] = (ncolor == 1)? z->from[c] : atoi(argv[i + 5 + c]);
+                }
+                if(verbose)printf("Fill zone %s with %s\n", argv[i + 1], (ncolor == 1)? "a color" : "a gradient");
+                zoneexpr[new_ptr->nzonefill++] = argv[i + 1];
+                new_ptr->status |= SM_ZONE; //set update flag
+                i += 2 + 3*ncolor;
+            } else {
+                fprintf(stderr, "Error: %s requires a zone and %i numeric color arguments in the range 0-255 (at most %i zone fills)\n", argv[i], 3*ncolor, SM_MAXZONEFILL);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "-nb") == 0 || strcmp(argv[i], "-np") == 0) {
+            // Flash a zone for a while, the daemon restores it
+            int valid = (i + 5 < argc && nnote < SM_MAXNOTIFY && atoi(argv[i + 5]) > 0);
+            for (int c = 0; valid && c < 3; c++) valid = validrgb(argv[i + 2 + c]);
+            if (valid) {
+                struct sm_notify *n = &notes[nnote];
+                memset(n, 0, sizeof(*n));
+                n->pattern = (argv[i][2] == 'b')? SM_NOTIFY_BLINK : (argv[i][2] == 'p')? SM_NOTIFY_PULSE : SM_NOTIFY_SOLID;
+                for (int c = 0; c < 3; c++) n->rgb[c] = atoi(argv[i + 2 + c]);
+                n->ms = strtoul(argv[i + 5], NULL, 10);
+                if(verbose)printf("Notify on zone %s for %u ms\n", argv[i + 1], n->ms);
+                noteexpr[nnote++] = argv[i + 1];
+                i += 6;
+            } else {
+                fprintf(stderr, "Error: %s requires a zone, 3 numeric color arguments in the range 0-255 and a duration in ms (at most %i notifications)\n", argv[i], SM_MAXNOTIFY);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--nprio") == 0) {
+            // Priority of the notifications
+            if (i + 1 < argc && atoi(argv[i + 1]) >= 0 && atoi(argv[i + 1]) <= 255) {
+                noteprio = atoi(argv[i + 1]);
                 i += 2;
             } else {
-                fprintf(stderr, "Error: -kf requires a LED number between 0 and %i\n",NKEYS-1);
+                fprintf(stderr, "Error: --nprio requires a priority between 0 and 255\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--image") == 0) {
+            // Picture or animated GIF resampled onto the keys
+            if (i + 1 < argc) {
+                if(verbose)printf("Show image %s\n", argv[i + 1]);
+                imagefile = argv[i + 1];
+                i += 2;
+            } else {
+                fprintf(stderr, "Error: --image requires a PNG or GIF file\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--loops") == 0) {
+            // Times to play an animated GIF
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]) && atoi(argv[i + 1]) <= 65535) {
+                imageloops = atoi(argv[i + 1]);
+                i += 2;
+            } else {
+                fprintf(stderr, "Error: --loops requires a count between 0 (forever) and 65535\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-host") == 0) {
+            // Set, clear or toggle a host state bit
+            if (i + 2 < argc && atoi(argv[i + 1]) >= 0 && atoi(argv[i + 1]) <= 14 &&
+                (strcmp(argv[i + 2], "on") == 0 || strcmp(argv[i + 2], "off") == 0 || strcmp(argv[i + 2], "tog") == 0)) {
+                uint16_t bit = 1 << atoi(argv[i + 1]);
+                if(verbose)printf("Host state %s: %s\n", argv[i + 1], argv[i + 2]);
+                if (strcmp(argv[i + 2], "on") == 0) hostset |= bit;
+                else if (strcmp(argv[i + 2], "off") == 0) hostclr |= bit;
+                else hosttog |= bit;
+                new_ptr->status |= SM_HOST; //set update flag
+                i += 3;
+            } else {
+                fprintf(stderr, "Error: -host requires a state number between 0 and 14 followed by on, off or tog\n");
                 return 1;
             }
         }
@@ -288,14 +527,26 @@ int main(int argc, char *argv[]) {
             if (i + 1 < argc && atoi(argv[i + 1]) >= 1 && atoi(argv[i + 1]) <= 65535) {
                 uint16_t scan = atoi(argv[i + 1]);
                 if(verbose)printf("Set scan speed to %i ms\n", scan);
-                new_ptr.scanspeed=scan; //set update value to focus color
-                new_ptr.status |= SM_SSPD; //set update flag
+                new_ptr->scanspeed=scan; //set update value to focus color
+                new_ptr->status |= SM_SSPD; //set update flag
                 i += 2;
             } else {
                 fprintf(stderr, "Error: --scan must be between 1 and 65535 ms, you specified: %s\n",argv[i + 1]);
                 return 1;
             }
         }
+        else if (strcmp(argv[i], "--layout") == 0) {
+            // List keys of the active layout
+            if(verbose)printf("List keys of the active layout\n");
+            layout=1;
+            i++;
+        }
+        else if (strcmp(argv[i], "--zones") == 0) {
+            // List zones of the active layout
+            if(verbose)printf("List zones of the active layout\n");
+            zones=1;
+            i++;
+        }
         else if (strcmp(argv[i], "--dump") == 0) {
             // Increase brightness
             if(verbose)printf("Dump contents of shared memory:\n");
@@ -326,28 +577,98 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     if(verbose)printf("Attached to shared memory\n");
+    if(maxled >= shm_ptr->nkeys){
+        fprintf(stderr, "Error: LED %i is not on the %s keyboard layout (0-%i)\n", maxled, shm_ptr->layout.name, shm_ptr->nkeys-1);
+        sharedmem_slaveclose(verbose);
+        return 1;
+    }
+    for(i=0; i<new_ptr->nzonefill; i++){
+        if(zone_parse(&shm_ptr->layout, zoneexpr[i], &new_ptr->zonefill[i].keys)!=0){
+            fprintf(stderr, "Error: zone %s is not on the %s keyboard layout, see --zones\n", zoneexpr[i], shm_ptr->layout.name);
+            sharedmem_slaveclose(verbose);
+            return 1;
+        }
+    }
+    for(i=0; i<nnote; i++){
+        if(zone_parse(&shm_ptr->layout, noteexpr[i], &notes[i].keys)!=0){
+            fprintf(stderr, "Error: zone %s is not on the %s keyboard layout, see --zones\n", noteexpr[i], shm_ptr->layout.name);
+            sharedmem_slaveclose(verbose);
+            return 1;
+        }
+    }
+    struct imageplay play = { .layout = &shm_ptr->layout };
+    if(imagefile){ // decode and resample up front, playback then only copies LED colors
+        char err[320];
+        int loops;
+        int n = image_load(imagefile, imageframe, &play, &loops, err, sizeof(err));
+        if(n < 0 || (uint32_t)n != play.nframes){
+            fprintf(stderr, "Error: %s\n", n < 0 ? err : "out of memory");
+            sharedmem_slaveclose(verbose);
+            return 1;
+        }
+        if(imageloops < 0) imageloops = loops;
+        if(verbose)printf("%s: %u frame(s) %ux%u, %u weights for %u LEDs, resampling took %.2f us per frame\n", imagefile, play.nframes,
+            play.m.w, play.m.h, play.m.nnz, play.m.nleds, play.applyus / play.nframes);
+        if(play.nframes == 1){ // a still picture becomes the keys' own colors like -k
+            for(int j = 0; j < shm_ptr->nkeys; j++) if(keyset_has(&play.frames[0].covered, j)){
+                memcpy(new_ptr->key[j], play.frames[0].rgb[j], 3);
+                new_ptr->key[j][3] = SM_UPD;
+            }
+            new_ptr->status |= SM_KEY;
+        }
+        resample_free(&play.m);
+    }
+    int noteerr = 0;
+    for(i=0; i<nnote; i++){ // sent first and never blocked on the semaphore, a busy daemon drops them rather than stall the caller
+        notes[i].priority = noteprio;
+        if(sharedmem_notify(&notes[i])!=0){
+            fprintf(stderr, "Error: kbled is busy or has too many notifications queued, notification on %s dropped\n", noteexpr[i]);
+            noteerr = 1;
+        }
+    }
+    if(nnote && new_ptr->status==0 && !memdump && !cputime && !layout && !zones && play.nframes <= 1){ // nothing else to do
+        sharedmem_slaveclose(verbose);
+        free(play.frames);
+        free(new_ptr);
+        return noteerr;
+    }
+    if(layout) printlayout(&shm_ptr->layout);
+    if(zones) printzones(&shm_ptr->layout);
     // Wait (lock) the semaphore before accessing shared memory and making updates;
     sharedmem_lock(); //lock semaphore **************************************************************************************
     if(verbose)printf("Semahpre opened\n");
-    if(new_ptr.status!=0) shm_ptr->status=new_ptr.status;
-    if(new_ptr.status & SM_ONOFF)   shm_ptr->onoff=((shm_ptr->onoff & 1) | (new_ptr.onoff & 1)) | (new_ptr.onoff & 2); //preserve state unless changed (first part) and set toggle flag
-    if(new_ptr.status & SM_B)       shm_ptr->brightness=new_ptr.brightness;
-    if(new_ptr.status & SM_BI)      shm_ptr->brightnessinc=new_ptr.brightnessinc;
-    if(new_ptr.status & SM_S)       shm_ptr->speed=new_ptr.speed;
-    if(new_ptr.status & SM_SI)      shm_ptr->speedinc=new_ptr.speedinc;
-    if(new_ptr.status & SM_E)       shm_ptr->effect=new_ptr.effect;
-    if(new_ptr.status & SM_EI)      shm_ptr->effectinc=new_ptr.effectinc;
-    if(new_ptr.status & SM_BL)      for(i=0; i<3; i++) shm_ptr->backlight[i]=new_ptr.backlight[i];
-    if(new_ptr.status & SM_FO)      for(i=0; i<3; i++) shm_ptr->focus[i]=new_ptr.focus[i];
-    if(new_ptr.status & SM_KEY)     for(i=0; i<4; i++) for(int j=0; j<NKEYS; j++) if(new_ptr.key[3]!=0)shm_ptr->key[j][i]=new_ptr.key[j][i];
-    if(new_ptr.status & SM_SSPD)    shm_ptr->scanspeed=new_ptr.scanspeed;
+    shm_ptr->status |= new_ptr->status; //keep flags other clients set that the daemon hasn't handled yet
+    if(new_ptr->status & SM_ONOFF)   shm_ptr->onoff=((shm_ptr->onoff & 1) | (new_ptr->onoff & 1)) | (new_ptr->onoff & 2); //preserve state unless changed (first part) and set toggle flag
+    if(new_ptr->status & SM_B)       shm_ptr->brightness=new_ptr->brightness;
+    if(new_ptr->status & SM_BI)      shm_ptr->brightnessinc=new_ptr->brightnessinc;
+    if(new_ptr->status & SM_S)       shm_ptr->speed=new_ptr->speed;
+    if(new_ptr->status & SM_SI)      shm_ptr->speedinc=new_ptr->speedinc;
+    if(new_ptr->status & SM_E)       shm_ptr->effect=new_ptr->effect;
+    if(new_ptr->status & SM_EI)      shm_ptr->effectinc=new_ptr->effectinc;
+    if(new_ptr->status & SM_BL)      for(i=0; i<3; i++) shm_ptr->backlight[i]=new_ptr->backlight[i];
+    if(new_ptr->status & SM_FO)      for(i=0; i<3; i++) shm_ptr->focus[i]=new_ptr->focus[i];
+    if(new_ptr->status & SM_KEY)     for(i=0; i<4; i++) for(int j=0; j<shm_ptr->nkeys; j++) if(new_ptr->key[j][3]!=0)shm_ptr->key[j][i]=new_ptr->key[j][i];
+    if(new_ptr->status & SM_SSPD)    shm_ptr->scanspeed=new_ptr->scanspeed;
+    if(new_ptr->status & SM_SFX)     shm_ptr->sfx=new_ptr->sfx;
+    if(new_ptr->status & SM_FPS)     shm_ptr->fps=new_ptr->fps;
+    if(new_ptr->status & SM_ZONE)    for(i=0; i<new_ptr->nzonefill; i++){
+        if(shm_ptr->nzonefill < SM_MAXZONEFILL) shm_ptr->zonefill[shm_ptr->nzonefill++]=new_ptr->zonefill[i];
+        else shm_ptr->zonefill[SM_MAXZONEFILL-1]=new_ptr->zonefill[i]; //queue full, the newest fill wins
+    }
+    if(new_ptr->status & SM_HOST)    shm_ptr->hoststate=((shm_ptr->hoststate | hostset) & ~hostclr) ^ hosttog;
     if(memdump) sharedmem_printstructure(shm_ptr,memdump);
     if(cputime) printf("Last kbled daemon LED update time: %f ms, idle loop time %f ns\n", shm_ptr->lastcputime*1000.0,shm_ptr->idlecputime*1000.0);
+    if(cputime && shm_ptr->sfx!=SM_SFX_NONE) printf("Software effect frames: %u @ %u fps, %u dropped, %u late, frame time last %.3f ms avg %.3f ms max %.3f ms\n",
+        shm_ptr->framestats.frames, shm_ptr->fps, shm_ptr->framestats.dropped, shm_ptr->framestats.late,
+        shm_ptr->framestats.lastus/1000.0, shm_ptr->framestats.avgus/1000.0, shm_ptr->framestats.maxus/1000.0);
     sharedmem_unlock(); //unlock semaphore  *********************************************************************************************************
     if(verbose)printf("Semaphore closed\n");
+    if(play.nframes > 1 && imageanimate(&play, imageloops, verbose) != 0) noteerr = 1;
+    free(play.frames);
     
     sharedmem_slaveclose(verbose);
     if(verbose)printf("Detached from shared memory\n");
+    free(new_ptr);
 
-    return 0;
+    return noteerr;
 }
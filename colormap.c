@@ -0,0 +1,95 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * Colormap lookup tables, see colormap.h.  Viridis and inferno come from 6th degree polynomial fits of the
+ * matplotlib maps, turbo from Google's published polynomial approximation.
+ */
+
+#include <string.h>
+#include <strings.h>
+#include "colormap.h"
+
+static const char *const names[COLORMAP_COUNT]={"ramp", "viridis", "turbo", "inferno"};
+static unsigned char lut[COLORMAP_COUNT][COLORMAP_SIZE][3];
+
+//polynomial coefficients per channel, lowest power first
+static const float viridis[7][3]={
+    { 0.2777273272234177f,  0.005407344544966578f,  0.3340998053353061f},
+    { 0.1050930431085774f,  1.404613529898575f,     1.384590162594685f},
+    {-0.3308618287255563f,  0.214847559468213f,     0.09509516302823659f},
+    {-4.634230498983486f,  -5.799100973351585f,   -19.33244095627987f},
+    { 6.228269936347081f,  14.17993336680509f,     56.69055260068105f},
+    { 4.776384997670288f, -13.74514537774601f,    -65.35303263337234f},
+    {-5.435455855934631f,   4.645852612178535f,    26.3124352495832f},
+};
+static const float inferno[7][3]={
+    { 0.0002189403691192265f, 0.001651004631001012f, -0.01948089843709184f},
+    { 0.1065134194856116f,    0.5639564367884091f,    3.932712388889277f},
+    {11.60249308247187f,     -3.972853965665698f,   -15.9423941062914f},
+    {-41.70399613139459f,    17.43639888205313f,     44.35414519872813f},
+    {77.162935699427f,      -33.40235894210092f,    -81.80730925738993f},
+    {-71.31942824499214f,    32.62606426397723f,     73.20951985803202f},
+    {25.13112622477341f,    -12.24266895238567f,    -23.07032500287172f},
+};
+static const float turbo[6][3]={
+    {  0.13572138f,  0.09140261f,   0.10667330f},
+    {  4.61539260f,  2.19418839f,  12.64194608f},
+    {-42.66032258f,  4.84296658f, -60.58204836f},
+    {132.13108234f, -14.18503333f, 110.36276771f},
+    {-152.94239396f,  4.27729857f, -89.90310912f},
+    { 59.28637943f,  2.82956604f,  27.34824973f},
+};
+
+static unsigned char level(float c){
+    c=c*255.0f+0.5f;
+    return (c<0.0f)? 0 : (c>255.0f)? 255 : (unsigned char)c;
+}
+
+static void polyfill(unsigned char (*t)[3], const float (*k)[3], int terms){
+    for(int i=0; i<COLORMAP_SIZE; i++){
+        float x=(float)i/(COLORMAP_SIZE-1);
+        for(int c=0; c<3; c++){
+            float v=0.0f;
+            for(int p=terms-1; p>=0; p--) v=v*x+k[p][c];
+            t[i][c]=level(v);
+        }
+    }
+}
+
+void colormap_init(){
+    for(int i=0; i<COLORMAP_SIZE; i++){ //blue fading to green over the first half, green to red over the second
+        float x=(float)i/(COLORMAP_SIZE-1);
+        lut[COLORMAP_RAMP][i][0]=level((x<0.5f)? 0.0f : 2.0f*x-1.0f);
+        lut[COLORMAP_RAMP][i][1]=level((x<0.5f)? 2.0f*x : 2.0f-2.0f*x);
+        lut[COLORMAP_RAMP][i][2]=level((x<0.5f)? 1.0f-2.0f*x : 0.0f);
+    }
+    polyfill(lut[COLORMAP_VIRIDIS], viridis, 7);
+    polyfill(lut[COLORMAP_TURBO], turbo, 6);
+    polyfill(lut[COLORMAP_INFERNO], inferno, 7);
+}
+
+int colormap_find(const char *name){
+    for(int i=0; i<COLORMAP_COUNT; i++) if(strcasecmp(name, names[i])==0) return i;
+    return -1;
+}
+
+const char *colormap_names(){
+    return "ramp, viridis, turbo or inferno";
+}
+
+void colormap_map(int map, const float *v, int n, unsigned char (*rgb)[3]){
+    const unsigned char (*t)[3]=lut[map];
+    uint8_t idx[COLORMAP_BATCH];
+    for(int base=0; base<n; base+=COLORMAP_BATCH){
+        int m=(n-base<COLORMAP_BATCH)? n-base : COLORMAP_BATCH;
+        //clamp and scale in one straight pass the compiler turns into vector min/max, then look them all up
+        for(int i=0; i<m; i++){
+            float x=v[base+i]*(COLORMAP_SIZE-1)+0.5f;
+            x=!(x>0.0f)? 0.0f : x; //written so a NaN reading lands on 0 too
+            x=(x>COLORMAP_SIZE-1)? COLORMAP_SIZE-1 : x;
+            idx[i]=(uint8_t)x;
+        }
+        for(int i=0; i<m; i++) memcpy(rgb[base+i], t[idx[i]], 3);
+    }
+}
@@ -0,0 +1,31 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * Colormaps for dashboards: 256 entry lookup tables filled once by colormap_init(), then whole arrays of values
+ * from 0 to 1 are turned into colors with colormap_map() without any division or branch per key.
+ */
+
+#ifndef COLORMAP_H
+#define COLORMAP_H
+
+#include <stdint.h>
+
+#define COLORMAP_SIZE  256
+#define COLORMAP_BATCH 64   //values converted to table indices per pass of colormap_map()
+
+enum colormap_id {
+    COLORMAP_RAMP,     //blue to green to red, the original kbledpsmon colors
+    COLORMAP_VIRIDIS,  //dark purple to yellow, perceptually uniform
+    COLORMAP_TURBO,    //blue to red through green, an improved rainbow
+    COLORMAP_INFERNO,  //black to yellow through red, perceptually uniform
+    COLORMAP_COUNT
+};
+
+void colormap_init();                    //fill the tables, call once before colormap_map()
+int colormap_find(const char *name);     //colormap_id for a name, -1 if there is none
+const char *colormap_names();            //names of every colormap for usage messages
+//rgb[i] is the color of v[i], values outside 0-1 get the end colors
+void colormap_map(int map, const float *v, int n, unsigned char (*rgb)[3]);
+
+#endif
@@ -0,0 +1,48 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ * 
+ * kbled.conf reader: each module registers the keyword(s) it cares about and gets the tokenized lines
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "config.h"
+
+int config_parse(const char *path, const char *keyword, config_handler handler){
+    FILE *file = fopen(path, "r");
+    if(file == NULL) return -1;
+    char line[CONF_MAXLINE], raw[CONF_MAXLINE];
+    char *tok[CONF_MAXTOK];
+    int lineno=0, handled=0;
+    size_t klen=strlen(keyword);
+
+    while(fgets(line, sizeof(line), file)){
+        lineno++;
+        line[strcspn(line, "#\r\n")] = '\0'; //strip comments and line endings
+        char *p=line;
+        while(isspace((unsigned char)*p)) p++;
+        if(strncmp(p, keyword, klen)!=0 || !(isspace((unsigned char)p[klen]) || p[klen]=='\0')) continue; //not ours
+        strcpy(raw, p+klen);
+        int ntok=0;
+        for(char *t=strtok(p, " \t"); t!=NULL && ntok<CONF_MAXTOK; t=strtok(NULL, " \t")) tok[ntok++]=t;
+        if(handler(ntok, tok, raw, lineno)!=0) fprintf(stderr, "%s:%i: could not parse '%s' line\n", path, lineno, keyword);
+        else handled++;
+    }
+    fclose(file);
+    return handled;
+}
+
+int config_color(int ntok, char **tok, int *pos, unsigned char *rgb){
+    if(*pos+2 >= ntok) return 1;
+    for(int i=0; i<3; i++){
+        char *end;
+        long v=strtol(tok[*pos+i], &end, 0);
+        if(*end!='\0' || v<0 || v>255) return 1;
+        rgb[i]=(unsigned char)v;
+    }
+    *pos+=3;
+    return 0;
+}
@@ -0,0 +1,22 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ * 
+ * kbled.conf reader: each module registers the keyword(s) it cares about and gets the tokenized lines
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#define CONF_FILE    "/etc/kbled.conf"  //default location of the configuration file
+#define CONF_MAXLINE 512 //longest line accepted in the configuration file
+#define CONF_MAXTOK  64  //max number of whitespace separated tokens per line
+
+//handler called for every line starting with the keyword: tok[0] is the keyword, raw is the untokenized remainder of the line
+//(comments stripped) for handlers that need their own parsing.  Return 0 if the line was accepted, nonzero to report it as bad
+typedef int (*config_handler)(int ntok, char **tok, const char *raw, int lineno);
+
+int config_parse(const char *path, const char *keyword, config_handler handler); //returns # of lines handled, -1 if the file can't be read
+int config_color(int ntok, char **tok, int *pos, unsigned char *rgb); //parse <R> <G> <B> at tok[*pos], advance *pos; 0 on success
+
+#endif
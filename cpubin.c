@@ -0,0 +1,165 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * CPU to key binning, see cpubin.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <dirent.h>
+#include "cpubin.h"
+
+static const char *const groupnames[]={"cpu", "core", "package", "node"};
+
+//sort key of every cpu: group first, then package and core so siblings end up next to each other
+struct cpukey {
+    long group, package, core;
+    int cpu;
+};
+
+int cpubin_findagg(const char *name, int *agg, int *pct){
+    char *end;
+    if(strcasecmp(name, "avg")==0) *agg=CPUBIN_AVG;
+    else if(strcasecmp(name, "max")==0) *agg=CPUBIN_MAX;
+    else if((name[0]=='p' || name[0]=='P') && name[1]!='\0'){
+        long p=strtol(name+1, &end, 10);
+        if(*end!='\0' || p<0 || p>100) return -1;
+        *agg=CPUBIN_PCT;
+        *pct=(int)p;
+    }
+    else return -1;
+    return 0;
+}
+
+int cpubin_findgroup(const char *name){
+    for(int i=0; i<4; i++) if(strcasecmp(name, groupnames[i])==0) return i;
+    return -1;
+}
+
+const char *cpubin_groupname(int group){
+    return groupnames[group];
+}
+
+//number in a sysfs file, -1 if it isn't there (offline cpus have no topology)
+static long cpubin_readnum(int cpu, const char *file){
+    char path[128], buf[32];
+    long v=-1;
+    snprintf(path, sizeof(path), "%s/cpu%i/%s", CPUBIN_TOPOLOGY, cpu, file);
+    FILE *f=fopen(path, "r");
+    if(f==NULL) return -1;
+    if(fgets(buf, sizeof(buf), f)) v=strtol(buf, NULL, 10);
+    fclose(f);
+    return v;
+}
+
+//NUMA node of a cpu from its node<n> link, 0 without NUMA
+static long cpubin_node(int cpu){
+    char path[128];
+    long node=0;
+    snprintf(path, sizeof(path), "%s/cpu%i", CPUBIN_TOPOLOGY, cpu);
+    DIR *d=opendir(path);
+    if(d==NULL) return 0;
+    struct dirent *e;
+    while((e=readdir(d))!=NULL) if(strncmp(e->d_name, "node", 4)==0 && e->d_name[4]>='0' && e->d_name[4]<='9') {
+        node=strtol(e->d_name+4, NULL, 10);
+        break;
+    }
+    closedir(d);
+    return node;
+}
+
+static int cpubin_compare(const void *a, const void *b){
+    const struct cpukey *x=a, *y=b;
+    if(x->group!=y->group) return (x->group<y->group)? -1 : 1;
+    if(x->package!=y->package) return (x->package<y->package)? -1 : 1;
+    if(x->core!=y->core) return (x->core<y->core)? -1 : 1;
+    return x->cpu-y->cpu;
+}
+
+int cpubin_build(struct cpubin *b, int ncpu, int group, int maxbins, int compact, int agg, int pct){
+    static struct cpukey keys[CPUSTAT_MAXCPU];
+    static uint16_t bin[CPUSTAT_MAXCPU];
+    int i, g, start;
+    if(ncpu>CPUSTAT_MAXCPU) ncpu=CPUSTAT_MAXCPU;
+    if(maxbins>CPUBIN_MAXBINS) maxbins=CPUBIN_MAXBINS;
+    if(maxbins>ncpu) maxbins=ncpu;
+    b->ncpu=ncpu;
+    b->agg=agg;
+    b->pct=pct;
+    b->nbins=0;
+    b->ngroups=0;
+    if(ncpu<=0 || maxbins<=0) return 0;
+    for(i=0; i<ncpu; i++){
+        keys[i].cpu=i;
+        keys[i].package= (group==CPUBIN_CPU)? 0 : cpubin_readnum(i, "topology/physical_package_id");
+        keys[i].core= (group==CPUBIN_CPU)? i : cpubin_readnum(i, "topology/core_id");
+        keys[i].group= (group==CPUBIN_NODE)? cpubin_node(i) : (group==CPUBIN_PACKAGE)? keys[i].package :
+                       (group==CPUBIN_CORE)? keys[i].package*65536+keys[i].core : i;
+    }
+    qsort(keys, ncpu, sizeof(keys[0]), cpubin_compare);
+    for(i=0; i<ncpu; i++) if(i==0 || keys[i].group!=keys[i-1].group) b->ngroups++;
+    if(compact && b->ngroups>maxbins) compact=0; //more groups than keys, fall back to sharing them out
+    if(compact || b->ngroups<=maxbins){
+        //each group gets whole bins, its share of maxbins rounded so every group has at least one and no more than
+        //it has cpus
+        int end=0;
+        for(i=0, g=0; i<ncpu; i=start, g++){
+            for(start=i+1; start<ncpu && keys[start].group==keys[i].group; start++);
+            int c=start-i, last;
+            if(compact) last=end+1;
+            else {
+                last=(int)(((long)maxbins*start+ncpu/2)/ncpu); //bins used up to the end of this group
+                if(last<end+1) last=end+1;
+                if(last>maxbins-(b->ngroups-g-1)) last=maxbins-(b->ngroups-g-1);
+                if(last>end+c) last=end+c;
+            }
+            for(int j=0; j<c; j++) bin[i+j]=(uint16_t)(end+(long)j*(last-end)/c);
+            end=last;
+        }
+        b->nbins=end;
+    }
+    else { //fewer keys than groups: share the groups out evenly, whole groups to a key
+        for(i=0, g=0; i<ncpu; i++){
+            if(i>0 && keys[i].group!=keys[i-1].group) g++;
+            bin[i]=(uint16_t)((long)g*maxbins/b->ngroups);
+        }
+        b->nbins=maxbins;
+    }
+    for(i=0; i<=b->nbins; i++) b->first[i]=0;
+    for(i=0; i<ncpu; i++){
+        b->cpu[i]=(uint16_t)keys[i].cpu;
+        b->first[bin[i]+1]=(uint16_t)(i+1);
+    }
+    for(i=1; i<=b->nbins; i++) if(b->first[i]<b->first[i-1]) b->first[i]=b->first[i-1];
+    return b->nbins;
+}
+
+void cpubin_apply(const struct cpubin *b, const float *load, float *out){
+    float v[CPUSTAT_MAXCPU];
+    for(int k=0; k<b->nbins; k++){
+        const uint16_t *c=b->cpu+b->first[k];
+        int n=b->first[k+1]-b->first[k];
+        float r=0.0f;
+        if(b->agg==CPUBIN_AVG){
+            for(int i=0; i<n; i++) r+=load[c[i]];
+            r/=(float)n;
+        }
+        else if(b->agg==CPUBIN_MAX){
+            for(int i=0; i<n; i++) if(load[c[i]]>r) r=load[c[i]];
+        }
+        else { //insertion sort, bins are a handful of cpus
+            for(int i=0; i<n; i++){
+                float x=load[c[i]];
+                int j=i;
+                for(; j>0 && v[j-1]>x; j--) v[j]=v[j-1];
+                v[j]=x;
+            }
+            int rank=(b->pct*n+99)/100;
+            r=v[(rank<1)? 0 : rank-1];
+        }
+        out[k]=r;
+    }
+}
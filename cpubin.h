@@ -0,0 +1,48 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * CPU to key binning for kbledpsmon.  Machines with more cpus than keys get several cpus per key, grouped by the
+ * topology in /sys/devices/system/cpu so a key never mixes packages or NUMA nodes while there are enough keys to
+ * keep them apart.  The bins are worked out once at startup, each update is then one pass over the cpus.
+ */
+
+#ifndef CPUBIN_H
+#define CPUBIN_H
+
+#include <stdint.h>
+#include "cpustat.h"
+#include "layout.h"
+
+#define CPUBIN_TOPOLOGY "/sys/devices/system/cpu"
+#define CPUBIN_MAXBINS  LAYOUT_MAXLEDS
+
+//how the cpus sharing a key are combined
+#define CPUBIN_AVG 0  //average load
+#define CPUBIN_MAX 1  //busiest cpu
+#define CPUBIN_PCT 2  //percentile, nearest rank
+
+//what cpus are kept together
+#define CPUBIN_CPU     0  //nothing, cpus in number order
+#define CPUBIN_CORE    1  //SMT siblings of a physical core
+#define CPUBIN_PACKAGE 2  //sockets
+#define CPUBIN_NODE    3  //NUMA nodes
+
+struct cpubin {
+    int ncpu;                          //cpus binned, later ones are ignored
+    int nbins;                         //keys in use
+    int ngroups;                       //topology groups found
+    int agg, pct;                      //CPUBIN_AVG/MAX/PCT and the percentile for CPUBIN_PCT
+    uint16_t first[CPUBIN_MAXBINS+1];  //cpus of bin b are cpu[first[b]] to cpu[first[b+1]-1]
+    uint16_t cpu[CPUSTAT_MAXCPU];      //cpu numbers ordered by bin
+};
+
+int cpubin_findagg(const char *name, int *agg, int *pct); //avg, max or p<0-100>, 0 on success
+int cpubin_findgroup(const char *name);                   //cpu, core, package or node, -1 if none of them
+const char *cpubin_groupname(int group);
+//spread cpus 0 to ncpu-1 over at most maxbins bins keeping each group together where possible, or one bin per group
+//if compact.  Returns the number of bins
+int cpubin_build(struct cpubin *b, int ncpu, int group, int maxbins, int compact, int agg, int pct);
+void cpubin_apply(const struct cpubin *b, const float *load, float *out); //out[bin] from load[cpu]
+
+#endif
@@ -0,0 +1,188 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * /proc/stat cpu load sampler, see cpustat.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include "cpustat.h"
+
+//skip spaces and read one decimal number
+static inline const char *cpustat_number(const char *p, uint64_t *v){
+    uint64_t x=0;
+    while(*p==' ') p++;
+    while((unsigned)(*p-'0')<10) x=x*10+(uint64_t)(*p++-'0');
+    *v=x;
+    return p;
+}
+
+//parse the cpu<n> lines at the top of buf into snapshot snap.  Returns 0 once a line that isn't a cpu line is
+//reached, 1 if buf ran out first (the cpu lines didn't fit)
+static int cpustat_parse(struct cpustat *s, const char *p, int snap){
+    uint64_t *total=s->total[snap], *idle=s->idle[snap];
+    int next=0; //cpus below this have been written
+    while(p[0]=='c' && p[1]=='p' && p[2]=='u'){
+        const char *eol=strchr(p, '\n');
+        if(eol==NULL) return 1;
+        if((unsigned)(p[3]-'0')<10){ //cpu<n>, the "cpu " line is the sum of them all
+            uint64_t n, v[8];
+            p=cpustat_number(p+3, &n);
+            if(n<CPUSTAT_MAXCPU){
+                for(int f=0; f<8; f++) p=cpustat_number(p, &v[f]); //user nice system idle iowait irq softirq steal, guest is in user
+                while(next<(int)n) total[next++]=0; //offline cpus in between
+                idle[n]=v[3]+v[4];
+                total[n]=v[0]+v[1]+v[2]+v[3]+v[4]+v[5]+v[6]+v[7];
+                next=(int)n+1;
+            }
+        }
+        p=eol+1;
+    }
+    if(*p=='\0') return 1;
+    while(next<s->ncpu) total[next++]=0; //cpus that went offline since the last sample
+    s->ncpu=next;
+    return 0;
+}
+
+//read the file and parse it into snapshot snap, growing the buffer until the cpu lines fit.  0 on success
+static int cpustat_read(struct cpustat *s, int snap){
+    for(;;){
+        ssize_t n=pread(s->fd, s->buf, s->size-1, 0);
+        if(n<=0) return -1;
+        s->buf[n]='\0';
+        if(cpustat_parse(s, s->buf, snap)==0) return 0;
+        if((size_t)n<s->size-1) return -1; //whole file read without the end of the cpu lines
+        char *grown=realloc(s->buf, s->size*2);
+        if(grown==NULL) return -1;
+        s->buf=grown;
+        s->size*=2;
+    }
+}
+
+int cpustat_open(struct cpustat *s, const char *path){
+    memset(s, 0, sizeof(*s));
+    s->fd=open(path, O_RDONLY | O_CLOEXEC);
+    if(s->fd<0){
+        perror(path);
+        return -1;
+    }
+    s->size=CPUSTAT_BUF;
+    s->buf=malloc(s->size);
+    if(s->buf==NULL || cpustat_read(s, 0)!=0){
+        printf("Could not read cpu times from %s\n", path);
+        cpustat_close(s);
+        return -1;
+    }
+    return 0;
+}
+
+void cpustat_close(struct cpustat *s){
+    if(s->fd>=0) close(s->fd);
+    free(s->buf);
+    s->buf=NULL;
+    s->fd=-1;
+}
+
+int cpustat_sample(struct cpustat *s, float *load, int max){
+    int prev=s->cur, now=s->cur^1;
+    if(cpustat_read(s, now)!=0) return -1;
+    s->cur=now;
+    int n=(s->ncpu<max)? s->ncpu : max;
+    const uint64_t *t0=s->total[prev], *t1=s->total[now], *i0=s->idle[prev], *i1=s->idle[now];
+    for(int i=0; i<n; i++){
+        //iowait can step backwards, so anything odd reads as idle rather than a spike
+        int64_t dt=(int64_t)(t1[i]-t0[i]), di=(int64_t)(i1[i]-i0[i]);
+        load[i]=(t0[i]==0 || t1[i]==0 || dt<=0 || di>=dt)? 0.0f : (di<=0)? 1.0f : 1.0f-(float)di/(float)dt;
+    }
+    return n;
+}
+
+//one sample the way kbledpsmon used to take them: fopen, fgets and sscanf every line
+static int cpustat_stdio(const char *path, uint64_t *total, uint64_t *idle){
+    char line[1024];
+    unsigned long long v[8];
+    int n=0;
+    FILE *file=fopen(path, "r");
+    if(file==NULL) return -1;
+    while(fgets(line, sizeof(line), file)){
+        if(strncmp(line, "cpu", 3)==0 && line[3]>='0' && line[3]<='9' && n<CPUSTAT_MAXCPU &&
+           sscanf(line, "cpu%*d %llu %llu %llu %llu %llu %llu %llu %llu", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7])==8){
+            idle[n]=v[3]+v[4];
+            total[n]=v[0]+v[1]+v[2]+v[3]+v[4]+v[5]+v[6]+v[7];
+            n++;
+        }
+    }
+    fclose(file);
+    return n;
+}
+
+//made up /proc/stat for ncpu cpus with a long intr line like real machines have, returns its path in path
+static int cpustat_fake(int ncpu, char *path, size_t len){
+    snprintf(path, len, "/tmp/kbledcpustat.XXXXXX");
+    int fd=mkstemp(path);
+    if(fd<0) return -1;
+    FILE *f=fdopen(fd, "w");
+    fprintf(f, "cpu  %u 1234 %u %u 4321 0 9876 0 0 0\n", 81234567u*ncpu, 2345678u*ncpu, 912345678u*ncpu);
+    for(int i=0; i<ncpu; i++) fprintf(f, "cpu%i %u 12 %u %u 43 0 98 0 0 0\n", i, 81234567u+i*1013u, 2345678u+i*7u, 912345678u-i*311u);
+    fprintf(f, "intr 1234567890");
+    for(int i=0; i<64+4*ncpu; i++) fprintf(f, " %u", (i%7)? 0u : 12345u*i);
+    fprintf(f, "\nctxt 9876543210\nbtime 1737100000\nprocesses 123456\nprocs_running 2\nprocs_blocked 0\n");
+    fprintf(f, "softirq 1234567 1 2 3 4 5 6 7 8 9 10\n");
+    fclose(f);
+    return 0;
+}
+
+static double cpustat_us(struct timespec a, struct timespec b, unsigned int samples){
+    return ((b.tv_sec-a.tv_sec)*1e6 + (b.tv_nsec-a.tv_nsec)/1e3)/samples;
+}
+
+void cpustat_bench(unsigned int samples){
+    static const int sizes[]={8, 64, 256, 0}; //0 is the real file
+    static float load[CPUSTAT_MAXCPU];
+    static uint64_t total[CPUSTAT_MAXCPU], idle[CPUSTAT_MAXCPU];
+    char path[64];
+    if(samples==0) samples=1;
+    printf("%u samples of each file\n", samples);
+    printf("%-22s %12s %12s %8s\n", "", "pread us", "stdio us", "speedup");
+    for(int k=0; k<4; k++){
+        struct cpustat s;
+        struct timespec a, b;
+        float sum=0.0f;
+        int n=0;
+        if(sizes[k]) {
+            if(cpustat_fake(sizes[k], path, sizeof(path))!=0){
+                perror("mkstemp");
+                return;
+            }
+        }
+        else snprintf(path, sizeof(path), "%s", CPUSTAT_FILE);
+        if(cpustat_open(&s, path)!=0) continue;
+        if(s.ncpu==0){
+            printf("%s has no cpu lines\n", path);
+            cpustat_close(&s);
+            continue;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &a);
+        for(unsigned int i=0; i<samples; i++){
+            n=cpustat_sample(&s, load, CPUSTAT_MAXCPU);
+            sum+=load[i%n]; //keeps the samples from being optimized away
+        }
+        clock_gettime(CLOCK_MONOTONIC, &b);
+        double fast=cpustat_us(a, b, samples);
+        cpustat_close(&s);
+        clock_gettime(CLOCK_MONOTONIC, &a);
+        for(unsigned int i=0; i<samples; i++) sum+=(float)(cpustat_stdio(path, total, idle)+total[i%n]%2);
+        clock_gettime(CLOCK_MONOTONIC, &b);
+        double slow=cpustat_us(a, b, samples);
+        if(sizes[k]) unlink(path);
+        char name[32];
+        if(sizes[k]) snprintf(name, sizeof(name), "%i cpus", sizes[k]);
+        else snprintf(name, sizeof(name), "%s (%i cpus)", CPUSTAT_FILE, n);
+        printf("%-22s %12.3f %12.3f %7.1fx  (%.0f)\n", name, fast, slow, slow/fast, sum);
+    }
+}
@@ -0,0 +1,37 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * Per CPU load from /proc/stat for kbledpsmon.  The file stays open and every sample is one pread() from offset 0
+ * into a buffer that is only reallocated if the file outgrows it, the cpu lines are picked apart with a plain digit
+ * loop and stored so the next sample is a diff against them.  Nothing sleeps in here, the caller paces the samples.
+ */
+
+#ifndef CPUSTAT_H
+#define CPUSTAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CPUSTAT_FILE   "/proc/stat"
+#define CPUSTAT_MAXCPU 1024   //highest cpu number + 1 that is tracked, later ones are ignored
+#define CPUSTAT_BUF    4096   //starting read buffer, doubled whenever the cpu lines don't fit
+
+struct cpustat {
+    int fd;
+    char *buf;
+    size_t size;                        //bytes allocated at buf
+    int ncpu;                           //highest cpu number seen in the last sample + 1
+    int cur;                            //snapshot holding the last sample, the other one is filled by the next
+    uint64_t total[2][CPUSTAT_MAXCPU];  //jiffies of every kind, 0 for a cpu that wasn't listed
+    uint64_t idle[2][CPUSTAT_MAXCPU];   //idle and iowait jiffies
+};
+
+int cpustat_open(struct cpustat *s, const char *path); //open path (CPUSTAT_FILE normally) and take the first snapshot, 0 on success
+void cpustat_close(struct cpustat *s);
+//load of each cpu from 0 to 1 since the last sample into load[0..max-1], cpus that are offline read 0.  Returns the
+//number of cpus (highest number + 1, at most max) or -1 if the file can't be read
+int cpustat_sample(struct cpustat *s, float *load, int max);
+void cpustat_bench(unsigned int samples); //time samples of made up 8, 64 and 256 cpu files and the real one
+
+#endif
@@ -25,13 +25,15 @@
 
 #define CYLONKEYS 20
 
-struct shared_data new_ptr; //internal structure to write to kbled shared memory 
+struct shared_data *new_ptr; //internal structure to write to kbled shared memory, sized for the largest layout
 
 void print_usage(char *programname) {
     fprintf(stderr, "Usage: %s [parameters...]\n", programname);
     fprintf(stderr, "Example: %s [parameters...]\n", programname);
     fprintf(stderr, " Parameter:                    Description:\n");
     fprintf(stderr, " -u or --update <msec>         Update process load frequency (100 to 65535 ms)  Default=200 ms\n");
+    fprintf(stderr, " --priority <0-255>            Layer priority, higher is drawn on top  Default=%i\n", SM_PRIO_DASHBOARD);
+    fprintf(stderr, " --alpha <0-255>               Layer opacity  Default=255\n");
     fprintf(stderr, " -cpu                          Display the time it took kbled daemon to execute the last update\n");
     fprintf(stderr, " -v                            Verbose output\n");
     fprintf(stderr, " --scan                        Change keyboard update speed (1 to 65535 ms) default= 100 ms\n");
@@ -87,14 +89,8 @@ void sighandle(int sig, siginfo_t *info, void *context) {
             printf("Received unknown signal: %d\n", sig);
             break;
     }
-    //restore keyboard to original state unless something went fairly wrong:
-    if(sig == SIGINT || sig == SIGTERM || sig == SIGABRT || sig == SIGQUIT || sig==SIGHUP){
-      sharedmem_lock();
-      shm_ptr->status |= SM_BL; //update backlight across the keyboard
-      sharedmem_unlock();
-    }
     //free(cpu); //free used memory for cpu load array
-    //release the shared memory, close the semaphore and remove the shared memory ftok token
+    //give back our layer so the keys underneath show again and detach from the shared memory
     sharedmem_slaveclose(SM_QUIET);
     printf("kbledpsmon closing...\n");
     exit(0);  // Exit the program since everything should be cleaned up
@@ -120,10 +116,12 @@ int main(int argc, char *argv[]) {
         }
     }
     
-    memset(&new_ptr, 0, sizeof(struct shared_data));
+    new_ptr = sharedmem_newlocal();
+    if(new_ptr == NULL) return 1;
     char verbose = 0; // Flag for verbose output
     char memdump = 0; // Flag for dumping shared memory
     char cputime = 0; // Flag for reporting time spent in last kbled keyboard update event
+    uint8_t priority = SM_PRIO_DASHBOARD, alpha = 255; // layer stacking and opacity
     uint32_t update = 150; //default update time
     int i = 1;
     
@@ -146,6 +144,18 @@ int main(int argc, char *argv[]) {
                 return 1;
             }
         }
+        else if ((strcmp(argv[i], "--priority") == 0) || (strcmp(argv[i], "--alpha") == 0)) {
+            // layer priority and opacity
+            if (i + 1 < argc && atoi(argv[i + 1]) >= 0 && atoi(argv[i + 1]) <= 255) {
+                if(verbose)printf("Set layer %s to: %s\n", argv[i]+2, argv[i + 1]);
+                if(argv[i][2]=='p') priority=atoi(argv[i+1]);
+                else alpha=atoi(argv[i+1]);
+                i += 2;
+            } else {
+                fprintf(stderr, "Error: %s requires an argument between 0 and 255\n",argv[i]);
+                return 1;
+            }
+        }
         else if (strcmp(argv[i], "--dump") == 0) {
             // Increase brightness
             if(verbose)printf("Dump contents of shared memory:\n");
@@ -182,6 +192,14 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     if(verbose)printf("Attached to shared memory\n");
+    sharedmem_lock();
+    int layer=sharedmem_layeropen("kbledcylon", priority, alpha);
+    sharedmem_unlock();
+    if(layer<0){
+        fprintf(stderr, "All %i kbled layers are in use\n", SM_MAXLAYERS);
+        sharedmem_slaveclose(verbose);
+        return 1;
+    }
     
     
     while(1){
@@ -192,13 +210,13 @@ int main(int argc, char *argv[]) {
             else if(i==cylonpos+1 || i== cylonpos-1) val=127; //if one less or one greater, then go at 1/2 brightness
             else if(i==cylonpos+2 || i== cylonpos-2) val=16; //if two less or two greater, then go at 1/16 brightness
             else val=0;
-            new_ptr.key[cylonkeymap[i]][0]=val; //set value
-            new_ptr.key[cylonkeymap[i]][1]=0; //set value
-            new_ptr.key[cylonkeymap[i]][2]=0; //set value
-            new_ptr.key[cylonkeymap[i]][3]=SM_UPD; //set update flag
+            new_ptr->key[cylonkeymap[i]][0]=val; //set value
+            new_ptr->key[cylonkeymap[i]][1]=0; //set value
+            new_ptr->key[cylonkeymap[i]][2]=0; //set value
+            new_ptr->key[cylonkeymap[i]][3]=(val==0)? SM_BKLT : SM_UPD; //set update flag, unlit keys show whatever is underneath
         }
         
-        new_ptr.status |= SM_KEY; //set update flag
+        new_ptr->status |= SM_KEY; //set update flag
         cylonpos+= cylondir;
         if(cylonpos>=CYLONKEYS){ //turn the other direction when we reach the max key
             cylonpos=CYLONKEYS-1; //subtract 2 if you want it to not pause for 1 cycle on the end
@@ -212,8 +230,10 @@ int main(int argc, char *argv[]) {
         
         sharedmem_lock(); //lock semaphore **************************************************************************************
         if(verbose)printf("Semaphore opened\n");
-        if(new_ptr.status!=0) shm_ptr->status=new_ptr.status;
-        if(new_ptr.status & SM_KEY)     for(i=0; i<4; i++) for(int j=0; j<NKEYS; j++) if(new_ptr.key[3]!=0)shm_ptr->key[j][i]=new_ptr.key[j][i];
+        if(new_ptr->status & SM_KEY)     for(int j=0; j<shm_ptr->nkeys; j++){ //draw on our own layer, the daemon blends it over the keys underneath
+            if(new_ptr->key[j][3]==SM_BKLT) sharedmem_layerclear(layer, j);
+            else if(new_ptr->key[j][3]!=0) sharedmem_layerkey(layer, j, new_ptr->key[j]);
+        }
         if(memdump) sharedmem_printstructure(shm_ptr,memdump);
         if(cputime) printf("Last kbled daemon LED update time: %f ms, idle loop time %f ns\n", shm_ptr->lastcputime*1000.0,shm_ptr->idlecputime*1000.0);
         sharedmem_unlock(); //unlock semaphore  *********************************************************************************************************
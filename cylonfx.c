@@ -0,0 +1,79 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * cylonfx.so - the kbledcylon scanning pattern as an effect plugin, drawn by kbled itself every frame so the
+ * eye moves smoothly instead of a key per 150 ms.  Also a starting point for your own plugin: copy it, change
+ * the name and render().  Load it with a line in /etc/kbled.conf:
+ *   plugin cylonfx [budget=<us>] [<Red> <Grn> <Blu>]
+ * then select it with kbledclient -sfx <number kbled printed for it>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "kbledplugin.h"
+
+#define CYLONKEYS 20     //most keys the eye travels across
+#define CYLONRATE 6.67f  //keys per second at speed 0, the standalone kbledcylon moved one key per 150 ms
+
+struct cylon {
+    int nkeys;
+    uint8_t keys[CYLONKEYS];  //top row LEDs from left to right
+    unsigned char rgb[3];
+};
+
+static void *cylon_init(const struct kbled_inputs *in, const char *args){
+    struct cylon *c=calloc(1, sizeof(*c));
+    if(c==NULL) return NULL;
+    int r=255, g=0, b=0;
+    if(args!=NULL && *args!='\0' && sscanf(args, "%i %i %i", &r, &g, &b)!=3){
+        fprintf(stderr, "cylonfx: expected <Red> <Grn> <Blu>, got '%s'\n", args);
+        free(c);
+        return NULL;
+    }
+    c->rgb[0]=r; c->rgb[1]=g; c->rgb[2]=b;
+    for(int i=0; i<in->nleds; i++){ //keys of the top row sorted by position
+        if(in->row[i]!=0.0f || c->nkeys>=CYLONKEYS) continue;
+        int j=c->nkeys++;
+        for(; j>0 && in->x[c->keys[j-1]]>in->x[i]; j--) c->keys[j]=c->keys[j-1];
+        c->keys[j]=i;
+    }
+    if(c->nkeys<2){
+        free(c);
+        return NULL;
+    }
+    return c;
+}
+
+static int cylon_render(void *state, unsigned char (*frame)[3], double t, double dt, const struct kbled_inputs *in){
+    (void)dt;
+    struct cylon *c=state;
+    //eye position goes back and forth across the row, brightness falls off 255, 127, 16 for keys 0, 1, 2 away
+    float span=c->nkeys-1;
+    float pos=fmodf((float)t*CYLONRATE*(1<<in->speed), 2.0f*span);
+    if(pos>span) pos=2.0f*span-pos;
+    for(int i=0; i<c->nkeys; i++){
+        float d=fabsf(i-pos), level;
+        if(d<1.0f) level=255.0f-128.0f*d;
+        else if(d<2.0f) level=127.0f-111.0f*(d-1.0f);
+        else if(d<3.0f) level=16.0f*(3.0f-d);
+        else continue; //unlit keys stay in the backlight color
+        unsigned char *rgb=frame[c->keys[i]];
+        for(int k=0; k<3; k++) rgb[k]=(unsigned char)(c->rgb[k]*level/255.0f);
+    }
+    return 0;
+}
+
+static void cylon_destroy(void *state){
+    free(state);
+}
+
+const struct kbled_plugin kbled_plugin={
+    .abi=KBLED_PLUGIN_ABI,
+    .name="cylon",
+    .budgetus=200,
+    .init=cylon_init,
+    .render=cylon_render,
+    .destroy=cylon_destroy,
+};
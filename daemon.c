@@ -10,11 +10,20 @@
 #include "it829x.h"
 #include "kbstatus.h"
 #include "sharedmem.h"
+#include "indicator.h"
+#include "config.h"
+#include "zone.h"
+#include "effects.h"
+#include "layer.h"
+#include "notify.h"
+#include "calib.h"
 #include <stdlib.h>   //needed for atoi()
+#include <string.h>   //memset()
 #include <stdint.h>   //uint8_t etc. definitions
 #include <unistd.h>   //for sleep function, open(), close() etc...
 #include <signal.h>   //for handling signals sent
 #include <time.h>     //for calculatinng the time the loop takes to execute
+#include <sys/timerfd.h> //loop and software effect frame timing
 #include <ucontext.h> //for handling sigsev, really not that useful.  If it causes trouble, delete the code in sighandle() -> case: SIGSEV and you can remove this dependency
 #include <systemd/sd-daemon.h>  //for talking to systemd
 
@@ -25,6 +34,25 @@
 #define DEFAULTSPEED 1 //default speed
 #define DEFAULTEFFECT SM_EFFECT_NONE //default keyboard effect, -1=no effect (normal operation)
 
+//restart the loop timer with a new period, the first tick is one period from now
+void settimer(int fd, uint64_t periodns){
+    struct itimerspec its;
+    its.it_interval.tv_sec = periodns / 1000000000ULL;
+    its.it_interval.tv_nsec = periodns % 1000000000ULL;
+    its.it_value = its.it_interval;
+    if(timerfd_settime(fd, 0, &its, NULL)==-1) perror("timerfd_settime");
+}
+
+//milliseconds on the monotonic clock
+uint64_t monoms(const struct timespec *t){
+    return (uint64_t)t->tv_sec*1000ULL + t->tv_nsec/1000000;
+}
+
+//microseconds from a to b
+uint32_t elapsedus(const struct timespec *a, const struct timespec *b){
+    return (uint32_t)((b->tv_sec - a->tv_sec)*1000000LL + (b->tv_nsec - a->tv_nsec)/1000);
+}
+
 void sighandle(int sig, siginfo_t *info, void *context) {
     // Print the signal name based on the signal number
     printf("\nReceived signal: %i @ %p\n",sig,info->si_addr);
@@ -80,8 +108,16 @@ void sighandle(int sig, siginfo_t *info, void *context) {
 }
 
 int main(int argc, char **argv){
+    if(argc>=2 && strcmp(argv[1], "--bench")==0){ //time the software effects, doesn't touch the keyboard or shared memory
+        keymap_load(CONF_FILE, SM_QUIET);
+        effects_init(kblayout);
+        effects_load(CONF_FILE, SM_VERBOSE);
+        effects_bench(argc>2? (unsigned int)atoi(argv[2]) : 10000);
+        return 0;
+    }
     if(!(argc==7 || argc==1)) {
         printf("Syntax: %s baselineR baselineG baselineB focusR focusG focusB\notherwise defaults are used without arguments\n",argv[0]);
+        printf("        %s --bench [frames]  time the software effects\n",argv[0]);
         return 0; //let systemd know that there was a problem
     }
     // Setup signal handler:
@@ -111,25 +147,42 @@ int main(int argc, char **argv){
     if (sd_notify(0, "STATUS=kbled is starting...") < 0) {
         printf("Systemd notifications not supported; running standalone. (i.e not started by systemd)\n");
     }
-    uint8_t state=0xFF; //set to a value that wouldn't ever appear so it forces an uppdate when the kbstat() function is first run for lock keys
+    uint32_t state=FAULT; //set to a value that wouldn't ever appear so it forces an uppdate when the kbstat() function is first run for lock keys
     uint16_t scanspeed=UPDATE; //set default scan speed/update period
-    uint8_t newstate=0; //latest keyboard lock key states
+    uint32_t newstate=0; //latest keyboard indicator and host states
+    uint32_t changed=0; //indicator sources that changed since the last update
     uint8_t lockupdate=0; //flag to determine if the state of the lock keys on the keyboard were updated in the main loop
     uint8_t backlight[3]=DEFAULTBKLT; //set to default value for backlight color in case it isn't set on the command line
     uint8_t focus[3]=DEFAULTFOCUS;  //set to default value for focus color in case it isn't set on the command line
     clock_t begintime, endtime; //variables for holding start/end times for cpu time calculation in loop
     double cputime=-1.0; //time it took to run through the loop the last time something was updated
     int i,j; //general purpose incrementing variables
+    uint8_t sfx=SM_SFX_NONE; //software effect being rendered
+    uint64_t periodns=(uint64_t)UPDATE*1000000ULL; //loop period: scan speed, or the frame period while a software effect runs
+    uint64_t ticks; //timer periods elapsed since the last pass, more than 1 means frames were missed
+    struct timespec tick, sfxstart, done; //start of this pass, start of the software effect, end of the frame
+    unsigned char frame[KB_MAXKEYS][3]; //software effect frame
+    int timer=timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC); //fixed cadence loop timer
     
     if(argc==7)for(i=0;i<3;i++) {
         backlight[i]=atoi(argv[1+i]);  //set default backlight color from command line
         focus[i]=atoi(argv[4+i]);  //set default focus color from command line
     }
     printf("Backlight set: R %u, G %u, B %u  Focus set: R %u, G %u, B %u\n",backlight[0],backlight[1],backlight[2],focus[0],focus[1],focus[2]);
+    keymap_load(CONF_FILE, SM_VERBOSE); //keyboard layout named in kbled.conf, built in bonw15 otherwise
+    indicator_init(CONF_FILE, SM_VERBOSE); //caps/num/scroll lock or whatever is bound in kbled.conf
+    calib_load(CONF_FILE, kblayout, SM_VERBOSE); //gamma and gain lines in kbled.conf
+    effects_init(kblayout);
+    effects_load(CONF_FILE, SM_VERBOSE); //sfx lines in kbled.conf
+    if(timer==-1){
+        perror("timerfd_create");
+        printf("Could not create loop timer.  Exiting...\n");
+        return 1; //let systemd know that there was a problem
+    }
     
     //initialize the keyboard:
     printf("Setup keyboard USB interface...\n");
-    if(it829x_init()==-1 || it829x_reset()==-1 || it829x_brightspeed(MAXBRIGHT, MAXSPEED)==-1 || it829x_setleds(allkeys, NKEYS, backlight)==-1){ //open connection to USB, set brightness/speed, initialize all keys to backlight; quit if there is a problem
+    if(it829x_init()==-1 || it829x_reset()==-1 || it829x_brightspeed(MAXBRIGHT, MAXSPEED)==-1 || it829x_setleds(allkeys, nkeys, backlight)==-1){ //open connection to USB, set brightness/speed, initialize all keys to backlight; quit if there is a problem
         it829x_close(); //try to close in case it was opened successfully, no need for semaphore and shared memory 
         sd_notify(0, "STATUS=kbled could not connect to IT829x device over usb... Exiting.  Check permissions and presence of IT829x with lsusb");
         printf("could not connect to IT829x device over usb... Exiting.\nCheck permissions and presence of IT829x (ID=048d:8910) with lsusb\nMake sure you are running this process as root or with sudo\n");
@@ -139,7 +192,7 @@ int main(int argc, char **argv){
     
     //now bring up the shared memory interface to get signals from the client
     printf("Setup shared memory...\n");
-    if(sharedmem_masterinit(SM_VERBOSE)!=0){
+    if(sharedmem_masterinit(SM_VERBOSE, kblayout)!=0){
         sd_notify(0, "STATUS=kbled could not allocate shared memory, check permissions.  Exiting...");
         printf("Could not allocate shared memory, check permissions.  Exiting...\n");
         sharedmem_masterclose(SM_VERBOSE); //try to clean up shared memory and semaphore in case some of it succeeded
@@ -163,38 +216,46 @@ int main(int argc, char **argv){
     shm_ptr->focus[0]=focus[0];
     shm_ptr->focus[1]=focus[1];
     shm_ptr->focus[2]=focus[2];
-    for(j=0;j<NKEYS;j++) for(i=0;i<4;i++){
+    shm_ptr->hoststate=0;
+    shm_ptr->nzonefill=0;
+    shm_ptr->sfx=SM_SFX_NONE;
+    shm_ptr->fps=SM_DEFAULTFPS;
+    memset(&shm_ptr->framestats, 0, sizeof(shm_ptr->framestats));
+    memset(shm_ptr->layers, 0, sizeof(shm_ptr->layers));
+    for(j=0;j<nkeys;j++) for(i=0;i<4;i++){
         if(i!=3)shm_ptr->key[j][i]=backlight[i];
         else shm_ptr->key[j][i]=0;
     }
+    indicatorlayer=sharedmem_layeropen("indicators", SM_PRIO_INDICATOR, 255); //lock keys stay visible over client layers and effects
+    shm_ptr->nnotify=0;
+    clock_gettime(CLOCK_MONOTONIC, &tick);
+    notify_init(sharedmem_layeropen("notify", SM_PRIO_NOTIFY, 255), monoms(&tick)); //notifications go over everything else
+    layer_invalidate(); //keyboard was just set to the backlight color outside of the compositor
     sharedmem_unlock();
     
     //keyboard at initial state, now wait for an event and update
     sd_notify(0, "READY=1"); //tell systemd that we're running
     sd_notify(0, "STATUS=kbled is running");
+    settimer(timer, periodns);
     while(1){
-        usleep((uint32_t)scanspeed * 1000); //polling time
+        if(read(timer, &ticks, sizeof(ticks))!=sizeof(ticks)) { //wait for the next tick
+            usleep((uint32_t)scanspeed * 1000); //polling time
+            ticks=1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &tick);
         begintime = clock(); //set the start time for measuring time spent for keyboard LED update
         newstate=kbstat();
-        if(state!=newstate && state != FAULT && shm_ptr->effect==SM_EFFECT_NONE){ //if the keyboard state changed, read successfully and the keyboard isn't in an effect mode then update the caps/scroll/num lock LEDs
+        if(!(newstate & FAULT) && shm_ptr->effect==SM_EFFECT_NONE){ //if the keyboard state read successfully and the keyboard isn't in an effect mode then update the bound indicator LEDs
+            newstate |= ((uint32_t)shm_ptr->hoststate << 16) & KB_HOSTMASK;
+            changed = (state & FAULT)? indicatormask : (state ^ newstate) & indicatormask; //FAULT in the old state forces every binding to refresh
             state=newstate;
-            it829x_init();
-            it829x_setled(K_CAPSL,    (state & CAPLOC)? shm_ptr->focus:shm_ptr->backlight);
-            it829x_setled(K_CAPSR,    (state & CAPLOC)? shm_ptr->focus:shm_ptr->backlight);
-            it829x_setled(K_NUM_LOCK, (state & NUMLOC)? shm_ptr->focus:shm_ptr->backlight);
-            it829x_setled(K_INSERT,   (state & SCRLOC)? shm_ptr->focus:shm_ptr->backlight);
-            it829x_close();
-            //update the key state array:
-            sharedmem_lock();
-            for(i=0;i<3;i++){ //update the state in shared memory
-                shm_ptr->key[findkey(K_CAPSL   )][i]=(state & CAPLOC)? shm_ptr->focus[i]:shm_ptr->backlight[i];
-                shm_ptr->key[findkey(K_CAPSR   )][i]=(state & CAPLOC)? shm_ptr->focus[i]:shm_ptr->backlight[i];
-                shm_ptr->key[findkey(K_NUM_LOCK)][i]=(state & NUMLOC)? shm_ptr->focus[i]:shm_ptr->backlight[i];
-                shm_ptr->key[findkey(K_INSERT  )][i]=(state & SCRLOC)? shm_ptr->focus[i]:shm_ptr->backlight[i];
+            if(changed){
+                sharedmem_lock();
+                indicator_update(state, changed); //only the keys bound to a changed source are redrawn
+                shm_ptr->lastcputime=cputime; //update cpu end time, this will be overwritten if something else happened in the same cycle
+                sharedmem_unlock();
+                lockupdate=1;
             }
-            shm_ptr->lastcputime=cputime; //update cpu end time, this will be overwritten if something else happened in the same cycle
-            sharedmem_unlock(); 
-            lockupdate=1;
         }
         if(shm_ptr->status!=0){
             //printf("Status: 0x%04x SM_B:%i SM_BI:%i SM_S:%i SM_SI:%i SM_E:%i SM_EI:%i SM_BL:%i SM_FO:%i SM_KEY:%i\n", shm_ptr->status, //debug to verify flags are set properly
@@ -207,6 +268,24 @@ int main(int argc, char **argv){
                 }
                 else printf("Scan speed out of range (1-65535 ms): %u ms\n",shm_ptr->scanspeed);
             }
+            if(shm_ptr->status & (SM_SFX | SM_FPS | SM_SSPD)){ //handle software effect and frame rate changes
+                if(shm_ptr->fps<1 || shm_ptr->fps>SM_MAXFPS) shm_ptr->fps=SM_DEFAULTFPS;
+                if(shm_ptr->sfx>effects_max()) shm_ptr->sfx=SM_SFX_NONE;
+                if((shm_ptr->status & SM_SFX) && shm_ptr->sfx!=sfx){
+                    if(shm_ptr->sfx==SM_SFX_NONE){
+                        shm_ptr->status |= (SM_BL | SM_FO); //put the backlight and focus colors back when the effect stops
+                        state=FAULT;  //force an update of the lock key states when we go back to normal mode
+                    }
+                    else {
+                        memset(&shm_ptr->framestats, 0, sizeof(shm_ptr->framestats));
+                        effects_start();
+                        sfxstart=tick;
+                    }
+                    if(!effects_keyinput(shm_ptr->sfx)) kbkeysclose(); //only the ripple and expressions using heat follow key presses
+                    sfx=shm_ptr->sfx;
+                    printf("Software effect: %u\n",sfx);
+                }
+            }
             if(shm_ptr->status & (SM_B | SM_BI | SM_S | SM_SI)){ //handle brightness and speed changes
                 if(shm_ptr->status & SM_BI){
                     printf("Inc/dec brightness: %i -> ",shm_ptr->brightness);
@@ -242,7 +321,8 @@ int main(int argc, char **argv){
                         it829x_reset();
                         it829x_brightspeed(shm_ptr->brightness, shm_ptr->speed);
                         shm_ptr->status |= (SM_BL | SM_FO); //make sure to update the backlight and focus colors if we're out of effect mode
-                        state=0xFF;  //force an update of the lock key states when we go back to normal mode
+                        state=FAULT;  //force an update of the lock key states when we go back to normal mode
+                        layer_invalidate(); //the hardware effect left the keys in an unknown state
                     }
                     else printf("Error opening connection to USB\n");
                 }
@@ -256,6 +336,7 @@ int main(int argc, char **argv){
                     if(it829x_init()==0) {
                         it829x_reset();
                         it829x_brightspeed(shm_ptr->brightness, shm_ptr->speed);
+                        it829x_close();
                     }
                     else printf("Error opening connection to USB\n");
                 }
@@ -264,34 +345,55 @@ int main(int argc, char **argv){
                     shm_ptr->focus[i]=pallete[shm_ptr->colorindex].focus[i];
                 }
                 shm_ptr->status |= (SM_BL | SM_FO); //make sure to update the backlight and focus colors if we're out of effect mode
-                state=0xFF;  //force an update of the lock key states when we go back to normal mode
+                state=FAULT;  //force an update of the lock key states when we go back to normal mode
             }
             if((shm_ptr->status & SM_BL) && (shm_ptr->effect==SM_EFFECT_NONE)){ //handle backlight color change but only if we're not displaying an effect
                 for(i=0;i<3;i++) {
-                    for(j=0;j<NKEYS;j++) shm_ptr->key[j][i]=shm_ptr->backlight[i]; //update key state array
+                    for(j=0;j<nkeys;j++) shm_ptr->key[j][i]=shm_ptr->backlight[i]; //update key state array
                 }
-                if(it829x_init()==-1 || it829x_setleds(allkeys, NKEYS, shm_ptr->backlight)==-1) printf("Error setting backlight from shared memory\n");
-                it829x_close();
+                layer_touchall();
                 printf("backlight: R:%i G:%i B:%i\n",shm_ptr->backlight[0],shm_ptr->backlight[1],shm_ptr->backlight[2]);
-                state=0xFF;
+                state=FAULT;
             }
             if((shm_ptr->status & SM_FO) && (shm_ptr->effect==SM_EFFECT_NONE)){ //handle focus color change but only if we're not displaying an effect
                 for(i=0;i<3;i++) focus[i]=shm_ptr->focus[i];
                 printf("focus: R:%i G:%i B:%i\n",shm_ptr->focus[0],shm_ptr->focus[1],shm_ptr->focus[2]);
-                state=0xFF;  //force an update of the lock key states since the focus color changed
+                state=FAULT;  //force an update of the lock key states since the focus color changed
             }
             if((shm_ptr->status & SM_KEY) && (shm_ptr->effect==SM_EFFECT_NONE)){ //handle focus color change but only if we're not displaying an effect
-                if(it829x_init()==0) {
-                    for(uint8_t k=0;k<NKEYS;k++){
-                        if(shm_ptr->key[k][3]==SM_UPD) it829x_setled(allkeys[k], shm_ptr->key[k]);
-                        if(shm_ptr->key[k][3]==SM_BKGND) it829x_setled(allkeys[k], shm_ptr->backlight);
-                        if(shm_ptr->key[k][3]==SM_FOCUS) it829x_setled(allkeys[k], shm_ptr->focus);
-                        shm_ptr->key[k][3]=SM_NOUPD;
-                    }
-                it829x_close();
+                for(uint8_t k=0;k<nkeys;k++){
+                    if(shm_ptr->key[k][3]==SM_NOUPD) continue;
+                    if(shm_ptr->key[k][3]==SM_BKGND) for(i=0;i<3;i++) shm_ptr->key[k][i]=shm_ptr->backlight[i];
+                    if(shm_ptr->key[k][3]==SM_FOCUS) for(i=0;i<3;i++) shm_ptr->key[k][i]=shm_ptr->focus[i];
+                    shm_ptr->key[k][3]=SM_NOUPD;
+                    layer_touch(k);
+                }
                 printf("Updated individual keyboard keys: %i\n",shm_ptr->effect);
+            }
+            if((shm_ptr->status & SM_ZONE) && (shm_ptr->effect==SM_EFFECT_NONE)){ //handle zone fills but only if we're not displaying an effect
+                keyset filled;
+                keyset_clear(&filled);
+                for(i=0;i<shm_ptr->nzonefill && i<SM_MAXZONEFILL;i++){ //later fills paint over earlier ones
+                    struct sm_zonefill *z=&shm_ptr->zonefill[i];
+                    z->keys=keyset_intersect(z->keys, keyset_first(nkeys));
+                    zone_color(kblayout, z->keys, z->mode, z->from, z->to, shm_ptr->key);
+                    filled=keyset_union(filled, z->keys);
+                }
+                for(j=keyset_next(&filled,-1); j>=0; j=keyset_next(&filled,j)){ //each key is sent once no matter how many fills covered it
+                    shm_ptr->key[j][3]=SM_NOUPD;
+                    layer_touch(j);
+                }
+                printf("Updated %i keyboard keys from %i zone fills\n", keyset_count(&filled), shm_ptr->nzonefill);
+            }
+            if(shm_ptr->status & SM_ZONE) shm_ptr->nzonefill=0; //fills made during an effect are dropped like individual keys
+            if(shm_ptr->status & SM_NOTIFY){ //start queued notifications, they keep time during a hardware effect and show when it ends
+                for(i=0;i<shm_ptr->nnotify && i<SM_MAXNOTIFY;i++){
+                    struct sm_notify *n=&shm_ptr->notify[i];
+                    n->keys=keyset_intersect(n->keys, keyset_first(nkeys));
+                    if(notify_add(n, monoms(&tick))<0) printf("Notification dropped, %i more important ones are showing\n", NOTIFY_MAX);
                 }
-                else printf("Error opening connection to USB\n");
+                printf("Started %i notifications\n", shm_ptr->nnotify);
+                shm_ptr->nnotify=0;
             }
             if(shm_ptr->status & SM_ONOFF){ //turn the keyboard backlight on or off
                 if(shm_ptr->brightness==0) shm_ptr->brightness=1; //turn on to minimum brightness if it was set at 0 to avoid confusion of whether it changed state
@@ -310,9 +412,59 @@ int main(int argc, char **argv){
             shm_ptr->lastcputime=cputime; //update cpu end time
             sharedmem_unlock();
             }
+        uint64_t newperiod=(uint64_t)scanspeed*1000000ULL; //frame period while an effect or a blinking/pulsing notification runs, scan speed otherwise
+        unsigned int fps=shm_ptr->fps; //read once outside the lock, a client could have written 0
+        if(fps<1) fps=1;
+        else if(fps>SM_MAXFPS) fps=SM_MAXFPS;
+        if(sfx!=SM_SFX_NONE || (notify_animating() && newperiod>1000000000ULL/fps)) newperiod=1000000000ULL/fps;
+        if(newperiod!=periodns){
+            periodns=newperiod;
+            settimer(timer, periodns);
+            printf("Loop period: %.3f ms\n",periodns/1000000.0);
+        }
+        if(sfx!=SM_SFX_NONE && shm_ptr->effect==SM_EFFECT_NONE && shm_ptr->onoff==SM_ON){ //render the next software effect frame
+            //the frame is drawn for the time it is shown, frames whose deadline already passed are skipped rather than sent late
+            double t = (tick.tv_sec - sfxstart.tv_sec) + (tick.tv_nsec - sfxstart.tv_nsec)/1e9;
+            if(effects_keyinput(sfx)){ //every key pressed since the last frame starts a ripple or heats the key up
+                uint16_t codes[16];
+                int n=kbkeys(codes, 16);
+                for(i=0;i<n;i++) if((j=keymap_keycode(codes[i]))>=0) effects_keypress(j, t);
+            }
+            int failed=effects_render(sfx, t, shm_ptr->speed, shm_ptr->backlight, shm_ptr->focus, frame);
+            sharedmem_lock();
+            if(failed){ //a plugin went over its time budget or gave up, or an animation ended, turn the effect off like kbledclient -sfx 0 would
+                shm_ptr->sfx=SM_SFX_NONE;
+                shm_ptr->status |= SM_SFX;
+            }
+            for(j=0;j<nkeys;j++){ //only keys that changed since the last frame are sent
+                if(frame[j][0]!=shm_ptr->key[j][0] || frame[j][1]!=shm_ptr->key[j][1] || frame[j][2]!=shm_ptr->key[j][2]){
+                    for(i=0;i<3;i++) shm_ptr->key[j][i]=frame[j][i];
+                    layer_touch(j);
+                }
+            }
+            sharedmem_unlock();
+        }
+        if(shm_ptr->effect==SM_EFFECT_NONE){ //blend the layers over the base colors and send what changed, the hardware effect owns the keys otherwise
+            sharedmem_lock();
+            layer_reap(shm_ptr); //a client that was killed leaves its layer behind
+            notify_expire(monoms(&tick));
+            notify_draw(monoms(&tick));
+            if(layer_composite(shm_ptr, allkeys, nkeys)<0) printf("Error opening connection to USB\n");
+            if(sfx!=SM_SFX_NONE && shm_ptr->onoff==SM_ON){
+                clock_gettime(CLOCK_MONOTONIC, &done);
+                struct sm_framestats *fs=&shm_ptr->framestats;
+                fs->frames++;
+                fs->dropped += ticks-1;
+                fs->lastus = elapsedus(&tick, &done);
+                fs->avgus = (fs->frames==1)? fs->lastus : fs->avgus + ((int64_t)fs->lastus - fs->avgus)/16;
+                if(fs->lastus > fs->maxus) fs->maxus = fs->lastus;
+                if((uint64_t)fs->lastus*1000 > periodns) fs->late++;
+            }
+            sharedmem_unlock();
+        }
         }
         endtime = clock(); //set the end time for measureing time spend for keyboard LED update
-        if(state==0xFF || lockupdate!=0) {
+        if(state==FAULT || lockupdate!=0) {
             cputime = ((double) (endtime - begintime)) / CLOCKS_PER_SEC; //if the keyboard LEDs were updated, update the last loop time
             lockupdate=0; //reset lockupdate flag back to zero
         }
@@ -0,0 +1,187 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * /proc/diskstats sampler, see diskstat.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "diskstat.h"
+
+//skip spaces and read one decimal number
+static inline const char *diskstat_number(const char *p, uint64_t *v){
+    uint64_t x=0;
+    while(*p==' ') p++;
+    while((unsigned)(*p-'0')<10) x=x*10+(uint64_t)(*p++-'0');
+    *v=x;
+    return p;
+}
+
+//read the whole file into buf, growing it as needed.  Returns the length or -1
+static ssize_t diskstat_read(struct diskstat *d){
+    for(;;){
+        ssize_t n=pread(d->fd, d->buf, d->size-1, 0);
+        if(n<0) return -1;
+        if((size_t)n<d->size-1) {
+            d->buf[n]='\0';
+            return n;
+        }
+        char *grown=realloc(d->buf, d->size*2);
+        if(grown==NULL) return -1;
+        d->buf=grown;
+        d->size*=2;
+    }
+}
+
+//a physical whole disk: listed in /sys/block (so not a partition) with a device behind it (so not loop, zram, dm...)
+static int diskstat_physical(const char *name){
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%s/device", DISKSTAT_SYSBLOCK, name);
+    return access(path, F_OK)==0;
+}
+
+//is name one of the + separated devices of spec
+static int diskstat_member(const char *spec, const char *name){
+    size_t len=strlen(name);
+    for(const char *p=spec; *p; ){
+        size_t n=strcspn(p, "+");
+        if(n==len && strncmp(p, name, n)==0) return 1;
+        p+=n;
+        if(*p=='+') p++;
+    }
+    return 0;
+}
+
+//match the device names of buf against the disks and rebuild the line table
+static void diskstat_resolve(struct diskstat *d){
+    char name[64];
+    const char *p=d->buf;
+    int k=0;
+    for(int i=0; i<d->ndisks; i++) d->disks[i].members=0;
+    while(*p && k<DISKSTAT_MAXLINES){
+        uint64_t major, minor;
+        const char *eol=strchr(p, '\n');
+        p=diskstat_number(p, &major);
+        p=diskstat_number(p, &minor);
+        while(*p==' ') p++;
+        size_t n=strcspn(p, " \n");
+        snprintf(name, sizeof(name), "%.*s", (int)((n<sizeof(name))? n : sizeof(name)-1), p);
+        d->dev[k]=(uint32_t)(major<<20 | minor);
+        d->disks_of[k]=0;
+        for(int i=0; i<d->ndisks; i++){
+            struct disk *s=&d->disks[i];
+            if(strcmp(s->spec, "all")==0? diskstat_physical(name) : diskstat_member(s->spec, name)) {
+                d->disks_of[k]|=(uint8_t)(1u<<i);
+                s->members++;
+            }
+        }
+        k++;
+        if(eol==NULL) break;
+        p=eol+1;
+    }
+    d->nlines=k;
+}
+
+//add the lines of buf into the disks' running sums, 1 if the devices changed since the table was built
+static int diskstat_parse(struct diskstat *d){
+    const char *p=d->buf;
+    int k=0;
+    for(int i=0; i<d->ndisks; i++) d->disks[i].nsectors=d->disks[i].nticks=0;
+    while(*p){
+        uint64_t major, minor, v[10];
+        if(k>=DISKSTAT_MAXLINES) break; //the rest were never tracked
+        if(k>=d->nlines) return 1;
+        p=diskstat_number(p, &major);
+        p=diskstat_number(p, &minor);
+        if(d->dev[k]!=(uint32_t)(major<<20 | minor)) return 1;
+        unsigned int of=d->disks_of[k++];
+        if(of){
+            while(*p==' ') p++;
+            while(*p!=' ' && *p!='\0') p++; //name
+            //reads merged sectors ms, writes merged sectors ms, in flight, ms doing io
+            for(int f=0; f<10; f++) p=diskstat_number(p, &v[f]);
+            for(; of; of&=of-1){
+                struct disk *s=&d->disks[__builtin_ctz(of)];
+                s->nsectors+=v[2]+v[6];
+                s->nticks+=v[9];
+            }
+        }
+        p=strchr(p, '\n');
+        if(p==NULL) break;
+        p++;
+    }
+    return (k==d->nlines)? 0 : 1;
+}
+
+int diskstat_open(struct diskstat *d){
+    memset(d, 0, sizeof(*d));
+    d->fd=open(DISKSTAT_FILE, O_RDONLY | O_CLOEXEC);
+    if(d->fd<0){
+        perror(DISKSTAT_FILE);
+        return -1;
+    }
+    d->size=DISKSTAT_BUF;
+    d->buf=malloc(d->size);
+    if(d->buf==NULL){
+        diskstat_close(d);
+        return -1;
+    }
+    return 0;
+}
+
+void diskstat_close(struct diskstat *d){
+    if(d->fd>=0) close(d->fd);
+    free(d->buf);
+    d->buf=NULL;
+    d->fd=-1;
+}
+
+int diskstat_add(struct diskstat *d, const char *spec){
+    if(d->ndisks>=DISKSTAT_MAX){
+        printf("Only %i disks can be shown, %s ignored\n", DISKSTAT_MAX, spec);
+        return -1;
+    }
+    struct disk *s=&d->disks[d->ndisks++];
+    memset(s, 0, sizeof(*s));
+    snprintf(s->spec, sizeof(s->spec), "%s", spec);
+    if(diskstat_read(d)<0) return -1;
+    diskstat_resolve(d);
+    if(s->members==0){
+        printf("No disk %s in %s\n", spec, DISKSTAT_FILE);
+        d->ndisks--;
+        diskstat_resolve(d);
+        return -1;
+    }
+    d->valid=0; //the sums of the disks before it are now stale
+    return d->ndisks-1;
+}
+
+int diskstat_sample(struct diskstat *d){
+    struct timespec now;
+    if(diskstat_read(d)<0) return -1;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int changed=diskstat_parse(d);
+    if(changed) { //a device came or went, match the names again and start the rates over
+        diskstat_resolve(d);
+        diskstat_parse(d);
+    }
+    double ms=(now.tv_sec-d->t.tv_sec)*1e3 + (now.tv_nsec-d->t.tv_nsec)/1e6;
+    for(int i=0; i<d->ndisks; i++){
+        struct disk *s=&d->disks[i];
+        if(d->valid && !changed && ms>0.0 && s->members>0 && s->nticks>=s->ticks && s->nsectors>=s->sectors){
+            float util=(float)((s->nticks-s->ticks)/(ms*s->members));
+            s->util= (util>1.0f)? 1.0f : util;
+            s->mbps=(float)((s->nsectors-s->sectors)*512.0/(ms*1e3));
+        }
+        else s->util=s->mbps=0.0f;
+        s->sectors=s->nsectors;
+        s->ticks=s->nticks;
+    }
+    d->t=now;
+    d->valid=1;
+    return 0;
+}
@@ -0,0 +1,54 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * Disk utilization and throughput from /proc/diskstats for kbledpsmon.  Like cpustat the file stays open and is
+ * pread from offset 0 every sample.  Which line feeds which shown disk is worked out once from the device names and
+ * kept as a table by line number, so a sample only compares the major:minor of each line with the table and skips
+ * the lines nobody asked for without parsing them; the names are only matched again when a device comes or goes.
+ */
+
+#ifndef DISKSTAT_H
+#define DISKSTAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#define DISKSTAT_FILE     "/proc/diskstats"
+#define DISKSTAT_SYSBLOCK "/sys/block"   //whole disks are listed here, a device link means real hardware
+#define DISKSTAT_MAX      8              //disks (or groups of them) shown at once, one bit each in disks_of[]
+#define DISKSTAT_MAXLINES 1024           //lines of /proc/diskstats tracked
+#define DISKSTAT_MAXSPEC  128            //longest device list
+#define DISKSTAT_BUF      16384          //starting read buffer, doubled when the file doesn't fit
+
+struct disk {
+    char spec[DISKSTAT_MAXSPEC];  //devices joined with +, or all for every physical disk
+    int members;                  //lines feeding this disk
+    uint64_t sectors, ticks;      //sectors read and written, ms busy at the last sample, summed over the members
+    uint64_t nsectors, nticks;    //the same being summed by the current sample
+    float util;                   //share of the last interval the members were busy, averaged over them
+    float mbps;                   //megabytes per second read and written
+};
+
+struct diskstat {
+    int fd;
+    char *buf;
+    size_t size;
+    int nlines;                          //lines in the file when the table was built
+    uint32_t dev[DISKSTAT_MAXLINES];     //major<<20 | minor of each line
+    uint8_t disks_of[DISKSTAT_MAXLINES]; //bit i set if the line adds to disks[i], 0 for lines nobody shows
+    int ndisks;
+    struct disk disks[DISKSTAT_MAX];
+    struct timespec t;                   //time of the last sample
+    int valid;                           //a sample has been taken
+};
+
+int diskstat_open(struct diskstat *d);  //0 on success
+void diskstat_close(struct diskstat *d);
+//show spec: a device (sda, nvme0n1p2...), devices joined with + to add them up, or all for every physical disk
+//without partitions.  Returns its index in disks[] or -1
+int diskstat_add(struct diskstat *d, const char *spec);
+int diskstat_sample(struct diskstat *d); //update util and mbps of every disk, 0 on success
+
+#endif
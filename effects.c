@@ -0,0 +1,444 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ * 
+ * Software effects, see effects.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <dlfcn.h>
+#include "effects.h"
+#include "sharedmem.h"
+#include "zone.h"
+#include "config.h"
+#include "expr.h"
+#include "kbledplugin.h"
+#include "anim.h"
+
+#define EFFECTS_PERIOD 4.0f   //seconds per effect cycle at speed 0, each speed step halves it
+#define EFFECTS_SCANW  0.08f  //half width of the scan bar, fraction of the keyboard width
+#define EFFECTS_SNAKE  12     //snake length in keys
+#define EFFECTS_MAXRIPPLE 16  //concurrent ripples, a new key press replaces the oldest
+#define EFFECTS_RIPPLEV   1000 //ripple speed at speed 0, coordinate units (LAYOUT_UNIT per key) per second
+#define EFFECTS_RIPPLEW   120  //half width of a ripple ring, coordinate units
+#define EFFECTS_HEATDECAY 0.5f //seconds for the heat of a pressed key to fall to 1/e
+#define EFFECTS_BENCHEXPR "r = 128+127*sin(t*2 + x/4); g = heat*255; b = 0" //expression effect timed against effects_handwritten()
+
+//per key tables, structure of arrays so each effect is a straight loop over the keys
+static uint8_t nleds;
+static float xpos[LAYOUT_MAXLEDS];      //0 at the left edge, 1 at the right edge
+static uint8_t snakepos[LAYOUT_MAXLEDS]; //place of each key along the snake path
+static uint8_t center;                   //key nearest the middle, ripples start here when nothing is typed
+static float kx[LAYOUT_MAXLEDS], ky[LAYOUT_MAXLEDS], krow[LAYOUT_MAXLEDS], kcol[LAYOUT_MAXLEDS], kled[LAYOUT_MAXLEDS]; //expression inputs
+static float heat[LAYOUT_MAXLEDS];       //1 when a key is pressed, decaying toward 0
+static double heatt;                     //effect time heat[] was last decayed
+static const char *kname[LAYOUT_MAXLEDS];
+static struct kbled_inputs inputs;       //what plugins see, colors and speed are filled in every frame
+
+//effects from the configuration file: sfx expressions first, then plugins, then animations
+static struct {
+    char name[CONF_MAXTOK];
+    struct expr x;
+    struct anim anim;                  //mapped animation file, anim.h is NULL for the other kinds
+    const struct kbled_plugin *plugin; //NULL for an expression
+    void *handle, *state;              //dlopen() handle (kept after a plugin is disabled to tell it from an expression) and what its init() returned
+    uint32_t budgetus;                 //time allowed per frame
+    uint8_t strikes;                   //frames in a row over budget
+    double lastt;                      //effect time of the last frame, <0 before the first
+} userfx[SM_SFX_MAXUSER];
+static uint8_t nuserfx;
+
+//ripples: distances between every pair of keys are worked out once so a frame only walks the keys under each ring
+static uint16_t keydist[LAYOUT_MAXLEDS][LAYOUT_MAXLEDS]; //center to center distance, coordinate units
+static uint8_t bydist[LAYOUT_MAXLEDS][LAYOUT_MAXLEDS];   //for each origin every key, nearest first
+static struct {
+    uint8_t origin; //key the ripple started from
+    double start;   //effect time it started, <0 when unused
+} ripples[EFFECTS_MAXRIPPLE];
+static int nextripple;     //slot the next ripple goes into
+static double lastripple;  //effect time of the newest ripple
+
+void effects_init(const struct layout *l){
+    int i, j, n, r;
+    uint16_t xmax=1, ymax=1;
+    nleds=l->nleds;
+    for(i=0; i<nleds; i++){
+        if(l->x[i]>xmax) xmax=l->x[i];
+        if(l->y[i]>ymax) ymax=l->y[i];
+    }
+    float dmin=1e9f;
+    for(i=0; i<nleds; i++){
+        float dx=(float)l->x[i]-xmax/2.0f, dy=(float)l->y[i]-ymax/2.0f;
+        xpos[i]=(float)l->x[i]/xmax;
+        kx[i]=(float)l->x[i]/LAYOUT_UNIT;
+        ky[i]=(float)l->y[i]/LAYOUT_UNIT;
+        krow[i]=l->row[i];
+        kcol[i]=l->col[i];
+        kled[i]=i;
+        kname[i]=l->ledname[i];
+        if(dx*dx + dy*dy < dmin){
+            dmin=dx*dx + dy*dy;
+            center=i;
+        }
+    }
+    for(i=0; i<nleds; i++){
+        for(j=0; j<nleds; j++){
+            float dx=(float)l->x[j]-l->x[i], dy=(float)l->y[j]-l->y[i];
+            keydist[i][j]=(uint16_t)(sqrtf(dx*dx + dy*dy)+0.5f);
+            //insertion sort by distance, only done once per layout
+            for(n=j; n>0 && keydist[i][bydist[i][n-1]]>keydist[i][j]; n--) bydist[i][n]=bydist[i][n-1];
+            bydist[i][n]=j;
+        }
+    }
+    //snake winds left to right on even rows and right to left on odd rows
+    uint8_t order[LAYOUT_MAXLEDS];
+    int pos=0;
+    for(r=0; r<l->nrows; r++){
+        keyset row;
+        keyset_clear(&row);
+        for(i=0; i<nleds; i++) if(l->row[i]==r) keyset_add(&row, i);
+        n=zone_sort(l, row, ZONE_LEFTRIGHT, order);
+        for(j=0; j<n; j++) snakepos[order[(r & 1)? n-1-j : j]]=pos++;
+    }
+    inputs.nleds=nleds;
+    inputs.x=kx;
+    inputs.y=ky;
+    inputs.row=krow;
+    inputs.col=kcol;
+    inputs.heat=heat;
+    inputs.ledname=kname;
+    effects_start();
+}
+
+void effects_start(){
+    for(int i=0; i<EFFECTS_MAXRIPPLE; i++) ripples[i].start=-1.0;
+    lastripple=0.0;
+    memset(heat, 0, sizeof(heat));
+    heatt=0.0;
+    for(int i=0; i<nuserfx; i++){
+        userfx[i].lastt=-1.0;
+        if(userfx[i].anim.h) anim_rewind(&userfx[i].anim);
+    }
+}
+
+void effects_keypress(uint8_t led, double t){
+    if(led>=nleds) return;
+    ripples[nextripple].origin=led;
+    ripples[nextripple].start=t;
+    nextripple=(nextripple+1)%EFFECTS_MAXRIPPLE;
+    lastripple=t;
+    heat[led]=1.0f;
+}
+
+static int effects_confline(int ntok, char **tok, const char *raw, int lineno){
+    (void)lineno;
+    char err[EXPR_MAXERR];
+    if(ntok<3) return 1;
+    if(nuserfx>=SM_SFX_MAXUSER){
+        printf("Only %i software effects can be defined, %s ignored\n", SM_SFX_MAXUSER, tok[1]);
+        return 1;
+    }
+    const char *src=raw+strspn(raw, " \t");
+    src+=strcspn(src, " \t"); //past the name
+    if(expr_compile(src, &userfx[nuserfx].x, err)!=0){
+        printf("Software effect %s: %s\n", tok[1], err);
+        return 1;
+    }
+    snprintf(userfx[nuserfx].name, sizeof(userfx[nuserfx].name), "%s", tok[1]);
+    userfx[nuserfx].plugin=NULL;
+    userfx[nuserfx].handle=NULL;
+    userfx[nuserfx].anim.h=NULL;
+    nuserfx++;
+    return 0;
+}
+
+//plugin <name or path> [budget=<us>] [arguments...]
+static int effects_pluginline(int ntok, char **tok, const char *raw, int lineno){
+    (void)lineno;
+    char path[CONF_MAXLINE];
+    if(ntok<2) return 1;
+    if(nuserfx>=SM_SFX_MAXUSER){
+        printf("Only %i software effects can be defined, %s ignored\n", SM_SFX_MAXUSER, tok[1]);
+        return 1;
+    }
+    if(strchr(tok[1], '/')) snprintf(path, sizeof(path), "%s", tok[1]);
+    else snprintf(path, sizeof(path), "%s/%s.so", EFFECTS_PLUGINDIR, tok[1]);
+    //arguments are whatever follows the name and budget
+    const char *args=raw+strspn(raw, " \t");
+    args+=strcspn(args, " \t");
+    args+=strspn(args, " \t");
+    uint32_t budget=0;
+    if(ntok>2 && strncmp(tok[2], "budget=", 7)==0){ //named so a numeric first argument stays the plugin's
+        budget=strtoul(tok[2]+7, NULL, 10);
+        args+=strcspn(args, " \t");
+        args+=strspn(args, " \t");
+    }
+    void *handle=dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if(handle==NULL){
+        printf("Plugin %s: %s\n", tok[1], dlerror());
+        return 1;
+    }
+    const struct kbled_plugin *p=dlsym(handle, KBLED_PLUGIN_SYMBOL);
+    if(p==NULL || p->abi!=KBLED_PLUGIN_ABI || p->render==NULL){
+        printf("Plugin %s: no %s for ABI %i\n", tok[1], KBLED_PLUGIN_SYMBOL, KBLED_PLUGIN_ABI);
+        dlclose(handle);
+        return 1;
+    }
+    void *state=NULL;
+    if(p->init!=NULL && (state=p->init(&inputs, args))==NULL){
+        printf("Plugin %s: init failed\n", tok[1]);
+        dlclose(handle);
+        return 1;
+    }
+    snprintf(userfx[nuserfx].name, sizeof(userfx[nuserfx].name), "%s", p->name? p->name : tok[1]);
+    userfx[nuserfx].plugin=p;
+    userfx[nuserfx].handle=handle;
+    userfx[nuserfx].state=state;
+    userfx[nuserfx].budgetus= budget? budget : p->budgetus? p->budgetus : KBLED_PLUGIN_BUDGETUS;
+    userfx[nuserfx].strikes=0;
+    userfx[nuserfx].lastt=-1.0;
+    userfx[nuserfx].anim.h=NULL;
+    nuserfx++;
+    return 0;
+}
+
+//anim <file made by kbledanim>
+static int effects_animline(int ntok, char **tok, const char *raw, int lineno){
+    (void)raw;
+    (void)lineno;
+    char err[CONF_MAXLINE];
+    if(ntok!=2) return 1;
+    if(nuserfx>=SM_SFX_MAXUSER){
+        printf("Only %i software effects can be defined, %s ignored\n", SM_SFX_MAXUSER, tok[1]);
+        return 1;
+    }
+    if(anim_open(&userfx[nuserfx].anim, tok[1], nleds, err, sizeof(err))!=0){
+        printf("Animation %s\n", err);
+        return 1;
+    }
+    const char *base=strrchr(tok[1], '/');
+    snprintf(userfx[nuserfx].name, sizeof(userfx[nuserfx].name), "%s", base? base+1 : tok[1]);
+    userfx[nuserfx].plugin=NULL;
+    userfx[nuserfx].handle=NULL;
+    nuserfx++;
+    return 0;
+}
+
+int effects_load(const char *conffile, char verbose){
+    nuserfx=0;
+    if(conffile!=NULL) config_parse(conffile, "sfx", effects_confline);
+    if(conffile!=NULL) config_parse(conffile, "plugin", effects_pluginline);
+    if(conffile!=NULL) config_parse(conffile, "anim", effects_animline);
+    for(int i=0; verbose && i<nuserfx; i++){
+        if(userfx[i].plugin) printf("Software effect %i: %s (plugin, %u us per frame)\n", SM_SFX_USER+i, userfx[i].name, userfx[i].budgetus);
+        else if(userfx[i].anim.h) printf("Software effect %i: %s (animation, %u keyframes over %u ms%s)\n", SM_SFX_USER+i, userfx[i].name,
+            userfx[i].anim.h->nframes, userfx[i].anim.h->duration, (userfx[i].anim.h->flags & ANIM_LOOP)? " looped" : "");
+        else printf("Software effect %i: %s (%u per key and %u per frame instructions)\n",
+            SM_SFX_USER+i, userfx[i].name, userfx[i].x.ncode, userfx[i].x.nucode);
+    }
+    return nuserfx;
+}
+
+uint8_t effects_max(){
+    return nuserfx? SM_SFX_USER+nuserfx-1 : SM_SFX_MAX;
+}
+
+int effects_keyinput(uint8_t sfx){
+    if(sfx==SM_SFX_RIPPLE) return 1;
+    if(sfx<SM_SFX_USER || sfx>=SM_SFX_USER+nuserfx) return 0;
+    return userfx[sfx-SM_SFX_USER].plugin!=NULL || (userfx[sfx-SM_SFX_USER].x.uses & (1u<<EXPR_HEAT));
+}
+
+//let the heat of pressed keys fade up to effect time t
+static void effects_cool(double t){
+    float f=expf(-(float)(t-heatt)/EFFECTS_HEATDECAY);
+    heatt=t;
+    for(int i=0; i<nleds; i++) heat[i]*=f;
+}
+
+static void effects_expr(struct expr *x, double t, uint8_t speed, unsigned char (*frame)[3]){
+    struct expr_in in;
+    if(x->uses & (1u<<EXPR_HEAT)) effects_cool(t);
+    in.n=nleds;
+    in.scalar[EXPR_T]=(float)t;
+    in.scalar[EXPR_SPEED]=speed;
+    in.key[EXPR_X]=kx;
+    in.key[EXPR_Y]=ky;
+    in.key[EXPR_ROW]=krow;
+    in.key[EXPR_COL]=kcol;
+    in.key[EXPR_LED]=kled;
+    in.key[EXPR_HEAT]=heat;
+    expr_eval(x, &in, frame);
+}
+
+//add the ring of every active ripple into level[], each ring only touches the keys within EFFECTS_RIPPLEW of its radius
+static void effects_ripples(double t, uint8_t speed, float *level){
+    float v=(float)(EFFECTS_RIPPLEV<<speed)/2.0f;
+    for(int r=0; r<EFFECTS_MAXRIPPLE; r++){
+        if(ripples[r].start<0.0) continue;
+        const uint8_t *order=bydist[ripples[r].origin];
+        const uint16_t *d=keydist[ripples[r].origin];
+        float radius=(float)(t-ripples[r].start)*v;
+        float reach=d[order[nleds-1]]+EFFECTS_RIPPLEW; //ring has passed the farthest key
+        if(radius>=reach) {
+            ripples[r].start=-1.0;
+            continue;
+        }
+        float fade=1.0f-radius/reach;
+        //binary search for the first key inside the ring
+        int lo=0, hi=nleds;
+        while(lo<hi){
+            int mid=(lo+hi)/2;
+            if(d[order[mid]] < radius-EFFECTS_RIPPLEW) lo=mid+1;
+            else hi=mid;
+        }
+        for(int i=lo; i<nleds && d[order[i]] <= radius+EFFECTS_RIPPLEW; i++){
+            int k=order[i];
+            level[k]+=fade*(1.0f-fabsf(d[k]-radius)/EFFECTS_RIPPLEW);
+        }
+    }
+}
+
+//frame[i] = bklt blended toward focus by level 0-1
+static inline void effects_blend(const unsigned char *bklt, const unsigned char *focus, float level, unsigned char *rgb){
+    for(int c=0; c<3; c++) rgb[c]=(unsigned char)(bklt[c] + (focus[c]-bklt[c])*level + 0.5f);
+}
+
+//fully saturated color for hue 0-1
+static inline void effects_hue(float h, unsigned char *rgb){
+    float f=(h-floorf(h))*6.0f;
+    int sector=(int)f;
+    unsigned char up=(unsigned char)(255.0f*(f-sector)), down=255-up;
+    switch(sector){
+        case 0:  rgb[0]=255;  rgb[1]=up;   rgb[2]=0;    break;
+        case 1:  rgb[0]=down; rgb[1]=255;  rgb[2]=0;    break;
+        case 2:  rgb[0]=0;    rgb[1]=255;  rgb[2]=up;   break;
+        case 3:  rgb[0]=0;    rgb[1]=down; rgb[2]=255;  break;
+        case 4:  rgb[0]=up;   rgb[1]=0;    rgb[2]=255;  break;
+        default: rgb[0]=255;  rgb[1]=0;    rgb[2]=down; break;
+    }
+}
+
+//run plugin effect u for one frame and hold it to its budget, -1 once it has been disabled
+static int effects_plugin(int u, double t, uint8_t speed, const unsigned char *bklt, const unsigned char *focus, unsigned char (*frame)[3]){
+    struct timespec a, b;
+    for(int i=0; i<nleds; i++) effects_blend(bklt, focus, 0.0f, frame[i]); //also what a disabled plugin shows
+    if(userfx[u].plugin==NULL) return -1; //disabled earlier
+    effects_cool(t);
+    inputs.speed=speed;
+    inputs.bklt=bklt;
+    inputs.focus=focus;
+    double dt=(userfx[u].lastt<0.0)? 0.0 : t-userfx[u].lastt;
+    userfx[u].lastt=t;
+    clock_gettime(CLOCK_MONOTONIC, &a);
+    int stop=userfx[u].plugin->render(userfx[u].state, frame, t, dt, &inputs);
+    clock_gettime(CLOCK_MONOTONIC, &b);
+    uint32_t us=(uint32_t)((b.tv_sec-a.tv_sec)*1000000LL + (b.tv_nsec-a.tv_nsec)/1000);
+    userfx[u].strikes= (us>userfx[u].budgetus)? userfx[u].strikes+1 : 0;
+    if(stop==0 && userfx[u].strikes<KBLED_PLUGIN_STRIKES) return 0;
+    if(stop) printf("Plugin %s stopped itself, disabling it\n", userfx[u].name);
+    else printf("Plugin %s took %u us, over its %u us budget %i frames in a row, disabling it\n", userfx[u].name, us, userfx[u].budgetus, KBLED_PLUGIN_STRIKES);
+    if(userfx[u].plugin->destroy) userfx[u].plugin->destroy(userfx[u].state);
+    dlclose(userfx[u].handle);
+    userfx[u].plugin=NULL;
+    for(int i=0; i<nleds; i++) effects_blend(bklt, focus, 0.0f, frame[i]);
+    return -1;
+}
+
+int effects_render(uint8_t sfx, double t, uint8_t speed, const unsigned char *bklt, const unsigned char *focus, unsigned char (*frame)[3]){
+    int i;
+
+    float phase=(float)fmod(t*(1<<speed)/EFFECTS_PERIOD, 1.0); //0-1 through the current cycle
+    switch(sfx){
+        case SM_SFX_WAVE:
+            for(i=0; i<nleds; i++) effects_hue(xpos[i]-phase, frame[i]);
+            break;
+        case SM_SFX_BREATHE: {
+            float level=0.5f-0.5f*cosf(2.0f*(float)M_PI*phase);
+            for(i=0; i<nleds; i++) effects_blend(bklt, focus, level, frame[i]);
+            break;
+        }
+        case SM_SFX_SCAN: {
+            float bar=(phase<0.5f)? phase*2.0f : 2.0f-phase*2.0f; //there and back each cycle
+            for(i=0; i<nleds; i++){
+                float level=1.0f-fabsf(xpos[i]-bar)/EFFECTS_SCANW;
+                effects_blend(bklt, focus, level>0.0f? level : 0.0f, frame[i]);
+            }
+            break;
+        }
+        case SM_SFX_SNAKE: {
+            int head=(int)(phase*nleds);
+            for(i=0; i<nleds; i++){
+                int behind=(head-snakepos[i]+nleds)%nleds;
+                effects_blend(bklt, focus, behind<EFFECTS_SNAKE? 1.0f-(float)behind/EFFECTS_SNAKE : 0.0f, frame[i]);
+            }
+            break;
+        }
+        case SM_SFX_RIPPLE: {
+            float level[LAYOUT_MAXLEDS]={0};
+            if(t-lastripple >= EFFECTS_PERIOD/(1<<speed)) effects_keypress(center, t); //keep rippling from the middle while nothing is typed
+            effects_ripples(t, speed, level);
+            for(i=0; i<nleds; i++) effects_blend(bklt, focus, level[i]<1.0f? level[i] : 1.0f, frame[i]); //overlapping rings add up
+            break;
+        }
+        default:
+            if(sfx>=SM_SFX_USER && sfx<SM_SFX_USER+nuserfx){
+                if(userfx[sfx-SM_SFX_USER].handle!=NULL) return effects_plugin(sfx-SM_SFX_USER, t, speed, bklt, focus, frame);
+                if(userfx[sfx-SM_SFX_USER].anim.h!=NULL) return anim_render(&userfx[sfx-SM_SFX_USER].anim, (uint32_t)(t*1000.0), frame);
+                effects_expr(&userfx[sfx-SM_SFX_USER].x, t, speed, frame);
+                break;
+            }
+            for(i=0; i<nleds; i++) effects_blend(bklt, focus, 0.0f, frame[i]);
+            break;
+    }
+    return 0;
+}
+
+//EFFECTS_BENCHEXPR written out in C, the floor for what the expression effect could cost
+static void effects_handwritten(double t, unsigned char (*frame)[3]){
+    effects_cool(t);
+    for(int i=0; i<nleds; i++){
+        float r=128.0f+127.0f*sinf((float)t*2.0f + kx[i]/4.0f), g=heat[i]*255.0f;
+        frame[i][0]=(unsigned char)(r<=0.0f? 0 : r>=255.0f? 255 : r+0.5f);
+        frame[i][1]=(unsigned char)(g<=0.0f? 0 : g>=255.0f? 255 : g+0.5f);
+        frame[i][2]=0;
+    }
+}
+
+void effects_bench(unsigned int frames){
+    static const unsigned char bklt[3]={0,0,64}, focus[3]={255,255,255};
+    unsigned char frame[LAYOUT_MAXLEDS][3];
+    struct expr x;
+    char err[EXPR_MAXERR];
+    if(expr_compile(EFFECTS_BENCHEXPR, &x, err)!=0){
+        printf("%s: %s\n", EFFECTS_BENCHEXPR, err);
+        return;
+    }
+    printf("%u keys, %u frames of each effect, a key pressed every 10 frames\n", nleds, frames);
+    printf("Expression: %s (%u per key and %u per frame instructions)\n", EFFECTS_BENCHEXPR, x.ncode, x.nucode);
+    for(int e=-2; e<=effects_max(); e++){ //-2 hand written, -1 the same as an expression, then every effect
+        if(e==SM_SFX_NONE) continue;
+        unsigned long sum=0;
+        struct timespec a, b;
+        effects_start();
+        clock_gettime(CLOCK_MONOTONIC, &a);
+        for(unsigned int f=0; f<frames; f++){
+            double t=f/(double)SM_DEFAULTFPS;
+            if(f%10==0) effects_keypress(f%nleds, t);
+            if(e==-2) effects_handwritten(t, frame);
+            else if(e==-1) effects_expr(&x, t, 1, frame);
+            else effects_render(e, t, 1, bklt, focus, frame);
+            sum+=frame[f%nleds][0]+frame[f%nleds][1]+frame[f%nleds][2]; //keeps the frames from being optimized away
+        }
+        clock_gettime(CLOCK_MONOTONIC, &b);
+        double us=((b.tv_sec-a.tv_sec)*1e6 + (b.tv_nsec-a.tv_nsec)/1e3)/frames;
+        const char *name= e==-2? "hand written C" : e==-1? "same as expression" : e>=SM_SFX_USER? userfx[e-SM_SFX_USER].name : NULL;
+        if(name) printf("%-20s %8.3f us/frame  (%lu)\n", name, us, sum);
+        else printf("sfx %-16i %8.3f us/frame  (%lu)\n", e, us, sum);
+    }
+    effects_start();
+}
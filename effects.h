@@ -0,0 +1,30 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ * 
+ * Software effects rendered by the daemon into a frame of per-key colors (SM_SFX_* in sharedmem.h), plus the ones
+ * defined as expressions on sfx lines in kbled.conf, plugins loaded from plugin lines and animations played from
+ * anim lines (numbered from SM_SFX_USER, see expr.h, kbledplugin.h and anim.h)
+ */
+
+#ifndef EFFECTS_H
+#define EFFECTS_H
+
+#include <stdint.h>
+#include "layout.h"
+
+#define EFFECTS_PLUGINDIR "/usr/lib/kbled" //plugin lines without a / load <name>.so from here
+
+void effects_init(const struct layout *l); //precompute per-key positions for the layout, call before effects_render()
+void effects_start(); //forget effect state (ripples) when an effect starts, t counts from 0 again
+void effects_keypress(uint8_t led, double t); //start a ripple and heat up LED index led at effect time t
+int effects_load(const char *conffile, char verbose); //compile the sfx lines, load the plugins and map the animations of the configuration file, returns the number loaded
+uint8_t effects_max(); //highest effect number that exists, built in or from the configuration file
+int effects_keyinput(uint8_t sfx); //1 if effect sfx reacts to key presses
+void effects_bench(unsigned int frames); //time rendering every effect against a hand written one and print the cost per frame
+//render effect sfx at t seconds since it started, speed 0-2 like the hardware effects, into frame[key][RGB].
+//Returns nonzero if the effect was a plugin that had to be disabled, the frame is then the backlight color, or an
+//animation that played to its end without looping, the frame then holds its last keyframe
+int effects_render(uint8_t sfx, double t, uint8_t speed, const unsigned char *bklt, const unsigned char *focus, unsigned char (*frame)[3]);
+
+#endif
@@ -0,0 +1,416 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * Expression compiler and evaluator, see expr.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "expr.h"
+
+//every operator and function once: name, commutative, result from operands a, b and c.  The scalar evaluator
+//(constant folding and the per frame program) and the per key loops are both generated from these lists
+#define EXPR_BINARY \
+    X(ADD,   NULL,    1, a+b) \
+    X(SUB,   NULL,    0, a-b) \
+    X(MUL,   NULL,    1, a*b) \
+    X(DIV,   NULL,    0, a/b) \
+    X(MOD,   NULL,    0, a-b*floorf(a/b)) \
+    X(POW,   "pow",   0, powf(a,b)) \
+    X(MIN,   "min",   1, fminf(a,b)) \
+    X(MAX,   "max",   1, fmaxf(a,b)) \
+    X(LT,    NULL,    0, (float)(a<b)) \
+    X(GT,    NULL,    0, (float)(a>b))
+#define EXPR_UNARY \
+    X(NEG,   NULL,    0, -a) \
+    X(SIN,   "sin",   0, sinf(a)) \
+    X(COS,   "cos",   0, cosf(a)) \
+    X(TAN,   "tan",   0, tanf(a)) \
+    X(ABS,   "abs",   0, fabsf(a)) \
+    X(SQRT,  "sqrt",  0, sqrtf(a)) \
+    X(EXP,   "exp",   0, expf(a)) \
+    X(FLOOR, "floor", 0, floorf(a)) \
+    X(FRACT, "fract", 0, a-floorf(a))
+#define EXPR_TERNARY \
+    X(CLAMP, "clamp", 0, fminf(fmaxf(a,b),c)) \
+    X(MIX,   "mix",   0, a+(b-a)*c)
+
+enum {
+#define X(id, name, comm, e) EXPR_OP_##id,
+    EXPR_BINARY
+    EXPR_UNARY
+    EXPR_TERNARY
+#undef X
+    EXPR_OP_LOAD,   //push input arg
+    EXPR_OP_K,      //push k[arg]
+    EXPR_OP_STORE,  //pop into channel arg (per key program) or k[arg] (per frame program)
+};
+
+static const struct {
+    const char *name;
+    uint8_t nargs, comm;
+} ops[]={
+#define X(id, name, comm, e) {name, 2, comm},
+    EXPR_BINARY
+#undef X
+#define X(id, name, comm, e) {name, 1, comm},
+    EXPR_UNARY
+#undef X
+#define X(id, name, comm, e) {name, 3, comm},
+    EXPR_TERNARY
+#undef X
+};
+
+static const struct {
+    const char *name;
+    uint8_t perkey;  //differs from key to key
+} vars[EXPR_NVARS]={
+    {"t", 0}, {"speed", 0}, {"x", 1}, {"y", 1}, {"row", 1}, {"col", 1}, {"led", 1}, {"heat", 1}
+};
+
+static float scalar_op(uint8_t op, float a, float b, float c){
+    (void)b; (void)c;
+    switch(op){
+#define X(id, name, comm, e) case EXPR_OP_##id: return (e);
+        EXPR_BINARY
+        EXPR_UNARY
+        EXPR_TERNARY
+#undef X
+    }
+    return 0.0f;
+}
+
+//parse tree, each node is tagged with how often its value can change
+enum { CLS_CONST, CLS_FRAME, CLS_KEY };
+enum { NODE_NUM, NODE_VAR, NODE_OP };
+
+struct node {
+    uint8_t type, cls, op;
+    int16_t arg[3];
+    float val;    //NODE_NUM
+    uint8_t var;  //NODE_VAR
+};
+
+struct compiler {
+    const char *p;       //parse position
+    const char *src;
+    char *err;
+    struct node node[EXPR_MAXNODE];
+    int nnode;
+    struct expr *x;
+    int depth;           //stack depth of the per key program at this point
+    int udepth;          //stack depth of the per frame program
+};
+
+static int fail(struct compiler *cc, const char *msg){
+    if(cc->err[0]=='\0') snprintf(cc->err, EXPR_MAXERR, "%s at column %i", msg, (int)(cc->p - cc->src)+1);
+    return -1;
+}
+
+static void skipspace(struct compiler *cc){
+    while(isspace((unsigned char)*cc->p)) cc->p++;
+}
+
+static int accept(struct compiler *cc, char c){
+    skipspace(cc);
+    if(*cc->p!=c) return 0;
+    cc->p++;
+    return 1;
+}
+
+static int newnode(struct compiler *cc){
+    if(cc->nnode>=EXPR_MAXNODE) return fail(cc, "expression too long");
+    memset(&cc->node[cc->nnode], 0, sizeof(struct node));
+    return cc->nnode++;
+}
+
+static int num(struct compiler *cc, float v){
+    int n=newnode(cc);
+    if(n<0) return -1;
+    cc->node[n].type=NODE_NUM;
+    cc->node[n].cls=CLS_CONST;
+    cc->node[n].val=v;
+    return n;
+}
+
+//operator node, folded to a number right away when every operand is constant
+static int opnode(struct compiler *cc, uint8_t op, int a, int b, int c){
+    int args[3]={a, b, c};
+    if(a<0 || (ops[op].nargs>1 && b<0) || (ops[op].nargs>2 && c<0)) return -1;
+    uint8_t cls=CLS_CONST;
+    for(int i=0; i<ops[op].nargs; i++) if(cc->node[args[i]].cls>cls) cls=cc->node[args[i]].cls;
+    if(cls==CLS_CONST){
+        float v[3]={0};
+        for(int i=0; i<ops[op].nargs; i++) v[i]=cc->node[args[i]].val;
+        return num(cc, scalar_op(op, v[0], v[1], v[2]));
+    }
+    int n=newnode(cc);
+    if(n<0) return -1;
+    struct node *nd=&cc->node[n];
+    nd->type=NODE_OP;
+    nd->op=op;
+    nd->cls=cls;
+    for(int i=0; i<3; i++) nd->arg[i]=args[i];
+    return n;
+}
+
+static int expr(struct compiler *cc);
+
+static int primary(struct compiler *cc){
+    skipspace(cc);
+    if(accept(cc, '(')){
+        int n=expr(cc);
+        if(n>=0 && !accept(cc, ')')) return fail(cc, "missing )");
+        return n;
+    }
+    if(isdigit((unsigned char)*cc->p) || *cc->p=='.'){
+        char *end;
+        float v=strtof(cc->p, &end);
+        cc->p=end;
+        return num(cc, v);
+    }
+    if(!isalpha((unsigned char)*cc->p)) return fail(cc, "expected a number, input or function");
+    char name[16];
+    int len=0;
+    while((isalnum((unsigned char)*cc->p) || *cc->p=='_') && len<(int)sizeof(name)-1) name[len++]=*cc->p++;
+    name[len]='\0';
+    if(strcmp(name, "pi")==0) return num(cc, (float)M_PI);
+    for(int v=0; v<EXPR_NVARS; v++){
+        if(strcmp(name, vars[v].name)!=0) continue;
+        int n=newnode(cc);
+        if(n<0) return -1;
+        cc->node[n].type=NODE_VAR;
+        cc->node[n].var=v;
+        cc->node[n].cls=vars[v].perkey? CLS_KEY : CLS_FRAME;
+        cc->x->uses |= 1u<<v;
+        return n;
+    }
+    for(uint8_t op=0; op<sizeof(ops)/sizeof(ops[0]); op++){
+        if(ops[op].name==NULL || strcmp(name, ops[op].name)!=0) continue;
+        int a[3]={-1, -1, -1};
+        if(!accept(cc, '(')) return fail(cc, "missing (");
+        for(int i=0; i<ops[op].nargs; i++){
+            if(i>0 && !accept(cc, ',')) return fail(cc, "missing argument");
+            if((a[i]=expr(cc))<0) return -1;
+        }
+        if(!accept(cc, ')')) return fail(cc, "missing )");
+        return opnode(cc, op, a[0], a[1], a[2]);
+    }
+    return fail(cc, "unknown name");
+}
+
+static int unary(struct compiler *cc);
+
+static int power(struct compiler *cc){
+    int n=primary(cc);
+    if(n>=0 && accept(cc, '^')) return opnode(cc, EXPR_OP_POW, n, unary(cc), -1); //right associative
+    return n;
+}
+
+static int unary(struct compiler *cc){
+    if(accept(cc, '-')) return opnode(cc, EXPR_OP_NEG, unary(cc), -1, -1);
+    if(accept(cc, '+')) return unary(cc);
+    return power(cc);
+}
+
+static int term(struct compiler *cc){
+    int n=unary(cc);
+    while(n>=0){
+        if(accept(cc, '*')) n=opnode(cc, EXPR_OP_MUL, n, unary(cc), -1);
+        else if(accept(cc, '/')) n=opnode(cc, EXPR_OP_DIV, n, unary(cc), -1);
+        else if(accept(cc, '%')) n=opnode(cc, EXPR_OP_MOD, n, unary(cc), -1);
+        else break;
+    }
+    return n;
+}
+
+static int sum(struct compiler *cc){
+    int n=term(cc);
+    while(n>=0){
+        if(accept(cc, '+')) n=opnode(cc, EXPR_OP_ADD, n, term(cc), -1);
+        else if(accept(cc, '-')) n=opnode(cc, EXPR_OP_SUB, n, term(cc), -1);
+        else break;
+    }
+    return n;
+}
+
+static int expr(struct compiler *cc){
+    int n=sum(cc);
+    while(n>=0){
+        if(accept(cc, '<')) n=opnode(cc, EXPR_OP_LT, n, sum(cc), -1);
+        else if(accept(cc, '>')) n=opnode(cc, EXPR_OP_GT, n, sum(cc), -1);
+        else break;
+    }
+    return n;
+}
+
+static int emit(struct compiler *cc, struct expr_op *code, uint8_t *ncode, uint8_t op, uint8_t scalar, uint8_t arg){
+    if(*ncode>=EXPR_MAXCODE) return fail(cc, "expression too long");
+    code[*ncode].op=op;
+    code[*ncode].scalar=scalar;
+    code[*ncode].arg=arg;
+    (*ncode)++;
+    return 0;
+}
+
+static int newk(struct compiler *cc, float v){
+    for(int i=0; i<cc->x->nk; i++) if(cc->x->k[i]==v) return i; //constants are shared, per frame slots get NAN until run
+    if(cc->x->nk>=EXPR_MAXK) return fail(cc, "too many constants");
+    cc->x->k[cc->x->nk]=v;
+    return cc->x->nk++;
+}
+
+//per frame program for a subexpression of t and speed
+static int genframe(struct compiler *cc, int n){
+    struct node *nd=&cc->node[n];
+    struct expr *x=cc->x;
+    if(nd->type==NODE_NUM){
+        int k=newk(cc, nd->val);
+        if(k<0) return -1;
+        cc->udepth++;
+        return emit(cc, x->ucode, &x->nucode, EXPR_OP_K, 0, k);
+    }
+    if(nd->type==NODE_VAR){
+        cc->udepth++;
+        return emit(cc, x->ucode, &x->nucode, EXPR_OP_LOAD, 0, nd->var);
+    }
+    for(int i=0; i<ops[nd->op].nargs; i++) if(genframe(cc, nd->arg[i])!=0) return -1;
+    if(cc->udepth>EXPR_STACK) return fail(cc, "expression nested too deep");
+    cc->udepth-=ops[nd->op].nargs-1;
+    return emit(cc, x->ucode, &x->nucode, nd->op, 0, 0);
+}
+
+//k[] slot holding a constant or per frame value
+static int kslot(struct compiler *cc, int n){
+    struct node *nd=&cc->node[n];
+    if(nd->cls==CLS_CONST) return newk(cc, nd->val);
+    if(cc->x->nk>=EXPR_MAXK) return fail(cc, "too many constants");
+    int k=cc->x->nk++;
+    cc->x->k[k]=NAN;
+    if(genframe(cc, n)!=0 || emit(cc, cc->x->ucode, &cc->x->nucode, EXPR_OP_STORE, 0, k)!=0) return -1;
+    cc->udepth--;
+    return k;
+}
+
+//per key program, leaves one plane on the stack
+static int genkey(struct compiler *cc, int n){
+    struct node *nd=&cc->node[n];
+    struct expr *x=cc->x;
+    int k;
+    if(nd->cls!=CLS_KEY){ //same for every key, spread it over the plane
+        if((k=kslot(cc, n))<0) return -1;
+        if(++cc->depth>EXPR_STACK) return fail(cc, "expression nested too deep");
+        return emit(cc, x->code, &x->ncode, EXPR_OP_K, 0, k);
+    }
+    if(nd->type==NODE_VAR){
+        if(++cc->depth>EXPR_STACK) return fail(cc, "expression nested too deep");
+        return emit(cc, x->code, &x->ncode, EXPR_OP_LOAD, 0, nd->var);
+    }
+    if(ops[nd->op].nargs==2){ //an operand that doesn't change from key to key is read straight from k[]
+        int l=nd->arg[0], r=nd->arg[1];
+        if(cc->node[r].cls!=CLS_KEY || (ops[nd->op].comm && cc->node[l].cls!=CLS_KEY)){
+            if(cc->node[r].cls==CLS_KEY){
+                l=nd->arg[1];
+                r=nd->arg[0];
+            }
+            if(genkey(cc, l)!=0 || (k=kslot(cc, r))<0) return -1;
+            return emit(cc, x->code, &x->ncode, nd->op, 1, k);
+        }
+    }
+    for(int i=0; i<ops[nd->op].nargs; i++) if(genkey(cc, nd->arg[i])!=0) return -1;
+    cc->depth-=ops[nd->op].nargs-1;
+    return emit(cc, x->code, &x->ncode, nd->op, 0, 0);
+}
+
+int expr_compile(const char *src, struct expr *x, char *err){
+    static struct compiler cc; //parse tree is too big for the stack of a config handler
+    uint8_t set=0;
+    memset(&cc, 0, sizeof(cc));
+    memset(x, 0, sizeof(*x));
+    cc.src=cc.p=src;
+    cc.err=err;
+    cc.x=x;
+    err[0]='\0';
+    do {
+        skipspace(&cc);
+        if(*cc.p=='\0') break;
+        const char *ch=strchr("rgb", *cc.p);
+        if(ch==NULL || isalnum((unsigned char)cc.p[1])) return fail(&cc, "expected r, g or b");
+        int c=ch-"rgb";
+        cc.p++;
+        if(!accept(&cc, '=')) return fail(&cc, "missing =");
+        int n=expr(&cc);
+        if(n<0 || genkey(&cc, n)!=0 || emit(&cc, x->code, &x->ncode, EXPR_OP_STORE, 0, c)!=0) return -1;
+        cc.depth--;
+        set |= 1<<c;
+    } while(accept(&cc, ';'));
+    skipspace(&cc);
+    if(*cc.p!='\0') return fail(&cc, "expected ;");
+    for(int c=0; c<3; c++){ //channels left out are off
+        if(set & (1<<c)) continue;
+        int k=newk(&cc, 0.0f);
+        if(k<0 || emit(&cc, x->code, &x->ncode, EXPR_OP_K, 0, k)!=0 || emit(&cc, x->code, &x->ncode, EXPR_OP_STORE, 0, c)!=0) return -1;
+    }
+    return 0;
+}
+
+void expr_eval(struct expr *x, const struct expr_in *in, unsigned char (*frame)[3]){
+    static float s[EXPR_STACK][LAYOUT_MAXLEDS]; //one plane per stack entry
+    float u[EXPR_STACK];
+    int i, sp=0, n=in->n;
+    //per frame values first, plain scalar stack
+    for(const struct expr_op *op=x->ucode; op<x->ucode+x->nucode; op++){
+        switch(op->op){
+            case EXPR_OP_LOAD:  u[sp++]=in->scalar[op->arg]; break;
+            case EXPR_OP_K:     u[sp++]=x->k[op->arg]; break;
+            case EXPR_OP_STORE: x->k[op->arg]=u[--sp]; break;
+            default:
+                sp-=ops[op->op].nargs-1;
+                u[sp-1]=scalar_op(op->op, u[sp-1], ops[op->op].nargs>1? u[sp] : 0.0f, ops[op->op].nargs>2? u[sp+1] : 0.0f);
+                break;
+        }
+    }
+    //then every instruction once over the whole plane of keys
+#define UNARY(e) do{ float *pa=s[sp-1]; for(i=0;i<n;i++){ const float a=pa[i]; pa[i]=(e); } }while(0)
+#define BINARY(e) do{ \
+        if(op->scalar){ float *pa=s[sp-1]; const float b=x->k[op->arg]; for(i=0;i<n;i++){ const float a=pa[i]; pa[i]=(e); } } \
+        else { float *pa=s[sp-2]; const float *pb=s[sp-1]; for(i=0;i<n;i++){ const float a=pa[i], b=pb[i]; pa[i]=(e); } sp--; } \
+    }while(0)
+#define TERNARY(e) do{ float *pa=s[sp-3]; const float *pb=s[sp-2], *pc=s[sp-1]; \
+        for(i=0;i<n;i++){ const float a=pa[i], b=pb[i], c=pc[i]; pa[i]=(e); } sp-=2; }while(0)
+    sp=0;
+    for(const struct expr_op *op=x->code; op<x->code+x->ncode; op++){
+        switch(op->op){
+#define X(id, name, comm, e) case EXPR_OP_##id: BINARY(e); break;
+            EXPR_BINARY
+#undef X
+#define X(id, name, comm, e) case EXPR_OP_##id: UNARY(e); break;
+            EXPR_UNARY
+#undef X
+#define X(id, name, comm, e) case EXPR_OP_##id: TERNARY(e); break;
+            EXPR_TERNARY
+#undef X
+            case EXPR_OP_LOAD:
+                memcpy(s[sp++], in->key[op->arg], n*sizeof(float));
+                break;
+            case EXPR_OP_K: {
+                const float v=x->k[op->arg];
+                for(i=0;i<n;i++) s[sp][i]=v;
+                sp++;
+                break;
+            }
+            case EXPR_OP_STORE: {
+                const float *pa=s[--sp];
+                for(i=0;i<n;i++) frame[i][op->arg]=!(pa[i]>0.0f)? 0 : pa[i]>=255.0f? 255 : (unsigned char)(pa[i]+0.5f); //NaN (0/0, sqrt(-1)) stores 0
+                break;
+            }
+        }
+    }
+#undef UNARY
+#undef BINARY
+#undef TERNARY
+}
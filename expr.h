@@ -0,0 +1,60 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * Per key expressions for effects defined in kbled.conf, e.g.  r = 128+127*sin(t*2 + x/4); g = heat*255; b = 0
+ * An expression is compiled once into bytecode for a stack machine whose stack entries are whole planes of
+ * keys: each instruction runs a plain loop over every LED, so decoding costs once per frame rather than once
+ * per key.  Constant subexpressions are folded when compiling, subexpressions of only t and speed are worked
+ * out once per frame by a separate scalar program and used as scalar operands.
+ */
+
+#ifndef EXPR_H
+#define EXPR_H
+
+#include <stdint.h>
+#include "layout.h"
+
+#define EXPR_MAXCODE  128  //instructions in each program
+#define EXPR_MAXK     64   //constants plus per frame values
+#define EXPR_STACK    8    //stack depth, deeper expressions are rejected
+#define EXPR_MAXNODE  256  //parse tree size while compiling
+#define EXPR_MAXERR   96   //compile error message
+
+//inputs: t and speed are the same for every key, the rest are one value per LED
+enum expr_var {
+    EXPR_T,      //seconds since the effect started
+    EXPR_SPEED,  //effect speed 0-2
+    EXPR_X,      //key center from the left edge, in keys
+    EXPR_Y,      //key center from the top edge, in keys
+    EXPR_ROW,    //row of the key
+    EXPR_COL,    //column of the key
+    EXPR_LED,    //LED index
+    EXPR_HEAT,   //1 when the key is pressed, fading to 0
+    EXPR_NVARS
+};
+
+struct expr_op {
+    uint8_t op;      //EXPR_OP_*
+    uint8_t scalar;  //binary ops: the right operand is k[arg] rather than the top of the stack
+    uint8_t arg;     //variable, k[] slot or channel
+};
+
+struct expr {
+    uint8_t ncode, nucode, nk;
+    uint32_t uses;                       //1<<var for every input the program reads
+    struct expr_op code[EXPR_MAXCODE];   //per key program
+    struct expr_op ucode[EXPR_MAXCODE];  //per frame program, fills k[] slots from t and speed
+    float k[EXPR_MAXK];                  //constants and per frame values
+};
+
+struct expr_in {
+    uint8_t n;                          //number of LEDs
+    float scalar[EXPR_NVARS];           //t and speed
+    const float *key[EXPR_NVARS];       //per LED planes for the others
+};
+
+int expr_compile(const char *src, struct expr *x, char *err); //compile "r = ...; g = ...; b = ..." channels left out are 0, 0 on success, nonzero with a message in err[EXPR_MAXERR]
+void expr_eval(struct expr *x, const struct expr_in *in, unsigned char (*frame)[3]); //run for every LED, results are clamped to 0-255
+
+#endif
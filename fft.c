@@ -0,0 +1,84 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * Power spectrum FFT, see fft.h
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "fft.h"
+
+int fft_init(struct fft *f, int bits){
+    memset(f, 0, sizeof(*f));
+    if(bits<2 || bits>FFT_MAXBITS) return 1;
+    int n=1<<bits;
+    f->n=n;
+    f->win=aligned_alloc(32, n*sizeof(float));
+    f->twr=aligned_alloc(32, n*sizeof(float));
+    f->twi=aligned_alloc(32, n*sizeof(float));
+    f->re=aligned_alloc(32, n*sizeof(float));
+    f->im=aligned_alloc(32, n*sizeof(float));
+    f->rev=malloc(n*sizeof(uint32_t));
+    if(!f->win || !f->twr || !f->twi || !f->re || !f->im || !f->rev){
+        fft_free(f);
+        return 1;
+    }
+    for(int i=0; i<n; i++){
+        f->win[i]=0.5f-0.5f*cosf(2.0f*(float)M_PI*i/n);
+        uint32_t r=0;
+        for(int b=0; b<bits; b++) if(i & (1<<b)) r|=1u<<(bits-1-b);
+        f->rev[i]=r;
+    }
+    for(int h=1; h<n; h<<=1){
+        for(int k=0; k<h; k++){
+            f->twr[h+k]=cosf((float)M_PI*k/h);
+            f->twi[h+k]=-sinf((float)M_PI*k/h);
+        }
+    }
+    return 0;
+}
+
+void fft_free(struct fft *f){
+    free(f->win);
+    free(f->twr);
+    free(f->twi);
+    free(f->re);
+    free(f->im);
+    free(f->rev);
+    memset(f, 0, sizeof(*f));
+}
+
+void fft_power(struct fft *f, const float *x, float *power){
+    const int n=f->n;
+    float *restrict re=f->re, *restrict im=f->im;
+    for(int i=0; i<n; i++){ //window while putting the samples in bit reversed order
+        uint32_t r=f->rev[i];
+        re[i]=x[r]*f->win[r];
+    }
+    memset(im, 0, n*sizeof(float));
+    //the first stage has a twiddle of 1, then each stage runs contiguous butterflies against its own twiddles
+    for(int i=0; i<n; i+=2){
+        float ar=re[i], br=re[i+1];
+        re[i]=ar+br;
+        re[i+1]=ar-br;
+    }
+    for(int h=2; h<n; h<<=1){
+        const float *restrict wr=f->twr+h, *restrict wi=f->twi+h;
+        for(int i=0; i<n; i+=2*h){
+            float *restrict ar=re+i, *restrict ai=im+i, *restrict br=re+i+h, *restrict bi=im+i+h;
+            for(int k=0; k<h; k++){
+                float tr=br[k]*wr[k]-bi[k]*wi[k];
+                float ti=br[k]*wi[k]+bi[k]*wr[k];
+                br[k]=ar[k]-tr;
+                bi[k]=ai[k]-ti;
+                ar[k]+=tr;
+                ai[k]+=ti;
+            }
+        }
+    }
+    //a full scale sine through the Hann window comes out at n/4
+    const float scale=16.0f/((float)n*n);
+    for(int i=0; i<n/2; i++) power[i]=(re[i]*re[i]+im[i]*im[i])*scale;
+}
@@ -0,0 +1,31 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * Windowed power spectrum for kbledspectrum.  Radix 2 FFT on split real/imaginary arrays with the twiddles of
+ * each stage stored next to each other, so every butterfly loop walks plain float arrays that the compiler can
+ * vectorize.  Everything is set up once by fft_init(), fft_power() does no allocation.
+ */
+
+#ifndef FFT_H
+#define FFT_H
+
+#include <stdint.h>
+
+#define FFT_MAXBITS 14  //largest transform is 1<<FFT_MAXBITS points
+
+struct fft {
+    int n;           //points, a power of 2
+    float *win;      //Hann window
+    float *twr, *twi;//twiddles, stage with half length h uses [h, 2h)
+    uint32_t *rev;   //bit reversed index
+    float *re, *im;  //work arrays
+};
+
+int fft_init(struct fft *f, int bits); //plan a 1<<bits point transform, 0 on success
+void fft_free(struct fft *f);
+//window the last n samples (oldest first) and write the power of bins 0 to n/2-1, scaled so a full scale sine
+//peaks at 1
+void fft_power(struct fft *f, const float *x, float *power);
+
+#endif
@@ -0,0 +1,71 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ * 
+ * genlayout - build time tool that turns a layout description into the C tables compiled into kbled
+ * Usage: genlayout layouts/bonw15.layout > keytables.c
+ */
+
+#include <stdio.h>
+#include "layout.h"
+
+static struct layout l;
+
+static void emit8(const char *field, const uint8_t *v, int n){
+    printf("    .%s={", field);
+    for(int i=0; i<n; i++) printf("%s%u", i? ",":"", v[i]);
+    printf("},\n");
+}
+
+static void emit16(const char *field, const uint16_t *v, int n){
+    printf("    .%s={", field);
+    for(int i=0; i<n; i++) printf("%s%u", i? ",":"", v[i]);
+    printf("},\n");
+}
+
+int main(int argc, char **argv){
+    int i, j;
+    if(argc!=2) {
+        fprintf(stderr, "Usage: %s <layout description>\n", argv[0]);
+        return 1;
+    }
+    if(layout_parse(argv[1], &l)!=0) return 1;
+
+    printf("/* generated by genlayout from %s, do not edit */\n\n", argv[1]);
+    printf("#include \"keymap.h\"\n\n");
+    printf("_Static_assert(NKEYS==%u, \"NKEYS does not match %s\");\n", l.nleds, argv[1]);
+    for(i=0; i<l.nleds; i++) printf("_Static_assert(K_%s==%u, \"keymap.h and %s disagree on K_%s\");\n", l.ledname[i], l.addr[i], argv[1], l.ledname[i]);
+
+    printf("\nconst struct layout layout_builtin={\n");
+    printf("    .name=\"%s\",\n    .description=\"%s\",\n", l.name, l.description);
+    printf("    .nleds=%u, .ngroups=%u, .nrows=%u, .ncols=%u,\n", l.nleds, l.ngroups, l.nrows, l.ncols);
+    emit8("addr", l.addr, l.nleds);
+    printf("    .ledname={");
+    for(i=0; i<l.nleds; i++) printf("%s\"%s\"", i? ",":"", l.ledname[i]);
+    printf("},\n");
+    emit16("x", l.x, l.nleds);
+    emit16("y", l.y, l.nleds);
+    emit8("row", l.row, l.nleds);
+    emit8("col", l.col, l.nleds);
+    emit8("group", l.group, l.nleds);
+    emit8("keyindex", l.keyindex, 256);
+    emit8("byname", l.byname, l.nleds);
+    printf("    .groups={");
+    for(i=0; i<l.ngroups; i++) printf("%s{\"%s\",%u,%u}", i? ",":"", l.groups[i].name, l.groups[i].first, l.groups[i].nleds);
+    printf("},\n");
+    emit8("groupleds", l.groupleds, l.nleds);
+    emit8("nneigh", l.nneigh, l.nleds);
+    printf("    .neigh={");
+    for(i=0; i<l.nleds; i++) {
+        printf("%s{", i? ",":"");
+        for(j=0; j<l.nneigh[i]; j++) printf("%s%u", j? ",":"", l.neigh[i][j]);
+        printf("}");
+    }
+    printf("},\n");
+    printf("    .nzones=%u,\n    .zones={", l.nzones);
+    for(i=0; i<l.nzones; i++) printf("%s{\"%s\",{{0x%016llxULL,0x%016llxULL}}}", i? ",":"", l.zones[i].name,
+        (unsigned long long)l.zones[i].keys.w[0], (unsigned long long)l.zones[i].keys.w[1]);
+    printf("},\n};\n\n");
+
+    return 0;
+}
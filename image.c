@@ -0,0 +1,260 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * PNG and GIF loading, see image.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <png.h>
+#include "image.h"
+
+#define GIF_MAXCODE 4096 //LZW codes are at most 12 bits
+
+static int image_png(const char *path, image_frame fn, void *ctx, char *err, size_t errlen){
+    png_image png;
+    memset(&png, 0, sizeof(png));
+    png.version=PNG_IMAGE_VERSION;
+    if(!png_image_begin_read_from_file(&png, path)){
+        snprintf(err, errlen, "%s: %s", path, png.message);
+        return -1;
+    }
+    if(png.width>IMAGE_MAXSIZE || png.height>IMAGE_MAXSIZE){
+        snprintf(err, errlen, "%s: %ux%u is too big", path, png.width, png.height);
+        png_image_free(&png);
+        return -1;
+    }
+    png.format=PNG_FORMAT_RGB; //transparency is blended onto black
+    unsigned char *rgb=malloc(PNG_IMAGE_SIZE(png));
+    if(rgb==NULL || !png_image_finish_read(&png, NULL, rgb, 0, NULL)){
+        snprintf(err, errlen, "%s: %s", path, rgb? png.message : "out of memory");
+        png_image_free(&png);
+        free(rgb);
+        return -1;
+    }
+    fn(rgb, png.width, png.height, 0, ctx);
+    free(rgb);
+    return 1;
+}
+
+//LZW decode one GIF image into color indices, returns the number of pixels decoded
+static size_t gif_lzw(const unsigned char *data, size_t len, int mcs, unsigned char *out, size_t npix){
+    uint16_t prefix[GIF_MAXCODE];
+    uint8_t suffix[GIF_MAXCODE], stack[GIF_MAXCODE+1];
+    int clear=1<<mcs, size=mcs+1, next=clear+2, old=-1;
+    uint8_t first=0;
+    uint32_t bits=0;
+    int nbits=0;
+    size_t o=0, i=0;
+    for(int c=0; c<clear; c++) suffix[c]=c;
+    while(o<npix){
+        while(nbits<size){
+            if(i>=len) return o;
+            bits|=(uint32_t)data[i++]<<nbits;
+            nbits+=8;
+        }
+        int code=bits&((1u<<size)-1);
+        bits>>=size;
+        nbits-=size;
+        if(code==clear){
+            size=mcs+1;
+            next=clear+2;
+            old=-1;
+            continue;
+        }
+        if(code==clear+1) break;
+        if(old<0){ //first code after a clear is a literal
+            if(code>clear) return o;
+            out[o++]=first=code;
+            old=code;
+            continue;
+        }
+        if(code>next) return o; //corrupt
+        int sp=0, c=code;
+        if(code==next){ //the string being defined: old's string plus its own first byte
+            stack[sp++]=first;
+            c=old;
+        }
+        while(c>clear){
+            stack[sp++]=suffix[c];
+            c=prefix[c];
+        }
+        stack[sp++]=first=c;
+        while(sp>0 && o<npix) out[o++]=stack[--sp];
+        if(next<GIF_MAXCODE){
+            prefix[next]=old;
+            suffix[next]=first;
+            next++;
+            if(next==(1<<size) && size<12) size++;
+        }
+        old=code;
+    }
+    return o;
+}
+
+//skip a chain of data sub-blocks, returns the position after the terminator or NULL past the end
+static const unsigned char *gif_skip(const unsigned char *p, const unsigned char *end){
+    while(p<end && *p) p+=*p+1;
+    return (p<end)? p+1 : NULL;
+}
+
+static int image_gif(const char *path, const unsigned char *f, size_t len, image_frame fn, void *ctx, int *loops, char *err, size_t errlen){
+    const unsigned char *p=f+13, *end=f+len;
+    if(len<13){
+        snprintf(err, errlen, "%s: truncated", path);
+        return -1;
+    }
+    uint16_t w=f[6]|f[7]<<8, h=f[8]|f[9]<<8;
+    const unsigned char *gct=NULL;
+    int ngct=0;
+    if(f[10]&0x80){
+        ngct=2<<(f[10]&7);
+        gct=p;
+        p+=ngct*3;
+    }
+    if(w==0 || h==0 || w>IMAGE_MAXSIZE || h>IMAGE_MAXSIZE || p>end){
+        snprintf(err, errlen, "%s: bad GIF header", path);
+        return -1;
+    }
+    unsigned char *canvas=calloc((size_t)w*h, 3), *prev=malloc((size_t)w*h*3), *idx=malloc((size_t)w*h);
+    unsigned char *data=malloc(len);
+    int nframes=0, stop=0, dispose=0, transparent=-1;
+    uint32_t delay=0;
+    const char *why=NULL;
+    if(canvas==NULL || prev==NULL || idx==NULL || data==NULL) why="out of memory";
+    *loops=1;
+    while(why==NULL && !stop){
+        if(p>=end){
+            why=nframes? NULL : "truncated";
+            break;
+        }
+        int block=*p++;
+        if(block==0x3B) break; //trailer
+        if(block==0x21){ //extension
+            if(p+1>=end){
+                why="truncated";
+                break;
+            }
+            int label=*p++;
+            if(label==0xF9 && p+5<end && p[0]==4){ //graphic control: disposal, delay and transparent color of the next image
+                dispose=(p[1]>>2)&7;
+                transparent=(p[1]&1)? p[4] : -1;
+                delay=(p[2]|p[3]<<8)*10u;
+            }
+            if(label==0xFF && p+16<end && p[0]==11 && memcmp(p+1, "NETSCAPE2.0", 11)==0 && p[12]==3 && p[13]==1){
+                int repeat=p[14]|p[15]<<8; //repeats after the first play, 0 for forever
+                *loops= repeat? repeat+1 : 0;
+            }
+            if((p=gif_skip(p, end))==NULL) why="truncated";
+            continue;
+        }
+        if(block!=0x2C || p+9>end){
+            why="bad GIF block";
+            break;
+        }
+        //image descriptor
+        int ix=p[0]|p[1]<<8, iy=p[2]|p[3]<<8, iw=p[4]|p[5]<<8, ih=p[6]|p[7]<<8, flags=p[8];
+        p+=9;
+        const unsigned char *pal=gct;
+        int npal=ngct;
+        if(flags&0x80){
+            npal=2<<(flags&7);
+            pal=p;
+            p+=npal*3;
+        }
+        if(pal==NULL || p+1>=end){
+            why=(pal==NULL)? "no color table" : "truncated";
+            break;
+        }
+        int mcs=*p++;
+        size_t n=0;
+        while(p<end && *p && p+*p<end){ //gather the sub-blocks
+            memcpy(data+n, p+1, *p);
+            n+=*p;
+            p+=*p+1;
+        }
+        if(p>=end || *p || mcs<2 || mcs>8){
+            why="bad image data";
+            break;
+        }
+        p++;
+        size_t npix=(size_t)iw*ih;
+        if(npix>(size_t)w*h){
+            why="image bigger than the screen";
+            break;
+        }
+        memset(idx, (transparent>=0)? transparent : 0, npix); //a short image leaves the rest unchanged
+        gif_lzw(data, n, mcs, idx, npix);
+        if(dispose==3) memcpy(prev, canvas, (size_t)w*h*3);
+        for(int r=0; r<ih; r++){
+            //interlaced rows come in 4 passes: every 8th from 0, every 8th from 4, every 4th from 2, every 2nd from 1
+            int y=r;
+            if(flags&0x40){
+                int p1=(ih+7)/8, p2=(ih+3)/8, p3=(ih+1)/4;
+                if(r<p1) y=r*8;
+                else if(r<p1+p2) y=(r-p1)*8+4;
+                else if(r<p1+p2+p3) y=(r-p1-p2)*4+2;
+                else y=(r-p1-p2-p3)*2+1;
+            }
+            if(iy+y>=h) continue;
+            for(int x=0; x<iw && ix+x<w; x++){
+                int c=idx[(size_t)r*iw+x];
+                if(c==transparent || c>=npal) continue;
+                memcpy(canvas+((size_t)(iy+y)*w+ix+x)*3, pal+c*3, 3);
+            }
+        }
+        nframes++;
+        stop=fn(canvas, w, h, (delay<IMAGE_MINDELAY)? IMAGE_SLOWDELAY : delay, ctx);
+        if(dispose==2) for(int y=iy; y<iy+ih && y<h; y++) for(int x=ix; x<ix+iw && x<w; x++) memset(canvas+((size_t)y*w+x)*3, 0, 3);
+        if(dispose==3) memcpy(canvas, prev, (size_t)w*h*3);
+        dispose=0;
+        transparent=-1;
+        delay=0;
+    }
+    free(canvas);
+    free(prev);
+    free(idx);
+    free(data);
+    if(why!=NULL){
+        snprintf(err, errlen, "%s: %s", path, why);
+        return -1;
+    }
+    return nframes;
+}
+
+int image_load(const char *path, image_frame fn, void *ctx, int *loops, char *err, size_t errlen){
+    FILE *file=fopen(path, "rb");
+    *loops=1;
+    if(file==NULL){
+        snprintf(err, errlen, "%s: %m", path);
+        return -1;
+    }
+    unsigned char sig[8]={0};
+    size_t n=fread(sig, 1, sizeof(sig), file);
+    if(n==sizeof(sig) && png_sig_cmp(sig, 0, sizeof(sig))==0){
+        fclose(file);
+        return image_png(path, fn, ctx, err, errlen);
+    }
+    if(n<6 || (memcmp(sig, "GIF87a", 6)!=0 && memcmp(sig, "GIF89a", 6)!=0)){
+        fclose(file);
+        snprintf(err, errlen, "%s: not a PNG or GIF file", path);
+        return -1;
+    }
+    //GIFs are small enough to read whole
+    fseek(file, 0, SEEK_END);
+    long len=ftell(file);
+    unsigned char *f=(len>0)? malloc(len) : NULL;
+    rewind(file);
+    if(f==NULL || fread(f, 1, len, file)!=(size_t)len){
+        snprintf(err, errlen, "%s: can't read it", path);
+        fclose(file);
+        free(f);
+        return -1;
+    }
+    fclose(file);
+    int r=image_gif(path, f, len, fn, ctx, loops, err, errlen);
+    free(f);
+    return r;
+}
@@ -0,0 +1,27 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * Picture loading for kbledclient --image: PNG through libpng and GIF (still or animated) with the decoder here.
+ * Frames are handed out one at a time as a whole packed RGB canvas, already composited the way a browser shows
+ * them, so the caller can resample each one and throw the pixels away.
+ */
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define IMAGE_MINDELAY  20   //ms, GIF frames asking for less are shown for IMAGE_SLOWDELAY like browsers do
+#define IMAGE_SLOWDELAY 100  //ms
+#define IMAGE_MAXSIZE   8192 //widest or tallest picture accepted
+
+//called for every frame with the canvas and how long it stays up, return nonzero to stop loading
+typedef int (*image_frame)(const unsigned char *rgb, uint16_t w, uint16_t h, uint32_t ms, void *ctx);
+
+//decode path and call fn for each frame.  loops is how often an animation asks to be played, 0 for forever.
+//Returns the number of frames, -1 with err set if the file couldn't be read
+int image_load(const char *path, image_frame fn, void *ctx, int *loops, char *err, size_t errlen);
+
+#endif
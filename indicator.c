@@ -0,0 +1,138 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ * 
+ * Indicator bindings: map any kbstat() source (EV_LED or host state) to a set of keys with on/off colors
+ *
+ * kbled.conf syntax (any indicator line replaces the built-in caps/num/scroll bindings):
+ *   indicator <source> <key>[,<key>...] [on focus|backlight|<R> <G> <B>] [off focus|backlight|<R> <G> <B>]
+ * source: num, caps, scroll, compose, kana, sleep, suspend, mute, misc, mail, charging, led<0-15> or host<0-14>
+ * key: keymap.h name with or without the K_ prefix (CAPSL, NUM_LOCK, K_1...) or a numeric LED address
+ *
+ * Bindings are drawn on the daemon's indicator layer, "backlight" leaves the key off the layer so whatever is
+ * underneath (the backlight, an effect or another client's layer) shows through.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "indicator.h"
+#include "kbstatus.h"
+#include "keymap.h"
+#include "sharedmem.h"
+#include "config.h"
+
+struct indicator indicators[IND_MAX];
+uint8_t nindicators=0;
+uint32_t indicatormask=0;
+int indicatorlayer=-1;
+
+static const char *ledsources[] = {"num", "caps", "scroll", "compose", "kana", "sleep", "suspend", "mute", "misc", "mail", "charging"};
+
+static uint32_t indicator_source(const char *name){
+    for(unsigned int i=0; i<sizeof(ledsources)/sizeof(ledsources[0]); i++) if(strcasecmp(name, ledsources[i])==0) return KB_LED(i);
+    if(strncasecmp(name, "led", 3)==0 && name[3]!='\0'){
+        int n=atoi(name+3);
+        if(n>=0 && n<16) return KB_LED(n);
+    }
+    if(strncasecmp(name, "host", 4)==0 && name[4]!='\0'){
+        int n=atoi(name+4);
+        if(n>=0 && n<KB_NHOST) return KB_HOST(n);
+    }
+    return 0;
+}
+
+static int indicator_add(uint32_t mask, const uint8_t *addr, uint8_t nkeys, struct indcolor on, struct indcolor off){
+    if(nindicators>=IND_MAX) {
+        printf("Too many indicator bindings, max is %i\n", IND_MAX);
+        return 1;
+    }
+    struct indicator *ind=&indicators[nindicators];
+    ind->mask=mask;
+    ind->nkeys=0;
+    for(uint8_t i=0; i<nkeys; i++){
+        if(kblayout->keyindex[addr[i]]==LAYOUT_NOKEY) continue; //not on this keyboard layout
+        ind->addr[ind->nkeys]=addr[i];
+        ind->idx[ind->nkeys]=kblayout->keyindex[addr[i]]; //resolve the array index once here instead of on every state change
+        ind->nkeys++;
+    }
+    ind->on=on;
+    ind->off=off;
+    indicatormask |= mask;
+    nindicators++;
+    return 0;
+}
+
+static int indicator_color(int ntok, char **tok, int *pos, struct indcolor *color){
+    if(*pos>=ntok) return 1;
+    if(strcasecmp(tok[*pos], "focus")==0) color->src=IND_FOCUS;
+    else if(strcasecmp(tok[*pos], "backlight")==0) color->src=IND_BKLT;
+    else {
+        color->src=IND_RGB;
+        return config_color(ntok, tok, pos, color->rgb);
+    }
+    (*pos)++;
+    return 0;
+}
+
+static int indicator_confline(int ntok, char **tok, const char *raw, int lineno){
+    (void)raw; (void)lineno;
+    if(ntok<3) return 1;
+    uint32_t mask=indicator_source(tok[1]);
+    if(mask==0) {
+        printf("Unknown indicator source: %s\n", tok[1]);
+        return 1;
+    }
+    uint8_t addr[IND_MAXKEYS];
+    uint8_t nkeys=0;
+    char *save;
+    for(char *k=strtok_r(tok[2], ",", &save); k!=NULL; k=strtok_r(NULL, ",", &save)){
+        int a=keybyname(k);
+        if(a<0 || nkeys>=IND_MAXKEYS) {
+            printf("Bad or too many keys for indicator %s: %s\n", tok[1], k);
+            return 1;
+        }
+        addr[nkeys++]=(uint8_t)a;
+    }
+    struct indcolor on={IND_FOCUS, {0,0,0}}, off={IND_BKLT, {0,0,0}};
+    int pos=3;
+    while(pos<ntok){
+        if(strcasecmp(tok[pos], "on")==0) { pos++; if(indicator_color(ntok, tok, &pos, &on)) return 1; }
+        else if(strcasecmp(tok[pos], "off")==0) { pos++; if(indicator_color(ntok, tok, &pos, &off)) return 1; }
+        else return 1;
+    }
+    return indicator_add(mask, addr, nkeys, on, off);
+}
+
+int indicator_init(const char *conffile, char verbose){
+    nindicators=0;
+    indicatormask=0;
+    if(conffile!=NULL && config_parse(conffile, "indicator", indicator_confline)>0){
+        if(verbose) printf("Loaded %u indicator bindings from %s\n", nindicators, conffile);
+        return 0;
+    }
+    nindicators=0; //nothing usable in the configuration file, use the original caps/num/scroll lock keys
+    indicatormask=0;
+    const struct indcolor on={IND_FOCUS, {0,0,0}}, off={IND_BKLT, {0,0,0}};
+    const uint8_t caps[]={K_CAPSL, K_CAPSR}, num[]={K_NUM_LOCK}, scroll[]={K_INSERT};
+    indicator_add(CAPLOC, caps, sizeof(caps), on, off);
+    indicator_add(NUMLOC, num, sizeof(num), on, off);
+    indicator_add(SCRLOC, scroll, sizeof(scroll), on, off);
+    if(verbose) printf("Using default caps/num/scroll lock indicator bindings\n");
+    return 0;
+}
+
+void indicator_update(uint32_t state, uint32_t changed){
+    if(indicatorlayer<0) return;
+    for(uint8_t i=0; i<nindicators; i++){
+        struct indicator *ind=&indicators[i];
+        if(!(ind->mask & changed)) continue; //only touch the keys whose source changed
+        const struct indcolor *c=(state & ind->mask)? &ind->on : &ind->off;
+        const uint8_t *color = (c->src==IND_FOCUS)? shm_ptr->focus : c->rgb;
+        for(uint8_t k=0; k<ind->nkeys; k++){
+            if(c->src==IND_BKLT) sharedmem_layerclear(indicatorlayer, ind->idx[k]);
+            else sharedmem_layerkey(indicatorlayer, ind->idx[k], color);
+        }
+    }
+}
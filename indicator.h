@@ -0,0 +1,43 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ * 
+ * Indicator bindings: map any kbstat() source (EV_LED or host state) to a set of keys with on/off colors
+ */
+
+#ifndef INDICATOR_H
+#define INDICATOR_H
+
+#include <stdint.h>
+
+#define IND_MAX      32  //max number of indicator bindings
+#define IND_MAXKEYS  8   //max number of LEDs driven by one binding
+
+//where the color for an on/off state comes from
+#define IND_RGB      0  //fixed color from the binding
+#define IND_FOCUS    1  //follow the global focus color
+#define IND_BKLT     2  //show whatever is underneath (the global backlight color unless a layer or effect covers the key)
+
+struct indcolor {
+    uint8_t src;    //IND_RGB, IND_FOCUS or IND_BKLT
+    uint8_t rgb[3]; //[R,G,B] used when src==IND_RGB
+};
+
+struct indicator {
+    uint32_t mask;              //kbstat() bit driving this binding (KB_LED(n) or KB_HOST(n))
+    uint8_t nkeys;              //number of LEDs bound
+    uint8_t addr[IND_MAXKEYS];  //LED addresses
+    uint8_t idx[IND_MAXKEYS];   //allkeys[] index for each LED, resolved once when the binding is loaded
+    struct indcolor on;         //color while the source is active
+    struct indcolor off;        //color while the source is inactive
+};
+
+extern struct indicator indicators[IND_MAX];
+extern uint8_t nindicators;
+extern uint32_t indicatormask; //union of every bound source, anything outside of this is ignored
+extern int indicatorlayer; //shared memory layer the bindings are drawn on, opened by the daemon
+
+int indicator_init(const char *conffile, char verbose); //load the caps/num/scroll defaults, replaced by "indicator" lines in conffile if present
+void indicator_update(uint32_t state, uint32_t changed); //redraw bindings whose source is in changed on the indicator layer; the semaphore must be held
+
+#endif
@@ -10,6 +10,7 @@
 #include <hidapi/hidapi.h>
 #include "it829x.h"
 #include "keymap.h"
+#include "calib.h"
 
 hid_device *keyboard;  //global pointer to usb handle
 
@@ -50,13 +51,11 @@ int8_t it829x_brightspeed(uint8_t bright, uint8_t speed){
     brightspeedcmd[3]=speed;
     return it829x_send(brightspeedcmd);
 }
-int8_t it829x_setleds(uint8_t *keys, uint8_t nkeys, uint8_t *color){
+int8_t it829x_setleds(const uint8_t *keys, uint8_t nkeys, uint8_t *color){
     int retval=0;
     for(uint8_t i=0; i<nkeys; i++){
         setledcmd[2]=keys[i];
-        setledcmd[3]=color[0];
-        setledcmd[4]=color[1];
-        setledcmd[5]=color[2];
+        for(int c=0; c<3; c++) setledcmd[3+c]=calib_on? calib_apply(keys[i], c, color[c]) : color[c];
         retval+=it829x_send(setledcmd);
     }
     if(retval!=0) {
@@ -74,9 +73,7 @@ int8_t it829x_effect(int8_t mode){
 }
 int8_t it829x_setled(uint8_t key, uint8_t *color){
     setledcmd[2]=key;
-    setledcmd[3]=color[0];
-    setledcmd[4]=color[1];
-    setledcmd[5]=color[2];
+    for(int c=0; c<3; c++) setledcmd[3+c]=calib_on? calib_apply(key, c, color[c]) : color[c]; //gamma and gain go on as the report is built
     return it829x_send(setledcmd);
 }
 int8_t it829x_send(uint8_t *msg){
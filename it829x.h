@@ -37,7 +37,7 @@ int8_t it829x_close();
 int8_t it829x_reset();
 int8_t it829x_brightspeed(uint8_t bright, uint8_t speed);
 int8_t it829x_effect(int8_t mode);
-int8_t it829x_setleds(uint8_t *keys, uint8_t nkeys, uint8_t *color);
+int8_t it829x_setleds(const uint8_t *keys, uint8_t nkeys, uint8_t *color);
 int8_t it829x_setled(uint8_t key, uint8_t *color);
 int8_t it829x_send(uint8_t *msg);
 
@@ -0,0 +1,49 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * Effect plugin interface.  A plugin is a shared object exporting a struct kbled_plugin named kbled_plugin,
+ * loaded by kbled from a "plugin" line in kbled.conf and drawn inside the daemon's frame loop like the built
+ * in software effects: no process, semaphore or shared memory of its own.  Only this header is needed to
+ * build one:  gcc -O2 -fPIC -shared -o myfx.so myfx.c   (cylonfx.c is an example)
+ *
+ * Each plugin gets a time budget per frame; one that goes over it KBLED_PLUGIN_STRIKES frames in a row, or
+ * whose render() returns nonzero, is destroyed and unloaded until kbled restarts.
+ */
+
+#ifndef KBLEDPLUGIN_H
+#define KBLEDPLUGIN_H
+
+#include <stdint.h>
+
+#define KBLED_PLUGIN_ABI      1      //changes whenever a structure below does, kbled refuses other versions
+#define KBLED_PLUGIN_SYMBOL   "kbled_plugin"
+#define KBLED_PLUGIN_BUDGETUS 1000   //budget per frame when neither the plugin nor kbled.conf sets one
+#define KBLED_PLUGIN_STRIKES  3      //frames in a row over budget before the plugin is disabled
+
+//what the daemon knows about the keyboard, one entry per LED in the planes.  Valid from init() to destroy()
+struct kbled_inputs {
+    uint8_t nleds;                  //number of LEDs, frames and planes have this many entries
+    uint8_t speed;                  //effect speed 0-2 set with kbledclient -s
+    const unsigned char *bklt;      //[R,G,B] backlight color
+    const unsigned char *focus;     //[R,G,B] focus color
+    const float *x, *y;             //LED center in keys from the left and top edges
+    const float *row, *col;         //row and whole key column of the LED
+    const float *heat;              //1 when the key is pressed, fading toward 0 (EVENT builds)
+    const char *const *ledname;     //LED names from the keyboard layout
+};
+
+struct kbled_plugin {
+    uint32_t abi;         //KBLED_PLUGIN_ABI
+    const char *name;     //shown in kbled's log
+    uint32_t budgetus;    //time allowed per frame in microseconds, 0 for KBLED_PLUGIN_BUDGETUS
+    //set up when kbled loads the plugin, args is the rest of the plugin line.  Returns the state handed to
+    //render() and destroy(), NULL if the plugin can't run
+    void *(*init)(const struct kbled_inputs *in, const char *args);
+    //draw frame[led][R,G,B] for t seconds since the effect was selected, dt since the last frame.  The frame
+    //starts out in the backlight color.  Return nonzero to be disabled
+    int (*render)(void *state, unsigned char (*frame)[3], double t, double dt, const struct kbled_inputs *in);
+    void (*destroy)(void *state);
+};
+
+#endif
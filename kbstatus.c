@@ -2,7 +2,7 @@
  * https://github.com/chememjc/kbled
  * Michael Curtis 2025-01-17
  * 
- * Functions for determining caps lock, num lock and scroll lock state
+ * Functions for determining keyboard indicator (caps lock, num lock, scroll lock, compose, kana...) state
  */
 
 #include <stdio.h>
@@ -14,17 +14,22 @@
 #if defined(X11)  //***********************************************************
 #include <X11/Xlib.h> //X11 libraries for looking at capslock, scroll lock and num lock
 #include <X11/XKBlib.h>  //X11 libraries for looking at capslock, scroll lock and num lock
-uint8_t kbstat() {
+//X11 reports indicators in keymap order, so look the ones we care about up by name
+static const struct { const char *name; uint8_t led; } xindicators[] = {
+    {"Num Lock", 0}, {"Caps Lock", 1}, {"Scroll Lock", 2}, {"Compose", 3}, {"Kana", 4},
+    {"Sleep", 5}, {"Suspend", 6}, {"Mute", 7}, {"Misc", 8}, {"Mail", 9}, {"Charging", 10}
+};
+uint32_t kbstat() {
     Display *display = XOpenDisplay(NULL);
     if (!display) {
         fprintf(stderr, "Failed to open X display\n");
         return FAULT;
     }
-    unsigned int state;
-    if (XkbGetIndicatorState(display, XkbUseCoreKbd, &state) != Success) {
-        fprintf(stderr, "Failed to get keyboard state\n");
-        XCloseDisplay(display);
-        return FAULT;
+    uint32_t state=0;
+    for(unsigned int i=0; i<sizeof(xindicators)/sizeof(xindicators[0]); i++){
+        Bool on=False;
+        Atom atom=XInternAtom(display, xindicators[i].name, True);
+        if(atom!=None && XkbGetNamedIndicator(display, atom, NULL, &on, NULL, NULL) && on) state |= KB_LED(xindicators[i].led);
     }
 
     XCloseDisplay(display);
@@ -34,7 +39,7 @@ uint8_t kbstat() {
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <linux/kd.h>
-uint8_t kbstat() {
+uint32_t kbstat() {
     int fd = open("/dev/console", O_RDONLY);
     if (fd < 0) {
         printf("Error opening console, is the executing user part of the tty group?\n");
@@ -47,7 +52,8 @@ uint8_t kbstat() {
         return FAULT;
     }
     close(fd);
-    return state;  //order is different for ioctl, so return the same order as the X11 call
+    //order is different for ioctl and only the three lock keys are available, so convert to EV_LED order
+    return ((state & LED_NUM)? NUMLOC:0) | ((state & LED_CAP)? CAPLOC:0) | ((state & LED_SCR)? SCRLOC:0);
 }
 #elif defined(EVENT)  //*******************************************************
 #include <fcntl.h>
@@ -83,7 +89,7 @@ int is_keyboard(const char *device_path) {
     return strstr(name, "keyboard") != NULL;
 }
 
-uint8_t check_led_states(const char *device_path) {
+uint32_t check_led_states(const char *device_path) {
     int fd = open(device_path, O_RDONLY);
     if (fd < 0) {
         perror("Error opening input device for LED state");
@@ -102,21 +108,17 @@ uint8_t check_led_states(const char *device_path) {
     //printf("Caps Lock: %s\n", (leds & (1 << LED_CAPSL)) ? "ON" : "OFF");
     //printf("Num Lock: %s\n", (leds & (1 << LED_NUML)) ? "ON" : "OFF");
     //printf("Scroll Lock: %s\n", (leds & (1 << LED_SCROLLL)) ? "ON" : "OFF");
-    uint8_t state=0;
-    if(leds & (1 << LED_CAPSL)) state|= CAPLOC;
-    if(leds & (1 << LED_NUML)) state|= NUMLOC;
-    if(leds & (1 << LED_SCROLLL)) state|= SCRLOC;
-    return state;
-    
+    return (uint32_t)(leds & KB_LEDMASK); //EVIOCGLED is already in EV_LED order (compose, kana, mute etc. included)
+
 }
 
-uint8_t kbfind() {
+uint32_t kbfind() {
     DIR *dir = opendir(INPUT_DIR);
     if (!dir) {
         perror("Error opening /dev/input");
-        return 1;
+        return FAULT;
     }
-    uint8_t state=FAULT;
+    uint32_t state=FAULT;
 
     struct dirent *entry;
     while ((entry = readdir(dir)) != NULL) {
@@ -137,8 +139,50 @@ uint8_t kbfind() {
     fprintf(stderr, "No keyboard device found\n");
     return FAULT;
 }
-uint8_t kbstat() {
+uint32_t kbstat() {
     if(device_path[0]=='X') return kbfind();
     return check_led_states(device_path);
 }
+
+static int keyfd=-1; //kept open between calls so no key press is missed between frames
+
+int kbkeys(uint16_t *codes, int max) {
+    struct input_event ev[64];
+    ssize_t len=0;
+    int n=0;
+    if (keyfd < 0) {
+        if (device_path[0]=='X' && kbfind()==FAULT) return 0;
+        keyfd = open(device_path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (keyfd < 0) {
+            perror("Error opening input device for key presses");
+            return 0;
+        }
+    }
+    while (n < max && (len = read(keyfd, ev, sizeof(ev))) > 0) {
+        for (size_t i = 0; i < (size_t)len / sizeof(ev[0]); i++) {
+            if (ev[i].type == EV_KEY && ev[i].value == 1 && n < max) codes[n++] = ev[i].code; //value 1=press, 2=autorepeat, 0=release
+        }
+    }
+    if (len < 0 && errno != EAGAIN) { //keyboard went away, reopen next time
+        perror("Error reading key presses");
+        kbkeysclose();
+    }
+    return n;
+}
+
+void kbkeysclose() {
+    if (keyfd >= 0) close(keyfd);
+    keyfd = -1;
+}
+#endif  //*********************************************************************
+
+#if !defined(EVENT) //*********************************************************
+//X11 and the console only report indicator state, not key presses
+int kbkeys(uint16_t *codes, int max) {
+    (void)codes; (void)max;
+    return 0;
+}
+
+void kbkeysclose() {
+}
 #endif  //*********************************************************************
@@ -10,22 +10,21 @@
 
 #include <stdint.h>  //uint8_t etc. definitions
 
-#define FAULT  0x80  //fault flag
+//kbstat() returns one bit per indicator source.  Bits 0-15 follow the linux EV_LED numbering (LED_NUML, LED_CAPSL...)
+//regardless of which backend is compiled in, bits 16-30 are host states set through shared memory (see SM_HOST)
+#define KB_LED(n)   (1UL<<(n))       //bit for EV_LED code n (0-15)
+#define KB_HOST(n)  (1UL<<(16+(n)))  //bit for host state n (0-14)
+#define KB_LEDMASK  0x0000FFFFUL     //all input LED bits
+#define KB_HOSTMASK 0x7FFF0000UL     //all host state bits
+#define KB_NHOST    15               //number of host state bits
+#define FAULT       0x80000000UL     //fault flag
 
-#if defined(X11)  //***********************************************************
-#define CAPLOC 0x01
-#define NUMLOC 0x02
-#define SCRLOC 0x04
-#elif defined(IOCTL)  //*******************************************************
-#define CAPLOC 0x04
-#define NUMLOC 0x02
-#define SCRLOC 0x01
-#elif defined(EVENT)  //*******************************************************
-#define CAPLOC 0x01
-#define NUMLOC 0x02
-#define SCRLOC 0x04
-#endif
+#define NUMLOC KB_LED(0)  //LED_NUML
+#define CAPLOC KB_LED(1)  //LED_CAPSL
+#define SCRLOC KB_LED(2)  //LED_SCROLLL
 
-uint8_t kbstat();
+uint32_t kbstat();
+int kbkeys(uint16_t *codes, int max); //linux key codes (KEY_*) pressed since the last call, at most max.  Only the EVENT build sees key presses, the others return 0
+void kbkeysclose(); //stop watching for key presses until the next kbkeys()
 
 #endif
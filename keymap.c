@@ -5,18 +5,110 @@
  * basic keymap found in System76 EC firmware layout (https://github.com/system76/ec/blob/master/src/keyboard/system76/15in_102/keymap/default.c)
  * Keys with mulitple LEDs, 2x unless specified (backspace, tab, keypad plus, caps lock, enter, lshift, rshift, keypad enter, lctrl, spacebar (4x), rctrl)
  * These cases were added to address each LED individually with L and R modifiers for left and right except the space where they are numbered 1-4 from left to right
+ *
+ * layout_builtin lives in keytables.c which is generated from layouts/bonw15.layout, other layouts are loaded at startup
  */
  
  #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <sys/stat.h>
+ #include <linux/input-event-codes.h>
  #include "keymap.h"
- unsigned char allkeys[]={K_ESC, K_F1, K_F2, K_F3, K_F4, K_F5, K_F6, K_F7, K_F8, K_F9, K_F10, K_F11, K_F12, K_PRINT_SCREEN, K_INSERT, K_DEL, K_HOME, K_END, K_PGUP, K_PGDN, K_TICK, K_1, K_2, K_3, K_4, K_5, K_6, K_7, K_8, K_9, K_0, K_MINUS, K_EQUALS, K_BKSPL, K_BKSPR, K_NUM_LOCK, K_NUM_SLASH, K_NUM_ASTERISK, K_NUM_MINUS, K_TABL, K_TABR, K_Q, K_W, K_E, K_R, K_T, K_Y, K_U, K_I, K_O, K_P, K_BRACE_OPEN, K_BRACE_CLOSE, K_BACKSLASH, K_NUM_7, K_NUM_8, K_NUM_9, K_NUM_PLUST, K_CAPSL, K_CAPSR, K_A, K_S, K_D, K_F, K_G, K_H, K_J, K_K, K_L, K_SEMICOLON, K_QUOTE, K_ENTERL, K_ENTERR, K_NUM_4, K_NUM_5, K_NUM_6, K_NUM_PLUSB, K_LEFT_SHIFTL, K_LEFT_SHIFTR, K_Z, K_X, K_C, K_V, K_B, K_N, K_M, K_COMMA, K_PERIOD, K_SLASH, K_RIGHT_SHIFTL, K_RIGHT_SHIFTR, K_UP, K_NUM_1, K_NUM_2, K_NUM_3, K_NUM_ENTERT, K_LEFT_CTRLL, K_LEFT_CTRLR, KT_FN, K_LEFT_SUPER, K_LEFT_ALT, K_SPACE1, K_SPACE2, K_SPACE3, K_SPACE4, K_RIGHT_ALT, K_APP, K_RIGHT_CTRLL, K_RIGHT_CTRLR, K_LEFT, K_DOWN, K_RIGHT, K_NUM_0, K_NUM_PERIOD, K_NUM_ENTERB};
+ #include "config.h"
+
+ const struct layout *kblayout=&layout_builtin;
+ const unsigned char *allkeys=layout_builtin.addr;
+ uint8_t nkeys=NKEYS;
+ static char layoutname[256]=""; //set by the "layout" line in kbled.conf
+ static uint8_t codeled[KEYMAP_MAXCODE]; //linux key code -> LED index of the active layout, built on first use
+ static char codeledinit=0;
+
+ //linux key codes of the keys named in the layout descriptions
+ static const struct { uint16_t code; const char *name; } keycodes[] = {
+    {KEY_ESC,"ESC"}, {KEY_F1,"F1"}, {KEY_F2,"F2"}, {KEY_F3,"F3"}, {KEY_F4,"F4"}, {KEY_F5,"F5"}, {KEY_F6,"F6"},
+    {KEY_F7,"F7"}, {KEY_F8,"F8"}, {KEY_F9,"F9"}, {KEY_F10,"F10"}, {KEY_F11,"F11"}, {KEY_F12,"F12"},
+    {KEY_SYSRQ,"PRINT_SCREEN"}, {KEY_INSERT,"INSERT"}, {KEY_DELETE,"DEL"}, {KEY_HOME,"HOME"}, {KEY_END,"END"},
+    {KEY_PAGEUP,"PGUP"}, {KEY_PAGEDOWN,"PGDN"},
+    {KEY_GRAVE,"TICK"}, {KEY_1,"1"}, {KEY_2,"2"}, {KEY_3,"3"}, {KEY_4,"4"}, {KEY_5,"5"}, {KEY_6,"6"}, {KEY_7,"7"},
+    {KEY_8,"8"}, {KEY_9,"9"}, {KEY_0,"0"}, {KEY_MINUS,"MINUS"}, {KEY_EQUAL,"EQUALS"}, {KEY_BACKSPACE,"BKSP"},
+    {KEY_NUMLOCK,"NUM_LOCK"}, {KEY_KPSLASH,"NUM_SLASH"}, {KEY_KPASTERISK,"NUM_ASTERISK"}, {KEY_KPMINUS,"NUM_MINUS"},
+    {KEY_TAB,"TAB"}, {KEY_Q,"Q"}, {KEY_W,"W"}, {KEY_E,"E"}, {KEY_R,"R"}, {KEY_T,"T"}, {KEY_Y,"Y"}, {KEY_U,"U"},
+    {KEY_I,"I"}, {KEY_O,"O"}, {KEY_P,"P"}, {KEY_LEFTBRACE,"BRACE_OPEN"}, {KEY_RIGHTBRACE,"BRACE_CLOSE"},
+    {KEY_BACKSLASH,"BACKSLASH"}, {KEY_KP7,"NUM_7"}, {KEY_KP8,"NUM_8"}, {KEY_KP9,"NUM_9"}, {KEY_KPPLUS,"NUM_PLUS"},
+    {KEY_CAPSLOCK,"CAPS"}, {KEY_A,"A"}, {KEY_S,"S"}, {KEY_D,"D"}, {KEY_F,"F"}, {KEY_G,"G"}, {KEY_H,"H"}, {KEY_J,"J"},
+    {KEY_K,"K"}, {KEY_L,"L"}, {KEY_SEMICOLON,"SEMICOLON"}, {KEY_APOSTROPHE,"QUOTE"}, {KEY_ENTER,"ENTER"},
+    {KEY_KP4,"NUM_4"}, {KEY_KP5,"NUM_5"}, {KEY_KP6,"NUM_6"},
+    {KEY_LEFTSHIFT,"LEFT_SHIFT"}, {KEY_Z,"Z"}, {KEY_X,"X"}, {KEY_C,"C"}, {KEY_V,"V"}, {KEY_B,"B"}, {KEY_N,"N"},
+    {KEY_M,"M"}, {KEY_COMMA,"COMMA"}, {KEY_DOT,"PERIOD"}, {KEY_SLASH,"SLASH"}, {KEY_RIGHTSHIFT,"RIGHT_SHIFT"},
+    {KEY_UP,"UP"}, {KEY_KP1,"NUM_1"}, {KEY_KP2,"NUM_2"}, {KEY_KP3,"NUM_3"}, {KEY_KPENTER,"NUM_ENTER"},
+    {KEY_LEFTCTRL,"LEFT_CTRL"}, {KEY_FN,"FN"}, {KEY_LEFTMETA,"LEFT_SUPER"}, {KEY_LEFTALT,"LEFT_ALT"}, {KEY_SPACE,"SPACE"},
+    {KEY_RIGHTALT,"RIGHT_ALT"}, {KEY_COMPOSE,"APP"}, {KEY_RIGHTCTRL,"RIGHT_CTRL"}, {KEY_LEFT,"LEFT"}, {KEY_DOWN,"DOWN"},
+    {KEY_RIGHT,"RIGHT"}, {KEY_KP0,"NUM_0"}, {KEY_KPDOT,"NUM_PERIOD"}
+ };
  
- unsigned char findkey(unsigned char key){
-    unsigned char i=0;
-    while(i<NKEYS){
-        if(allkeys[i]==key) return i; //return array index of key
-        i++;
+ static int keymap_confline(int ntok, char **tok, const char *raw, int lineno){
+    (void)raw; (void)lineno;
+    if(ntok!=2) return 1;
+    snprintf(layoutname, sizeof(layoutname), "%s", tok[1]);
+    return 0;
+ }
+
+ int keymap_load(const char *conffile, char verbose){
+    char src[320], cache[320];
+    const struct layout *l;
+    config_parse(conffile, "layout", keymap_confline);
+    if(layoutname[0]=='\0' || strcmp(layoutname, layout_builtin.name)==0) {
+        if(verbose) printf("Using built in %s keyboard layout (%u keys)\n", layout_builtin.name, layout_builtin.nleds);
+        return 0;
+    }
+    //a bare name is looked up in LAYOUT_DIR, anything with a / is a path to a description
+    if(strchr(layoutname, '/')==NULL) snprintf(src, sizeof(src), "%s/%s.layout", LAYOUT_DIR, layoutname);
+    else snprintf(src, sizeof(src), "%s", layoutname);
+    const char *base=strrchr(src, '/');
+    snprintf(cache, sizeof(cache), "%s/%.*s.bin", LAYOUT_CACHEDIR, (int)strcspn(base+1, "."), base+1);
+    mkdir(LAYOUT_CACHEDIR, 0755); //fails harmlessly if it already exists
+    if((l=layout_load(src, cache, verbose))==NULL) {
+        printf("Could not load keyboard layout %s, using built in %s layout\n", src, layout_builtin.name);
+        return 1;
     }
+    kblayout=l;
+    allkeys=l->addr;
+    nkeys=l->nleds;
+    codeledinit=0;
+    if(verbose) printf("Using %s keyboard layout: %s (%u keys)\n", l->name, l->description, l->nleds);
+    return 0;
+ }
+ 
+ unsigned char findkey(unsigned char key){
+    unsigned char i=kblayout->keyindex[key]; //reverse table, no scan
+    if(i!=LAYOUT_NOKEY) return i; //return array index of key
     printf("Index out of range for key: %i\n",key);
     return 0;
  }
+ 
+ int keybyname(const char *name){
+    char *end;
+    if((name[0]=='K' || name[0]=='k') && name[1]=='_') name+=2; //K_ prefix is always a name, use K_1 for the '1' key
+    else {
+        long addr=strtol(name, &end, 0);
+        if(*name!='\0' && *end=='\0') return (addr>=0 && addr<=255)? (int)addr:-1; //numeric LED address
+    }
+    int i=layout_findname(kblayout, name);
+    return (i<0)? -1 : kblayout->addr[i];
+ }
+
+ int keymap_keycode(unsigned int code){
+    if(!codeledinit) {
+        memset(codeled, LAYOUT_NOKEY, sizeof(codeled));
+        for(unsigned int i=0; i<sizeof(keycodes)/sizeof(keycodes[0]); i++){
+            int g=layout_findgroup(kblayout, keycodes[i].name);
+            if(g<0 || keycodes[i].code>=KEYMAP_MAXCODE) continue; //not on this keyboard
+            const struct layout_group *grp=&kblayout->groups[g];
+            codeled[keycodes[i].code]=kblayout->groupleds[grp->first + grp->nleds/2]; //middle LED of wide keys
+        }
+        codeledinit=1;
+    }
+    if(code>=KEYMAP_MAXCODE || codeled[code]==LAYOUT_NOKEY) return -1;
+    return codeled[code];
+ }
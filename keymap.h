@@ -5,14 +5,30 @@
  * basic keymap found in System76 EC firmware layout (https://github.com/system76/ec/blob/master/src/keyboard/system76/15in_102/keymap/default.c)
  * Keys with mulitple LEDs, 2x unless specified (backspace, tab, keypad plus, caps lock, enter, lshift, rshift, keypad enter, lctrl, spacebar (4x), rctrl)
  * These cases were added to address each LED individually with L and R modifiers for left and right except the space where they are numbered 1-4 from left to right
+ *
+ * The key order, position, row/column, multi-LED grouping and neighbor tables are generated at build time from
+ * layouts/bonw15.layout by genlayout (see layout.h), the addresses below are checked against it when compiling.
+ * Other chassis are supported by loading a different layout description at startup (keymap_load()), so code should
+ * use nkeys/kblayout rather than NKEYS, which is only the size of the built in bonw15 layout.
  */
  
 #ifndef KEYMAP_H
 #define KEYMAP_H
 
-#define NKEYS 115
-extern unsigned char allkeys[NKEYS]; //array of all the keys on the keyboard
+#include <stdint.h>
+#include "layout.h"
+
+#define NKEYS 115  //number of keys in the built in bonw15 layout
+#define KB_MAXKEYS LAYOUT_MAXLEDS  //largest number of keys any layout can have
+#define KEYMAP_MAXCODE 0x200  //linux key codes below this are mapped to keys (KEY_FN is 0x1d0)
+extern const unsigned char *allkeys; //array of all the keys on the keyboard (LED addresses of the active layout)
+extern uint8_t nkeys; //number of keys in the active layout
+extern const struct layout layout_builtin; //generated from layouts/bonw15.layout
+extern const struct layout *kblayout; //active layout, geometry lookups are plain array accesses into this
+int keymap_load(const char *conffile, char verbose); //select the layout named by the "layout" line in conffile, built in bonw15 if none
 unsigned char findkey(unsigned char key);  //function to return index of each led/key
+int keybyname(const char *name);  //LED address for a key name ("CAPSL", "K_CAPSL") or number, -1 if unknown
+int keymap_keycode(unsigned int code); //LED index of the key sending linux key code (KEY_*), -1 if it isn't on the layout
 
 //      Key Name        LED Address 
 //row 1
@@ -120,6 +136,7 @@ unsigned char findkey(unsigned char key);  //function to return index of each le
 #define K_LEFT_CTRLL    160  // left of key
 #define K_LEFT_CTRLR    161  // right of key
 #define KT_FN           162
+#define K_FN            KT_FN
 #define K_LEFT_SUPER    163
 #define K_LEFT_ALT      164
 #define K_SPACE1        165  // left of key
@@ -0,0 +1,46 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ * 
+ * 128 bit key sets (one bit per LED index) with set operations, used for zones and coverage masks
+ */
+
+#ifndef KEYSET_H
+#define KEYSET_H
+
+#include <stdint.h>
+
+#define KEYSET_BITS 128  //matches LAYOUT_MAXLEDS
+
+typedef struct {
+    uint64_t w[2]; //bit i = LED index i
+} keyset;
+
+static inline void keyset_clear(keyset *s) { s->w[0]=0; s->w[1]=0; }
+static inline void keyset_add(keyset *s, unsigned int i) { s->w[i>>6] |= 1ULL<<(i&63); }
+static inline void keyset_remove(keyset *s, unsigned int i) { s->w[i>>6] &= ~(1ULL<<(i&63)); }
+static inline int keyset_has(const keyset *s, unsigned int i) { return (s->w[i>>6]>>(i&63)) & 1; }
+static inline int keyset_empty(const keyset *s) { return (s->w[0] | s->w[1])==0; }
+static inline int keyset_count(const keyset *s) { return __builtin_popcountll(s->w[0]) + __builtin_popcountll(s->w[1]); }
+static inline keyset keyset_union(keyset a, keyset b) { keyset r={{a.w[0] | b.w[0], a.w[1] | b.w[1]}}; return r; }
+static inline keyset keyset_intersect(keyset a, keyset b) { keyset r={{a.w[0] & b.w[0], a.w[1] & b.w[1]}}; return r; }
+static inline keyset keyset_diff(keyset a, keyset b) { keyset r={{a.w[0] & ~b.w[0], a.w[1] & ~b.w[1]}}; return r; }
+
+//all indices below n (n<=128)
+static inline keyset keyset_first(unsigned int n) {
+    keyset r={{n>=64? ~0ULL : (1ULL<<n)-1, n>=128? ~0ULL : (n>64? (1ULL<<(n-64))-1 : 0)}};
+    return r;
+}
+
+//iterate: for(int i=keyset_next(&s,-1); i>=0; i=keyset_next(&s,i))
+static inline int keyset_next(const keyset *s, int prev) {
+    unsigned int i=(unsigned int)(prev+1);
+    while(i<KEYSET_BITS) {
+        uint64_t w=s->w[i>>6] >> (i&63);
+        if(w) return (int)(i + __builtin_ctzll(w));
+        i=(i|63)+1; //rest of this word is empty
+    }
+    return -1;
+}
+
+#endif
@@ -0,0 +1,87 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ * 
+ * Layer compositor, see layer.h
+ */
+
+#include <stdio.h>
+#include <signal.h>
+#include <errno.h>
+#include "layer.h"
+#include "it829x.h"
+
+static keyset basedirty;                     //keys whose base color changed since the last composite
+static keyset known;                         //keys whose color on the keyboard is in shown[]
+static uint8_t shown[3][LAYOUT_MAXLEDS];     //colors last sent to the keyboard
+
+void layer_touch(uint8_t key){
+    keyset_add(&basedirty, key);
+}
+
+void layer_touchall(){
+    basedirty=keyset_first(LAYOUT_MAXLEDS);
+}
+
+void layer_invalidate(){
+    keyset_clear(&known);
+    layer_touchall();
+}
+
+int layer_reap(struct shared_data *shm){
+    int n=0;
+    for(int i=0; i<SM_MAXLAYERS; i++){
+        int32_t owner=shm->layers[i].owner;
+        if(owner!=0 && kill(owner, 0)==-1 && errno==ESRCH){
+            printf("Layer %i (%s) owner %i is gone, releasing it\n", i, shm->layers[i].name, owner);
+            sharedmem_layerclose(i);
+            n++;
+        }
+    }
+    return n;
+}
+
+int layer_composite(struct shared_data *shm, const uint8_t *addr, uint8_t nkeys){
+    int i, c, n, sent=0;
+    uint8_t order[SM_MAXLAYERS];
+    keyset dirty=basedirty;
+    //layers in drawing order, bottom first
+    for(i=0, n=0; i<SM_MAXLAYERS; i++){
+        struct sm_layer *l=&shm->layers[i];
+        dirty=keyset_union(dirty, l->dirty);
+        if(l->owner==0 || l->alpha==0 || keyset_empty(&l->cover)) continue;
+        int j=n++;
+        for(; j>0 && shm->layers[order[j-1]].priority > l->priority; j--) order[j]=order[j-1];
+        order[j]=i;
+    }
+    dirty=keyset_intersect(dirty, keyset_first(nkeys));
+    if(keyset_empty(&dirty)) return 0;
+    //only the span of keys holding dirty bits is blended, each pass is a plain loop down one color plane
+    int lo=keyset_next(&dirty, -1), hi=lo;
+    for(i=lo; i>=0; i=keyset_next(&dirty, i)) hi=i+1;
+    int16_t out[3][LAYOUT_MAXLEDS];
+    uint8_t a[LAYOUT_MAXLEDS];
+    for(c=0; c<3; c++) for(i=lo; i<hi; i++) out[c][i]=shm->key[i][c];
+    for(int k=0; k<n; k++){
+        const struct sm_layer *l=&shm->layers[order[k]];
+        for(i=lo; i<hi; i++) a[i]=keyset_has(&l->cover, i)? l->alpha : 0;
+        for(c=0; c<3; c++){
+            const uint8_t *src=l->rgb[c];
+            int16_t *dst=out[c];
+            for(i=lo; i<hi; i++) dst[i]+=((src[i]-dst[i])*a[i])/255;
+        }
+    }
+    if(it829x_init()!=0) return -1; //leave everything dirty for the next try
+    for(i=keyset_next(&dirty, -1); i>=0; i=keyset_next(&dirty, i)){
+        uint8_t rgb[3]={(uint8_t)out[0][i], (uint8_t)out[1][i], (uint8_t)out[2][i]};
+        if(keyset_has(&known, i) && rgb[0]==shown[0][i] && rgb[1]==shown[1][i] && rgb[2]==shown[2][i]) continue;
+        it829x_setled(addr[i], rgb);
+        for(c=0; c<3; c++) shown[c][i]=rgb[c];
+        keyset_add(&known, i);
+        sent++;
+    }
+    it829x_close();
+    keyset_clear(&basedirty);
+    for(i=0; i<SM_MAXLAYERS; i++) keyset_clear(&shm->layers[i].dirty);
+    return sent;
+}
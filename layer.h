@@ -0,0 +1,22 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ * 
+ * Daemon side of the layers in shared memory: blend the client layers over the base key[] colors and send the
+ * keys that changed.  Everything that changes a base color marks the key with layer_touch() instead of talking
+ * to the keyboard, layer_composite() then sends the result once per loop.
+ */
+
+#ifndef LAYER_H
+#define LAYER_H
+
+#include <stdint.h>
+#include "sharedmem.h"
+
+void layer_touch(uint8_t key);   //base color of key changed
+void layer_touchall();           //every base color changed (backlight)
+void layer_invalidate();         //the keyboard was reset, resend every key regardless of what was sent before
+int layer_reap(struct shared_data *shm); //release layers whose owner died, returns the number released.  Semaphore must be held
+int layer_composite(struct shared_data *shm, const uint8_t *addr, uint8_t nkeys); //blend and send dirty keys, returns the number sent or -1 if the keyboard couldn't be opened.  Semaphore must be held
+
+#endif
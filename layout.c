@@ -0,0 +1,276 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ * 
+ * Keyboard layout model: parse a layout description (see layouts/bonw15.layout) and build the derived tables
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "layout.h"
+
+#define LAYOUT_MAXLINE 256
+
+static int layout_addgroup(struct layout *l, const char *name){
+    for(int g=0; g<l->ngroups; g++) if(strcmp(l->groups[g].name, name)==0) return g; //key spanning rows, already known
+    if(l->ngroups>=LAYOUT_MAXGROUPS) return -1;
+    snprintf(l->groups[l->ngroups].name, LAYOUT_NAMELEN, "%s", name);
+    return l->ngroups++;
+}
+
+static int layout_addled(struct layout *l, const char *name, long addr, int group, int x, int y, int row){
+    if(l->nleds>=LAYOUT_MAXLEDS || addr<0 || addr>255) return 1;
+    uint8_t i=l->nleds++;
+    snprintf(l->ledname[i], LAYOUT_NAMELEN, "%s", name);
+    l->addr[i]=(uint8_t)addr;
+    l->x[i]=(uint16_t)x;
+    l->y[i]=(uint16_t)y;
+    l->row[i]=(uint8_t)row;
+    l->col[i]=(uint8_t)(x/LAYOUT_UNIT);
+    l->group[i]=(uint8_t)group;
+    return 0;
+}
+
+//LED index by name while parsing (byname[] isn't built yet)
+static int layout_scanname(const struct layout *l, const char *name){
+    for(int i=0; i<l->nleds; i++) if(strcasecmp(l->ledname[i], name)==0) return i;
+    return -1;
+}
+
+//zone <name> <item>[,<item>...] where item is a key name (all of its LEDs), an LED name or FIRST-LAST range of LEDs
+static int layout_addzone(struct layout *l, const char *name, char *items){
+    if(l->nzones>=LAYOUT_MAXZONES || items==NULL) return 1;
+    struct layout_zone *z=&l->zones[l->nzones];
+    snprintf(z->name, LAYOUT_NAMELEN, "%s", name);
+    keyset_clear(&z->keys);
+    char *save;
+    for(char *item=strtok_r(items, ",", &save); item!=NULL; item=strtok_r(NULL, ",", &save)){
+        char *dash=strchr(item, '-');
+        int g, first, last;
+        if(dash!=NULL) {
+            *dash='\0';
+            first=layout_scanname(l, item);
+            last=layout_scanname(l, dash+1);
+            if(first<0 || last<first) return 1;
+            for(int i=first; i<=last; i++) keyset_add(&z->keys, i);
+        }
+        else if((g=layout_findgroup(l, item))>=0) {
+            for(int i=0; i<l->nleds; i++) if(l->group[i]==g) keyset_add(&z->keys, i);
+        }
+        else if((first=layout_scanname(l, item))>=0) keyset_add(&z->keys, first);
+        else return 1;
+    }
+    l->nzones++;
+    return 0;
+}
+
+int layout_parse(const char *path, struct layout *l){
+    FILE *file=fopen(path, "r");
+    if(file==NULL) {
+        perror("layout_parse: fopen");
+        return 1;
+    }
+    char line[LAYOUT_MAXLINE];
+    int lineno=0, row=-1, x=0, err=0;
+    memset(l, 0, sizeof(*l));
+
+    while(!err && fgets(line, sizeof(line), file)){
+        lineno++;
+        line[strcspn(line, "#\r\n")]='\0';
+        char *key=strtok(line, " \t");
+        if(key==NULL) continue; //blank or comment
+        if(strcmp(key, "layout")==0){
+            char *name=strtok(NULL, " \t");
+            char *desc=strtok(NULL, "");
+            if(name==NULL) { err=1; break; }
+            snprintf(l->name, sizeof(l->name), "%s", name);
+            while(desc!=NULL && isspace((unsigned char)*desc)) desc++;
+            snprintf(l->description, sizeof(l->description), "%s", desc? desc:"");
+            continue;
+        }
+        if(strcmp(key, "row")==0) {
+            row++;
+            x=0;
+            continue;
+        }
+        char *leds=strtok(NULL, " \t");
+        if(strcmp(key, "zone")==0) {
+            if(leds==NULL || layout_addzone(l, leds, strtok(NULL, " \t"))) err=1;
+            continue;
+        }
+        if(strcmp(key, "gap")==0) {
+            if(leds==NULL) { err=1; break; }
+            x+=(int)(atof(leds)*LAYOUT_UNIT+0.5);
+            continue;
+        }
+        char *width=strtok(NULL, " \t");
+        if(row<0 || leds==NULL || width==NULL) { err=1; break; }
+        int w=(int)(atof(width)*LAYOUT_UNIT+0.5);
+        int g=layout_addgroup(l, key);
+        if(g<0 || w<=0) { err=1; break; }
+
+        //count the LEDs first so they can be spread evenly across the key
+        int n=1;
+        for(char *c=leds; *c; c++) if(*c==',') n++;
+        int j=0;
+        char *save;
+        for(char *led=strtok_r(leds, ",", &save); led!=NULL && !err; led=strtok_r(NULL, ",", &save), j++){
+            char *eq=strchr(led, '=');
+            const char *name=key;
+            char *end;
+            if(eq!=NULL) { *eq='\0'; name=led; led=eq+1; }
+            long addr=strtol(led, &end, 0);
+            if(*end!='\0' || layout_addled(l, name, addr, g, x+w*(2*j+1)/(2*n), row*LAYOUT_UNIT+LAYOUT_UNIT/2, row)) err=1;
+        }
+        x+=w;
+    }
+    fclose(file);
+    if(err || l->nleds==0) {
+        fprintf(stderr, "%s:%i: bad layout description\n", path, lineno);
+        return 1;
+    }
+    l->nrows=(uint8_t)(row+1);
+    layout_build(l);
+    return 0;
+}
+
+static const struct layout *sortlayout; //qsort has no context pointer
+static int layout_namecmp(const void *a, const void *b){
+    return strcasecmp(sortlayout->ledname[*(const uint8_t *)a], sortlayout->ledname[*(const uint8_t *)b]);
+}
+
+void layout_build(struct layout *l){
+    int i, j, k;
+    memset(l->keyindex, LAYOUT_NOKEY, sizeof(l->keyindex));
+    l->ncols=0;
+    for(i=0; i<l->nleds; i++){
+        l->keyindex[l->addr[i]]=(uint8_t)i;
+        if(l->col[i]+1>l->ncols) l->ncols=l->col[i]+1;
+        l->byname[i]=(uint8_t)i;
+    }
+    sortlayout=l;
+    qsort(l->byname, l->nleds, 1, layout_namecmp);
+
+    //LED lists for each logical key, kept contiguous so a key is just (first, nleds)
+    k=0;
+    for(j=0; j<l->ngroups; j++){
+        l->groups[j].first=(uint8_t)k;
+        l->groups[j].nleds=0;
+        for(i=0; i<l->nleds; i++) if(l->group[i]==j) {
+            l->groupleds[k++]=(uint8_t)i;
+            l->groups[j].nleds++;
+        }
+    }
+
+    //nearest neighbors by insertion into a short sorted list, squared distance avoids needing sqrt
+    for(i=0; i<l->nleds; i++){
+        long dist[LAYOUT_MAXNEIGH];
+        uint8_t n=0;
+        for(j=0; j<l->nleds; j++){
+            if(j==i) continue;
+            long dx=(long)l->x[j]-l->x[i], dy=(long)l->y[j]-l->y[i];
+            long d=dx*dx+dy*dy;
+            if(d>(long)LAYOUT_NEIGHDIST*LAYOUT_NEIGHDIST) continue;
+            if(n==LAYOUT_MAXNEIGH && d>=dist[n-1]) continue;
+            k=(n<LAYOUT_MAXNEIGH)? n++ : n-1;
+            while(k>0 && dist[k-1]>d) {
+                dist[k]=dist[k-1];
+                l->neigh[i][k]=l->neigh[i][k-1];
+                k--;
+            }
+            dist[k]=d;
+            l->neigh[i][k]=(uint8_t)j;
+        }
+        l->nneigh[i]=n;
+    }
+}
+
+int layout_findgroup(const struct layout *l, const char *name){
+    for(int g=0; g<l->ngroups; g++) if(strcasecmp(l->groups[g].name, name)==0) return g;
+    return -1;
+}
+
+int layout_findname(const struct layout *l, const char *name){
+    int lo=0, hi=l->nleds-1;
+    while(lo<=hi){
+        int mid=(lo+hi)/2;
+        int c=strcasecmp(name, l->ledname[l->byname[mid]]);
+        if(c==0) return l->byname[mid];
+        if(c<0) hi=mid-1;
+        else lo=mid+1;
+    }
+    return -1;
+}
+
+static int64_t layout_mtime(const struct stat *st){
+    return (int64_t)st->st_mtim.tv_sec*1000000000LL + st->st_mtim.tv_nsec;
+}
+
+//map a compiled layout if it was built from the same version of the description, NULL if it is missing or stale
+static const struct layout *layout_mapcache(const char *cache, const struct stat *src){
+    int fd=open(cache, O_RDONLY);
+    if(fd<0) return NULL;
+    struct stat st;
+    size_t size=sizeof(struct layout_cachehdr)+sizeof(struct layout);
+    if(fstat(fd, &st)!=0 || (size_t)st.st_size!=size) {
+        close(fd);
+        return NULL;
+    }
+    void *map=mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); //the mapping stays valid after close
+    if(map==MAP_FAILED) return NULL;
+    const struct layout_cachehdr *hdr=map;
+    if(hdr->magic!=LAYOUT_MAGIC || hdr->version!=LAYOUT_VERSION || hdr->size!=sizeof(struct layout) ||
+       hdr->srcmtime!=layout_mtime(src) || hdr->srcsize!=(int64_t)src->st_size) {
+        munmap(map, size);
+        return NULL;
+    }
+    return (const struct layout *)(hdr+1);
+}
+
+static int layout_writecache(const char *cache, const struct stat *src, const struct layout *l){
+    char tmp[256];
+    struct layout_cachehdr hdr={LAYOUT_MAGIC, LAYOUT_VERSION, sizeof(struct layout), layout_mtime(src), (int64_t)src->st_size};
+    snprintf(tmp, sizeof(tmp), "%s.tmp", cache);
+    int fd=open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd<0) return 1;
+    int bad = write(fd, &hdr, sizeof(hdr))!=(ssize_t)sizeof(hdr) || write(fd, l, sizeof(*l))!=(ssize_t)sizeof(*l);
+    close(fd);
+    if(bad || rename(tmp, cache)!=0) { //rename so a reader never maps a half written file
+        unlink(tmp);
+        return 1;
+    }
+    return 0;
+}
+
+const struct layout *layout_load(const char *src, const char *cache, char verbose){
+    struct stat st;
+    if(stat(src, &st)!=0) {
+        perror("layout_load: stat");
+        return NULL;
+    }
+    const struct layout *l=layout_mapcache(cache, &st);
+    if(l!=NULL) {
+        if(verbose) printf("Mapped compiled layout %s from %s\n", l->name, cache);
+        return l;
+    }
+    struct layout *parsed=malloc(sizeof(struct layout));
+    if(parsed==NULL || layout_parse(src, parsed)!=0) {
+        free(parsed);
+        return NULL;
+    }
+    if(verbose) printf("Parsed layout %s (%u LEDs) from %s\n", parsed->name, parsed->nleds, src);
+    if(layout_writecache(cache, &st, parsed)!=0) printf("Could not write layout cache %s, parsing again next start\n", cache);
+    else if((l=layout_mapcache(cache, &st))!=NULL) {
+        free(parsed);
+        return l;
+    }
+    return parsed;
+}
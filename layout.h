@@ -0,0 +1,80 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ * 
+ * Keyboard layout model: LED addresses, physical position, row/column, logical key groups and neighbors
+ * built from a layout description (see layouts/bonw15.layout).  Everything is stored in fixed size arrays
+ * so the tables can be emitted as C source, copied into shared memory or written to a cache file and mmapped.
+ */
+
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <stdint.h>
+#include "keyset.h"
+
+#define LAYOUT_MAXLEDS   128  //max number of LEDs in a layout
+#define LAYOUT_MAXGROUPS 128  //max number of logical keys in a layout
+#define LAYOUT_MAXNEIGH  8    //max number of neighbors stored per LED
+#define LAYOUT_MAXZONES  32   //max number of named zones in a layout
+#define LAYOUT_NAMELEN   16   //max length of key/LED names including the terminator
+#define LAYOUT_UNIT      100  //coordinate units per key width/row height
+#define LAYOUT_NEIGHDIST 160  //LEDs closer than this (center to center, coordinate units) are neighbors
+#define LAYOUT_NOKEY     0xFF //keyindex[] entry for an address not on the keyboard
+
+#define LAYOUT_DIR       "/usr/share/kbled/layouts"  //installed layout descriptions (<name>.layout)
+#define LAYOUT_CACHEDIR  "/var/cache/kbled"          //compiled layouts (<name>.bin)
+#define LAYOUT_MAGIC     0x54594c4244424b4bULL       //"KBKDBLYT" cache file signature
+#define LAYOUT_VERSION   2                           //bump when struct layout changes
+
+struct layout_group {
+    char name[LAYOUT_NAMELEN]; //logical key name (BKSP, SPACE...)
+    uint8_t first;             //first entry in groupleds[]
+    uint8_t nleds;             //number of LEDs making up the key
+};
+
+struct layout_zone {
+    char name[LAYOUT_NAMELEN]; //zone name (numpad, frow...)
+    keyset keys;               //LED indices in the zone
+};
+
+struct layout {
+    char name[LAYOUT_NAMELEN];                      //short name of the layout (bonw15)
+    char description[64];                           //human readable description
+    uint8_t nleds;                                  //number of LEDs
+    uint8_t ngroups;                                //number of logical keys
+    uint8_t nrows;                                  //number of rows
+    uint8_t nzones;                                 //number of named zones
+    uint8_t ncols;                                  //number of whole key columns spanned by the layout
+    uint8_t addr[LAYOUT_MAXLEDS];                   //LED address sent to the controller, index order = allkeys[] order
+    char ledname[LAYOUT_MAXLEDS][LAYOUT_NAMELEN];   //LED name (keymap.h name without K_)
+    uint16_t x[LAYOUT_MAXLEDS];                     //LED center, LAYOUT_UNIT per key from the left edge
+    uint16_t y[LAYOUT_MAXLEDS];                     //LED center, LAYOUT_UNIT per row from the top edge
+    uint8_t row[LAYOUT_MAXLEDS];                    //row number (0=top)
+    uint8_t col[LAYOUT_MAXLEDS];                    //whole key column the LED center falls in
+    uint8_t group[LAYOUT_MAXLEDS];                  //logical key each LED belongs to
+    uint8_t keyindex[256];                          //LED address -> index, LAYOUT_NOKEY if not present
+    uint8_t byname[LAYOUT_MAXLEDS];                 //LED indices sorted by ledname for binary search
+    struct layout_group groups[LAYOUT_MAXGROUPS];   //logical keys
+    uint8_t groupleds[LAYOUT_MAXLEDS];              //LED indices of each group, contiguous per group
+    uint8_t nneigh[LAYOUT_MAXLEDS];                 //number of neighbors of each LED
+    uint8_t neigh[LAYOUT_MAXLEDS][LAYOUT_MAXNEIGH]; //neighbors of each LED, nearest first
+    struct layout_zone zones[LAYOUT_MAXZONES];      //named groups of keys from "zone" lines
+};
+
+//header of a compiled layout cache file, followed directly by struct layout
+struct layout_cachehdr {
+    uint64_t magic;     //LAYOUT_MAGIC
+    uint32_t version;   //LAYOUT_VERSION
+    uint32_t size;      //sizeof(struct layout)
+    int64_t srcmtime;   //modification time (ns) of the description the cache was built from
+    int64_t srcsize;    //size of the description the cache was built from
+};
+
+int layout_parse(const char *path, struct layout *l); //read a layout description and build all derived tables, 0 on success
+void layout_build(struct layout *l);                   //(re)build keyindex, byname, groups and neighbors from the per-LED data
+int layout_findname(const struct layout *l, const char *name); //LED index for a name (case insensitive), -1 if not found
+int layout_findgroup(const struct layout *l, const char *name); //logical key index for a name (case insensitive), -1 if not found
+const struct layout *layout_load(const char *src, const char *cache, char verbose); //mmap cache if it matches src, otherwise parse src and rewrite cache.  NULL on failure
+
+#endif
@@ -0,0 +1,158 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * rtnetlink interface statistics, see netstat.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <net/if.h>  //before the linux headers so they leave out what it defines
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
+#include <linux/wireless.h>
+#include "netstat.h"
+
+static double netstat_seconds(struct timespec a, struct timespec b){
+    return (b.tv_sec-a.tv_sec) + (b.tv_nsec-a.tv_nsec)/1e9;
+}
+
+//link speed in Mbps: sysfs for wired links (-1 when wireless or down), then the wireless bit rate, then a guess
+static float netstat_speed(struct netstat *n, const struct netif *i){
+    char path[64], buf[32];
+    long mbps=-1;
+    snprintf(path, sizeof(path), "/sys/class/net/%s/speed", i->name);
+    int fd=open(path, O_RDONLY | O_CLOEXEC);
+    if(fd>=0){
+        ssize_t len=read(fd, buf, sizeof(buf)-1);
+        if(len>0){
+            buf[len]='\0';
+            mbps=strtol(buf, NULL, 10);
+        }
+        close(fd);
+    }
+    if(mbps>0) return (float)mbps;
+    struct iwreq wrq;
+    memset(&wrq, 0, sizeof(wrq));
+    memcpy(wrq.ifr_name, i->name, IFNAMSIZ); //both IFNAMSIZ, name is terminated
+    if(n->iw>=0 && ioctl(n->iw, SIOCGIWRATE, &wrq)==0 && wrq.u.bitrate.value>0) return (float)wrq.u.bitrate.value/1e6f;
+    return NETSTAT_DEFAULTMBPS;
+}
+
+int netstat_open(struct netstat *n){
+    struct sockaddr_nl local={.nl_family=AF_NETLINK};
+    n->nif=0;
+    n->seq=0;
+    n->iw=socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    n->fd=socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if(n->fd<0 || bind(n->fd, (struct sockaddr *)&local, sizeof(local))!=0){
+        perror("netlink");
+        netstat_close(n);
+        return -1;
+    }
+    return 0;
+}
+
+void netstat_close(struct netstat *n){
+    if(n->fd>=0) close(n->fd);
+    if(n->iw>=0) close(n->iw);
+    n->fd=-1;
+    n->iw=-1;
+}
+
+//ask for one interface's statistics and read them out of the reply, 0 on success
+static int netstat_query(struct netstat *n, struct netif *i, uint64_t *rx, uint64_t *tx){
+    struct {
+        struct nlmsghdr nh;
+        struct ifinfomsg ifi;
+    } req;
+    memset(&req, 0, sizeof(req));
+    req.nh.nlmsg_len=NLMSG_LENGTH(sizeof(struct ifinfomsg));
+    req.nh.nlmsg_type=RTM_GETLINK;
+    req.nh.nlmsg_flags=NLM_F_REQUEST;
+    req.nh.nlmsg_seq=++n->seq;
+    req.ifi.ifi_family=AF_UNSPEC;
+    req.ifi.ifi_index=i->index;
+    if(send(n->fd, &req, req.nh.nlmsg_len, 0)<0) return -1;
+    for(;;){ //skip anything left over from an earlier request
+        ssize_t len=recv(n->fd, n->buf, sizeof(n->buf), 0);
+        if(len<=0) return -1;
+        for(struct nlmsghdr *h=(struct nlmsghdr *)n->buf; NLMSG_OK(h, (size_t)len); h=NLMSG_NEXT(h, len)){
+            if(h->nlmsg_seq!=n->seq) continue;
+            if(h->nlmsg_type==NLMSG_ERROR || h->nlmsg_type!=RTM_NEWLINK) return -1;
+            struct ifinfomsg *ifi=NLMSG_DATA(h);
+            int alen=IFLA_PAYLOAD(h);
+            for(struct rtattr *a=IFLA_RTA(ifi); RTA_OK(a, alen); a=RTA_NEXT(a, alen)){
+                if(a->rta_type==IFLA_STATS64 && RTA_PAYLOAD(a)>=sizeof(struct rtnl_link_stats64)){
+                    struct rtnl_link_stats64 s;
+                    memcpy(&s, RTA_DATA(a), sizeof(s)); //attributes are only 4 byte aligned
+                    *rx=s.rx_bytes;
+                    *tx=s.tx_bytes;
+                    return 0;
+                }
+            }
+            return -1;
+        }
+    }
+}
+
+int netstat_add(struct netstat *n, const char *name, float mbps){
+    if(n->nif>=NETSTAT_MAXIF){
+        printf("Only %i network interfaces can be shown, %s ignored\n", NETSTAT_MAXIF, name);
+        return -1;
+    }
+    struct netif *i=&n->ifs[n->nif];
+    memset(i, 0, sizeof(*i));
+    snprintf(i->name, sizeof(i->name), "%s", name);
+    i->index=(int)if_nametoindex(name);
+    if(i->index==0){
+        printf("No network interface %s\n", name);
+        return -1;
+    }
+    i->fixedmbps=mbps;
+    i->mbps= (mbps>0.0f)? mbps : netstat_speed(n, i);
+    clock_gettime(CLOCK_MONOTONIC, &i->speedt);
+    return n->nif++;
+}
+
+int netstat_sample(struct netstat *n){
+    int fail=0;
+    for(int k=0; k<n->nif; k++){
+        struct netif *i=&n->ifs[k];
+        uint64_t rx, tx;
+        struct timespec now;
+        if(netstat_query(n, i, &rx, &tx)!=0){
+            i->rxmbps=i->txmbps=0.0f;
+            fail=-1;
+            continue;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double dt=netstat_seconds(i->t, now);
+        if(i->valid && dt>0.0) {
+            //counters that went backwards (interface reset) read as idle for one sample
+            i->rxmbps= (rx>=i->rx)? (float)((rx-i->rx)*8/dt/1e6) : 0.0f;
+            i->txmbps= (tx>=i->tx)? (float)((tx-i->tx)*8/dt/1e6) : 0.0f;
+        }
+        i->rx=rx;
+        i->tx=tx;
+        i->t=now;
+        i->valid=1;
+        if(i->fixedmbps<=0.0f && netstat_seconds(i->speedt, now)*1000.0>=NETSTAT_SPEEDMS){ //wireless rates move around
+            i->mbps=netstat_speed(n, i);
+            i->speedt=now;
+        }
+    }
+    return fail;
+}
+
+float netstat_load(const struct netif *i, int dir){
+    float mbps= (dir==1)? i->rxmbps : (dir==2)? i->txmbps : (i->rxmbps>i->txmbps)? i->rxmbps : i->txmbps;
+    float load=mbps/i->mbps;
+    return (load>1.0f)? 1.0f : load;
+}
@@ -0,0 +1,51 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * Network interface rates for kbledpsmon.  The 64 bit byte counters of each interface come from an RTM_GETLINK
+ * request for just that interface on a netlink socket opened once, the rates are worked out against CLOCK_MONOTONIC
+ * so they are right at any update period.  The link speed comes from /sys/class/net/<if>/speed for wired links or
+ * the wireless bit rate, and is checked again every NETSTAT_SPEEDMS.
+ */
+
+#ifndef NETSTAT_H
+#define NETSTAT_H
+
+#include <stdint.h>
+#include <time.h>
+#include <net/if.h>
+
+#define NETSTAT_MAXIF       8        //interfaces watched at once
+#define NETSTAT_BUF         16384    //netlink reply buffer, a link with everything reported fits easily
+#define NETSTAT_SPEEDMS     5000     //how often the link speed is checked again
+#define NETSTAT_DEFAULTMBPS 1000.0f  //link speed used when neither sysfs nor the wireless rate has one
+
+struct netif {
+    char name[IF_NAMESIZE];
+    int index;               //interface index the requests ask for
+    float fixedmbps;         //link speed from the command line, 0 to look it up
+    float mbps;              //link speed in use
+    uint64_t rx, tx;         //byte counters at the last sample
+    struct timespec t;       //time of the last sample
+    struct timespec speedt;  //time the link speed was last looked up
+    int valid;               //counters have been read once
+    float rxmbps, txmbps;    //rates over the last interval in megabits per second
+};
+
+struct netstat {
+    int fd;                  //NETLINK_ROUTE socket
+    int iw;                  //datagram socket for the wireless rate ioctl
+    uint32_t seq;            //sequence number of the last request
+    int nif;
+    struct netif ifs[NETSTAT_MAXIF];
+    char buf[NETSTAT_BUF] __attribute__((aligned(8)));
+};
+
+int netstat_open(struct netstat *n);   //0 on success
+void netstat_close(struct netstat *n);
+//watch interface name, mbps is its link speed or 0 to look it up.  Returns its index in ifs[] or -1
+int netstat_add(struct netstat *n, const char *name, float mbps);
+int netstat_sample(struct netstat *n); //update the rates of every interface, 0 on success
+float netstat_load(const struct netif *i, int dir); //share of the link speed in use 0-1: dir 0 the busier way, 1 rx, 2 tx
+
+#endif
@@ -0,0 +1,145 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * Notifications with a timer wheel, see notify.h
+ */
+
+#include <stdio.h>
+#include "notify.h"
+
+struct notification {
+    struct sm_notify n;
+    uint64_t start;     //ms it started, orders equal priorities and phases the pattern
+    uint32_t rounds;    //wheel revolutions left before it expires
+    int8_t next;        //next notification in the same wheel slot, -1 at the end
+    uint8_t used;
+};
+
+static struct notification active[NOTIFY_MAX];
+static int8_t wheel[NOTIFY_WHEEL];  //head of each slot's list, -1 when empty
+static uint32_t cur;                //slot of the last tick processed
+static uint64_t wheelms;            //time of the last tick processed
+static int layer=-1;                //notify layer in shared memory
+static uint8_t changed;             //a notification started or expired since the last draw
+
+void notify_init(int l, uint64_t nowms){
+    layer=l;
+    for(int i=0; i<NOTIFY_WHEEL; i++) wheel[i]=-1;
+    for(int i=0; i<NOTIFY_MAX; i++) active[i].used=0;
+    cur=0;
+    wheelms=nowms;
+    changed=0;
+}
+
+static void unlink_slot(int i){
+    uint32_t slot;
+    for(slot=0; slot<NOTIFY_WHEEL; slot++){
+        for(int8_t *p=&wheel[slot]; *p>=0; p=&active[*p].next){
+            if(*p==i){
+                *p=active[i].next;
+                return;
+            }
+        }
+    }
+}
+
+int notify_add(const struct sm_notify *n, uint64_t nowms){
+    int i, slot=-1;
+    if(n->pattern>SM_NOTIFY_MAX || keyset_empty(&n->keys)) return -1;
+    for(i=0; i<NOTIFY_MAX && slot<0; i++) if(!active[i].used) slot=i;
+    if(slot<0){ //full, replace the oldest of the lowest priority if the new one is at least as important
+        for(i=0; i<NOTIFY_MAX; i++){
+            if(slot<0 || active[i].n.priority<active[slot].n.priority ||
+                (active[i].n.priority==active[slot].n.priority && active[i].start<active[slot].start)) slot=i;
+        }
+        if(active[slot].n.priority>n->priority) return -1;
+        unlink_slot(slot);
+    }
+    struct notification *a=&active[slot];
+    //ticks from the last one processed, rounded up so it never ends early
+    uint64_t ticks=(nowms-wheelms+n->ms+NOTIFY_TICKMS-1)/NOTIFY_TICKMS;
+    if(ticks==0) ticks=1;
+    uint32_t s=(cur+ticks)%NOTIFY_WHEEL;
+    a->n=*n;
+    a->start=nowms;
+    a->rounds=(ticks-1)/NOTIFY_WHEEL;
+    a->used=1;
+    a->next=wheel[s];
+    wheel[s]=slot;
+    changed=1;
+    return slot;
+}
+
+int notify_expire(uint64_t nowms){
+    int n=0;
+    while(wheelms+NOTIFY_TICKMS<=nowms){
+        wheelms+=NOTIFY_TICKMS;
+        cur=(cur+1)%NOTIFY_WHEEL;
+        for(int8_t *p=&wheel[cur]; *p>=0; ){
+            struct notification *a=&active[*p];
+            if(a->rounds>0){
+                a->rounds--;
+                p=&a->next;
+                continue;
+            }
+            a->used=0;
+            *p=a->next;
+            n++;
+        }
+    }
+    if(n) changed=1;
+    return n;
+}
+
+//color of a notification at nowms, 0 if it is in the off half of a blink
+static int color(const struct notification *a, uint64_t nowms, unsigned char *rgb){
+    uint32_t phase, level=255;
+    switch(a->n.pattern){
+        case SM_NOTIFY_BLINK:
+            if((nowms-a->start)%NOTIFY_BLINKMS >= NOTIFY_BLINKMS/2) return 0;
+            break;
+        case SM_NOTIFY_PULSE: //triangle from the color down to black and back
+            phase=(nowms-a->start)%NOTIFY_PULSEMS;
+            level=(phase<NOTIFY_PULSEMS/2)? 255-phase*510/NOTIFY_PULSEMS : (phase-NOTIFY_PULSEMS/2)*510/NOTIFY_PULSEMS;
+            if(level>255) level=255;
+            break;
+    }
+    for(int c=0; c<3; c++) rgb[c]=a->n.rgb[c]*level/255;
+    return 1;
+}
+
+void notify_draw(uint64_t nowms){
+    int i, k;
+    if(layer<0 || (!changed && !notify_animating())) return;
+    keyset lit;
+    unsigned char rgb[LAYOUT_MAXLEDS][3];
+    int8_t owner[LAYOUT_MAXLEDS]; //notification showing on each key
+    keyset_clear(&lit);
+    for(i=0; i<NOTIFY_MAX; i++){
+        const struct notification *a=&active[i];
+        if(!a->used) continue;
+        for(k=keyset_next(&a->n.keys, -1); k>=0; k=keyset_next(&a->n.keys, k)){
+            if(keyset_has(&lit, k)){
+                const struct notification *b=&active[owner[k]];
+                if(b->n.priority>a->n.priority || (b->n.priority==a->n.priority && b->start>a->start)) continue;
+            }
+            keyset_add(&lit, k);
+            owner[k]=i;
+        }
+    }
+    //layerkey() only marks keys whose color changed, so steady notifications cost nothing to redraw
+    keyset cover=shm_ptr->layers[layer].cover;
+    for(k=keyset_next(&lit, -1); k>=0; k=keyset_next(&lit, k)){
+        if(color(&active[owner[k]], nowms, rgb[k])) sharedmem_layerkey(layer, k, rgb[k]);
+        else sharedmem_layerclear(layer, k);
+    }
+    cover=keyset_diff(cover, lit); //expired, the keys underneath show again
+    for(k=keyset_next(&cover, -1); k>=0; k=keyset_next(&cover, k)) sharedmem_layerclear(layer, k);
+    changed=0;
+}
+
+int notify_animating(){
+    for(int i=0; i<NOTIFY_MAX; i++) if(active[i].used && active[i].n.pattern!=SM_NOTIFY_SOLID) return 1;
+    return 0;
+}
@@ -0,0 +1,28 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * Daemon side of the notifications: the ones clients queue in shared memory are drawn on the daemon's notify
+ * layer until they expire.  Expiry runs off a timer wheel so a pass only looks at the notifications due in the
+ * ticks that went by, clearing a notification from the layer shows whatever is underneath again.
+ */
+
+#ifndef NOTIFY_H
+#define NOTIFY_H
+
+#include <stdint.h>
+#include "sharedmem.h"
+
+#define NOTIFY_MAX 16        //notifications showing at once, the oldest of the lowest priority makes way for a new one
+#define NOTIFY_TICKMS 10     //timer wheel resolution in ms
+#define NOTIFY_WHEEL 256     //timer wheel slots, longer notifications go around more than once
+#define NOTIFY_BLINKMS 500   //blink period in ms
+#define NOTIFY_PULSEMS 1500  //pulse period in ms
+
+void notify_init(int layer, uint64_t nowms); //draw on layer, clock in ms
+int notify_add(const struct sm_notify *n, uint64_t nowms); //start showing a notification, returns the slot or -1 if it was dropped
+int notify_expire(uint64_t nowms); //advance the wheel to nowms and drop what expired, returns the number dropped
+void notify_draw(uint64_t nowms); //redraw the notify layer for nowms.  Semaphore must be held
+int notify_animating(); //1 while a blinking or pulsing notification needs redrawing every frame
+
+#endif
@@ -28,6 +28,8 @@ util_dir="$src_dir/utils"
 bin_dir="/usr/bin"
 systemd_dir="/etc/systemd/system"
 config_dir="/etc"
+layout_dir="/usr/share/kbled/layouts"
+plugin_dir="/usr/lib/kbled"
 debian_dir="/DEBIAN"
 depends=$(cat "$script_dir/dependencies")
 # Define multiple extensions to look for in util_dir
@@ -72,8 +74,8 @@ fi
 #Copy all executable files into the staged usr/bin
 for file in "$src_dir"/*; do
   # Check if the file is executable
-  if [ -x "$file" ] && [ -f "$file" ]; then
-    # Copy the executable file to the destination directory
+  if [ -x "$file" ] && [ -f "$file" ] && [[ "$file" != *.so ]]; then
+    # Copy the executable file to the destination directory (plugins go to plugin_dir below)
     cp "$file" "$origin_dir/$bin_dir"
     echo "Added: $file to $bin_dir"
   fi
@@ -125,6 +127,16 @@ if [ config != "" ]; then
     echo "Copied $config to $config_dir"
 fi
 
+#Copy the keyboard layout descriptions
+mkdir -p "$origin_dir$layout_dir"
+cp "$src_dir"/layouts/*.layout "$origin_dir$layout_dir"
+echo "Copied keyboard layouts to $layout_dir"
+
+#Copy the effect plugins
+mkdir -p "$origin_dir$plugin_dir"
+cp "$src_dir"/*.so "$origin_dir$plugin_dir"
+echo "Copied effect plugins to $plugin_dir"
+
 #Add the files to the DEBIAN directory
 echo "Source: $name" > "$origin_dir$debian_dir/control"
 echo "Package: $name" >> "$origin_dir$debian_dir/control"
@@ -0,0 +1,203 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * kbledprocmon - light keys while chosen programs run and blink them when they exit
+ *   kbledprocmon --while "make|cc1|cc1plus|ld" frow 255 160 0 --exit "sshd|nginx" ESC 255 0 0
+ * Follows process fork, exec and exit events from the kernel's proc connector (needs root) rather than scanning
+ * /proc, sleeping until something happens and only touching the keys of a rule whose count went to or from zero.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include "sharedmem.h"
+#include "zone.h"
+#include "procwatch.h"
+
+#define PROCMON_WHILE 0  //rule lights its zone while a matching process is alive
+#define PROCMON_EXIT  1  //rule blinks its zone when a matching process exits
+
+struct procrule {
+    int kind;            //PROCMON_WHILE or PROCMON_EXIT
+    const char *names;   //program names as given
+    const char *zone;    //zone expression
+    keyset keys;
+    unsigned char rgb[3];
+};
+
+volatile sig_atomic_t stop = 0;
+
+void handle_stop(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+void print_usage(char *programname) {
+    fprintf(stderr, "Usage: %s [parameters...]\n", programname);
+    fprintf(stderr, "Example: %s --while \"make|cc1|cc1plus|ld\" frow 255 160 0 --exit sshd ESC 255 0 0\n", programname);
+    fprintf(stderr, " Parameter:                    Description:\n");
+    fprintf(stderr, " --while <names> <zone> <Red> <Grn> <Blu>  Light a zone while any of the programs runs, later rules are drawn on top\n");
+    fprintf(stderr, " --exit <names> <zone> <Red> <Grn> <Blu>   Blink a zone when one of the programs exits\n");
+    fprintf(stderr, " --flash <ms>                  How long an --exit zone blinks (100 to 65535 ms)  Default=2000 ms\n");
+    fprintf(stderr, " --priority <0-255>            Layer priority, higher is drawn on top  Default=%i\n", SM_PRIO_DASHBOARD);
+    fprintf(stderr, " -v                            Verbose output, every rule change\n");
+    fprintf(stderr, " --selftest                    Check the process counting against a child of this process and exit\n");
+    fprintf(stderr, " -h or --help                  Display this message\n");
+    fprintf(stderr, " Where <names> are program names joined by |, name* matches the start of a name and a name with a / the\n");
+    fprintf(stderr, " whole executable path, and <zone> is a zone as in kbledclient, e.g. frow, ESC or alpha-locks.  Up to %i rules\n", PROCWATCH_MAXRULES);
+}
+
+int main(int argc, char *argv[]) {
+    static struct procwatch w;
+    struct procrule rules[PROCWATCH_MAXRULES];
+    int nrules = 0;
+    char verbose = 0;
+    uint8_t priority = SM_PRIO_DASHBOARD;
+    uint32_t flash = 2000;
+    int i = 1;
+    procwatch_init(&w);
+    while (i < argc) {
+        if (strcmp(argv[i], "-v") == 0) {
+            verbose = 1;
+            i++;
+        }
+        else if ((strcmp(argv[i], "--while") == 0) || (strcmp(argv[i], "--exit") == 0)) {
+            // program names, zone and color of a rule
+            int ok = (i + 5 < argc && nrules < PROCWATCH_MAXRULES);
+            for (int c = 3; ok && c <= 5; c++) ok = atoi(argv[i + c]) >= 0 && atoi(argv[i + c]) <= 255;
+            if (!ok || procwatch_rule(&w, argv[i + 1]) < 0) {
+                fprintf(stderr, "Error: %s requires <names> <zone> <Red> <Grn> <Blu> with colors 0-255, at most %i rules\n", argv[i], PROCWATCH_MAXRULES);
+                return 1;
+            }
+            struct procrule *r = &rules[nrules++];
+            r->kind = (argv[i][2] == 'w') ? PROCMON_WHILE : PROCMON_EXIT;
+            r->names = argv[i + 1];
+            r->zone = argv[i + 2];
+            for (int c = 0; c < 3; c++) r->rgb[c] = atoi(argv[i + 3 + c]);
+            i += 6;
+        }
+        else if (strcmp(argv[i], "--flash") == 0) {
+            if (i + 1 < argc && atoi(argv[i + 1]) >= 100 && atoi(argv[i + 1]) <= 65535) {
+                flash = atoi(argv[i + 1]);
+                i += 2;
+            } else {
+                fprintf(stderr, "Error: %s requires an argument between 100 and 65535\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--priority") == 0) {
+            if (i + 1 < argc && atoi(argv[i + 1]) >= 0 && atoi(argv[i + 1]) <= 255) {
+                priority = atoi(argv[i + 1]);
+                i += 2;
+            } else {
+                fprintf(stderr, "Error: %s requires an argument between 0 and 255\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--selftest") == 0) {
+            return procwatch_selftest() ? 1 : 0;
+        }
+        else if ((strcmp(argv[i], "--help") == 0) || (strcmp(argv[i], "-h") == 0)) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        else {
+            fprintf(stderr, "Error: Unknown switch: %s\n", argv[i]);
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (nrules == 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (sharedmem_slaveinit(verbose) != 0) {
+        fprintf(stderr, "Failed to connect to kbled daemon, are you sure it is running?\n");
+        return 1;
+    }
+    for (i = 0; i < nrules; i++) {
+        if (zone_parse(&shm_ptr->layout, rules[i].zone, &rules[i].keys) != 0 || keyset_empty(&rules[i].keys)) {
+            fprintf(stderr, "Zone %s is not on the %s keyboard layout, see kbledclient --zones\n", rules[i].zone, shm_ptr->layout.name);
+            sharedmem_slaveclose(verbose);
+            return 1;
+        }
+    }
+    sharedmem_lock();
+    int layer = sharedmem_layeropen("kbledprocmon", priority, 255);
+    sharedmem_unlock();
+    if (layer < 0) {
+        fprintf(stderr, "All %i kbled layers are in use\n", SM_MAXLAYERS);
+        sharedmem_slaveclose(verbose);
+        return 1;
+    }
+    if (procwatch_open(&w) != 0) {
+        sharedmem_slaveclose(verbose);
+        return 1;
+    }
+    uint32_t whilemask = 0, exitmask = 0;
+    for (i = 0; i < nrules; i++) {
+        if (rules[i].kind == PROCMON_WHILE) whilemask |= 1u << i;
+        else exitmask |= 1u << i;
+        printf("%s %s: %i running\n", rules[i].kind == PROCMON_WHILE ? "While" : "Exit of", rules[i].names, w.count[i]);
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+
+    unsigned char shown[LAYOUT_MAXLEDS][3], frame[LAYOUT_MAXLEDS][3];
+    uint8_t lit[LAYOUT_MAXLEDS] = {0}, was[LAYOUT_MAXLEDS] = {0}; //keys drawn on our layer, the rest show what is underneath
+    const int nkeys = shm_ptr->nkeys;
+    while (!stop) {
+        if (w.changed & whilemask) { //redraw from the rules that are on, each over the ones before it
+            memset(lit, 0, sizeof(lit));
+            for (i = 0; i < nrules; i++) {
+                if (!(whilemask & (1u << i)) || w.count[i] == 0) continue;
+                for (int k = keyset_next(&rules[i].keys, -1); k >= 0 && k < nkeys; k = keyset_next(&rules[i].keys, k)) {
+                    memcpy(frame[k], rules[i].rgb, 3);
+                    lit[k] = 1;
+                }
+            }
+            sharedmem_lock();
+            for (int k = 0; k < nkeys; k++) {
+                if (lit[k] && (!was[k] || memcmp(frame[k], shown[k], 3) != 0)) sharedmem_layerkey(layer, k, frame[k]);
+                else if (!lit[k] && was[k]) sharedmem_layerclear(layer, k);
+                memcpy(shown[k], frame[k], 3);
+                was[k] = lit[k];
+            }
+            sharedmem_unlock();
+        }
+        for (uint32_t ex = w.exited & exitmask; ex; ex &= ex - 1) { //blinking is left to the daemon's notifications
+            struct procrule *r = &rules[__builtin_ctz(ex)];
+            struct sm_notify n = { .keys = r->keys, .pattern = SM_NOTIFY_BLINK, .priority = priority, .ms = flash };
+            memcpy(n.rgb, r->rgb, 3);
+            if (sharedmem_notify(&n) != 0) fprintf(stderr, "kbled is busy, exit of %s not shown\n", r->names);
+        }
+        if (verbose) for (uint32_t ch = w.changed | (w.exited & exitmask); ch; ch &= ch - 1) {
+            int r = __builtin_ctz(ch);
+            printf("%s: %i running%s\n", rules[r].names, w.count[r], (w.exited & (1u << r)) ? ", one exited" : "");
+        }
+        w.changed = w.exited = 0;
+        struct pollfd p = { .fd = w.fd, .events = POLLIN };
+        if (poll(&p, 1, -1) < 0 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+        if (!stop && procwatch_read(&w) < 0) {
+            perror("proc connector");
+            break;
+        }
+    }
+    if (verbose) printf("%llu process events, %llu rescans after lost events\n", (unsigned long long)w.events, (unsigned long long)w.rescans);
+    procwatch_close(&w);
+    sharedmem_slaveclose(verbose); //gives our layer back
+    return 0;
+}
@@ -0,0 +1,360 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * Proc connector process matcher, see procwatch.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+#include "procwatch.h"
+
+static uint32_t procwatch_hash(const char *s){ //FNV-1a
+    uint32_t h=2166136261u;
+    while(*s) h=(h^(unsigned char)*s++)*16777619u;
+    return h;
+}
+
+static uint32_t procwatch_lookup(const struct procwatch *w, const char *name){
+    for(uint32_t i=procwatch_hash(name); ; i++){
+        const struct procwatch_name *n=&w->names[i & (PROCWATCH_NAMESLOTS-1)];
+        if(n->name[0]=='\0') return 0;
+        if(strcmp(n->name, name)==0) return n->mask;
+    }
+}
+
+//rules matching a program: its comm, and its exe when a rule names a path or the comm may have been cut to 15
+//characters
+static uint32_t procwatch_match(const struct procwatch *w, int32_t pid){
+    char path[64], comm[32], exe[PROCWATCH_NAMELEN];
+    snprintf(path, sizeof(path), "/proc/%i/comm", pid);
+    int fd=open(path, O_RDONLY | O_CLOEXEC);
+    if(fd<0) return 0;
+    ssize_t n=read(fd, comm, sizeof(comm)-1);
+    close(fd);
+    if(n<=0) return 0;
+    comm[n]='\0';
+    comm[strcspn(comm, "\n")]='\0';
+    uint32_t mask=procwatch_lookup(w, comm);
+    const char *base=comm;
+    if(w->exe || strlen(comm)==15){
+        snprintf(path, sizeof(path), "/proc/%i/exe", pid);
+        n=readlink(path, exe, sizeof(exe)-1);
+        if(n>0){
+            exe[n]='\0';
+            base=strrchr(exe, '/')? strrchr(exe, '/')+1 : exe;
+            if(w->exe) mask|=procwatch_lookup(w, exe);
+            if(base!=exe && strcmp(base, comm)!=0) mask|=procwatch_lookup(w, base);
+            else base=comm;
+        }
+    }
+    for(int i=0; i<w->nprefix; i++){
+        size_t len=strlen(w->prefix[i].name);
+        if(strncmp(comm, w->prefix[i].name, len)==0 || strncmp(base, w->prefix[i].name, len)==0) mask|=w->prefix[i].mask;
+    }
+    return mask;
+}
+
+static struct procwatch_pid *procwatch_slot(struct procwatch *w, int32_t pid){
+    for(uint32_t i=(uint32_t)pid*2654435761u; ; i++){
+        struct procwatch_pid *p=&w->pids[i & (PROCWATCH_PIDSLOTS-1)];
+        if(p->pid==pid || p->pid==0) return p;
+    }
+}
+
+//give pid a new set of rules, counting the change.  Only an exit counts as one for exited, a process that execs
+//another program or renames itself leaves its rules without having exited
+static void procwatch_set(struct procwatch *w, int32_t pid, uint32_t mask, int exiting){
+    struct procwatch_pid *p=procwatch_slot(w, pid);
+    uint32_t old= (p->pid==pid)? p->mask : 0;
+    if(old==mask) return;
+    if(old==0 && w->npids>=PROCWATCH_PIDSLOTS/2) return; //full enough for the probes to get long, stop tracking more
+    for(uint32_t diff=old^mask; diff; diff&=diff-1){
+        int r=__builtin_ctz(diff);
+        if(mask & (1u<<r)) {
+            if(w->count[r]++==0) w->changed|=1u<<r;
+        } else {
+            if(--w->count[r]==0) w->changed|=1u<<r;
+            if(exiting) w->exited|=1u<<r;
+        }
+    }
+    if(mask){
+        if(p->pid==0) w->npids++;
+        p->pid=pid;
+        p->mask=mask;
+        return;
+    }
+    //remove it, moving later entries of the probe chain back so no lookup stops short
+    w->npids--;
+    uint32_t hole=(uint32_t)(p-w->pids);
+    for(uint32_t i=(hole+1) & (PROCWATCH_PIDSLOTS-1); w->pids[i].pid!=0; i=(i+1) & (PROCWATCH_PIDSLOTS-1)){
+        uint32_t home=((uint32_t)w->pids[i].pid*2654435761u) & (PROCWATCH_PIDSLOTS-1);
+        if(((i-home) & (PROCWATCH_PIDSLOTS-1)) >= ((i-hole) & (PROCWATCH_PIDSLOTS-1))){
+            w->pids[hole]=w->pids[i];
+            hole=i;
+        }
+    }
+    w->pids[hole].pid=0;
+    w->pids[hole].mask=0;
+}
+
+static uint32_t procwatch_mask(struct procwatch *w, int32_t pid){
+    struct procwatch_pid *p=procwatch_slot(w, pid);
+    return (p->pid==pid)? p->mask : 0;
+}
+
+//count every running process again.  Whether the processes missing now exited or exec'd something else can't be
+//told any more, so exited is left alone
+static void procwatch_scan(struct procwatch *w){
+    int old[PROCWATCH_MAXRULES];
+    uint32_t changed=w->changed;
+    memcpy(old, w->count, sizeof(old));
+    memset(w->count, 0, sizeof(w->count));
+    memset(w->pids, 0, sizeof(w->pids));
+    w->npids=0;
+    DIR *d=opendir("/proc");
+    struct dirent *e;
+    while(d!=NULL && (e=readdir(d))!=NULL) {
+        if(!isdigit((unsigned char)e->d_name[0])) continue;
+        int32_t pid=atoi(e->d_name);
+        procwatch_set(w, pid, procwatch_match(w, pid), 0);
+    }
+    if(d!=NULL) closedir(d);
+    //only what differs from before counts as a change
+    w->changed=changed;
+    for(int r=0; r<w->nrules; r++) if((old[r]>0)!=(w->count[r]>0)) w->changed|=1u<<r;
+}
+
+void procwatch_init(struct procwatch *w){
+    memset(w, 0, sizeof(*w));
+    w->fd=-1;
+}
+
+int procwatch_rule(struct procwatch *w, const char *names){
+    char buf[1024], *save=NULL;
+    if(w->nrules>=PROCWATCH_MAXRULES){
+        printf("Only %i rules can be watched, %s ignored\n", PROCWATCH_MAXRULES, names);
+        return -1;
+    }
+    uint32_t bit=1u<<w->nrules;
+    snprintf(buf, sizeof(buf), "%s", names);
+    for(char *n=strtok_r(buf, "|", &save); n!=NULL; n=strtok_r(NULL, "|", &save)){
+        size_t len=strlen(n);
+        if(len==0 || len>=PROCWATCH_NAMELEN) continue;
+        if(n[len-1]=='*'){
+            n[len-1]='\0';
+            int i;
+            for(i=0; i<w->nprefix && strcmp(w->prefix[i].name, n)!=0; i++);
+            if(i==PROCWATCH_MAXPREFIX) {
+                printf("Only %i names ending in * can be watched, %s* ignored\n", PROCWATCH_MAXPREFIX, n);
+                continue;
+            }
+            if(i==w->nprefix) snprintf(w->prefix[w->nprefix++].name, PROCWATCH_NAMELEN, "%s", n);
+            w->prefix[i].mask|=bit;
+            continue;
+        }
+        if(strchr(n, '/')!=NULL) w->exe=1;
+        struct procwatch_name *slot=NULL;
+        for(uint32_t i=procwatch_hash(n); ; i++){
+            slot=&w->names[i & (PROCWATCH_NAMESLOTS-1)];
+            if(slot->name[0]=='\0' || strcmp(slot->name, n)==0) break;
+        }
+        if(slot->name[0]=='\0'){
+            if(w->nnames>=PROCWATCH_MAXNAMES) {
+                printf("Only %i program names can be watched, %s ignored\n", PROCWATCH_MAXNAMES, n);
+                continue;
+            }
+            snprintf(slot->name, PROCWATCH_NAMELEN, "%s", n);
+            w->nnames++;
+        }
+        slot->mask|=bit;
+    }
+    return w->nrules++;
+}
+
+int procwatch_open(struct procwatch *w){
+    w->fd=socket(PF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+    if(w->fd<0) {
+        perror("proc connector socket");
+        return -1;
+    }
+    int rcvbuf=PROCWATCH_RCVBUF;
+    if(setsockopt(w->fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf))!=0) setsockopt(w->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    struct sockaddr_nl sa={.nl_family=AF_NETLINK, .nl_groups=CN_IDX_PROC, .nl_pid=0};
+    if(bind(w->fd, (struct sockaddr *)&sa, sizeof(sa))!=0) {
+        perror("proc connector bind (needs root)");
+        procwatch_close(w);
+        return -1;
+    }
+    union {
+        struct nlmsghdr nl;
+        char buf[NLMSG_SPACE(sizeof(struct cn_msg)+sizeof(enum proc_cn_mcast_op))];
+    } req;
+    memset(&req, 0, sizeof(req));
+    req.nl.nlmsg_len=NLMSG_LENGTH(sizeof(struct cn_msg)+sizeof(enum proc_cn_mcast_op));
+    req.nl.nlmsg_type=NLMSG_DONE;
+    struct cn_msg *cn=NLMSG_DATA(&req.nl);
+    cn->id.idx=CN_IDX_PROC;
+    cn->id.val=CN_VAL_PROC;
+    cn->len=sizeof(enum proc_cn_mcast_op);
+    enum proc_cn_mcast_op op=PROC_CN_MCAST_LISTEN;
+    memcpy(cn->data, &op, sizeof(op));
+    if(send(w->fd, &req, req.nl.nlmsg_len, 0)<0) {
+        perror("proc connector subscribe");
+        procwatch_close(w);
+        return -1;
+    }
+    procwatch_scan(w); //after subscribing, so nothing starting in between is missed
+    w->changed=(w->nrules<32)? (1u<<w->nrules)-1 : ~0u; //everything has to be drawn once
+    w->exited=0;
+    return 0;
+}
+
+void procwatch_close(struct procwatch *w){
+    if(w->fd>=0) close(w->fd);
+    w->fd=-1;
+}
+
+void procwatch_event(struct procwatch *w, const struct proc_event *ev){
+    switch(ev->what){
+        case PROC_EVENT_FORK: //a new process runs the parent's program until it execs
+            if(ev->event_data.fork.child_pid==ev->event_data.fork.child_tgid) {
+                uint32_t mask=procwatch_mask(w, ev->event_data.fork.parent_tgid);
+                if(mask) procwatch_set(w, ev->event_data.fork.child_tgid, mask, 0);
+            }
+            break;
+        case PROC_EVENT_EXEC:
+            procwatch_set(w, ev->event_data.exec.process_tgid, procwatch_match(w, ev->event_data.exec.process_tgid), 0);
+            break;
+        case PROC_EVENT_COMM:
+            if(ev->event_data.comm.process_pid==ev->event_data.comm.process_tgid)
+                procwatch_set(w, ev->event_data.comm.process_tgid, procwatch_match(w, ev->event_data.comm.process_tgid), 0);
+            break;
+        case PROC_EVENT_EXIT:
+            if(ev->event_data.exit.process_pid==ev->event_data.exit.process_tgid) procwatch_set(w, ev->event_data.exit.process_tgid, 0, 1);
+            break;
+        default:
+            break;
+    }
+}
+
+int procwatch_read(struct procwatch *w){
+    char buf[8192] __attribute__((aligned(NLMSG_ALIGNTO)));
+    int handled=0;
+    for(;;){
+        ssize_t len=recv(w->fd, buf, sizeof(buf), 0);
+        if(len<0 && errno==ENOBUFS) { //the kernel dropped events, the counts can't be trusted any more
+            w->rescans++;
+            procwatch_scan(w);
+            continue;
+        }
+        if(len<0 && errno==EINTR) continue;
+        if(len<0) {
+            w->events+=handled;
+            return (errno==EAGAIN || errno==EWOULDBLOCK)? handled : -1;
+        }
+        for(struct nlmsghdr *nl=(struct nlmsghdr *)buf; NLMSG_OK(nl, (size_t)len); nl=NLMSG_NEXT(nl, len)){
+            if(nl->nlmsg_type==NLMSG_ERROR || nl->nlmsg_type==NLMSG_NOOP) continue;
+            const struct cn_msg *cn=NLMSG_DATA(nl);
+            if(cn->id.idx!=CN_IDX_PROC || cn->id.val!=CN_VAL_PROC) continue;
+            handled++;
+            procwatch_event(w, (const struct proc_event *)cn->data);
+        }
+    }
+}
+
+static int procwatch_check(const char *what, int ok){
+    printf("%-60s %s\n", what, ok? "ok" : "FAILED");
+    return !ok;
+}
+
+//this process matches the only rule, a child forked from it then execs sleep, which doesn't.  Needs no root, the
+//events are made up and only /proc is read
+int procwatch_selftest(void){
+    static struct procwatch w;
+    struct proc_event ev;
+    char comm[32];
+    int fd[2], failed=0;
+    procwatch_init(&w);
+    int in=open("/proc/self/comm", O_RDONLY | O_CLOEXEC);
+    ssize_t n= (in>=0)? read(in, comm, sizeof(comm)-1) : -1;
+    if(in>=0) close(in);
+    if(n<=0) {
+        perror("/proc/self/comm");
+        return 1;
+    }
+    comm[n]='\0';
+    comm[strcspn(comm, "\n")]='\0';
+    procwatch_rule(&w, comm);
+    int32_t self=getpid();
+    memset(&ev, 0, sizeof(ev));
+    ev.what=PROC_EVENT_EXEC;
+    ev.event_data.exec.process_pid=ev.event_data.exec.process_tgid=self;
+    procwatch_event(&w, &ev);
+    failed+=procwatch_check("exec of a matching program counts it", w.count[0]==1 && w.changed==1 && w.exited==0);
+    w.changed=0;
+
+    //the child execs sleep once the close on exec end of the pipe reads as closed
+    if(pipe(fd)!=0 || fcntl(fd[1], F_SETFD, FD_CLOEXEC)!=0) {
+        perror("pipe");
+        return 1;
+    }
+    pid_t child=fork();
+    if(child<0) {
+        perror("fork");
+        return 1;
+    }
+    if(child==0) {
+        close(fd[0]);
+        execlp("sleep", "sleep", "30", (char *)NULL);
+        _exit(127);
+    }
+    close(fd[1]);
+    while(read(fd[0], comm, 1)<0 && errno==EINTR);
+    close(fd[0]);
+    memset(&ev, 0, sizeof(ev));
+    ev.what=PROC_EVENT_FORK;
+    ev.event_data.fork.parent_pid=ev.event_data.fork.parent_tgid=self;
+    ev.event_data.fork.child_pid=ev.event_data.fork.child_tgid=child;
+    procwatch_event(&w, &ev);
+    failed+=procwatch_check("fork of a matching process counts the child", w.count[0]==2 && w.changed==0 && w.exited==0);
+    memset(&ev, 0, sizeof(ev));
+    ev.what=PROC_EVENT_EXEC;
+    ev.event_data.exec.process_pid=ev.event_data.exec.process_tgid=child;
+    procwatch_event(&w, &ev);
+    failed+=procwatch_check("exec of another program drops the child without an exit", w.count[0]==1 && w.changed==0 && w.exited==0);
+    memset(&ev, 0, sizeof(ev));
+    ev.what=PROC_EVENT_EXIT;
+    ev.event_data.exit.process_pid=ev.event_data.exit.process_tgid=child;
+    procwatch_event(&w, &ev);
+    failed+=procwatch_check("exit of the child no longer matching is ignored", w.count[0]==1 && w.exited==0);
+
+    //the same child counted again, the rescan after lost events finds it running sleep
+    ev.what=PROC_EVENT_FORK;
+    ev.event_data.fork.parent_pid=ev.event_data.fork.parent_tgid=self;
+    ev.event_data.fork.child_pid=ev.event_data.fork.child_tgid=child;
+    procwatch_event(&w, &ev);
+    procwatch_scan(&w);
+    failed+=procwatch_check("rescan drops the child without an exit", procwatch_mask(&w, child)==0 && w.count[0]>=1 && w.exited==0);
+    kill(child, SIGTERM);
+    waitpid(child, NULL, 0);
+
+    memset(&ev, 0, sizeof(ev));
+    ev.what=PROC_EVENT_EXIT;
+    ev.event_data.exit.process_pid=ev.event_data.exit.process_tgid=self;
+    procwatch_event(&w, &ev);
+    failed+=procwatch_check("exit of a matching process sets exited", procwatch_mask(&w, self)==0 && w.exited==1);
+    return failed;
+}
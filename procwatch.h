@@ -0,0 +1,64 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * Live count of the processes matching a set of rules for kbledprocmon, kept up to date from the fork, exec and
+ * exit events of the netlink proc connector instead of scanning /proc.  The program names of every rule go into one
+ * hash table mapping a name to the rules it belongs to, so a new program costs one lookup of its comm (and of its
+ * exe when the comm could be cut short) whatever the number of rules.  Only matching processes are remembered.
+ * /proc is only scanned at startup and when the kernel had to drop events.
+ */
+
+#ifndef PROCWATCH_H
+#define PROCWATCH_H
+
+#include <stdint.h>
+
+struct proc_event;
+
+#define PROCWATCH_MAXRULES  32     //one bit each in the masks
+#define PROCWATCH_MAXNAMES  256    //program names over all rules
+#define PROCWATCH_NAMESLOTS 512    //hash table of names, a power of 2 and at least twice PROCWATCH_MAXNAMES
+#define PROCWATCH_MAXPREFIX 16     //names ending in *, compared one by one
+#define PROCWATCH_NAMELEN   128    //longest name or exe path
+#define PROCWATCH_PIDSLOTS  16384  //matching processes tracked, a power of 2
+#define PROCWATCH_RCVBUF    (1<<20)//socket buffer asked for, enough for a burst of a parallel build
+
+struct procwatch_name {
+    char name[PROCWATCH_NAMELEN];  //"" for an empty slot
+    uint32_t mask;                 //rules listing it
+};
+
+struct procwatch_pid {
+    int32_t pid;                   //0 for an empty slot
+    uint32_t mask;                 //rules it matched
+};
+
+struct procwatch {
+    int fd;                        //netlink proc connector socket
+    int nrules;
+    int count[PROCWATCH_MAXRULES]; //processes alive per rule
+    uint32_t changed;              //rules that went from none to some or back since the caller last cleared it
+    uint32_t exited;               //rules that lost a process to an exit (not an exec) since the caller last cleared it
+    int exe;                       //some name is an exe path, the exe link of each new program is read
+    struct procwatch_name names[PROCWATCH_NAMESLOTS];
+    int nnames;
+    struct procwatch_name prefix[PROCWATCH_MAXPREFIX]; //without the *
+    int nprefix;
+    struct procwatch_pid pids[PROCWATCH_PIDSLOTS];
+    int npids;
+    uint64_t events;               //proc connector messages handled
+    uint64_t rescans;              //times /proc had to be scanned after lost events
+};
+
+void procwatch_init(struct procwatch *w);
+//add a rule: program names separated by |, a name ending in * matches as a prefix, a name with a / matches the exe
+//path.  Returns the rule index or -1
+int procwatch_rule(struct procwatch *w, const char *names);
+int procwatch_open(struct procwatch *w);  //subscribe and count what is already running, 0 on success
+void procwatch_close(struct procwatch *w);
+int procwatch_read(struct procwatch *w);  //handle every queued event without blocking, the number handled or -1
+void procwatch_event(struct procwatch *w, const struct proc_event *ev); //count one fork, exec, comm or exit event
+int procwatch_selftest(void);  //feed made up events about this process and a child, 0 when the counts come out right
+
+#endif
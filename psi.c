@@ -0,0 +1,131 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * Pressure stall information sampler and triggers, see psi.h
+ */
+
+#define _GNU_SOURCE  //ppoll
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include "psi.h"
+
+static const char *const names[PSI_COUNT]={"cpu", "memory", "io"};
+
+const char *psi_name(int resource){
+    return names[resource];
+}
+
+//the total= figures of the some and full lines, 0 on success
+static int psi_read(int fd, uint64_t *total){
+    char buf[256];
+    ssize_t len=pread(fd, buf, sizeof(buf)-1, 0);
+    if(len<=0) return -1;
+    buf[len]='\0';
+    total[0]=total[1]=0; //cpu has no full line before 5.13
+    const char *p=buf;
+    for(int k=0; k<2 && (p=strstr(p, "total="))!=NULL; k++){
+        uint64_t v=0;
+        for(p+=6; (unsigned)(*p-'0')<10; p++) v=v*10+(uint64_t)(*p-'0');
+        total[k]=v;
+    }
+    return 0;
+}
+
+int psi_open(struct psi *p, uint32_t stallus){
+    char path[64], trig[64];
+    int nfd=0;
+    memset(p, 0, sizeof(*p));
+    snprintf(trig, sizeof(trig), "some %u %u", stallus, PSI_WINDOWUS);
+    for(int r=0; r<PSI_COUNT; r++){
+        snprintf(path, sizeof(path), "%s/%s", PSI_DIR, names[r]);
+        p->fd[r]=open(path, O_RDONLY | O_CLOEXEC);
+        p->trig[r]=-1;
+        if(p->fd[r]<0 || psi_read(p->fd[r], p->total[r])!=0) {
+            if(p->fd[r]>=0) close(p->fd[r]);
+            p->fd[r]=-1;
+            continue;
+        }
+        nfd++;
+        p->trig[r]=open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if(p->trig[r]>=0 && write(p->trig[r], trig, strlen(trig)+1)<0) {
+            close(p->trig[r]);
+            p->trig[r]=-1;
+        }
+        if(p->trig[r]>=0) p->ntrig++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &p->t);
+    if(nfd==0) printf("No pressure stall information in %s, the kernel needs CONFIG_PSI\n", PSI_DIR);
+    return nfd? 0 : -1;
+}
+
+void psi_close(struct psi *p){
+    for(int r=0; r<PSI_COUNT; r++){
+        if(p->fd[r]>=0) close(p->fd[r]);
+        if(p->trig[r]>=0) close(p->trig[r]);
+        p->fd[r]=p->trig[r]=-1;
+    }
+    p->ntrig=0;
+}
+
+int psi_sample(struct psi *p){
+    struct timespec now;
+    uint64_t total[2];
+    int fail=0;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double us=(now.tv_sec-p->t.tv_sec)*1e6 + (now.tv_nsec-p->t.tv_nsec)/1e3;
+    p->t=now;
+    for(int r=0; r<PSI_COUNT; r++){
+        if(p->fd[r]<0 || psi_read(p->fd[r], total)!=0) {
+            p->value[r][0]=p->value[r][1]=0.0f;
+            fail=-1;
+            continue;
+        }
+        for(int k=0; k<2; k++){
+            float v= (us>0.0 && total[k]>=p->total[r][k])? (float)((total[k]-p->total[r][k])/us) : 0.0f;
+            p->value[r][k]= (v>1.0f)? 1.0f : v;
+            p->total[r][k]=total[k];
+        }
+    }
+    return fail;
+}
+
+int psi_wait(struct psi *p, const struct timespec *deadline, int wake){
+    struct pollfd fds[PSI_COUNT];
+    int n=0;
+    for(int r=0; wake && r<PSI_COUNT; r++) if(p->trig[r]>=0) {
+        fds[n].fd=p->trig[r];
+        fds[n++].events=POLLPRI;
+    }
+    if(n==0) {
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, NULL)==EINTR);
+        return 0;
+    }
+    for(;;){
+        struct timespec now, left;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        left.tv_sec=deadline->tv_sec-now.tv_sec;
+        left.tv_nsec=deadline->tv_nsec-now.tv_nsec;
+        if(left.tv_nsec<0) {
+            left.tv_nsec+=1000000000L;
+            left.tv_sec--;
+        }
+        if(left.tv_sec<0) return 0;
+        int ready=ppoll(fds, n, &left, NULL);
+        if(ready==0) return 0;
+        if(ready<0) continue; //signal
+        int fired=0;
+        for(int i=0; i<n; i++){
+            if(fds[i].revents & (POLLERR | POLLNVAL)) { //trigger went away (cgroup or file gone), stop listening to it
+                fds[i].fd=-1;
+                continue;
+            }
+            if(fds[i].revents & POLLPRI) fired=1;
+        }
+        if(fired) return 1;
+    }
+}
@@ -0,0 +1,39 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * Pressure stall information for kbledpsmon.  /proc/pressure/{cpu,memory,io} stay open and each sample turns the
+ * growth of their some/full stall totals into the share of time stalled since the last one.  A PSI trigger on each
+ * file lets psi_wait() sleep through a slow heartbeat and still wake as soon as a resource starts stalling.
+ */
+
+#ifndef PSI_H
+#define PSI_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define PSI_DIR      "/proc/pressure"
+#define PSI_WINDOWUS 2000000  //trigger window, unprivileged triggers need a multiple of 2 s
+
+enum psi_resource {PSI_CPU, PSI_MEMORY, PSI_IO, PSI_COUNT};
+
+struct psi {
+    int fd[PSI_COUNT];            //read back with pread, -1 if the kernel doesn't have it
+    int trig[PSI_COUNT];          //trigger on the same file, -1 if it couldn't be set
+    int ntrig;                    //triggers set
+    uint64_t total[PSI_COUNT][2]; //some and full stall totals at the last sample in us
+    struct timespec t;            //time of the last sample
+    float value[PSI_COUNT][2];    //share of the time since the last sample that was stalled, some and full
+};
+
+//open the pressure files and set triggers for stallus of some stall in a PSI_WINDOWUS window.  0 if any pressure
+//file could be read
+int psi_open(struct psi *p, uint32_t stallus);
+void psi_close(struct psi *p);
+int psi_sample(struct psi *p); //update value[], 0 on success
+//sleep until the absolute CLOCK_MONOTONIC deadline, or until a trigger fires if wake is set.  1 if woken by a trigger
+int psi_wait(struct psi *p, const struct timespec *deadline, int wake);
+const char *psi_name(int resource);
+
+#endif
@@ -17,33 +17,113 @@
 #include <ctype.h>
 #include <semaphore.h>
 #include <fcntl.h>
-#include <sys/ioctl.h>
-#include <sys/socket.h>
-#include <linux/wireless.h>
 #include <time.h>
+#include <errno.h>
+#include <pthread.h>
 #include "sharedmem.h"
+#include "colormap.h"
+#include "cpustat.h"
+#include "cpubin.h"
+#include "netstat.h"
+#include "psi.h"
+#include "diskstat.h"
+#include "sensors.h"
+#include "cgroups.h"
+#include "smooth.h"
+#include "slot.h"
 
-#define MAX_CORES 128
 #define MAX_LINE_LENGTH 1024
-#define MAX_IFLEN 32
+#define PSI_CALMMS 5000 //ms below the pressure trigger level before --psi drops back to the heartbeat
+#define PSMON_STATS 10  //seconds between --stats reports
+
+//metrics, each one a smoothing group
+enum metric {METRIC_CPU, METRIC_MEM, METRIC_SWAP, METRIC_NET, METRIC_DISK, METRIC_SENSOR, METRIC_CGROUP, METRIC_PSI, METRIC_COUNT};
+static const char *const metricnames[METRIC_COUNT]={"cpu", "mem", "swap", "net", "disk", "sensor", "cgroup", "psi"};
+
+//what the sampling thread measured on one tick, everything as a 0-1 fill except the memory percentages
+struct sample {
+    uint64_t seq;                 //tick number, gaps are samples the publisher never drew
+    struct timespec t;            //when the sample was finished
+    uint32_t period;              //ms the tick was planned for, a PSI trigger can end it early
+    int cpuok, memok;
+    float cpu[CPUBIN_MAXBINS];    //load of each cpu key
+    float mem[2];                 //RAM and swap used in percent
+    float psi[2*PSI_COUNT];
+    float net[2*NETSTAT_MAXIF];
+    float disk[2*DISKSTAT_MAX];   //utilization then throughput of each disk
+    float sensor[SENSORS_MAX];
+    float cgroup[2*CGROUPS_MAX];  //cpu then memory of each cgroup
+};
+
+//sampling thread: the sources it reads and how, it owns them once it is started
+struct sampler {
+    struct slot *out;
+    char verbose;
+    uint32_t update, heartbeat;   //ms between ticks, fast and with --psi while there is no pressure
+    struct cpustat *stat;
+    struct cpubin *bins;
+    float *cpu;
+    int ram;
+    struct netstat *net;
+    int nbars, netsplit;
+    struct diskstat *disk;
+    float diskmax, diskpeak;
+    struct sensors *sens;
+    struct cgroups *cg;
+    int psimode;
+    struct psi *psi;
+    float psiscale;
+    uint32_t psitrigger;
+};
 
-struct shared_data new_ptr; //internal structure to write to kbled shared memory 
-char interface[MAX_IFLEN] = "*"; // update to correct interface from command line arguments, placeholder
+struct shared_data *new_ptr; //internal structure to write to kbled shared memory, sized for the largest layout
+struct smooth filt; //smoothing and quantization of every key
 
 void print_usage(char *programname) {
     fprintf(stderr, "Usage: %s [parameters...]\n", programname);
     fprintf(stderr, "Example: %s [parameters...]\n", programname);
     fprintf(stderr, " Parameter:                    Description:\n");
     fprintf(stderr, " -u or --update <msec>         Update process load frequency (100 to 65535 ms)  Default=200 ms\n");
-    fprintf(stderr, " -n or --network <interface>   Display network load on /dev/<interface>\n e.g. eth0 for /dev/eth0\n");
-    fprintf(stderr, " -b or --bandwidth <mbits>     Define max bandwith of device specified by -n, otherwise determined automatically\n");
+    fprintf(stderr, " -n or --network <interface>   Display network load on <interface> e.g. eth0, repeat for up to %i interfaces\n", NETSTAT_MAXIF);
+    fprintf(stderr, " -b or --bandwidth <mbits>     Link speed of the last -n interface, otherwise read from the link\n");
+    fprintf(stderr, " --netsplit                    Separate receive and transmit bars for each interface\n");
+    fprintf(stderr, " -d or --disk <dev[+dev...]|all>  Display utilization and throughput of a disk, disks added up or every physical disk, repeat for up to %i\n", DISKSTAT_MAX);
+    fprintf(stderr, " --diskmax <MB/s>              Throughput shown as a full bar  Default=highest seen so far\n");
+    fprintf(stderr, " --sensor <kind>[:<chip>[:<label|n>]][=<min>,<max>]  Display a temp, fan, battery or charge sensor, repeat for up to %i\n", SENSORS_MAX);
+    fprintf(stderr, " --cgroup <path|unit>          Display cpu and memory use of a cgroup v2 path or systemd unit, repeat for up to %i\n", CGROUPS_MAX);
     fprintf(stderr, " -r or --ram                   Show RAM saturation\n");
     fprintf(stderr, " -s or --swap                  Show swap saturation\n");
+    fprintf(stderr, " --memzone <zone>              Keys for the RAM bar graph, filled bottom to top  Default=membar\n");
+    fprintf(stderr, " --swapzone <zone>             Keys for the swap bar graph  Default=swapbar\n");
+    fprintf(stderr, " --netzone <zone>[,<zone>...]  Keys for the network bar graphs in order, bars past the last zone share it  Default=netbar\n");
+    fprintf(stderr, " --cpuzone <zone>              Keys for the CPU loads  Default=every key not used by a bar graph\n");
+    fprintf(stderr, " --cpukeys <n>                 Use at most n of those keys, cpus share keys when there are more of them\n");
+    fprintf(stderr, " --cpugroup <group>            Keep cpus sharing a key within one: cpu (none), core, package or node  Default=core\n");
+    fprintf(stderr, " --cpuagg <avg|max|p<n>>       Load shown for a key shared by several cpus: average, max or nth percentile  Default=avg\n");
+    fprintf(stderr, " --compact                     One key per core, package or node instead of spreading the cpus over the keys\n");
+    fprintf(stderr, " --diskzone <zone>[,<zone>...] Keys for the disk bars, utilization then throughput of each disk  Default=frow\n");
+    fprintf(stderr, " --sensorzone <zone>[,<zone>...]  Keys for the sensor bars in order  Default=numrow\n");
+    fprintf(stderr, " --cgroupzone <zone>[,<zone>...]  Keys for the cgroup bars, cpu then memory of each cgroup  Default=alpha\n");
+    fprintf(stderr, " --psi                         Show cpu, memory and io pressure stalls and only update quickly while there are some\n");
+    fprintf(stderr, " --psizone <zone>              Keys for cpu some, cpu full, memory some, memory full, io some and io full  Default=nav\n");
+    fprintf(stderr, " --psimax <percent>            Stalled time shown as the end of the colormap  Default=25\n");
+    fprintf(stderr, " --psitrigger <msec>           Stall per 2 s that wakes the fast updates (1 to 2000 ms)  Default=100 ms\n");
+    fprintf(stderr, " --heartbeat <msec>            Update period without pressure in --psi mode (100 to 65535 ms)  Default=2000 ms\n");
+    fprintf(stderr, " --cpumap <map>                Colors of the CPU keys: %s  Default=ramp\n", colormap_names());
+    fprintf(stderr, " --memmap, --swapmap, --netmap, --diskmap, --psimap, --sensormap, --cgroupmap <map>  Colors of the other graphs  Default=ramp\n");
+    fprintf(stderr, " --smooth [<metric>=]<msec>    Average each key over about msec, for every metric or one of cpu, mem, swap, net, disk, sensor, cgroup or psi  Default=0\n");
+    fprintf(stderr, " --hold [<metric>=]<msec>      Show a new high at once and hold it for msec before the average takes over  Default=0\n");
+    fprintf(stderr, " --levels <2-256>              Colors a key steps through from empty to full  Default=%i\n", SMOOTH_LEVELS);
+    fprintf(stderr, " --hysteresis <0-200>          Percent of a step past half way before a key changes level  Default=%i\n", (int)(SMOOTH_BAND*100.0f));
+    fprintf(stderr, " --stats                       Report the key updates sent to kbled per second every %i s\n", PSMON_STATS);
+    fprintf(stderr, " --priority <0-255>            Layer priority, higher is drawn on top  Default=%i\n", SM_PRIO_DASHBOARD);
+    fprintf(stderr, " --alpha <0-255>               Layer opacity  Default=255\n");
     fprintf(stderr, " -cpu                          Display the time it took kbled daemon to execute the last update\n");
-    fprintf(stderr, " -v                            Verbose output\n");
+    fprintf(stderr, " -v                            Verbose output, with the tick jitter, overruns and commit latency every %i s\n", PSMON_STATS);
     fprintf(stderr, " --scan                        Change keyboard update speed (1 to 65535 ms) default= 100 ms\n");
     fprintf(stderr, " --dump                        Show contents of shared memory\n");
     fprintf(stderr, " --dump+                       Show contents of shared memory with each key's state\n");
+    fprintf(stderr, " --bench [samples]             Time the /proc/stat sampler on 8, 64 and 256 cpus and this machine\n");
     fprintf(stderr, " -h or --help                  Display this message\n");
 }
 
@@ -94,268 +174,13 @@ void sighandle(int sig, siginfo_t *info, void *context) {
             printf("Received unknown signal: %d\n", sig);
             break;
     }
-    //restore keyboard to original state unless something went fairly wrong:
-    if(sig == SIGINT || sig == SIGTERM || sig == SIGABRT || sig == SIGQUIT || sig==SIGHUP){
-      sharedmem_lock();
-      shm_ptr->status |= SM_BL; //update backlight across the keyboard
-      sharedmem_unlock();
-    }
     //free(cpu); //free used memory for cpu load array
-    //release the shared memory, close the semaphore and remove the shared memory ftok token
+    //give back our layer so the keys underneath show again and detach from the shared memory
     sharedmem_slaveclose(SM_QUIET);
     printf("kbledpsmon closing...\n");
     exit(0);  // Exit the program since everything should be cleaned up
 }
 
-//CPU Use     ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-typedef struct {
-    unsigned long long user, nice, system, idle, iowait, irq, softirq, steal;
-} CpuTime;
-
-// Function to parse a line from /proc/stat and extract CPU times
-int parsecpu(const char *line, CpuTime *cpu_time) {
-    return sscanf(line, "cpu%*d %llu %llu %llu %llu %llu %llu %llu %llu",
-                  &cpu_time->user, &cpu_time->nice, &cpu_time->system, &cpu_time->idle,
-                  &cpu_time->iowait, &cpu_time->irq, &cpu_time->softirq, &cpu_time->steal);
-}
-
-// Function to calculate CPU load for all cores
-int cpuload(float *cpu_loads, int *num_cores, int avg_time_ms) {
-    FILE *file;
-    CpuTime prev_times[MAX_CORES], curr_times[MAX_CORES];
-    char buffer[MAX_LINE_LENGTH];
-    int core_count = 0;
-
-    // First read of /proc/stat
-    if ((file = fopen("/proc/stat", "r")) == NULL) {
-        perror("fopen");
-        return -1;
-    }
-
-    // Parse the CPU lines
-    while (fgets(buffer, sizeof(buffer), file)) {
-        if (strncmp(buffer, "cpu", 3) == 0 && buffer[3] >= '0' && buffer[3] <= '9') {
-            if (parsecpu(buffer, &prev_times[core_count]) != 8) {
-                fclose(file);
-                return -1;
-            }
-            core_count++;
-        }
-    }
-    fclose(file);
-
-    *num_cores = core_count;
-
-    // Sleep for the specified averaging time
-    usleep(avg_time_ms * 1000);
-
-    // Second read of /proc/stat
-    if ((file = fopen("/proc/stat", "r")) == NULL) {
-        perror("fopen");
-        return -1;
-    }
-
-    core_count = 0;
-    while (fgets(buffer, sizeof(buffer), file)) {
-        if (strncmp(buffer, "cpu", 3) == 0 && buffer[3] >= '0' && buffer[3] <= '9') {
-            if (parsecpu(buffer, &curr_times[core_count]) != 8) {
-                fclose(file);
-                return -1;
-            }
-            core_count++;
-        }
-    }
-    fclose(file);
-
-    // Calculate CPU load for each core
-    for (int i = 0; i < *num_cores; i++) {
-        unsigned long long prev_idle = prev_times[i].idle + prev_times[i].iowait;
-        unsigned long long curr_idle = curr_times[i].idle + curr_times[i].iowait;
-        unsigned long long prev_total = prev_idle + prev_times[i].user + prev_times[i].nice + prev_times[i].system +
-                                         prev_times[i].irq + prev_times[i].softirq + prev_times[i].steal;
-        unsigned long long curr_total = curr_idle + curr_times[i].user + curr_times[i].nice + curr_times[i].system +
-                                         curr_times[i].irq + curr_times[i].softirq + curr_times[i].steal;
-        unsigned long long total_diff = curr_total - prev_total;
-        unsigned long long idle_diff = curr_idle - prev_idle;
-
-        if (total_diff == 0) {
-            cpu_loads[i] = 0.0f;
-        } else {
-            cpu_loads[i] = 100.0f * (1.0f - ((float)idle_diff / total_diff));
-        }
-    }
-
-    return 0;
-}
-//CPU Use     ------------------------------------------------------------------------------------
-//Network Use ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-struct net_stats {
-    unsigned long long rx_bytes;
-    unsigned long long tx_bytes;
-    time_t last_checked;
-};
-
-float max_bandwidth_mbps = 1.0f; // 1 Gbps in Mbps, updated on 
-static struct net_stats last_checked_net = {0, 0, 0};
-
-// Function to get bandwidth for wireless interfaces
-float getbandwidth_wireless(const char *interface) {
-    int sockfd;
-    struct iwreq wrq;
-    float bandwidth = -1.0f; // Error indicator
-
-    // Open socket to communicate with kernel
-    if ((sockfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
-        perror("socket");
-        return bandwidth;
-    }
-
-    // Prepare the ioctl structure
-    memset(&wrq, 0, sizeof(wrq));
-    strncpy(wrq.ifr_name, interface, IFNAMSIZ);
-
-    // Get the bit rate
-    if (ioctl(sockfd, SIOCGIWRATE, &wrq) < 0) {
-        close(sockfd);
-        return bandwidth; // Not wireless or error
-    }
-
-    // Convert from iw_param to float. Note: iw_param.value is in bps
-    bandwidth = (float)wrq.u.bitrate.value / 1e6; // Convert bps to Mbps
-
-    close(sockfd);
-    return bandwidth;
-}
-
-// Function to get bandwidth for wired interfaces
-float getbandwidth_wired(const char *interface) {
-    FILE *net_dev = fopen("/proc/net/dev", "r");
-    if (net_dev == NULL) {
-        perror("Error opening /proc/net/dev");
-        return -1.0f;
-    }
-
-    char line[MAX_LINE_LENGTH];
-    unsigned long long rx_bytes, tx_bytes;
-    float bandwidth = 0.0f;
-
-    // Skip header lines
-    for (int i = 0; i < 2; ++i) {
-        if (fgets(line, sizeof(line), net_dev) == NULL) {
-            fclose(net_dev);
-            return -1.0f;
-        }
-    }
-
-    // Find our interface
-    while (fgets(line, sizeof(line), net_dev)) {
-        char iface_name[MAX_LINE_LENGTH];
-        if (sscanf(line, "%[^:]: %llu %*u %*u %*u %*u %*u %*u %*u %llu", iface_name, &rx_bytes, &tx_bytes) == 3) {
-            if (strcmp(iface_name, interface) == 0) {
-                time_t now = time(NULL);
-                float time_diff = (float)(now - last_checked_net.last_checked);
-                
-                if (last_checked_net.last_checked == 0) { // First run, we can't calculate bandwidth correctly
-                    bandwidth = 0.0f; // Or you could return -1.0f to indicate no valid data
-                } else {
-                    // Calculate bandwidth in Mbps for both RX and TX
-                    float rx_mbps = ((float)(rx_bytes - last_checked_net.rx_bytes) * 8) / (time_diff * 1024 * 1024);
-                    float tx_mbps = ((float)(tx_bytes - last_checked_net.tx_bytes) * 8) / (time_diff * 1024 * 1024);
-                    bandwidth = rx_mbps + tx_mbps;
-                }
-
-                // Update last checked values
-                last_checked_net.rx_bytes = rx_bytes;
-                last_checked_net.tx_bytes = tx_bytes;
-                last_checked_net.last_checked = now;
-                
-                break;
-            }
-        }
-    }
-
-    fclose(net_dev);
-    return bandwidth;
-}
-
-// Generalized function to get bandwidth for any interface
-float getbandwidth(const char *interface) {
-    float bandwidth = getbandwidth_wireless(interface);
-    if (bandwidth < 0) { // If it's not wireless or there was an error
-        bandwidth = getbandwidth_wired(interface);
-    }
-    return bandwidth;
-}
-
-// Function to get network link saturation as a percentage
-int netuse(float *saturation, float *mbps) {
-    FILE *net_dev = fopen("/proc/net/dev", "r");
-    if (net_dev == NULL) {
-        perror("Error opening /proc/net/dev");
-        return 1;
-    }
-
-    char line[MAX_LINE_LENGTH];
-    unsigned long long rx_bytes, tx_bytes;
-    *saturation = 0.0f;
-    *mbps = 0.0f;
-
-    // Skip header lines
-    for (int i = 0; i < 2; ++i) {
-        if (fgets(line, sizeof(line), net_dev) == NULL) {
-            fclose(net_dev);
-            return 1;
-        }
-    }
-
-    // Find our interface
-    while (fgets(line, sizeof(line), net_dev)) {
-        char iface_name[MAX_LINE_LENGTH];
-        if (sscanf(line, "%[^:]: %llu %*u %*u %*u %*u %*u %*u %*u %llu", iface_name, &rx_bytes, &tx_bytes) == 3) {
-            if (strcmp(iface_name, interface) == 0) {
-                time_t now = time(NULL);
-                float time_diff = (float)(now - last_checked_net.last_checked);
-                
-                if (last_checked_net.last_checked == 0 || time_diff == 0) { 
-                    // First run or no time has passed, return 0.0 for saturation and bandwidth
-                    *saturation = 0.0f;
-                    *mbps = 0.0f;
-                } else {
-                    // Calculate bandwidth in Mbps for both RX and TX
-                    float rx_diff = (float)(rx_bytes - last_checked_net.rx_bytes);
-                    float tx_diff = (float)(tx_bytes - last_checked_net.tx_bytes);
-                    
-                    if (rx_diff < 0 || tx_diff < 0) {
-                        // Handle potential counter wrap-around or data error
-                        *saturation = 0.0f;
-                        *mbps = 0.0f;
-                    } else {
-                        *mbps = ((rx_diff + tx_diff) * 8) / (time_diff * 1024 * 1024);
-                        float max_bandwidth_mbps = 864.60f; // Use the actual interface speed from your system
-
-                        if (max_bandwidth_mbps > 0) {
-                            *saturation = (*mbps / max_bandwidth_mbps) * 100.0f;
-                            if (*saturation > 100.0f) *saturation = 100.0f; // Cap at 100%
-                        } else {
-                            *saturation = 0.0f;
-                        }
-                    }
-                }
-
-                // Update last checked values
-                last_checked_net.rx_bytes = rx_bytes;
-                last_checked_net.tx_bytes = tx_bytes;
-                last_checked_net.last_checked = now;
-                
-                break;
-            }
-        }
-    }
-
-    fclose(net_dev);
-    return 0; // Success
-}
-//Network Use ------------------------------------------------------------------------------------
 //Memory Use  ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 int memuse(float *usage) {
     FILE *meminfo = fopen("/proc/meminfo", "r");
@@ -398,48 +223,179 @@ int memuse(float *usage) {
 }
 //Memory Use    ------------------------------------------------------------------------------------
 
-void gradient(float value, float max, float min,  uint8_t bright, uint8_t *target, uint8_t elements){
-    //value=variable, max=max possible value, min=min possible value, bright=color intensity 0-255, *target=key index array, elements=#of elements to include from array
-    //write color to array for value from min-max
+void gradient(float value, float max, float min, int map, uint8_t *target, uint8_t elements){
+    //value=variable, max=max possible value, min=min possible value, map=colormap, *target=key index array, elements=#of elements to include from array
+    //each key shows how full its own share of the bar is: empty keys get the start of the colormap, full keys the end
+    float fill[LAYOUT_MAXLEDS];
+    unsigned char color[LAYOUT_MAXLEDS][3];
+    float bars=(value-min)/(max-min)*elements; //number of full keys, one division for the whole bar
     uint8_t i; //for lops
-    //make sure value is within bounds
-    if(value<min) value=min;
-    else if(value>max) value=max;
-    //generate bin size
-    float color[3]; //color array
-    value += -min; //rerange so 0=minimum
-    max += -min; //rearrange so max is reranged as well
-    float binsize = (max)/((float) elements); //since everything is reranged, max is the largest value from 0->max
+    if(elements==0) return;
+    for(i=0; i<elements; i++) fill[i]=bars-i; //colormap_map() clamps to 0-1
+    smooth_apply(&filt, target, fill, elements);
+    colormap_map(map, fill, elements, color);
     for(i=0; i<elements; i++){
-        if (value<0.0){
-            color[0]=0;
-            color[1]=0; //green
-            color[2]=bright; //blue
-            //new_ptr.key[target[i]][3] = SM_BKLT ; //set to backlight color
-        }
-        else if(value<binsize/2){
-            color[0]=0;
-            color[1]=(int) (((float) bright)*value/(binsize/2)); //green
-            color[2]=((float) bright)-color[1]; //blue
-        }
-        else if(value<binsize){
-            color[0]=(int) (((float) bright)*(value-binsize/2)/(binsize/2)); //red
-            color[1]=((float) bright)-color[0]; //green
-            color[2]=0.0;
-        }
-        else { //greater than max, set to max color
-            color[0]=bright;
-            color[1]=0.0;
-            color[2]=0.0;
-        }
-        if(color[0] != new_ptr.key[target[i]][0] || color[1] != new_ptr.key[target[i]][1] || color[2] != new_ptr.key[target[i]][2]){
-            new_ptr.key[target[i]][0]=color[0];
-            new_ptr.key[target[i]][1]=color[1];
-            new_ptr.key[target[i]][2]=color[2];
-            if(new_ptr.key[target[i]][3] != SM_BKLT) new_ptr.key[target[i]][3]=SM_UPD; //set update flag for key unless it is set to backlight mode
-        }
-        value += -binsize; //decrement the value by binsize for the next indicator
+        if(memcmp(color[i], new_ptr->key[target[i]], 3) != 0 || new_ptr->key[target[i]][3] == 0){
+            memcpy(new_ptr->key[target[i]], color[i], 3);
+            if(new_ptr->key[target[i]][3] != SM_BKLT) new_ptr->key[target[i]][3]=SM_UPD; //set update flag for key unless it is set to backlight mode
+        }
+    }
+}
+
+//color key target[i] by value[i] (0-1) through a colormap, marking only the keys that change
+void keycolors(const float *value, int map, const uint8_t *target, int elements){
+    unsigned char color[LAYOUT_MAXLEDS][3];
+    float fill[LAYOUT_MAXLEDS];
+    memcpy(fill, value, elements*sizeof(float));
+    smooth_apply(&filt, target, fill, elements);
+    colormap_map(map, fill, elements, color);
+    for(int i=0; i<elements; i++){
+        if(memcmp(new_ptr->key[target[i]], color[i], 3) != 0 || new_ptr->key[target[i]][3] == 0){
+            memcpy(new_ptr->key[target[i]], color[i], 3);
+            new_ptr->key[target[i]][3]=SM_UPD;
+        }
+    }
+}
+
+//resolve a zone expression to bar graph keys ordered bottom to top, returns the number of keys (0 if the zone isn't on this keyboard)
+uint8_t barzone(const char *expr, uint8_t *keymap) {
+    keyset s;
+    if(zone_parse(&shm_ptr->layout, expr, &s)!=0 || keyset_empty(&s)) {
+        printf("Zone %s is not on the %s keyboard layout, not displaying it\n", expr, shm_ptr->layout.name);
+        return 0;
+    }
+    return (uint8_t) zone_sort(&shm_ptr->layout, s, ZONE_BOTTOMUP, keymap);
+}
+
+//keys of a set of bars: the zones of a comma separated list in order, bars past the end of the list share out the
+//last zone by columns left to right
+void zonebars(const char *list, int nbars, uint8_t (*keymap)[LAYOUT_MAXLEDS], uint8_t *nkeys) {
+    char buf[ZONE_MAXEXPR], *save=NULL;
+    const char *zones[2*NETSTAT_MAXIF > 2*DISKSTAT_MAX ? 2*NETSTAT_MAXIF : 2*DISKSTAT_MAX];
+    int nzones=0;
+    snprintf(buf, sizeof(buf), "%s", list);
+    for(char *z=strtok_r(buf, ",", &save); z!=NULL && nzones<nbars; z=strtok_r(NULL, ",", &save)) zones[nzones++]=z;
+    if(nzones==0) return;
+    for(int b=0; b<nzones-1; b++) nkeys[b]=barzone(zones[b], keymap[b]);
+    int shared=nbars-(nzones-1); //bars splitting the last zone
+    uint8_t cols[LAYOUT_MAXLEDS];
+    keyset s;
+    if(zone_parse(&shm_ptr->layout, zones[nzones-1], &s)!=0 || keyset_empty(&s)) {
+        printf("Zone %s is not on the %s keyboard layout, not displaying it\n", zones[nzones-1], shm_ptr->layout.name);
+        return;
     }
+    int n=zone_sort(&shm_ptr->layout, s, ZONE_LEFTRIGHT, cols);
+    for(int k=0; k<shared; k++){
+        keyset part;
+        keyset_clear(&part);
+        for(int j=k*n/shared; j<(k+1)*n/shared; j++) keyset_add(&part, cols[j]);
+        nkeys[nzones-1+k]=keyset_empty(&part)? 0 : (uint8_t)zone_sort(&shm_ptr->layout, part, ZONE_BOTTOMUP, keymap[nzones-1+k]);
+    }
+}
+
+static int64_t nsec(const struct timespec *t) {
+    return (int64_t)t->tv_sec*1000000000LL+t->tv_nsec;
+}
+
+//sampling thread: reads every source on an absolute deadline and hands the result to the publisher, never waiting on
+//it or on kbled, so a slow commit can't push the ticks around
+void *sampler(void *arg) {
+    struct sampler *sm = arg;
+    struct timespec tick, now, statt;
+    int fast = 1; //updating every <update> ms, otherwise every <heartbeat> ms waiting on the PSI triggers
+    uint32_t calm = 0; //ms without pressure at the fast rate
+    uint64_t seq = 0, ticks = 0, overruns = 0; //overruns: ticks that ended past the next deadline
+    int64_t latesum = 0, latemax = 0; //ns woken after the deadline
+    clock_gettime(CLOCK_MONOTONIC, &tick);
+    statt = tick;
+    while(1){
+        uint32_t period = fast? sm->update : sm->heartbeat;
+        tick.tv_nsec += (long)(period % 1000) * 1000000L;
+        tick.tv_sec += period / 1000 + tick.tv_nsec / 1000000000L;
+        tick.tv_nsec %= 1000000000L;
+        int64_t late;
+        if (sm->psimode && psi_wait(sm->psi, &tick, !fast)) { //a trigger fired during the heartbeat: sample now and keep going fast
+            clock_gettime(CLOCK_MONOTONIC, &tick);
+            if(sm->verbose) printf("Pressure trigger, %u ms updates\n", sm->update);
+            fast = 1;
+            calm = 0;
+            late = 0;
+        } else {
+            if (!sm->psimode) while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &tick, NULL) == EINTR);
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            late = nsec(&now) - nsec(&tick);
+        }
+        struct sample *out = slot_writebuf(sm->out);
+        out->period = period;
+        out->cpuok = cpustat_sample(sm->stat, sm->cpu, CPUSTAT_MAXCPU) >= 0; // load since the last pass
+        if (out->cpuok) cpubin_apply(sm->bins, sm->cpu, out->cpu); //cpus that came online since startup aren't binned and stay off the keys
+        else fprintf(stderr, "Failed to get CPU load\n");
+        if (sm->psimode) {
+            float worst=0.0f;
+            if (psi_sample(sm->psi) != 0) printf("Failed to read pressure stall information.\n");
+            for(int i=0; i<2*PSI_COUNT; i++){
+                out->psi[i]=sm->psi->value[i/2][i%2]/sm->psiscale;
+                if(i%2==0 && sm->psi->value[i/2][0]>worst) worst=sm->psi->value[i/2][0];
+            }
+            //stalling at the trigger level or above keeps the fast rate, PSI_CALMMS of less drops back to the heartbeat
+            if (worst*PSI_WINDOWUS >= sm->psitrigger) {
+                calm = 0;
+                if(!fast && sm->verbose) printf("Pressure %.1f%%, %u ms updates\n", worst*100.0f, sm->update);
+                fast = 1;
+            } else if (fast && (calm += sm->update) >= PSI_CALMMS) {
+                if(sm->verbose) printf("No pressure, %u ms heartbeat\n", sm->heartbeat);
+                fast = 0;
+            }
+        }
+        out->memok = sm->ram != 0 && memuse(out->mem) == 0;
+        if (sm->ram != 0 && !out->memok) printf("Failed to get memory information.\n");
+        if (sm->nbars > 0) {
+            if (netstat_sample(sm->net) != 0) printf("Failed to get network statistics.\n");
+            for(int b=0; b<sm->nbars; b++) //busier direction on one bar per interface, or receive then transmit
+                out->net[b]=netstat_load(&sm->net->ifs[sm->netsplit? b/2 : b], sm->netsplit? 1+b%2 : 0);
+        }
+        if (sm->disk->ndisks > 0) {
+            if (diskstat_sample(sm->disk) != 0) printf("Failed to read %s.\n", DISKSTAT_FILE);
+            for(int b=0; b<sm->disk->ndisks; b++){
+                const struct disk *dk=&sm->disk->disks[b];
+                if(dk->mbps>sm->diskpeak) sm->diskpeak=dk->mbps;
+                out->disk[2*b]=dk->util;
+                out->disk[2*b+1]=dk->mbps/(sm->diskmax>0.0f? sm->diskmax : sm->diskpeak);
+            }
+        }
+        if (sm->sens->n > 0) {
+            if (sensors_sample(sm->sens) != 0) printf("Failed to read a sensor.\n");
+            for(int b=0; b<sm->sens->n; b++) out->sensor[b]=sensors_fill(&sm->sens->s[b]);
+        }
+        if (sm->cg->n > 0) { //empty bars while one doesn't exist
+            if (cgroups_sample(sm->cg) != 0) printf("Failed to read a cgroup.\n");
+            for(int b=0; b<sm->cg->n; b++){
+                out->cgroup[2*b]=sm->cg->g[b].cpu;
+                out->cgroup[2*b+1]=sm->cg->g[b].mem;
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        out->t = now;
+        out->seq = ++seq;
+        slot_publish(sm->out);
+        //a tick that ran into the next deadline skips it rather than firing a burst of late ones to catch up
+        ticks++;
+        latesum += late;
+        if (late > latemax) latemax = late;
+        int64_t next = nsec(&tick) + (int64_t)(fast? sm->update : sm->heartbeat) * 1000000LL;
+        if (nsec(&now) >= next) {
+            overruns++;
+            tick = now;
+        }
+        if (sm->verbose && now.tv_sec - statt.tv_sec >= PSMON_STATS) {
+            printf("Sampler: %llu ticks, woke %.0f us late on average and %.0f us at worst, %llu overruns\n", (unsigned long long)ticks,
+                latesum / 1000.0 / ticks, latemax / 1000.0, (unsigned long long)overruns);
+            ticks = overruns = 0;
+            latesum = latemax = 0;
+            statt = now;
+        }
+    }
+    return NULL;
 }
 
 int main(int argc, char *argv[]) {
@@ -462,12 +418,34 @@ int main(int argc, char *argv[]) {
         }
     }
     
-    memset(&new_ptr, 0, sizeof(struct shared_data));
+    new_ptr = sharedmem_newlocal();
+    if(new_ptr == NULL) return 1;
+    smooth_init(&filt);
     char verbose = 0; // Flag for verbose output
     char memdump = 0; // Flag for dumping shared memory
     char cputime = 0; // Flag for reporting time spent in last kbled keyboard update event
+    uint8_t priority = SM_PRIO_DASHBOARD, alpha = 255; // layer stacking and opacity
     uint8_t ram=0; //flag for showing ram/swap saturation
     uint32_t update = 150; //update time
+    const char *memzone = "membar", *swapzone = "swapbar", *netzone = "netbar"; //zones used for the bar graphs
+    const char *cpuzone = NULL; //zone for the cpu loads, NULL for every key the bar graphs leave free
+    int cpukeys = CPUBIN_MAXBINS, cpugroup = CPUBIN_CORE, cpuagg = CPUBIN_AVG, cpupct = 50, compact = 0; //core to key binning
+    const char *ifnames[NETSTAT_MAXIF]; //network interfaces shown
+    float ifmbps[NETSTAT_MAXIF]; //their link speed from the command line, 0 to read it from the link
+    int nifs = 0, netsplit = 0;
+    int cpumap = COLORMAP_RAMP, memmap = COLORMAP_RAMP, swapmap = COLORMAP_RAMP, netmap = COLORMAP_RAMP, psimap = COLORMAP_RAMP; //colormap of each metric
+    const char *disks[DISKSTAT_MAX], *diskzone = "frow"; //disks shown and their bars
+    int ndisks = 0, diskmap = COLORMAP_RAMP;
+    float diskmax = 0.0f; //MB/s of a full throughput bar, 0 to follow the highest seen
+    const char *sensorspecs[SENSORS_MAX], *sensorzone = "numrow"; //sensors shown and their bars
+    int nsensors = 0, sensormap = COLORMAP_RAMP;
+    const char *cgroupspecs[CGROUPS_MAX], *cgroupzone = "alpha"; //cgroups shown and their bars
+    int ncgroups = 0, cgroupmap = COLORMAP_RAMP;
+    int stats = 0; //report the key updates sent per second
+    int psimode = 0; //pressure keys and event driven update rate
+    const char *psizone = "nav";
+    float psiscale = 0.25f; //stalled share shown at the end of the colormap
+    uint32_t psitrigger = 100000, heartbeat = 2000; //us of stall per PSI_WINDOWUS that wakes the fast updates, quiet update period
     int i = 1;
     
     while (i < argc) {
@@ -490,29 +468,35 @@ int main(int argc, char *argv[]) {
             }
         }
         else if ((strcmp(argv[i], "-n") == 0) || (strcmp(argv[i], "--network") == 0)) {
-            // Set pattern (-1 to 6)
-            if (i + 1 < argc && argv[i+1][0]!='/') {
-                if(verbose)printf("Set network device to: %s\n", argv[i + 1]);
-                strncpy(interface, argv[i+1], MAX_IFLEN-1); //set value, give space for null character
-                printf("Network interface set to %s\n",interface);
+            // add a network interface
+            if (i + 1 < argc && argv[i+1][0]!='/' && nifs < NETSTAT_MAXIF) {
+                if(verbose)printf("Add network device: %s\n", argv[i + 1]);
+                ifnames[nifs]=argv[i+1];
+                ifmbps[nifs++]=0.0f;
                 i += 2;
             } else {
-                fprintf(stderr, "Error: %s expects just the device name, ex: not '/dev/eth0' just 'eth0'\n",argv[i]);
+                fprintf(stderr, "Error: %s expects just the device name, ex: not '/dev/eth0' just 'eth0', at most %i of them\n",argv[i],NETSTAT_MAXIF);
                 return 1;
             }
         }
         else if ((strcmp(argv[i], "-b") == 0) || (strcmp(argv[i], "--bandwidth") == 0)) {
-            // Set pattern (-1 to 6)
-            if (i + 1 < argc && atof(argv[i+1]) >1.0 && atof(argv[i+1]) <- 50000.0) {  //make sure range is greater than 1 megabit and less than or equal to 50 gigabits
-                if(verbose)printf("Set network device %s to: %f\n", interface, atof(argv[i + 1]));
-                max_bandwidth_mbps = atof(argv[i+1]); //set value
-                printf("Network interface speed set to %f Mbps\n",max_bandwidth_mbps);
+            // link speed of the interface given before it
+            if (i + 1 < argc && nifs > 0 && atof(argv[i+1]) >= 1.0 && atof(argv[i+1]) <= 400000.0) {
+                if(verbose)printf("Set network device %s to: %f\n", ifnames[nifs-1], atof(argv[i + 1]));
+                ifmbps[nifs-1] = atof(argv[i+1]); //set value
+                printf("Network interface %s speed set to %f Mbps\n",ifnames[nifs-1],ifmbps[nifs-1]);
                 i += 2;
             } else {
-                fprintf(stderr, "Error: %s expects just the device name, ex: not '/dev/eth0' just 'eth0'\n",argv[i]);
+                fprintf(stderr, "Error: %s expects a speed from 1 to 400000 Mbps after -n <interface>\n",argv[i]);
                 return 1;
             }
         }
+        else if (strcmp(argv[i], "--netsplit") == 0) {
+            // receive and transmit on their own bars
+            if(verbose)printf("Separate receive and transmit bars\n");
+            netsplit=1;
+            i++;
+        }
         else if ((strcmp(argv[i], "-r") == 0) || (strcmp(argv[i], "--ram") == 0)) {
             // display ram saturation
             if(verbose)printf("Display RAM saturation:\n");
@@ -525,6 +509,230 @@ int main(int argc, char *argv[]) {
             ram |= 2;
             i++;
         }
+        else if ((strcmp(argv[i], "--memzone") == 0) || (strcmp(argv[i], "--swapzone") == 0) || (strcmp(argv[i], "--netzone") == 0)) {
+            // keys to use for a bar graph, resolved once attached to the daemon's layout
+            if (i + 1 < argc) {
+                if(verbose)printf("Set %s to: %s\n", argv[i]+2, argv[i + 1]);
+                if(argv[i][2]=='m') memzone=argv[i+1];
+                else if(argv[i][2]=='s') swapzone=argv[i+1];
+                else netzone=argv[i+1];
+                i += 2;
+            } else {
+                fprintf(stderr, "Error: %s requires a zone, see kbledclient --zones\n",argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--cpuzone") == 0) {
+            // keys to show the cpus on, resolved once attached to the daemon's layout
+            if (i + 1 < argc) {
+                if(verbose)printf("Set cpuzone to: %s\n", argv[i + 1]);
+                cpuzone=argv[i+1];
+                i += 2;
+            } else {
+                fprintf(stderr, "Error: %s requires a zone, see kbledclient --zones\n",argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--cpukeys") == 0) {
+            // most keys used for the cpus
+            if (i + 1 < argc && atoi(argv[i + 1]) >= 1 && atoi(argv[i + 1]) <= CPUBIN_MAXBINS) {
+                if(verbose)printf("Set cpukeys to: %s\n", argv[i + 1]);
+                cpukeys=atoi(argv[i+1]);
+                i += 2;
+            } else {
+                fprintf(stderr, "Error: %s requires an argument between 1 and %i\n",argv[i],CPUBIN_MAXBINS);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--cpugroup") == 0) {
+            // topology level kept together on a key
+            if (i + 1 < argc && cpubin_findgroup(argv[i + 1]) >= 0) {
+                if(verbose)printf("Set cpugroup to: %s\n", argv[i + 1]);
+                cpugroup=cpubin_findgroup(argv[i+1]);
+                i += 2;
+            } else {
+                fprintf(stderr, "Error: %s requires cpu, core, package or node\n",argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--cpuagg") == 0) {
+            // how cpus sharing a key are combined
+            if (i + 1 < argc && cpubin_findagg(argv[i + 1], &cpuagg, &cpupct) == 0) {
+                if(verbose)printf("Set cpuagg to: %s\n", argv[i + 1]);
+                i += 2;
+            } else {
+                fprintf(stderr, "Error: %s requires avg, max or p<0-100> e.g. p90\n",argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--compact") == 0) {
+            // one key per topology group
+            if(verbose)printf("Compact cpu display\n");
+            compact=1;
+            i++;
+        }
+        else if ((strcmp(argv[i], "-d") == 0) || (strcmp(argv[i], "--disk") == 0)) {
+            // add a disk, devices joined with + or all
+            if (i + 1 < argc && ndisks < DISKSTAT_MAX && strlen(argv[i + 1]) < DISKSTAT_MAXSPEC) {
+                if(verbose)printf("Add disk: %s\n", argv[i + 1]);
+                disks[ndisks++]=argv[i+1];
+                i += 2;
+            } else {
+                fprintf(stderr, "Error: %s expects a device name like sda or nvme0n1, names joined with + or all, at most %i of them\n",argv[i],DISKSTAT_MAX);
+                return 1;
+            }
+        }
+        else if ((strcmp(argv[i], "--diskzone") == 0) || (strcmp(argv[i], "--diskmax") == 0)) {
+            // disk bar keys and throughput scale
+            if (i + 1 < argc && (argv[i][6]=='z' || atof(argv[i + 1]) > 0.0)) {
+                if(verbose)printf("Set %s to: %s\n", argv[i]+2, argv[i + 1]);
+                if(argv[i][6]=='z') diskzone=argv[i+1];
+                else diskmax=atof(argv[i+1]);
+                i += 2;
+            } else {
+                fprintf(stderr, "Error: %s requires %s\n",argv[i],argv[i][6]=='z'? "a zone, see kbledclient --zones" : "a speed in MB/s");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--sensor") == 0) {
+            // add a hwmon or power_supply sensor
+            if (i + 1 < argc && nsensors < SENSORS_MAX && strlen(argv[i + 1]) < SENSORS_MAXSPEC) {
+                if(verbose)printf("Add sensor: %s\n", argv[i + 1]);
+                sensorspecs[nsensors++]=argv[i+1];
+                i += 2;
+            } else {
+                fprintf(stderr, "Error: %s expects temp, fan, battery or charge, optionally :<chip>:<label> and =<min>,<max>, at most %i of them\n",argv[i],SENSORS_MAX);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--sensorzone") == 0) {
+            // keys for the sensor bars
+            if (i + 1 < argc) {
+                if(verbose)printf("Set sensorzone to: %s\n", argv[i + 1]);
+                sensorzone=argv[i+1];
+                i += 2;
+            } else {
+                fprintf(stderr, "Error: %s requires a zone, see kbledclient --zones\n",argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--cgroup") == 0) {
+            // add a cgroup or systemd unit
+            if (i + 1 < argc && ncgroups < CGROUPS_MAX && strlen(argv[i + 1]) < CGROUPS_MAXSPEC) {
+                if(verbose)printf("Add cgroup: %s\n", argv[i + 1]);
+                cgroupspecs[ncgroups++]=argv[i+1];
+                i += 2;
+            } else {
+                fprintf(stderr, "Error: %s expects a cgroup path like system.slice/sshd.service or a unit like sshd.service, at most %i of them\n",argv[i],CGROUPS_MAX);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--cgroupzone") == 0) {
+            // keys for the cgroup bars
+            if (i + 1 < argc) {
+                if(verbose)printf("Set cgroupzone to: %s\n", argv[i + 1]);
+                cgroupzone=argv[i+1];
+                i += 2;
+            } else {
+                fprintf(stderr, "Error: %s requires a zone, see kbledclient --zones\n",argv[i]);
+                return 1;
+            }
+        }
+        else if ((strcmp(argv[i], "--smooth") == 0) || (strcmp(argv[i], "--hold") == 0)) {
+            // time constant or peak hold of every metric or one of them
+            const char *eq = (i + 1 < argc) ? strchr(argv[i + 1], '=') : NULL, *ms = (eq != NULL) ? eq + 1 : (i + 1 < argc) ? argv[i + 1] : "";
+            int group = -1;
+            for (int m = 0; eq != NULL && m < METRIC_COUNT; m++) if (strncmp(argv[i + 1], metricnames[m], eq - argv[i + 1]) == 0 && metricnames[m][eq - argv[i + 1]] == '\0') group = m;
+            if (isdigit((unsigned char)ms[0]) && atoi(ms) <= 65535 && (eq == NULL || group >= 0)) {
+                if(verbose)printf("Set %s to: %s\n", argv[i]+2, argv[i + 1]);
+                if(argv[i][2]=='s') smooth_set(&filt, group, atoi(ms), -1.0f);
+                else smooth_set(&filt, group, -1.0f, atoi(ms));
+                i += 2;
+            } else {
+                fprintf(stderr, "Error: %s requires [<metric>=]<msec> with msec up to 65535 and metric cpu, mem, swap, net, disk, sensor, cgroup or psi\n",argv[i]);
+                return 1;
+            }
+        }
+        else if ((strcmp(argv[i], "--levels") == 0) || (strcmp(argv[i], "--hysteresis") == 0)) {
+            // quantization of the key colors
+            int lo = (argv[i][2]=='l')? 2 : 0, hi = (argv[i][2]=='l')? COLORMAP_SIZE : 200;
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]) && atoi(argv[i + 1]) >= lo && atoi(argv[i + 1]) <= hi) {
+                if(verbose)printf("Set %s to: %s\n", argv[i]+2, argv[i + 1]);
+                if(argv[i][2]=='l') filt.levels=atoi(argv[i+1]);
+                else filt.band=atoi(argv[i+1])*0.01f;
+                i += 2;
+            } else {
+                fprintf(stderr, "Error: %s requires an argument between %i and %i\n",argv[i],lo,hi);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--stats") == 0) {
+            // key update rate
+            stats=1;
+            i++;
+        }
+        else if (strcmp(argv[i], "--psi") == 0) {
+            // pressure keys and event driven updates
+            if(verbose)printf("Show pressure stall information\n");
+            psimode=1;
+            i++;
+        }
+        else if (strcmp(argv[i], "--psizone") == 0) {
+            // keys for the pressure
+            if (i + 1 < argc) {
+                if(verbose)printf("Set psizone to: %s\n", argv[i + 1]);
+                psizone=argv[i+1];
+                i += 2;
+            } else {
+                fprintf(stderr, "Error: %s requires a zone, see kbledclient --zones\n",argv[i]);
+                return 1;
+            }
+        }
+        else if ((strcmp(argv[i], "--psimax") == 0) || (strcmp(argv[i], "--psitrigger") == 0) || (strcmp(argv[i], "--heartbeat") == 0)) {
+            // pressure scale, trigger level and quiet update period
+            int lo = (argv[i][2]=='h')? 100 : 1, hi = (argv[i][2]=='h')? 65535 : (argv[i][5]=='m')? 100 : 2000;
+            if (i + 1 < argc && atoi(argv[i + 1]) >= lo && atoi(argv[i + 1]) <= hi) {
+                if(verbose)printf("Set %s to: %s\n", argv[i]+2, argv[i + 1]);
+                if(argv[i][2]=='h') heartbeat=atoi(argv[i+1]);
+                else if(argv[i][5]=='m') psiscale=atoi(argv[i+1])*0.01f;
+                else psitrigger=atoi(argv[i+1])*1000;
+                i += 2;
+            } else {
+                fprintf(stderr, "Error: %s requires an argument between %i and %i\n",argv[i],lo,hi);
+                return 1;
+            }
+        }
+        else if ((strcmp(argv[i], "--cpumap") == 0) || (strcmp(argv[i], "--memmap") == 0) || (strcmp(argv[i], "--swapmap") == 0) || (strcmp(argv[i], "--netmap") == 0) || (strcmp(argv[i], "--diskmap") == 0) || (strcmp(argv[i], "--psimap") == 0) || (strcmp(argv[i], "--sensormap") == 0) || (strcmp(argv[i], "--cgroupmap") == 0)) {
+            // colormap of one metric
+            int map = (i + 1 < argc) ? colormap_find(argv[i + 1]) : -1;
+            if (map >= 0) {
+                if(verbose)printf("Set %s to: %s\n", argv[i]+2, argv[i + 1]);
+                if(argv[i][2]=='c' && argv[i][3]=='g') cgroupmap=map;
+                else if(argv[i][2]=='c') cpumap=map;
+                else if(argv[i][2]=='m') memmap=map;
+                else if(argv[i][2]=='s' && argv[i][3]=='e') sensormap=map;
+                else if(argv[i][2]=='s') swapmap=map;
+                else if(argv[i][2]=='n') netmap=map;
+                else if(argv[i][2]=='d') diskmap=map;
+                else psimap=map;
+                i += 2;
+            } else {
+                fprintf(stderr, "Error: %s requires a colormap: %s\n", argv[i], colormap_names());
+                return 1;
+            }
+        }
+        else if ((strcmp(argv[i], "--priority") == 0) || (strcmp(argv[i], "--alpha") == 0)) {
+            // layer priority and opacity
+            if (i + 1 < argc && atoi(argv[i + 1]) >= 0 && atoi(argv[i + 1]) <= 255) {
+                if(verbose)printf("Set layer %s to: %s\n", argv[i]+2, argv[i + 1]);
+                if(argv[i][2]=='p') priority=atoi(argv[i+1]);
+                else alpha=atoi(argv[i+1]);
+                i += 2;
+            } else {
+                fprintf(stderr, "Error: %s requires an argument between 0 and 255\n",argv[i]);
+                return 1;
+            }
+        }
         else if (strcmp(argv[i], "--dump") == 0) {
             // Increase brightness
             if(verbose)printf("Dump contents of shared memory:\n");
@@ -537,6 +745,11 @@ int main(int argc, char *argv[]) {
             memdump=2;
             i++;
         }
+        else if (strcmp(argv[i], "--bench") == 0) {
+            // time the cpu sampler, doesn't need the daemon
+            cpustat_bench((i + 1 < argc) ? (unsigned int)atoi(argv[i + 1]) : 10000);
+            return 0;
+        }
         else if ((strcmp(argv[i], "--help") == 0) || (strcmp(argv[i], "-h") == 0)) {
             // Increase brightness
             print_usage(argv[0]);
@@ -550,92 +763,219 @@ int main(int argc, char *argv[]) {
         }
     }
     //Houskeeping Complete  ------------------------------------------------------------------------------------
+    colormap_init();
     int cores=0;
-    uint8_t cpukeymap[MAX_CORES]={0};
-    int keyidx=0;
-    float cpu[MAX_CORES]={0};
-    float mem[2]; //memory use: 0=mem% 1=swap%
-    uint8_t memkeymap[5]={113,94,75,56,37}; //listed min to max :max to min: {37,56,75,94,113}
-    uint8_t swapkeymap[5]={114,95,76,57,38}; //listed min to max :max to min: {38,57,76,95,114}
-    //uint8_t netkeymap[5]={112,93,74,55,36}; //listed min to max :max to min: {37,56,75,94,113}
-    //uint8_t net100keymap[4]={111,92,73,54}; //100 megabit bar graph (right arrow to 7 key)
-    //uint8_t netkeymap[16]={96,97,98,99,100,101,102,103,104,105,106,107,108,109,110,111}; //bottom row bar
-    uint8_t netkeymap[9]={111,112,92,93,73,74,54,55,36};
+    uint8_t cpukeymap[LAYOUT_MAXLEDS]; //key of each cpu bin
+    static float cpu[CPUSTAT_MAXCPU]; //load of every cpu
+    static struct cpubin bins;
+    uint8_t memkeymap[LAYOUT_MAXLEDS], swapkeymap[LAYOUT_MAXLEDS]; //bar graph keys listed min to max
+    uint8_t netkeymap[2*NETSTAT_MAXIF][LAYOUT_MAXLEDS]; //network bars: each interface, or its receive then transmit bars
+    uint8_t memkeys=0, swapkeys=0, netkeys[2*NETSTAT_MAXIF]={0}; //number of keys in each bar graph
+    int nbars=0; //network bars
+    static struct netstat net;
+    uint8_t diskkeymap[2*DISKSTAT_MAX][LAYOUT_MAXLEDS]; //utilization and throughput bars of each disk
+    uint8_t diskkeys[2*DISKSTAT_MAX]={0};
+    float diskpeak = 10.0f; //highest throughput seen, the full scale when --diskmax isn't given
+    static struct diskstat disk;
+    uint8_t sensorkeymap[SENSORS_MAX][LAYOUT_MAXLEDS]; //one bar per sensor
+    uint8_t sensorkeys[SENSORS_MAX]={0};
+    static struct sensors sens;
+    uint8_t cgroupkeymap[2*CGROUPS_MAX][LAYOUT_MAXLEDS]; //cpu and memory bars of each cgroup
+    uint8_t cgroupkeys[2*CGROUPS_MAX]={0};
+    static struct cgroups cg;
+    uint8_t psikeymap[LAYOUT_MAXLEDS]; //pressure keys left to right
+    int psikeys=0;
+    static struct psi psi;
     
     if(sharedmem_slaveinit(verbose)!=0){
         fprintf(stderr, "Failed to connect to kbled daemon, are you sure it is running?\n");
         return 1;
     }
     if(verbose)printf("Attached to shared memory\n");
+    sharedmem_lock();
+    int layer=sharedmem_layeropen("kbledpsmon", priority, alpha);
+    sharedmem_unlock();
+    if(layer<0){
+        fprintf(stderr, "All %i kbled layers are in use\n", SM_MAXLAYERS);
+        sharedmem_slaveclose(verbose);
+        return 1;
+    }
+    if(ram & 1) memkeys=barzone(memzone, memkeymap);
+    if(ram & 2) swapkeys=barzone(swapzone, swapkeymap);
+    if(nifs>0){
+        if(netstat_open(&net)!=0){
+            sharedmem_slaveclose(verbose);
+            return 1;
+        }
+        for(i=0; i<nifs; i++) if(netstat_add(&net, ifnames[i], ifmbps[i])>=0)
+            printf("Link speed of %s: %.2f Mbps%s\n", ifnames[i], net.ifs[net.nif-1].mbps, ifmbps[i]>0.0f? "" : " (checked every few seconds)");
+        nbars=net.nif*(netsplit? 2 : 1);
+        zonebars(netzone, nbars, netkeymap, netkeys);
+    }
+    if(ndisks>0){
+        if(diskstat_open(&disk)!=0){
+            sharedmem_slaveclose(verbose);
+            return 1;
+        }
+        for(i=0; i<ndisks; i++) if(diskstat_add(&disk, disks[i])>=0 && verbose)
+            printf("Disk %s: %i devices\n", disks[i], disk.disks[disk.ndisks-1].members);
+        zonebars(diskzone, 2*disk.ndisks, diskkeymap, diskkeys);
+        diskstat_sample(&disk); //first counters, the rates start with the next one
+    }
+    if(nsensors>0){
+        for(i=0; i<nsensors; i++) if(sensors_add(&sens, sensorspecs[i])>=0)
+            printf("Sensor %s: %s, %g to %g\n", sensorspecs[i], sens.s[sens.n-1].found, sens.s[sens.n-1].min, sens.s[sens.n-1].max);
+        zonebars(sensorzone, sens.n, sensorkeymap, sensorkeys);
+    }
+    if(ncgroups>0){
+        if(cgroups_open(&cg)!=0){
+            sharedmem_slaveclose(verbose);
+            return 1;
+        }
+        for(i=0; i<ncgroups; i++) if(cgroups_add(&cg, cgroupspecs[i])>=0)
+            printf("Cgroup %s: %s/%s%s\n", cgroupspecs[i], cg.root, cg.g[cg.n-1].path, cg.g[cg.n-1].fdcpu>=0? "" : " (waiting for it)");
+        zonebars(cgroupzone, 2*cg.n, cgroupkeymap, cgroupkeys);
+        cgroups_sample(&cg); //first usage, the loads start with the next one
+    }
+    if(psimode){
+        if(psi_open(&psi, psitrigger)!=0){
+            sharedmem_slaveclose(verbose);
+            return 1;
+        }
+        printf("Pressure of");
+        for(i=0; i<PSI_COUNT; i++) if(psi.fd[i]>=0) printf(" %s%s", psi_name(i), psi.trig[i]>=0? "" : " (no trigger)");
+        printf(", %u ms heartbeat without any\n", heartbeat);
+        keyset s;
+        if(zone_parse(&shm_ptr->layout, psizone, &s)!=0 || keyset_empty(&s))
+            printf("Zone %s is not on the %s keyboard layout, not displaying pressure\n", psizone, shm_ptr->layout.name);
+        else psikeys=zone_sort(&shm_ptr->layout, s, ZONE_LEFTRIGHT, psikeymap);
+        if(psikeys>2*PSI_COUNT) psikeys=2*PSI_COUNT;
+    }
     //find out how many cores we are dealing with
-    cpuload(cpu, &cores, 100);
-    printf("Found %i cores, assigning to keys 0 to %i\n",cores, cores-1);
-    for(i=0;i<MAX_CORES;i++){ //load defaults into cpu activity keymap array
-        if(i<NKEYS) cpukeymap[i]=i;
-        else cpukeymap[MAX_CORES]=NKEYS-1; //out of keys to assign.  You either have a lot of processor cores or not many keys!
+    struct cpustat stat;
+    if(cpustat_open(&stat, CPUSTAT_FILE)!=0){
+        sharedmem_slaveclose(verbose);
+        return 1;
     }
-    //handle network interface
-    if(max_bandwidth_mbps==1.0) max_bandwidth_mbps = getbandwidth(interface); //if bandwidth wasn't set on command line, set it automagically
-    if (max_bandwidth_mbps > 0) {
-        printf("Bandwidth for %s: %.2f Mbps\n", interface, max_bandwidth_mbps);
+    cores=stat.ncpu;
+    //cpu keys: the zone asked for, or every key the bar graphs don't use, in layout order
+    keyset cpuset;
+    if(cpuzone!=NULL){
+        if(zone_parse(&shm_ptr->layout, cpuzone, &cpuset)!=0 || keyset_empty(&cpuset)){
+            fprintf(stderr, "Zone %s is not on the %s keyboard layout\n", cpuzone, shm_ptr->layout.name);
+            sharedmem_slaveclose(verbose);
+            return 1;
+        }
     } else {
-        printf("Failed to get bandwidth for %s.  Setting to gigabit (1000 megabits)\n", interface);
-        max_bandwidth_mbps = 1000.0;
+        cpuset=keyset_first(shm_ptr->nkeys);
+        for(i=0; i<memkeys; i++) keyset_remove(&cpuset, memkeymap[i]);
+        for(i=0; i<swapkeys; i++) keyset_remove(&cpuset, swapkeymap[i]);
+        for(int b=0; b<nbars; b++) for(i=0; i<netkeys[b]; i++) keyset_remove(&cpuset, netkeymap[b][i]);
+        for(i=0; i<psikeys; i++) keyset_remove(&cpuset, psikeymap[i]);
+        for(int b=0; b<2*disk.ndisks; b++) for(i=0; i<diskkeys[b]; i++) keyset_remove(&cpuset, diskkeymap[b][i]);
+        for(int b=0; b<sens.n; b++) for(i=0; i<sensorkeys[b]; i++) keyset_remove(&cpuset, sensorkeymap[b][i]);
+        for(int b=0; b<2*cg.n; b++) for(i=0; i<cgroupkeys[b]; i++) keyset_remove(&cpuset, cgroupkeymap[b][i]);
     }
-    float saturation,mbps;
-    //netuse(&saturation,&mbps);
-    if (netuse(&saturation,&mbps) == 0) {
-        printf("Network link saturation: %.2f%%\n", saturation);
-    } else {
-        printf("Failed to get network saturation.\n");
+    int ncpukeys=0;
+    for(int k=keyset_next(&cpuset, -1); k>=0 && ncpukeys<cpukeys; k=keyset_next(&cpuset, k)) cpukeymap[ncpukeys++]=(uint8_t)k;
+    cpubin_build(&bins, cores, cpugroup, ncpukeys, compact, cpuagg, cpupct);
+    //smoothing group of every key, a key in two graphs goes with the later one
+    smooth_assign(&filt, METRIC_CPU, cpukeymap, bins.nbins);
+    smooth_assign(&filt, METRIC_MEM, memkeymap, memkeys);
+    smooth_assign(&filt, METRIC_SWAP, swapkeymap, swapkeys);
+    for(int b=0; b<nbars; b++) smooth_assign(&filt, METRIC_NET, netkeymap[b], netkeys[b]);
+    for(int b=0; b<2*disk.ndisks; b++) smooth_assign(&filt, METRIC_DISK, diskkeymap[b], diskkeys[b]);
+    for(int b=0; b<sens.n; b++) smooth_assign(&filt, METRIC_SENSOR, sensorkeymap[b], sensorkeys[b]);
+    for(int b=0; b<2*cg.n; b++) smooth_assign(&filt, METRIC_CGROUP, cgroupkeymap[b], cgroupkeys[b]);
+    smooth_assign(&filt, METRIC_PSI, psikeymap, psikeys);
+    printf("Found %i cpus in %i %s groups, showing them on %i keys", cores, bins.ngroups, cpubin_groupname(cpugroup), bins.nbins);
+    if(bins.nbins<cores) printf(" (%s of up to %i cpus per key)", cpuagg==CPUBIN_AVG? "average" : cpuagg==CPUBIN_MAX? "max" : "percentile", (cores+bins.nbins-1)/bins.nbins);
+    printf("\n");
+    if(nifs>0) netstat_sample(&net); //first counters, the rates start with the next one
+    if (psimode && psi.ntrig == 0) printf("Could not set pressure triggers, going fast when a heartbeat sees pressure\n");
+    //sampling runs on its own thread, this one draws and commits whatever sample is newest
+    static struct slot slot;
+    static struct sampler smp;
+    pthread_t sampling;
+    smp = (struct sampler){ .out = &slot, .verbose = verbose, .update = update, .heartbeat = heartbeat, .stat = &stat, .bins = &bins, .cpu = cpu,
+        .ram = ram, .net = &net, .nbars = nbars, .netsplit = netsplit, .disk = &disk, .diskmax = diskmax, .diskpeak = diskpeak, .sens = &sens,
+        .cg = &cg, .psimode = psimode, .psi = &psi, .psiscale = psiscale, .psitrigger = psitrigger };
+    if (slot_init(&slot, sizeof(struct sample)) != 0 || pthread_create(&sampling, NULL, sampler, &smp) != 0) {
+        fprintf(stderr, "Failed to start the sampling thread\n");
+        sharedmem_slaveclose(verbose);
+        return 1;
     }
+    unsigned char shown[LAYOUT_MAXLEDS][3]; //colors on our layer, only keys that differ from them are sent
+    uint8_t drawn[LAYOUT_MAXLEDS] = {0}, send[LAYOUT_MAXLEDS];
+    uint64_t sent = 0, passes = 0, lastseq = 0, skipped = 0; //keys sent, updates and samples never drawn since the last report
+    int64_t latsum = 0, latmax = 0; //ns from the end of a sample to the end of its commit
+    struct timespec statt, now, lastt; //lastt: when the last sample drawn was taken
+    clock_gettime(CLOCK_MONOTONIC, &statt);
     while(1){
-        //usleep((uint32_t)update * 1000); //polling time
-        if (cpuload(cpu, &cores, update) != 0) { // Average over <update> ms, also serves to pause between updates
-            fprintf(stderr, "Failed to get CPU load\n");
-        } else{
-            new_ptr.status|=SM_KEY;
-            for(i=0;i<32; i++){
-                keyidx=cpukeymap[i];
-                if(cpu[i]<50.0){
-                    new_ptr.key[keyidx][3]=SM_UPD;
-                    new_ptr.key[keyidx][0]=0; //red
-                    new_ptr.key[keyidx][1]=(int)  (255.0*cpu[i]/50.0); //green
-                    new_ptr.key[keyidx][2]=255-new_ptr.key[keyidx][0]; //blue
-                } else {
-                    new_ptr.key[keyidx][3]=SM_UPD;
-                    new_ptr.key[keyidx][0]=(int)  (255.0*(cpu[i]-50.0)/50.0); //red
-                    new_ptr.key[keyidx][1]=255-new_ptr.key[keyidx][0]; //green
-                    new_ptr.key[keyidx][2]=0; //blue
-                }
-            }
+        const struct sample *in = slot_wait(&slot);
+        //the smoothing goes by the time between the samples drawn, not the planned period: a PSI trigger cuts a
+        //heartbeat short and skipped samples leave several periods between two drawn ones
+        int64_t gap = (lastseq == 0) ? (int64_t)in->period * 1000000LL : nsec(&in->t) - nsec(&lastt);
+        skipped += in->seq - lastseq - 1;
+        lastseq = in->seq;
+        lastt = in->t;
+        smooth_tick(&filt, (gap < 1000000LL) ? 1 : (uint32_t)((gap + 500000LL) / 1000000LL));
+        if (in->cpuok) {
+            keycolors(in->cpu, cpumap, cpukeymap, bins.nbins);
+            new_ptr->status |= SM_KEY;
         }
-        if (ram !=0 && memuse(mem) == 0) {
-            //printf("RAM used: %.2f%% Swap used: %.2f%%\n", mem[0], mem[1]);
-            if(ram & 1) gradient(mem[0], 100.0, 0.0,  255, memkeymap, (uint8_t) sizeof(memkeymap));
-            if(ram & 2)gradient(mem[1], 100.0, 0.0,  255, swapkeymap, (uint8_t) sizeof(swapkeymap));
-            new_ptr.status |= SM_KEY;
-        } else {
-            if(ram !=0) printf("Failed to get memory information.\n");
+        if (psimode) {
+            if(psikeys) keycolors(in->psi, psimap, psikeymap, psikeys);
+            new_ptr->status |= SM_KEY;
         }
-        //Network
-        if(interface[0]!='*' && time(NULL)-last_checked_net.last_checked>1){
-            if (netuse(&saturation, &mbps) == 0) {
-                //printf("Network link saturation: %.2f%% @ %02f mbps\n", saturation, mbps);
-                gradient(saturation, 100.0, 0.0,  255, netkeymap, (uint8_t) sizeof(netkeymap));
-            } else {
-                printf("Failed to get network saturation.\n");
-            }
-        } //else it is too soon
+        if (in->memok) {
+            if(memkeys) gradient(in->mem[0], 100.0, 0.0, memmap, memkeymap, memkeys);
+            if(swapkeys) gradient(in->mem[1], 100.0, 0.0, swapmap, swapkeymap, swapkeys);
+            new_ptr->status |= SM_KEY;
+        }
+        for(int b=0; b<nbars; b++) if(netkeys[b]) gradient(in->net[b], 1.0, 0.0, netmap, netkeymap[b], netkeys[b]);
+        for(int b=0; b<2*disk.ndisks; b++) if(diskkeys[b]) gradient(in->disk[b], 1.0, 0.0, diskmap, diskkeymap[b], diskkeys[b]);
+        for(int b=0; b<sens.n; b++) if(sensorkeys[b]) gradient(in->sensor[b], 1.0, 0.0, sensormap, sensorkeymap[b], sensorkeys[b]);
+        for(int b=0; b<2*cg.n; b++) if(cgroupkeys[b]) gradient(in->cgroup[b], 1.0, 0.0, cgroupmap, cgroupkeymap[b], cgroupkeys[b]);
+        if (nbars > 0 || disk.ndisks > 0 || sens.n > 0 || cg.n > 0) new_ptr->status |= SM_KEY;
         
-        sharedmem_lock(); //lock semaphore **************************************************************************************
-        if(verbose)printf("Semaphore opened\n");
-        if(new_ptr.status!=0) shm_ptr->status=new_ptr.status;
-        if(new_ptr.status & SM_KEY)     for(i=0; i<4; i++) for(int j=0; j<NKEYS; j++) if(new_ptr.key[3]!=0)shm_ptr->key[j][i]=new_ptr.key[j][i];
-        if(memdump) sharedmem_printstructure(shm_ptr,memdump);
-        if(cputime) printf("Last kbled daemon LED update time: %f ms, idle loop time %f ns\n", shm_ptr->lastcputime*1000.0,shm_ptr->idlecputime*1000.0);
-        sharedmem_unlock(); //unlock semaphore  *********************************************************************************************************
-        if(verbose)printf("Semaphore closed\n");
+        //only the keys whose final color changed go to kbled, each one is a report to the keyboard
+        int nsend=0;
+        if(new_ptr->status & SM_KEY) for(int j=0; j<shm_ptr->nkeys; j++){
+            if(new_ptr->key[j][3]==SM_BKLT) { if(drawn[j]) send[nsend++]=j; }
+            else if(new_ptr->key[j][3]!=0 && (!drawn[j] || memcmp(shown[j], new_ptr->key[j], 3)!=0)) send[nsend++]=j;
+        }
+        new_ptr->status &= ~SM_KEY;
+        sent+=nsend;
+        passes++;
+        if(nsend>0 || memdump || cputime){ //nothing changed, no semaphore
+            sharedmem_lock(); //lock semaphore **************************************************************************************
+            if(verbose)printf("Semaphore opened\n");
+            for(int n=0; n<nsend; n++){ //draw on our own layer, the daemon blends it over the keys underneath
+                int j=send[n];
+                if(new_ptr->key[j][3]==SM_BKLT) sharedmem_layerclear(layer, j);
+                else sharedmem_layerkey(layer, j, new_ptr->key[j]);
+                memcpy(shown[j], new_ptr->key[j], 3);
+                drawn[j]= new_ptr->key[j][3]!=SM_BKLT;
+            }
+            if(memdump) sharedmem_printstructure(shm_ptr,memdump);
+            if(cputime) printf("Last kbled daemon LED update time: %f ms, idle loop time %f ns\n", shm_ptr->lastcputime*1000.0,shm_ptr->idlecputime*1000.0);
+            sharedmem_unlock(); //unlock semaphore  *********************************************************************************************************
+            if(verbose)printf("Semaphore closed\n");
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        int64_t lat = nsec(&now) - nsec(&in->t);
+        latsum += lat;
+        if (lat > latmax) latmax = lat;
+        if((stats || verbose) && now.tv_sec-statt.tv_sec >= PSMON_STATS){
+            double dt=(now.tv_sec-statt.tv_sec)+(now.tv_nsec-statt.tv_nsec)*1e-9;
+            if(stats) printf("%.1f key reports/s, %.2f of %i keys per update at %.1f updates/s\n", sent/dt, (double)sent/passes, shm_ptr->nkeys, passes/dt);
+            if(verbose) printf("Publisher: %llu samples drawn, %llu skipped, committed %.0f us after sampling on average and %.0f us at worst\n",
+                (unsigned long long)passes, (unsigned long long)skipped, latsum / 1000.0 / passes, latmax / 1000.0);
+            sent=passes=skipped=0;
+            latsum=latmax=0;
+            statt=now;
+        }
     }
     
     sharedmem_slaveclose(verbose);
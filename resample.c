@@ -0,0 +1,125 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * Picture to LED resampling, see resample.h
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "resample.h"
+
+int resample_build(struct resample *m, const struct layout *l, uint16_t w, uint16_t h){
+    if(m->pix!=NULL && m->w==w && m->h==h && m->nleds==l->nleds) return 0;
+    resample_free(m);
+    if(w==0 || h==0 || l->nleds==0) return 1;
+    uint32_t cap=(uint32_t)l->nleds*RESAMPLE_GRID*RESAMPLE_GRID*4;
+    m->pix=malloc(cap*sizeof(uint32_t));
+    m->weight=malloc(cap*sizeof(uint32_t));
+    if(m->pix==NULL || m->weight==NULL){
+        resample_free(m);
+        return 1;
+    }
+    //keyboard outline from the LED centers, each LED covers one key unit around its center
+    int kx0=l->x[0], kx1=l->x[0], ky0=l->y[0], ky1=l->y[0];
+    for(int i=1; i<l->nleds; i++){
+        if(l->x[i]<kx0) kx0=l->x[i];
+        if(l->x[i]>kx1) kx1=l->x[i];
+        if(l->y[i]<ky0) ky0=l->y[i];
+        if(l->y[i]>ky1) ky1=l->y[i];
+    }
+    kx0-=LAYOUT_UNIT/2; kx1+=LAYOUT_UNIT/2;
+    ky0-=LAYOUT_UNIT/2; ky1+=LAYOUT_UNIT/2;
+    //pixels per coordinate unit with the whole picture on the keyboard, then centered
+    float s=fmaxf((float)w/(kx1-kx0), (float)h/(ky1-ky0));
+    float offx=(w-(kx1-kx0)*s)/2.0f, offy=(h-(ky1-ky0)*s)/2.0f;
+    float box=s*LAYOUT_UNIT; //key size in pixels
+    int n=(int)ceilf(box);
+    if(n<1) n=1;
+    if(n>RESAMPLE_GRID) n=RESAMPLE_GRID;
+    m->w=w;
+    m->h=h;
+    m->nleds=l->nleds;
+    m->nnz=0;
+    for(int i=0; i<l->nleds; i++){
+        //n x n points spread over the key, each split between the 4 pixels around it
+        uint32_t pix[RESAMPLE_GRID*RESAMPLE_GRID*4];
+        float wt[RESAMPLE_GRID*RESAMPLE_GRID*4], total=0.0f;
+        int np=0, inside=0;
+        float bx=(l->x[i]-kx0)*s+offx-box/2.0f, by=(l->y[i]-ky0)*s+offy-box/2.0f;
+        m->row[i]=m->nnz;
+        for(int a=0; a<n; a++) for(int b=0; b<n; b++){
+            float px=bx+(a+0.5f)*box/n, py=by+(b+0.5f)*box/n;
+            if(px<0.0f || py<0.0f || px>=w || py>=h) continue;
+            inside++;
+            float fx=px-0.5f, fy=py-0.5f;
+            int x0=(int)floorf(fx), y0=(int)floorf(fy);
+            float tx=fx-x0, ty=fy-y0;
+            for(int c=0; c<4; c++){
+                int x=x0+(c&1), y=y0+(c>>1);
+                float f=((c&1)? tx : 1.0f-tx)*((c>>1)? ty : 1.0f-ty);
+                if(f<=0.0f) continue;
+                if(x<0) x=0;
+                if(x>=w) x=w-1;
+                if(y<0) y=0;
+                if(y>=h) y=h-1;
+                uint32_t p=(uint32_t)y*w+x;
+                int k;
+                for(k=0; k<np && pix[k]!=p; k++);
+                if(k==np){
+                    pix[np]=p;
+                    wt[np++]=0.0f;
+                }
+                wt[k]+=f;
+                total+=f;
+            }
+        }
+        if(inside*2<n*n || total<=0.0f) continue; //mostly off the picture, the key is left alone
+        //integer weights adding up to exactly RESAMPLE_ONE, the rounding goes to the biggest
+        uint32_t sum=0;
+        int big=0;
+        for(int k=0; k<np; k++){
+            uint32_t q=(uint32_t)lroundf(wt[k]/total*RESAMPLE_ONE);
+            if(wt[k]>wt[big]) big=k;
+            wt[k]=q;
+            sum+=q;
+        }
+        wt[big]+=(float)((int64_t)RESAMPLE_ONE-sum);
+        for(int k=0; k<np; k++){
+            if(wt[k]<=0.0f) continue;
+            m->pix[m->nnz]=pix[k];
+            m->weight[m->nnz++]=(uint32_t)wt[k];
+        }
+    }
+    m->row[l->nleds]=m->nnz;
+    return 0;
+}
+
+void resample_free(struct resample *m){
+    free(m->pix);
+    free(m->weight);
+    m->pix=NULL;
+    m->weight=NULL;
+    m->nnz=0;
+}
+
+keyset resample_apply(const struct resample *m, const unsigned char *rgb, unsigned char (*led)[3]){
+    keyset covered;
+    keyset_clear(&covered);
+    for(int i=0; i<m->nleds; i++){
+        uint32_t r=RESAMPLE_ONE/2, g=RESAMPLE_ONE/2, b=RESAMPLE_ONE/2;
+        if(m->row[i]==m->row[i+1]) continue;
+        for(uint32_t k=m->row[i]; k<m->row[i+1]; k++){
+            const unsigned char *p=rgb+(size_t)m->pix[k]*3;
+            r+=m->weight[k]*p[0];
+            g+=m->weight[k]*p[1];
+            b+=m->weight[k]*p[2];
+        }
+        led[i][0]=r>>16;
+        led[i][1]=g>>16;
+        led[i][2]=b>>16;
+        keyset_add(&covered, i);
+    }
+    return covered;
+}
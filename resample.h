@@ -0,0 +1,35 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * Resample a picture onto the LEDs of a keyboard layout.  The weights of every source pixel for every LED are
+ * worked out once per picture size and kept as a sparse matrix in compressed row form (one row per LED, only the
+ * pixels under the key), so each frame after that is a sparse matrix times the pixel vector.
+ */
+
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <stdint.h>
+#include "layout.h"
+
+#define RESAMPLE_GRID 8          //most sample points across a key in each direction, bounds the weights per LED
+#define RESAMPLE_ONE  (1u<<16)   //weights of a row add up to this
+
+struct resample {
+    uint16_t w, h;                    //picture size the weights were built for
+    uint8_t nleds;                    //rows
+    uint32_t row[LAYOUT_MAXLEDS+1];   //weights of LED i are [row[i], row[i+1]), an empty row is a key off the picture
+    uint32_t nnz;                     //number of weights
+    uint32_t *pix;                    //pixel index (y*w+x) of each weight
+    uint32_t *weight;                 //weight out of RESAMPLE_ONE
+};
+
+//weights for a w x h picture fitted to the keyboard (aspect ratio kept, centered), 0 on success.  Reuses m if it
+//was already built for the same size
+int resample_build(struct resample *m, const struct layout *l, uint16_t w, uint16_t h);
+void resample_free(struct resample *m);
+//LED colors of a packed RGB picture, returns a keyset of the LEDs the picture covers
+keyset resample_apply(const struct resample *m, const unsigned char *rgb, unsigned char (*led)[3]);
+
+#endif
@@ -0,0 +1,211 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * hwmon and power_supply sensors, see sensors.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "sensors.h"
+
+#define SENSORS_MAXHWMON 64  //hwmon<n> directories looked at
+#define SENSORS_MAXCHAN  32  //temp<n>/fan<n> channels looked at
+
+static const char *const kinds[SENSOR_KINDS]={"temp", "fan", "battery", "charge"};
+static const float kindmin[SENSOR_KINDS]={30.0f, 0.0f, 0.0f, -65.0f};
+static const float kindmax[SENSOR_KINDS]={100.0f, 5000.0f, 100.0f, 65.0f};
+//chips that carry the cpu package temperature, best first, and the label of that temperature on each
+static const char *const cpuchips[][2]={{"coretemp", "Package id"}, {"k10temp", "Tctl"}, {"zenpower", "Tdie"}, {"cpu_thermal", ""}, {"acpitz", ""}};
+
+//first line of a small sysfs file without the newline, 0 on success
+static int sensors_text(const char *path, char *buf, size_t len){
+    int fd=open(path, O_RDONLY | O_CLOEXEC);
+    if(fd<0) return -1;
+    ssize_t n=read(fd, buf, len-1);
+    close(fd);
+    if(n<=0) return -1;
+    buf[n]='\0';
+    buf[strcspn(buf, "\n")]='\0';
+    return 0;
+}
+
+//reread an open attribute, 0 on success
+static int sensors_number(int fd, double *v){
+    char buf[32];
+    ssize_t n=pread(fd, buf, sizeof(buf)-1, 0);
+    if(n<=0) return -1;
+    buf[n]='\0';
+    *v=strtod(buf, NULL);
+    return 0;
+}
+
+static int sensors_open(const char *dir, const char *file){
+    char path[384];
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+//hwmon channel <type><n>_input of dir matching chan (a number, a label prefix or "" for want, then the first one)
+static int sensors_channel(const char *dir, const char *type, const char *chan, const char *want){
+    char file[64], label[64], path[256];
+    if(chan[0] && isdigit((unsigned char)chan[0])) {
+        snprintf(file, sizeof(file), "%s%i_input", type, atoi(chan));
+        return sensors_open(dir, file);
+    }
+    const char *match= chan[0]? chan : want;
+    int first=-1;
+    for(int n=1; n<=SENSORS_MAXCHAN; n++){
+        snprintf(path, sizeof(path), "%s/%s%i_input", dir, type, n);
+        if(access(path, R_OK)!=0) continue;
+        if(first<0) first=n;
+        snprintf(path, sizeof(path), "%s/%s%i_label", dir, type, n);
+        if(match[0] && sensors_text(path, label, sizeof(label))==0 && strncasecmp(label, match, strlen(match))==0) {
+            snprintf(file, sizeof(file), "%s%i_input", type, n);
+            return sensors_open(dir, file);
+        }
+    }
+    if(chan[0] || first<0) return -1; //a label was asked for and isn't there
+    snprintf(file, sizeof(file), "%s%i_input", type, first);
+    return sensors_open(dir, file);
+}
+
+//find a temperature or fan: the named chip, otherwise the cpu chips in order (temp) or any chip with fans
+static int sensors_hwmon(struct sensor *s, const char *chip, const char *chan){
+    char dir[128], path[192], name[64];
+    const char *type= (s->kind==SENSOR_TEMP)? "temp" : "fan";
+    int passes= (chip[0] || s->kind==SENSOR_FAN)? 1 : (int)(sizeof(cpuchips)/sizeof(cpuchips[0]));
+    for(int pass=0; pass<passes; pass++){
+        for(int h=0; h<SENSORS_MAXHWMON; h++){
+            snprintf(dir, sizeof(dir), "%s/hwmon%i", SENSORS_HWMON, h);
+            snprintf(path, sizeof(path), "%s/name", dir);
+            if(sensors_text(path, name, sizeof(name))!=0) continue;
+            if(chip[0] && strcasecmp(name, chip)!=0) continue;
+            if(!chip[0] && s->kind==SENSOR_TEMP && strcasecmp(name, cpuchips[pass][0])!=0) continue;
+            int fd=sensors_channel(dir, type, chan, (!chip[0] && s->kind==SENSOR_TEMP)? cpuchips[pass][1] : "");
+            if(fd<0) continue;
+            s->fd[0]=fd;
+            snprintf(s->found, sizeof(s->found), "hwmon%i %s", h, name);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+//find a battery: the named supply, otherwise the first one of type Battery by name
+static int sensors_battery(struct sensor *s, const char *supply){
+    char dir[320], path[320], type[32], best[256]="";
+    if(supply[0]) snprintf(best, sizeof(best), "%s", supply);
+    else {
+        DIR *d=opendir(SENSORS_POWER);
+        struct dirent *e;
+        while(d!=NULL && (e=readdir(d))!=NULL){
+            if(e->d_name[0]=='.') continue;
+            snprintf(path, sizeof(path), "%s/%s/type", SENSORS_POWER, e->d_name);
+            if(sensors_text(path, type, sizeof(type))==0 && strcmp(type, "Battery")==0 && (best[0]=='\0' || strcmp(e->d_name, best)<0))
+                snprintf(best, sizeof(best), "%s", e->d_name);
+        }
+        if(d!=NULL) closedir(d);
+        if(best[0]=='\0') return -1;
+    }
+    snprintf(dir, sizeof(dir), "%s/%s", SENSORS_POWER, best);
+    if(s->kind==SENSOR_BATTERY) s->fd[0]=sensors_open(dir, "capacity");
+    else {
+        s->status=sensors_open(dir, "status");
+        if((s->fd[0]=sensors_open(dir, "power_now"))<0) { //otherwise current times voltage
+            s->fd[0]=sensors_open(dir, "current_now");
+            s->fd[1]=sensors_open(dir, "voltage_now");
+            s->scale=1e-12f;
+            if(s->fd[1]<0) return -1;
+        }
+    }
+    snprintf(s->found, sizeof(s->found), "%.*s", (int)sizeof(s->found)-1, best);
+    return (s->fd[0]<0)? -1 : 0;
+}
+
+static void sensors_release(struct sensor *s){
+    for(int i=0; i<SENSORS_MAXFILES; i++) if(s->fd[i]>=0) close(s->fd[i]);
+    if(s->status>=0) close(s->status);
+}
+
+int sensors_add(struct sensors *ss, const char *spec){
+    char buf[SENSORS_MAXSPEC], *range, *chip="", *chan="";
+    if(ss->n>=SENSORS_MAX){
+        printf("Only %i sensors can be shown, %s ignored\n", SENSORS_MAX, spec);
+        return -1;
+    }
+    struct sensor *s=&ss->s[ss->n];
+    memset(s, 0, sizeof(*s));
+    for(int i=0; i<SENSORS_MAXFILES; i++) s->fd[i]=-1;
+    s->status=-1;
+    snprintf(s->spec, sizeof(s->spec), "%s", spec);
+    snprintf(buf, sizeof(buf), "%s", spec);
+    if((range=strchr(buf, '='))!=NULL) *range++='\0';
+    char *colon=strchr(buf, ':');
+    if(colon!=NULL) {
+        *colon='\0';
+        chip=colon+1;
+        if((colon=strchr(chip, ':'))!=NULL) {
+            *colon='\0';
+            chan=colon+1;
+        }
+    }
+    s->kind=-1;
+    for(int k=0; k<SENSOR_KINDS; k++) if(strcasecmp(buf, kinds[k])==0) s->kind=k;
+    if(s->kind<0){
+        printf("Unknown sensor %s, use temp, fan, battery or charge\n", spec);
+        return -1;
+    }
+    s->min=kindmin[s->kind];
+    s->max=kindmax[s->kind];
+    if(range!=NULL && (sscanf(range, "%f,%f", &s->min, &s->max)!=2 || s->max<=s->min)){
+        printf("Sensor %s: the range is =<min>,<max>\n", spec);
+        return -1;
+    }
+    s->scale= (s->kind==SENSOR_TEMP)? 0.001f : (s->kind==SENSOR_CHARGE)? 1e-6f : 1.0f;
+    int found= (s->kind==SENSOR_TEMP || s->kind==SENSOR_FAN)? sensors_hwmon(s, chip, chan) : sensors_battery(s, chip);
+    if(found!=0){
+        printf("No sensor found for %s\n", spec);
+        sensors_release(s);
+        return -1;
+    }
+    return ss->n++;
+}
+
+int sensors_sample(struct sensors *ss){
+    int fail=0;
+    for(int i=0; i<ss->n; i++){
+        struct sensor *s=&ss->s[i];
+        double v, volts;
+        if(sensors_number(s->fd[0], &v)!=0 || (s->fd[1]>=0 && sensors_number(s->fd[1], &volts)!=0)) {
+            fail=-1;
+            continue;
+        }
+        if(s->fd[1]>=0) v*=volts;
+        v*=s->scale;
+        if(s->kind==SENSOR_CHARGE){ //some batteries sign their own power, some don't: go by the status
+            char status[16];
+            ssize_t n= (s->status>=0)? pread(s->status, status, sizeof(status)-1, 0) : -1;
+            if(v<0.0) v=-v;
+            if(n>0 && strncmp(status, "Discharging", 11)==0) v=-v;
+        }
+        s->value=(float)v;
+    }
+    return fail;
+}
+
+void sensors_close(struct sensors *ss){
+    for(int i=0; i<ss->n; i++) sensors_release(&ss->s[i]);
+    ss->n=0;
+}
+
+float sensors_fill(const struct sensor *s){
+    float f=(s->value-s->min)/(s->max-s->min);
+    return (f<0.0f)? 0.0f : (f>1.0f)? 1.0f : f;
+}
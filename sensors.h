@@ -0,0 +1,50 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * Temperature, fan and battery sensors for kbledpsmon.  Each sensor is looked up once in /sys/class/hwmon or
+ * /sys/class/power_supply when it is added, the attribute files it needs stay open and every sample is a pread from
+ * offset 0, so there is no path lookup or directory scan after startup.
+ */
+
+#ifndef SENSORS_H
+#define SENSORS_H
+
+#define SENSORS_HWMON    "/sys/class/hwmon"
+#define SENSORS_POWER    "/sys/class/power_supply"
+#define SENSORS_MAX      8    //sensors shown at once
+#define SENSORS_MAXFILES 3    //attribute files read for one sensor
+#define SENSORS_MAXSPEC  96   //longest sensor description
+
+enum sensor_kind {
+    SENSOR_TEMP,     //degrees C, the cpu package unless a chip is named
+    SENSOR_FAN,      //RPM
+    SENSOR_BATTERY,  //charge level in percent
+    SENSOR_CHARGE,   //watts into the battery, negative while discharging
+    SENSOR_KINDS
+};
+
+struct sensor {
+    char spec[SENSORS_MAXSPEC];  //as given, for messages
+    char found[SENSORS_MAXSPEC]; //what it was matched to
+    int kind;
+    int fd[SENSORS_MAXFILES];    //value, then voltage for a battery that only reports current, -1 when unused
+    int status;                  //battery status file giving the sign of SENSOR_CHARGE, -1 when unused
+    float scale;                 //file units to the units above
+    float min, max;              //range of a bar from empty to full
+    float value;                 //last reading
+};
+
+struct sensors {
+    int n;
+    struct sensor s[SENSORS_MAX];
+};
+
+//add a sensor: <kind>[:<chip or supply>[:<label or number>]][=<min>,<max>] with kind temp, fan, battery or charge,
+//e.g. temp, temp:nvme, fan:thinkpad:2=0,6000, battery:BAT1.  Returns its index in s[] or -1
+int sensors_add(struct sensors *ss, const char *spec);
+int sensors_sample(struct sensors *ss); //read every sensor, 0 on success
+void sensors_close(struct sensors *ss);
+float sensors_fill(const struct sensor *s); //value scaled to 0-1 between min and max
+
+#endif
@@ -16,6 +16,7 @@
 #include <fcntl.h>
 #include <time.h>
 #include <errno.h>
+#include <signal.h>
 #include "sharedmem.h"
 
 struct colorpallete pallete[SM_NUMCOLORS]={
@@ -45,7 +46,7 @@ int get_executable_path(char *buffer, size_t size) {
     return 0;
 }
 
-int sharedmem_masterinit(char verbose) {
+int sharedmem_masterinit(char verbose, const struct layout *layout) {
     char exe_path[256];
     key_t shm_key={0};
     FILE *file;
@@ -78,8 +79,8 @@ int sharedmem_masterinit(char verbose) {
     fclose(file);
 
     // Create the shared memory segment with 0666 permissions (readable and writable by all)
-    if(verbose)printf("Create shared memeory segment (%li bytes)...\n",sizeof(struct shared_data));
-    shm_id = shmget(shm_key, sizeof(struct shared_data), IPC_CREAT | 0666);
+    if(verbose)printf("Create shared memeory segment (%li bytes)...\n",SM_SIZE(layout->nleds));
+    shm_id = shmget(shm_key, SM_SIZE(layout->nleds), IPC_CREAT | 0666);
     if(shm_id == -1) {
         perror("shmget failed");
         return 1;
@@ -92,6 +93,8 @@ int sharedmem_masterinit(char verbose) {
         perror("shmat failed");
         return 1;
     }
+    shm_ptr->nkeys = layout->nleds; //publish the layout so clients don't have to assume a keyboard
+    memcpy(&shm_ptr->layout, layout, sizeof(struct layout));
 
     // Create the semaphore for mutual exclusion
     if(verbose)printf("Create the semaphore...\n");
@@ -128,8 +131,8 @@ int sharedmem_slaveinit(char verbose) {
         return 1;
     }
 
-    // Access the shared memory segment using the key
-    shm_id = shmget(shm_key, sizeof(struct shared_data), 0666);
+    // Access the shared memory segment using the key, size 0 since it depends on the layout the daemon loaded
+    shm_id = shmget(shm_key, 0, 0666);
     if (shm_id == -1) {
         perror("slaveinit shmget failed");
         if(verbose)printf("The kbled shared memory is not accessible, check permissions?\n");
@@ -236,7 +239,94 @@ int sharedmem_masterclose(char verbose) {
     return problem;
 }
 
+struct shared_data *sharedmem_newlocal() {
+    struct shared_data *local = calloc(1, SM_SIZE(KB_MAXKEYS));
+    if(local == NULL) perror("sharedmem_newlocal: calloc failed");
+    return local;
+}
+
+int sharedmem_layeropen(const char *name, uint8_t priority, uint8_t alpha) {
+    int32_t pid = getpid();
+    int slot = -1;
+    for (int i = 0; i < SM_MAXLAYERS && slot < 0; i++) if (shm_ptr->layers[i].owner == pid && strncmp(shm_ptr->layers[i].name, name, SM_LAYERNAME - 1) == 0) slot = i; //already have one
+    for (int i = 0; i < SM_MAXLAYERS && slot < 0; i++) {
+        struct sm_layer *l = &shm_ptr->layers[i];
+        if (l->owner == 0) slot = i;
+        else if (kill(l->owner, 0) == -1 && errno == ESRCH) { //owner died without closing it, the daemon just hasn't noticed yet
+            sharedmem_layerclose(i);
+            slot = i;
+        }
+    }
+    if (slot < 0) return -1;
+    struct sm_layer *l = &shm_ptr->layers[slot];
+    l->owner = pid;
+    snprintf(l->name, sizeof(l->name), "%s", name);
+    l->priority = priority;
+    l->alpha = alpha;
+    l->dirty = keyset_union(l->dirty, l->cover);
+    shm_ptr->status |= SM_LAYER;
+    return slot;
+}
+
+void sharedmem_layerclose(int layer) {
+    if (layer < 0 || layer >= SM_MAXLAYERS) return;
+    struct sm_layer *l = &shm_ptr->layers[layer];
+    l->dirty = keyset_union(l->dirty, l->cover); //what it covered has to be redrawn from the layers underneath
+    keyset_clear(&l->cover);
+    l->owner = 0;
+    shm_ptr->status |= SM_LAYER;
+}
+
+void sharedmem_layerkey(int layer, uint8_t key, const unsigned char *rgb) {
+    struct sm_layer *l = &shm_ptr->layers[layer];
+    if (keyset_has(&l->cover, key) && l->rgb[0][key] == rgb[0] && l->rgb[1][key] == rgb[1] && l->rgb[2][key] == rgb[2]) return;
+    for (int c = 0; c < 3; c++) l->rgb[c][key] = rgb[c];
+    keyset_add(&l->cover, key);
+    keyset_add(&l->dirty, key);
+    shm_ptr->status |= SM_LAYER;
+}
+
+void sharedmem_layerclear(int layer, uint8_t key) {
+    struct sm_layer *l = &shm_ptr->layers[layer];
+    if (!keyset_has(&l->cover, key)) return;
+    keyset_remove(&l->cover, key);
+    keyset_add(&l->dirty, key);
+    shm_ptr->status |= SM_LAYER;
+}
+
+int sharedmem_notify(const struct sm_notify *n) {
+    // Never wait out SEM_TIMEOUT_MS here, a shell hook firing a notification shouldn't stall on a busy daemon
+    if (sem == NULL) {
+        fprintf(stderr, "sharedmem_notify: Semaphore not opened!\n");
+        return 1;
+    }
+    for (int tries = 1; sem_trywait(sem) == -1; tries++) {
+        if (errno != EAGAIN && errno != EINTR) {
+            perror("sharedmem_notify: sem_trywait");
+            return 1;
+        }
+        if (tries >= SM_NOTIFYTRIES) return 1;
+        usleep(1000);
+    }
+    int full = (shm_ptr->nnotify >= SM_MAXNOTIFY);
+    if (!full) {
+        shm_ptr->notify[shm_ptr->nnotify++] = *n;
+        shm_ptr->status |= SM_NOTIFY;
+    }
+    sharedmem_unlock();
+    return full;
+}
+
 int sharedmem_slaveclose(char verbose) {
+    // Give back any layer this process was drawing so the keys underneath show again
+    int32_t pid = getpid();
+    for (int i = 0; i < SM_MAXLAYERS; i++) {
+        if (shm_ptr->layers[i].owner == pid) {
+            sharedmem_lock();
+            sharedmem_layerclose(i);
+            sharedmem_unlock();
+        }
+    }
     // Detach from the shared memory segment
     if (shmdt(shm_ptr) == -1) {
         if(verbose) perror("shmdt failed");
@@ -270,9 +360,9 @@ int sharedmem_daemonstatus() {
 
 void sharedmem_printstructure(struct shared_data *data, char type) {
     // Print each member of the structure
-    printf("Status: 0x%04x SM_B:%i SM_BI:%i SM_S:%i SM_SI:%i SM_E:%i SM_EI:%i SM_BL:%i SM_FO:%i SM_KEY:%i \nSM_SSPD: %i SM_PALT: %i SM_ONOFF: %i SM_BIT13: %i SM_BIT14: %i SM_BIT15: %i SM_BIT16: %i\n", data->status,
+    printf("Status: 0x%08x SM_B:%i SM_BI:%i SM_S:%i SM_SI:%i SM_E:%i SM_EI:%i SM_BL:%i SM_FO:%i SM_KEY:%i \nSM_SSPD: %i SM_PALT: %i SM_ONOFF: %i SM_HOST: %i SM_ZONE: %i SM_SFX: %i SM_FPS: %i SM_LAYER: %i SM_NOTIFY: %i\n", data->status,
         data->status & 1,(data->status>>1) & 1,(data->status>>2) & 1,(data->status>>3) & 1,(data->status>>4) & 1,(data->status>>5) & 1,(data->status>>6) & 1,(data->status>>7) & 1,(data->status>>8) & 1,
-        (data->status>>9) & 1,(data->status>>10) & 1, (data->status>>11) & 1, (data->status>>12) & 1, (data->status>>13) & 1, (data->status>>14) & 1, (data->status>>15) & 1);
+        (data->status>>9) & 1,(data->status>>10) & 1, (data->status>>11) & 1, (data->status>>12) & 1, (data->status>>13) & 1, (data->status>>14) & 1, (data->status>>15) & 1, (data->status>>16) & 1, (data->status>>17) & 1);
     printf("On/Off state: %u\n", data->onoff);
     printf("Brightness: %u\n", data->brightness);
     printf("Brightness Increment: %d\n", data->brightnessinc);
@@ -286,13 +376,23 @@ void sharedmem_printstructure(struct shared_data *data, char type) {
     
     // Print the focus (R, G, B values)
     printf("Focus (R,G,B): (%u, %u, %u)\n", data->focus[0], data->focus[1], data->focus[2]);
+    printf("Host state: 0x%04x\n", data->hoststate);
+    printf("Zone fills queued: %u\n", data->nzonefill);
+    printf("Notifications queued: %u\n", data->nnotify);
+    for (int i = 0; i < SM_MAXLAYERS; i++) {
+        const struct sm_layer *l = &data->layers[i];
+        if (l->owner != 0) printf("Layer %i: %-15s pid %i priority %u alpha %u, %i keys\n", i, l->name, l->owner, l->priority, l->alpha, keyset_count(&l->cover));
+    }
+    printf("Software effect: %u @ %u fps, frames %u dropped %u late %u, frame time last %u us avg %u us max %u us\n", data->sfx, data->fps,
+        data->framestats.frames, data->framestats.dropped, data->framestats.late, data->framestats.lastus, data->framestats.avgus, data->framestats.maxus);
+    printf("Layout: %s, %u keys\n", data->layout.name, data->nkeys);
     
     // Print the key array if memdump=2
     if(type==2){
         printf("Keys: (R,G,B) Updt\n");
-        for (int j = 0; j < NKEYS; j++) {
+        for (int j = 0; j < data->nkeys; j++) {
             printf("Key[%3d]:(%3u,%3u,%3u)%u ", j,data->key[j][0],data->key[j][1],data->key[j][2],data->key[j][3]);
-            if(j>1 && ((j+1)%3==0 || j==NKEYS-1)) printf("\n"); //put carraige return after printing out every 4 keys and at the end of the array
+            if(j>1 && ((j+1)%3==0 || j==data->nkeys-1)) printf("\n"); //put carraige return after printing out every 4 keys and at the end of the array
         }
     }
 }
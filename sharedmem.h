@@ -8,7 +8,10 @@
 #define SHAREDMEM_H
 
 #include "keymap.h"
+#include "layout.h"
+#include "zone.h"
 #include <stdint.h>
+#include <stddef.h>
 
 #define TOKEN_FILE "/var/run/kbled.ftok"  // File to store the ftok token
 #define PROJECT_ID 'A'  // The project ID used to generate the ftok key
@@ -26,6 +29,12 @@
 #define SM_SSPD  0x0200  //Scan speed updated
 #define SM_PALT  0x0400  //color pallete index updated
 #define SM_ONOFF 0x0800  //update on/off state of keyboard backlight
+#define SM_HOST  0x1000  //host state bits updated (drive host<n> indicator bindings)
+#define SM_ZONE  0x2000  //zone fills queued in zonefill[]
+#define SM_SFX   0x4000  //software effect updated
+#define SM_FPS   0x8000  //software effect frame rate updated
+#define SM_LAYER 0x00010000  //a client layer changed (colors, coverage, alpha, priority or owner)
+#define SM_NOTIFY 0x00020000 //notifications queued in notify[]
 
 // on/off status/toggle for toggle
 #define SM_OFF   0
@@ -49,12 +58,83 @@
 #define SM_EFFECT_RIPPLE    5  //doesn't seem to work on my bonw15/clevo x370 laptop with System76 firmware
 #define SM_EFFECT_SNAKE     6
 
+//Software effects, rendered by the daemon from the backlight/focus colors and the key positions:
+#define SM_SFX_NONE     0
+#define SM_SFX_WAVE     1  //rainbow sweeping left to right
+#define SM_SFX_BREATHE  2  //whole keyboard fading between backlight and focus colors
+#define SM_SFX_SCAN     3  //focus colored bar sweeping back and forth
+#define SM_SFX_SNAKE    4  //focus colored snake winding through the rows
+#define SM_SFX_RIPPLE   5  //focus colored rings spreading from each key pressed (from the middle while nothing is typed)
+#define SM_SFX_MAX      SM_SFX_RIPPLE
+#define SM_SFX_USER     6  //first effect defined on an sfx line in kbled.conf, numbered in the order of the file
+#define SM_SFX_MAXUSER  8  //effects kbled.conf can define
+
+#define SM_DEFAULTFPS 30  //software effect frames per second
+#define SM_MAXFPS     60
+
 //color pallete
 #define SM_NUMCOLORS 10 //set this to the number of default colors you have configured.  They are defined in sharedmem.c
 
 #define SEM_NAME "/kbled_semaphore"  // Semaphore name to synchronize access to shared memory
 #define SEM_TIMEOUT_MS 1000 //semaphore timeout value; if blocked for longer than this time, ignore the semaphore and proceed
 
+//zone fills queued per update, a client adding more than this has to wait for the daemon to drain the queue
+#define SM_MAXZONEFILL 8
+
+//software effect frame timing, kept by the daemon
+struct sm_framestats {
+    uint32_t frames;   //frames rendered
+    uint32_t dropped;  //frames skipped because their deadline passed before they could start
+    uint32_t late;     //frames that took longer than the frame period to render and send
+    uint32_t lastus;   //time to render and send the last frame (us)
+    uint32_t avgus;    //running average of the frame time (us)
+    uint32_t maxus;    //longest frame time (us)
+};
+
+//Layers: each client draws into its own layer instead of key[], the daemon blends them over key[] (the base layer:
+//backlight, individual keys, zone fills and software effects) in priority order, so closing or killing a client
+//reveals whatever is underneath
+#define SM_MAXLAYERS 8
+#define SM_LAYERNAME 16
+#define SM_PRIO_DASHBOARD  100  //default priority, kbledpsmon and similar clients
+#define SM_PRIO_INDICATOR  200  //lock key and host state indicators (owned by the daemon)
+#define SM_PRIO_NOTIFY     250  //notifications
+
+struct sm_layer {
+    int32_t owner;              //pid of the process drawing the layer, 0 when the slot is free
+    char name[SM_LAYERNAME];    //who it is, for --dump
+    uint8_t priority;           //higher is drawn on top, equal priorities stack in slot order
+    uint8_t alpha;              //opacity 0-255 of the whole layer
+    keyset cover;               //keys the layer draws, everything else shows through
+    keyset dirty;               //keys changed since the daemon last composited, set by sharedmem_layerkey()/layerclear()
+    unsigned char rgb[3][LAYOUT_MAXLEDS]; //color planes, one array per channel so blending runs straight down each plane
+};
+
+//fill a whole zone in one command instead of writing every key
+struct sm_zonefill {
+    keyset keys;            //LED indices to fill
+    uint8_t mode;           //ZONE_SOLID, ZONE_HGRAD or ZONE_VGRAD
+    unsigned char from[3];  //[R,G,B] solid color or gradient start (left/top)
+    unsigned char to[3];    //[R,G,B] gradient end (right/bottom)
+};
+
+//Notifications: flash a set of keys for a while, then the daemon puts back whatever was underneath on its own.
+//Clients queue them with sharedmem_notify() and exit, the daemon moves them onto its notify layer and expires them
+#define SM_MAXNOTIFY 8          //notifications queued for the daemon at once
+#define SM_NOTIFYTRIES 5        //attempts at the semaphore 1 ms apart before sharedmem_notify() gives up
+#define SM_NOTIFY_SOLID 0       //steady color
+#define SM_NOTIFY_BLINK 1       //on/off, the keys underneath show while off
+#define SM_NOTIFY_PULSE 2       //fades between black and the color
+#define SM_NOTIFY_MAX SM_NOTIFY_PULSE
+
+struct sm_notify {
+    keyset keys;            //LED indices to flash
+    uint8_t pattern;        //SM_NOTIFY_SOLID, SM_NOTIFY_BLINK or SM_NOTIFY_PULSE
+    uint8_t priority;       //where notifications overlap the highest priority is shown, the newest of equals
+    unsigned char rgb[3];   //[R,G,B] color
+    uint32_t ms;            //how long it lasts in milliseconds
+};
+
 //shared memory verbosity options
 #define SM_VERBOSE 1
 #define SM_QUIET   0
@@ -62,7 +142,7 @@
 // The structure of the shared memory segment
 // Both programs can read from and write to this structure
 struct shared_data {
-    uint16_t status; //status flag, each binary bit represents a changed entry in the shared array
+    uint32_t status; //status flag, each binary bit represents a changed entry in the shared array
     double lastcputime; //contains the time in seconds it took to run through the last loop where a change was made to the keyboard LEDs
     double idlecputime; //contains the time in seconds it took to run through a loop where nothing was updated
     uint16_t scanspeed; //scan speed
@@ -76,9 +156,23 @@ struct shared_data {
     unsigned char colorindex; //index of current color pallete item
     unsigned char backlight[3]; //[R,G,B] 0-255 for each.  All keys
     unsigned char focus[3];  //[R,G,B] 0-255 for each, focus color (caps lock, num lock, scroll lock active)
-    unsigned char key[NKEYS][4]; //RGB + update field for each key key[4] values are 0=no update, 1=updated, 2=use backlight color, 3=use focus color
+    uint8_t sfx; //software effect SM_SFX_*, only shown while the hardware effect is SM_EFFECT_NONE
+    uint8_t fps; //software effect frames per second 1-SM_MAXFPS
+    struct sm_framestats framestats; //software effect frame timing
+    uint16_t hoststate; //host state bits 0-14, set by clients to drive indicator bindings in kbled.conf (host0-host14)
+    uint8_t nzonefill; //number of queued zone fills
+    struct sm_zonefill zonefill[SM_MAXZONEFILL]; //zone fills, applied in order by the daemon and cleared
+    struct sm_layer layers[SM_MAXLAYERS]; //client layers composited over key[]
+    uint8_t nnotify; //number of queued notifications
+    struct sm_notify notify[SM_MAXNOTIFY]; //notifications waiting for the daemon to pick them up
+    uint8_t nkeys; //number of keys in the active layout, key[] has this many entries
+    struct layout layout; //copy of the active keyboard layout so clients can look up key count, names and geometry
+    unsigned char key[][4]; //RGB + update field for each key key[4] values are 0=no update, 1=updated, 2=use backlight color, 3=use focus color
 };
 
+//size of the shared memory segment (or a local copy) for a layout with n keys
+#define SM_SIZE(n) (offsetof(struct shared_data, key) + (size_t)(n)*4)
+
 struct colorpallete {
     unsigned char backlight[3]; //[R,G,B] for backlight
     unsigned char focus[3]; //[R,G,B] for focus
@@ -88,13 +182,19 @@ extern struct shared_data *shm_ptr;
 extern struct colorpallete pallete[SM_NUMCOLORS];
 
 
-int sharedmem_masterinit(char verbose);  //initialize master for shared memory and semaphore (allocates shared memory and semaphore)
+int sharedmem_masterinit(char verbose, const struct layout *layout);  //initialize master for shared memory and semaphore (allocates shared memory sized for layout and semaphore)
 int sharedmem_slaveinit(char verbose);   //initialize master for shared memory and semaphore (uses already allocated shared memory and semaphore)
 int sharedmem_masterclose(char verbose); //master: disconnect from shared memory and semaphore and deallocate
 int sharedmem_slaveclose(char verbose);  //slave: disconeect from shared memory but do not deallocate shared memory or semaphore
+struct shared_data *sharedmem_newlocal(); //zeroed local staging copy of the structure big enough for any layout, free() when done
 int sharedmem_lock();       //acquire a lock on shared memory, timeout after SEM_TIMEOUT_MS milliseconds (decrement semaphore)
 void sharedmem_unlock();     //relinquish a lock on shared memory (increment semaphore)
 int sharedmem_daemonstatus(); //return 1 if the daemon is running, return 0 if the daemon is not running
+int sharedmem_layeropen(const char *name, uint8_t priority, uint8_t alpha); //claim a layer for this process (reuses its own of the same name or a dead process's), -1 if none are free.  Semaphore must be held
+void sharedmem_layerclose(int layer);  //release a layer so the keys underneath show again.  Semaphore must be held
+void sharedmem_layerkey(int layer, uint8_t key, const unsigned char *rgb); //draw a key on a layer, only marked dirty if it changed.  Semaphore must be held
+void sharedmem_layerclear(int layer, uint8_t key); //stop drawing a key so the one underneath shows.  Semaphore must be held
+int sharedmem_notify(const struct sm_notify *n); //queue a notification without waiting on a busy daemon, 0 if queued, 1 if the semaphore was busy or the queue full
 void sharedmem_printstructure(struct shared_data *data, char type); //Print out passed shared_data structure, type=1->no key status type=2->individual key status
 
 #endif // SHARED_MEMORY_H
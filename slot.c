@@ -0,0 +1,50 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * Triple buffered latest value slot, see slot.h
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include "slot.h"
+
+#define SLOT_FRESH 4u //set on ready while the reader hasn't taken that buffer yet
+
+int slot_init(struct slot *s, size_t size){
+    for(int i=0; i<3; i++) s->buf[i]=calloc(1, size);
+    if(!s->buf[0] || !s->buf[1] || !s->buf[2] || sem_init(&s->wake, 0, 0)!=0){
+        for(int i=0; i<3; i++) free(s->buf[i]);
+        return -1;
+    }
+    s->w=0;
+    atomic_init(&s->ready, 1u);
+    s->r=2;
+    return 0;
+}
+
+void slot_free(struct slot *s){
+    sem_destroy(&s->wake);
+    for(int i=0; i<3; i++) free(s->buf[i]);
+}
+
+void *slot_writebuf(struct slot *s){
+    return s->buf[s->w];
+}
+
+void slot_publish(struct slot *s){
+    unsigned int old=atomic_exchange_explicit(&s->ready, s->w | SLOT_FRESH, memory_order_acq_rel);
+    s->w=old & 3u;
+    if(!(old & SLOT_FRESH)) sem_post(&s->wake); //otherwise the reader hasn't woken for the last one yet
+}
+
+const void *slot_wait(struct slot *s){
+    for(;;){
+        //only the reader clears SLOT_FRESH, so once seen it stays until the exchange below
+        if(atomic_load_explicit(&s->ready, memory_order_acquire) & SLOT_FRESH){
+            s->r=atomic_exchange_explicit(&s->ready, s->r, memory_order_acq_rel) & 3u;
+            return s->buf[s->r];
+        }
+        while(sem_wait(&s->wake)!=0 && errno==EINTR);
+    }
+}
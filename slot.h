@@ -0,0 +1,31 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * Latest value slot between one writer thread and one reader thread.  Three buffers rotate through an atomic
+ * index: the writer always has one to fill and the reader one to look at, so neither ever waits on the other and a
+ * reader that falls behind simply skips to the newest value.  The reader sleeps on a semaphore that is only posted
+ * when it has taken everything written so far.
+ */
+
+#ifndef SLOT_H
+#define SLOT_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <semaphore.h>
+
+struct slot {
+    void *buf[3];
+    atomic_uint ready;   //buffer holding the newest value, | SLOT_FRESH until the reader takes it
+    unsigned int w, r;   //buffers owned by the writer and the reader
+    sem_t wake;
+};
+
+int slot_init(struct slot *s, size_t size); //0 on success
+void slot_free(struct slot *s);
+void *slot_writebuf(struct slot *s);       //writer: the buffer to fill next
+void slot_publish(struct slot *s);         //writer: make it the newest value
+const void *slot_wait(struct slot *s);     //reader: wait for a value newer than the last one taken and return it
+
+#endif
@@ -0,0 +1,61 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * Key fill smoothing and quantization, see smooth.h
+ */
+
+#include <string.h>
+#include <math.h>
+#include "smooth.h"
+
+void smooth_init(struct smooth *s){
+    memset(s, 0, sizeof(*s));
+    s->levels=SMOOTH_LEVELS;
+    s->band=SMOOTH_BAND;
+    for(int g=0; g<SMOOTH_MAXGROUPS; g++) s->group[g].alpha=1.0f;
+    for(int k=0; k<LAYOUT_MAXLEDS; k++) s->level[k]=-1;
+}
+
+void smooth_set(struct smooth *s, int group, float tau, float hold){
+    for(int g=0; g<SMOOTH_MAXGROUPS; g++){
+        if(group>=0 && g!=group) continue;
+        if(tau>=0.0f) s->group[g].tau=tau;
+        if(hold>=0.0f) s->group[g].hold=hold;
+    }
+}
+
+void smooth_assign(struct smooth *s, int group, const uint8_t *keys, int n){
+    for(int i=0; i<n; i++) s->keygroup[keys[i]]=(uint8_t)group;
+}
+
+void smooth_tick(struct smooth *s, uint32_t ms){
+    if(ms==s->period) return;
+    s->period=ms;
+    for(int g=0; g<SMOOTH_MAXGROUPS; g++) s->group[g].alpha= (s->group[g].tau>0.0f)? 1.0f-expf(-(float)ms/s->group[g].tau) : 1.0f;
+}
+
+void smooth_apply(struct smooth *s, const uint8_t *keys, float *fill, int n){
+    const float top=(float)(s->levels-1), reach=0.5f+s->band;
+    for(int i=0; i<n; i++){
+        const int k=keys[i];
+        const struct smooth_group *g=&s->group[s->keygroup[k]];
+        float x=fill[i];
+        x=(x<0.0f)? 0.0f : (x>1.0f)? 1.0f : x;
+        if(s->level[k]<0) s->ema[k]=s->peak[k]=x;
+        else s->ema[k]+=g->alpha*(x-s->ema[k]);
+        float v=s->ema[k];
+        if(g->hold>0.0f){ //a new high shows at once and stays for hold ms, then the average takes over again
+            if(x>=s->peak[k]) {
+                s->peak[k]=x;
+                s->age[k]=0.0f;
+            }
+            else if((s->age[k]+=s->period)>g->hold) s->peak[k]=v;
+            if(s->peak[k]>v) v=s->peak[k];
+        }
+        //only leave the shown level once the value is band steps beyond half way to the next one
+        float pos=v*top;
+        if(s->level[k]<0 || fabsf(pos-s->level[k])>reach) s->level[k]=(int16_t)(pos+0.5f);
+        fill[i]=s->level[k]/top;
+    }
+}
@@ -0,0 +1,45 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * Per key smoothing and quantization for kbledpsmon.  Each key's fill (0-1, what goes into the colormap) is passed
+ * through an exponential moving average and an optional peak hold set per group of keys (one group per metric), then
+ * snapped to one of a few levels with a hysteresis band, so a load wandering by a fraction of a percent leaves the
+ * key alone instead of costing a USB report every update.
+ */
+
+#ifndef SMOOTH_H
+#define SMOOTH_H
+
+#include <stdint.h>
+#include "layout.h"
+
+#define SMOOTH_MAXGROUPS 16
+#define SMOOTH_LEVELS    32     //default number of levels a fill is snapped to
+#define SMOOTH_BAND      0.25f  //default hysteresis, steps past the half way point before a key moves to the next level
+
+struct smooth_group {
+    float tau;            //EMA time constant in ms, 0 for none
+    float hold;           //ms a new peak is held before the average is shown again, 0 for none
+    float alpha;          //EMA weight of a new value at the current update period
+};
+
+struct smooth {
+    int levels;
+    float band;
+    uint32_t period;                   //ms since the last update
+    struct smooth_group group[SMOOTH_MAXGROUPS];
+    uint8_t keygroup[LAYOUT_MAXLEDS];  //group of each key
+    float ema[LAYOUT_MAXLEDS], peak[LAYOUT_MAXLEDS];
+    float age[LAYOUT_MAXLEDS];         //ms since peak was set
+    int16_t level[LAYOUT_MAXLEDS];     //level shown, -1 before the first value
+};
+
+void smooth_init(struct smooth *s);  //no smoothing, SMOOTH_LEVELS levels with a SMOOTH_BAND band
+//set the time constant (or hold time) of one group, or of all of them for group<0
+void smooth_set(struct smooth *s, int group, float tau, float hold);
+void smooth_assign(struct smooth *s, int group, const uint8_t *keys, int n); //keys belong to a group
+void smooth_tick(struct smooth *s, uint32_t ms);  //update period in ms, call before the keys of an update
+void smooth_apply(struct smooth *s, const uint8_t *keys, float *fill, int n); //filter and snap fill[i] of keys[i] in place
+
+#endif
@@ -0,0 +1,326 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ *
+ * kbledspectrum - equalizer style audio spectrum across the keyboard columns
+ * Reads 16 bit PCM from a WAV file or stdin (WAV or raw), for what is playing right now:
+ *   parec --format=s16le --rate=44100 --channels=2 | kbledspectrum
+ * Each keyboard column is a log spaced frequency band, bars rise from the bottom row with a peak that holds
+ * for a moment before falling.  Only keys that changed since the last frame are sent to kbled.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <math.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "sharedmem.h"
+#include "fft.h"
+
+#define SPECTRUM_BITS     11        //2048 point FFT, 21.5 Hz per bin at 44.1 kHz
+#define SPECTRUM_FMIN     40.0f     //lowest band starts here (Hz)
+#define SPECTRUM_FMAX     16000.0f  //highest band ends here, or just under half the sample rate
+#define SPECTRUM_FLOOR    -60.0f    //dB below full scale shown as an empty bar
+#define SPECTRUM_FALL     1.5f      //bar heights per second a bar drops
+#define SPECTRUM_HOLD     0.5f      //seconds a peak stays put
+#define SPECTRUM_PEAKFALL 0.5f      //bar heights per second a peak drops after that
+#define SPECTRUM_STATS    10        //seconds between CPU reports with -v
+
+volatile sig_atomic_t stop = 0;
+
+void handle_stop(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+void print_usage(char *programname) {
+    fprintf(stderr, "Usage: %s [parameters...] [file.wav|-]   (default: stdin)\n", programname);
+    fprintf(stderr, " Parameter:                    Description:\n");
+    fprintf(stderr, " --rate <Hz>                   Sample rate of raw PCM on stdin  Default=44100\n");
+    fprintf(stderr, " --channels <1-2>              Channels of raw PCM on stdin  Default=2\n");
+    fprintf(stderr, " --fps <1-%i>                  Frames per second  Default=%i\n", SM_MAXFPS, SM_MAXFPS);
+    fprintf(stderr, " --priority <0-255>            Layer priority, higher is drawn on top  Default=%i\n", SM_PRIO_DASHBOARD);
+    fprintf(stderr, " --alpha <0-255>               Layer opacity  Default=255\n");
+    fprintf(stderr, " --bench                       Analyze the whole input as fast as possible without kbled and report the cost per frame\n");
+    fprintf(stderr, " -v                            Verbose output, CPU use every %i s\n", SPECTRUM_STATS);
+    fprintf(stderr, " -h or --help                  Display this message\n");
+    fprintf(stderr, "Raw PCM is 16 bit little endian, for example: parec --format=s16le --rate=44100 --channels=2 | %s\n", programname);
+}
+
+//16 bit PCM input, a WAV header is recognized on files and stdin alike
+struct pcm {
+    int fd;
+    int rate, channels;
+    unsigned char pend[12]; //bytes read looking for a header that turned out to be samples
+    int npend;
+};
+
+//read exactly len bytes unless the input ends, returns the number read
+static size_t pcm_read(struct pcm *p, void *buf, size_t len) {
+    size_t got = 0;
+    while (p->npend > 0 && got < len) {
+        ((unsigned char *)buf)[got++] = p->pend[0];
+        memmove(p->pend, p->pend + 1, --p->npend);
+    }
+    while (got < len) {
+        ssize_t r = read(p->fd, (unsigned char *)buf + got, len - got);
+        if (r < 0 && errno == EINTR && !stop) continue;
+        if (r <= 0) break;
+        got += r;
+    }
+    return got;
+}
+
+static int pcm_open(struct pcm *p, const char *path) {
+    unsigned char h[40];
+    p->fd = (path == NULL || strcmp(path, "-") == 0) ? STDIN_FILENO : open(path, O_RDONLY);
+    p->npend = 0;
+    if (p->fd < 0) {
+        perror(path);
+        return 1;
+    }
+    size_t n = pcm_read(p, h, 12);
+    if (n < 12 || memcmp(h, "RIFF", 4) != 0 || memcmp(h + 8, "WAVE", 4) != 0) { //raw samples
+        memcpy(p->pend, h, n);
+        p->npend = n;
+        return 0;
+    }
+    int fmt = 0;
+    while (pcm_read(p, h, 8) == 8) { //chunks up to the samples
+        uint32_t size = h[4] | h[5] << 8 | h[6] << 16 | (uint32_t)h[7] << 24;
+        if (memcmp(h, "data", 4) == 0) {
+            if (!fmt) break;
+            return 0;
+        }
+        int isfmt = memcmp(h, "fmt ", 4) == 0;
+        size += size & 1;
+        if (isfmt && size >= 16) {
+            size_t k = size < sizeof(h) ? size : sizeof(h);
+            if (pcm_read(p, h, k) != k) break;
+            size -= k;
+            int format = h[0] | h[1] << 8, bits = h[14] | h[15] << 8;
+            p->channels = h[2] | h[3] << 8;
+            p->rate = h[4] | h[5] << 8 | h[6] << 16 | h[7] << 24;
+            if ((format != 1 && format != 0xFFFE) || bits != 16 || p->channels < 1 || p->channels > 8 || p->rate < 8000) {
+                fprintf(stderr, "%s: only 16 bit PCM WAV files are supported\n", path ? path : "stdin");
+                return 1;
+            }
+            fmt = 1;
+        }
+        while (size > 0) {
+            size_t k = size < sizeof(h) ? size : sizeof(h);
+            if (pcm_read(p, h, k) != k) break;
+            size -= k;
+        }
+    }
+    fprintf(stderr, "%s: no samples in the WAV file\n", path ? path : "stdin");
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    struct pcm in = { .rate = 44100, .channels = 2 };
+    const char *path = NULL;
+    char verbose = 0, bench = 0;
+    int fps = SM_MAXFPS;
+    uint8_t priority = SM_PRIO_DASHBOARD, alpha = 255; // layer stacking and opacity
+    int i = 1;
+    while (i < argc) {
+        if (strcmp(argv[i], "-v") == 0) {
+            verbose = 1;
+            i++;
+        }
+        else if (strcmp(argv[i], "--rate") == 0 || strcmp(argv[i], "--channels") == 0 || strcmp(argv[i], "--fps") == 0) {
+            int v = (i + 1 < argc) ? atoi(argv[i + 1]) : 0;
+            int ok = (argv[i][2] == 'r') ? (v >= 8000 && v <= 192000) : (argv[i][2] == 'c') ? (v >= 1 && v <= 2) : (v >= 1 && v <= SM_MAXFPS);
+            if (!ok) {
+                fprintf(stderr, "Error: %s is out of range, see --help\n", argv[i]);
+                return 1;
+            }
+            if (argv[i][2] == 'r') in.rate = v;
+            else if (argv[i][2] == 'c') in.channels = v;
+            else fps = v;
+            i += 2;
+        }
+        else if ((strcmp(argv[i], "--priority") == 0) || (strcmp(argv[i], "--alpha") == 0)) {
+            // layer priority and opacity
+            if (i + 1 < argc && atoi(argv[i + 1]) >= 0 && atoi(argv[i + 1]) <= 255) {
+                if(verbose)printf("Set layer %s to: %s\n", argv[i]+2, argv[i + 1]);
+                if(argv[i][2]=='p') priority=atoi(argv[i+1]);
+                else alpha=atoi(argv[i+1]);
+                i += 2;
+            } else {
+                fprintf(stderr, "Error: %s requires an argument between 0 and 255\n",argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--bench") == 0) {
+            bench = 1;
+            i++;
+        }
+        else if ((strcmp(argv[i], "--help") == 0) || (strcmp(argv[i], "-h") == 0)) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        else if (argv[i][0] != '-' || strcmp(argv[i], "-") == 0) {
+            path = argv[i];
+            i++;
+        }
+        else {
+            fprintf(stderr, "Error: Unknown switch: %s\n", argv[i]);
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (pcm_open(&in, path) != 0) return 1;
+    struct stat st;
+    int pace = !bench && fstat(in.fd, &st) == 0 && S_ISREG(st.st_mode); //a file is played at its own speed, a pipe paces itself
+    struct fft f;
+    if (fft_init(&f, SPECTRUM_BITS) != 0) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    const int n = f.n, hop = in.rate / fps;
+    float *hist = calloc(n, sizeof(float)), *power = calloc(n / 2, sizeof(float));
+    int16_t *pcm = malloc((size_t)hop * in.channels * sizeof(int16_t));
+    if (hist == NULL || power == NULL || pcm == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    //keys of each keyboard column bottom to top, one log spaced band per column that has keys
+    int layer = -1;
+    const struct layout *l = &layout_builtin;
+    if (!bench) {
+        if (sharedmem_slaveinit(verbose) != 0) {
+            fprintf(stderr, "Failed to connect to kbled daemon, are you sure it is running?\n");
+            return 1;
+        }
+        l = &shm_ptr->layout;
+        sharedmem_lock();
+        layer = sharedmem_layeropen("kbledspectrum", priority, alpha);
+        sharedmem_unlock();
+        if (layer < 0) {
+            fprintf(stderr, "All %i kbled layers are in use\n", SM_MAXLAYERS);
+            sharedmem_slaveclose(verbose);
+            return 1;
+        }
+    }
+    uint8_t colkeys[LAYOUT_MAXLEDS][LAYOUT_MAXLEDS], ncolkeys[LAYOUT_MAXLEDS] = {0};
+    int nbands = 0;
+    for (int c = 0; c < l->ncols; c++) {
+        int k = 0;
+        for (int j = 0; j < l->nleds; j++) {
+            if (l->col[j] != c) continue;
+            int m = k++;
+            for (; m > 0 && l->row[colkeys[nbands][m - 1]] < l->row[j]; m--) colkeys[nbands][m] = colkeys[nbands][m - 1];
+            colkeys[nbands][m] = j;
+        }
+        if (k) ncolkeys[nbands++] = k;
+    }
+    int lo[LAYOUT_MAXLEDS], hi[LAYOUT_MAXLEDS];
+    float binhz = (float)in.rate / n, fmax = fminf(SPECTRUM_FMAX, in.rate * 0.45f);
+    for (int b = 0; b < nbands; b++) {
+        float f0 = SPECTRUM_FMIN * powf(fmax / SPECTRUM_FMIN, (float)b / nbands), f1 = SPECTRUM_FMIN * powf(fmax / SPECTRUM_FMIN, (float)(b + 1) / nbands);
+        lo[b] = (int)(f0 / binhz + 0.5f);
+        hi[b] = (int)(f1 / binhz + 0.5f) - 1;
+        if (lo[b] < 1) lo[b] = 1;
+        if (hi[b] < lo[b]) hi[b] = lo[b];
+        if (hi[b] > n / 2 - 1) hi[b] = n / 2 - 1;
+    }
+    if (verbose) printf("%i Hz %i channel(s), %i bands from %.0f to %.0f Hz, %i point FFT every %i samples\n",
+        in.rate, in.channels, nbands, SPECTRUM_FMIN, fmax, n, hop);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGPIPE, &sa, NULL);
+
+    float bar[LAYOUT_MAXLEDS] = {0}, peak[LAYOUT_MAXLEDS] = {0}, peakt[LAYOUT_MAXLEDS] = {0};
+    unsigned char shown[LAYOUT_MAXLEDS][3], frame[LAYOUT_MAXLEDS][3];
+    memset(shown, 0xFF, sizeof(shown)); //nothing drawn yet, the first frame sends every key
+    const float dt = (float)hop / in.rate;
+    uint64_t frames = 0, changed = 0;
+    struct timespec next, cpu0, cpu1, wall0, wall1;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu0);
+    wall0 = next;
+    while (!stop) {
+        size_t want = (size_t)hop * in.channels * sizeof(int16_t);
+        if (pcm_read(&in, pcm, want) != want) break;
+        //mix down to mono and slide the history window along by one hop
+        int keep = (hop < n) ? n - hop : 0, skip = (hop < n) ? 0 : hop - n;
+        memmove(hist, hist + n - keep, keep * sizeof(float));
+        for (int s = skip; s < hop; s++) {
+            int sum = 0;
+            for (int c = 0; c < in.channels; c++) sum += pcm[s * in.channels + c];
+            hist[keep + s - skip] = sum / (32768.0f * in.channels);
+        }
+        fft_power(&f, hist, power);
+        float t = frames * dt;
+        for (int b = 0; b < nbands; b++) {
+            float p = 0.0f;
+            for (int k = lo[b]; k <= hi[b]; k++) if (power[k] > p) p = power[k];
+            float level = (10.0f * log10f(p + 1e-12f) - SPECTRUM_FLOOR) / -SPECTRUM_FLOOR;
+            level = fminf(fmaxf(level, 0.0f), 1.0f);
+            bar[b] = fmaxf(level, bar[b] - SPECTRUM_FALL * dt);
+            if (bar[b] >= peak[b]) {
+                peak[b] = bar[b];
+                peakt[b] = t;
+            }
+            else if (t - peakt[b] > SPECTRUM_HOLD) peak[b] = fmaxf(bar[b], peak[b] - SPECTRUM_PEAKFALL * dt);
+            //green at the bottom through yellow to red at the top, the peak in white, the rest dark
+            int nk = ncolkeys[b], lit = (int)(bar[b] * nk + 0.5f), pk = (int)(peak[b] * nk + 0.5f) - 1;
+            for (int k = 0; k < nk; k++) {
+                unsigned char *rgb = frame[colkeys[b][k]];
+                float h = (k + 0.5f) / nk;
+                if (k < lit) {
+                    rgb[0] = (h < 0.5f) ? (unsigned char)(510.0f * h) : 255;
+                    rgb[1] = (h < 0.5f) ? 255 : (unsigned char)(510.0f * (1.0f - h));
+                    rgb[2] = 0;
+                }
+                else memset(rgb, (k == pk) ? 255 : 0, 3);
+            }
+        }
+        int nchanged = 0;
+        for (int j = 0; j < l->nleds; j++) if (memcmp(frame[j], shown[j], 3) != 0) nchanged++;
+        if (nchanged && !bench) { //only changed keys, and no semaphore at all for a frame that looks the same
+            sharedmem_lock();
+            for (int j = 0; j < l->nleds; j++) if (memcmp(frame[j], shown[j], 3) != 0) sharedmem_layerkey(layer, j, frame[j]);
+            sharedmem_unlock();
+        }
+        memcpy(shown, frame, sizeof(shown));
+        changed += nchanged;
+        frames++;
+        if (pace) {
+            next.tv_nsec += (long)(dt * 1e9f);
+            next.tv_sec += next.tv_nsec / 1000000000L;
+            next.tv_nsec %= 1000000000L;
+            while (!stop && clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) != 0);
+        }
+        if (verbose && !bench && frames % (SPECTRUM_STATS * fps) == 0) {
+            clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu1);
+            clock_gettime(CLOCK_MONOTONIC, &wall1);
+            double c = (cpu1.tv_sec - cpu0.tv_sec) + (cpu1.tv_nsec - cpu0.tv_nsec) / 1e9, w = (wall1.tv_sec - wall0.tv_sec) + (wall1.tv_nsec - wall0.tv_nsec) / 1e9;
+            printf("%.2f%% CPU, %.1f keys changed per frame\n", 100.0 * c / w, (double)changed / frames);
+        }
+    }
+    if (bench) {
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu1);
+        double us = ((cpu1.tv_sec - cpu0.tv_sec) * 1e6 + (cpu1.tv_nsec - cpu0.tv_nsec) / 1e3) / (frames ? frames : 1);
+        printf("%llu frames (%.1f s of audio), %.2f us per frame, %.3f%% CPU at %i fps, %.1f of %u keys changed per frame\n",
+            (unsigned long long)frames, frames * dt, us, us * fps / 1e4, fps, frames ? (double)changed / frames : 0.0, l->nleds);
+    }
+    else sharedmem_slaveclose(verbose); //gives our layer back
+    fft_free(&f);
+    free(hist);
+    free(power);
+    free(pcm);
+    return 0;
+}
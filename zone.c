@@ -0,0 +1,115 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ * 
+ * Zone expressions and fills, see zone.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include "zone.h"
+
+//n for "<prefix><n>", -1 if name doesn't have that form
+static int zone_number(const char *name, const char *prefix){
+    size_t len=strlen(prefix);
+    if(strncasecmp(name, prefix, len)!=0 || !isdigit((unsigned char)name[len])) return -1;
+    char *end;
+    long n=strtol(name+len, &end, 10);
+    return (*end=='\0' && n<256)? (int)n : -1;
+}
+
+int zone_lookup(const struct layout *l, const char *name, keyset *out){
+    int i, n;
+    keyset_clear(out);
+    for(i=0; i<l->nzones; i++) if(strcasecmp(name, l->zones[i].name)==0) {
+        *out=l->zones[i].keys;
+        return 0;
+    }
+    if(strcasecmp(name, "all")==0) {
+        *out=keyset_first(l->nleds);
+        return 0;
+    }
+    if(strcasecmp(name, "multi")==0) { //every LED of the keys lit by more than one LED
+        for(i=0; i<l->ngroups; i++) for(n=0; l->groups[i].nleds>1 && n<l->groups[i].nleds; n++) keyset_add(out, l->groupleds[l->groups[i].first+n]);
+        return 0;
+    }
+    if((n=zone_number(name, "row"))>=0) {
+        for(i=0; i<l->nleds; i++) if(l->row[i]==n) keyset_add(out, i);
+        return keyset_empty(out)? -1 : 0;
+    }
+    if((n=zone_number(name, "col"))>=0) {
+        for(i=0; i<l->nleds; i++) if(l->col[i]==n) keyset_add(out, i);
+        return keyset_empty(out)? -1 : 0;
+    }
+    if((n=layout_findgroup(l, name))>=0) {
+        const struct layout_group *g=&l->groups[n];
+        for(i=0; i<g->nleds; i++) keyset_add(out, l->groupleds[g->first+i]);
+        return 0;
+    }
+    if((n=layout_findname(l, name))>=0) {
+        keyset_add(out, n);
+        return 0;
+    }
+    if((n=zone_number(name, ""))>=0 && n<l->nleds) { //plain LED number like -k uses
+        keyset_add(out, n);
+        return 0;
+    }
+    return -1;
+}
+
+int zone_parse(const struct layout *l, const char *expr, keyset *out){
+    char buf[ZONE_MAXEXPR];
+    keyset term;
+    char op='+';
+    if(strlen(expr)>=sizeof(buf)) return -1;
+    strcpy(buf, expr);
+    keyset_clear(out);
+    char *p=buf;
+    while(1){
+        char *end=p+strcspn(p, "+&-");
+        char next=*end;
+        *end='\0';
+        while(isspace((unsigned char)*p)) p++;
+        for(char *t=end; t>p && isspace((unsigned char)t[-1]); t--) t[-1]='\0';
+        if(*p=='\0' || zone_lookup(l, p, &term)!=0) return -1;
+        if(op=='+') *out=keyset_union(*out, term);
+        else if(op=='&') *out=keyset_intersect(*out, term);
+        else *out=keyset_diff(*out, term);
+        if(next=='\0') return 0;
+        op=next;
+        p=end+1;
+    }
+}
+
+int zone_sort(const struct layout *l, keyset s, int order, uint8_t *out){
+    int n=0;
+    for(int i=keyset_next(&s, -1); i>=0; i=keyset_next(&s, i)){
+        //insertion sort, zones are at most LAYOUT_MAXLEDS long
+        int j=n++;
+        for(; j>0; j--){
+            int k=out[j-1], before;
+            if(order==ZONE_BOTTOMUP) before= l->y[i]>l->y[k] || (l->y[i]==l->y[k] && l->x[i]<l->x[k]);
+            else before= l->x[i]<l->x[k] || (l->x[i]==l->x[k] && l->y[i]<l->y[k]);
+            if(!before) break;
+            out[j]=out[j-1];
+        }
+        out[j]=i;
+    }
+    return n;
+}
+
+void zone_color(const struct layout *l, keyset s, uint8_t mode, const unsigned char *from, const unsigned char *to, unsigned char (*key)[4]){
+    int i, c, lo=0xFFFF, hi=0;
+    const uint16_t *pos=(mode==ZONE_VGRAD)? l->y : l->x;
+    if(mode!=ZONE_SOLID) for(i=keyset_next(&s, -1); i>=0; i=keyset_next(&s, i)){ //gradient runs edge to edge of the zone, not the keyboard
+        if(pos[i]<lo) lo=pos[i];
+        if(pos[i]>hi) hi=pos[i];
+    }
+    for(i=keyset_next(&s, -1); i>=0; i=keyset_next(&s, i)){
+        int t=(mode==ZONE_SOLID || hi==lo)? 0 : (pos[i]-lo)*255/(hi-lo); //0-255 position in the zone
+        for(c=0; c<3; c++) key[i][c]=from[c] + ((to[c]-from[c])*t)/255;
+    }
+}
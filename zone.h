@@ -0,0 +1,30 @@
+/* kbled IT829x keyboard backilight control
+ * https://github.com/chememjc/kbled
+ * Michael Curtis 2025-01-17
+ * 
+ * Zones: sets of keys named in the layout or built on the fly from expressions like "alpha+numrow-locks"
+ */
+
+#ifndef ZONE_H
+#define ZONE_H
+
+#include <stdint.h>
+#include "layout.h"
+
+#define ZONE_MAXEXPR 256 //max length of a zone expression
+
+// zone fill modes
+#define ZONE_SOLID 0  //every key gets the from color
+#define ZONE_HGRAD 1  //from color at the left edge of the zone to the to color at the right edge
+#define ZONE_VGRAD 2  //from color at the top edge of the zone to the to color at the bottom edge
+
+// zone_sort() orders
+#define ZONE_LEFTRIGHT 0 //by x, then top to bottom
+#define ZONE_BOTTOMUP  1 //by row from the bottom, then left to right (bar graphs)
+
+int zone_lookup(const struct layout *l, const char *name, keyset *out); //one name: layout zone, all, multi, row<n>, col<n>, key name, LED name or LED number.  0 on success
+int zone_parse(const struct layout *l, const char *expr, keyset *out);  //names joined by + (union) & (intersection) - (difference), evaluated left to right.  0 on success
+int zone_sort(const struct layout *l, keyset s, int order, uint8_t *out); //LED indices of s in the given order, returns the count
+void zone_color(const struct layout *l, keyset s, uint8_t mode, const unsigned char *from, const unsigned char *to, unsigned char (*key)[4]); //set RGB of each key of s
+
+#endif